@@ -9,46 +9,30 @@
 #include <ubx_interrupt.h>
 #include <arduino_udp.h>
 #include <arduino_timers.h>
+#include <scha63x_pingpong.h>
 
 /*!
     @file murata.ino
     @brief Main program loop
-*/
-
 
-#define ATOMIC_BLOCK_FORCEON AtomicBlockForceOn atomicBlockForceOn_
-
-class AtomicBlockForceOn
-{
-public:
-    // Constructor: called when the object is created
-    inline AtomicBlockForceOn()
-    {
-        noInterrupts(); // turn interrupts OFF
-    }
+    The sample timer interrupt reads the sensor into one of two
+    buffers, loop() sends the other one with interrupts enabled
+*/
 
-    // Destructor: called when the object is destroyed (ex: goes
-    // out-of-scope)
-    inline ~AtomicBlockForceOn()
-    {
-        interrupts(); // turn interrupts ON
-    }
-};
 
 /*!
-    \brief data vector for storing raw data from scha63x
+    \brief data vectors for storing raw data from scha63x, ping-pong
 */
-scha63x_raw_data data_vector[BUFFER_SIZE];
+scha63x_raw_data data_vector[2][BUFFER_SIZE];
 
 /*!
-    \brief index for data buffer, looping in main sampling loop
+    \brief buffer the sample interrupt fills and the one waiting for loop()
 */
-static volatile int buffer_index = 0;
+static scha63x_pingpong buffers;
 
-/*!
-    \brief number of bytes in data buffer, used in sending UDP packets
-*/
-static int buf_bytes = BUFFER_SIZE * STRUCT_SIZE;
+#if BUFFER_SIZE > SCHA63X_WIRE_MAX_SAMPLES
+#error "BUFFER_SIZE samples do not fit into one UDP packet"
+#endif
 
 /*!
     \brief server IP address
@@ -64,7 +48,6 @@ static volatile bool UnoError = false;
 
 ///@{
 /*! \brief Interrupt flag */
-volatile bool imu_sampling_flag = false;
 volatile bool cam_trigger_flag = false;
 volatile bool ubx_trigger_flag = false;
 volatile bool reset_flag = false;
@@ -80,14 +63,56 @@ volatile uint64_t ubx_timestamp;
 /*! \brief Number of microseconds */
 volatile long int microsec_counter;
 
+///@{
+/*! \brief Last filter command, answered once its filters have settled */
+static scha63x_filter_command filter_answer;
+static bool filter_received = false;
+static bool filter_settling = false;
+static uint32_t filter_set_at;
+///@}
+
 
 /*!
-    \brief Callback function for data sampling via SPI 
+    \brief Callback function for data sampling via SPI
+
+    Runs in the sample timer interrupt, reads the sensor into the
+    buffer being filled. A full buffer goes to loop(), if loop() has
+    not sent the previous one yet it is dropped and counted.
 */
 void imu_sampling_callback(void)
 {
 //  Serial.println("IMU");
-  imu_sampling_flag = true;
+  imu_timestamp = micros();
+
+  if (cam_trigger_flag) {
+//    Serial.println("T");
+    microsec_counter = imu_timestamp;
+    digitalWrite(CAM_TRIGGER_PIN, HIGH);
+  }
+
+  scha63x_raw_data *sample = scha63x_pingpong_slot(&buffers, imu_timestamp);
+  scha63x_read_data(sample);
+  sample->timeStamp = imu_timestamp;
+
+  // Triggers
+  if (cam_trigger_flag) {
+    sample->cam_trigger = true;
+    cam_trigger_flag = false;
+  }
+
+  if (ubx_trigger_flag) {
+    sample->ubx_trigger = true;
+    ubx_trigger_flag = false;
+  }
+
+  if (sample->rs_error_due) {
+    DueError = true;
+  }
+  if (sample->rs_error_uno) {
+    UnoError = true;
+  }
+
+  scha63x_pingpong_commit(&buffers);
 }
 
 /*!
@@ -118,6 +143,37 @@ void reset_callback(void)
   reset_flag = true;
 }
 
+/*!
+    \brief Apply a filter command of the server while sampling
+
+    Rewrites only the filter registers, the answer goes out from loop()
+    after the settling time of the new filters. A repeated command is
+    answered again without touching the sensor.
+*/
+void filter_command(void)
+{
+  scha63x_filter_command command;
+  scha63x_sensor_config config;
+  if (!getFilterCommand(&command, &config)) {
+    return;
+  }
+
+  // Its answer got lost or the filters are still settling
+  if (filter_received && command.sequence == filter_answer.sequence) {
+    if (!filter_settling) {
+      sendFilterAnswer(udp_server, &filter_answer);
+    }
+    return;
+  }
+
+  filter_answer = command;
+  filter_answer.settle_ms = 0;
+  filter_answer.status = scha63x_set_filter(&config, &filter_answer.settle_ms);
+  filter_received = true;
+  filter_settling = true;
+  filter_set_at = millis();
+}
+
 
 void setup()
 {
@@ -145,12 +201,7 @@ void setup()
     }
   }
   
-  // Initialize UDP, receive IMU config
-  udp_server = udp_init();
-  startUpSeq(udp_server);
-
-
-  // Filter config, structs from UDP
+  // Filter config, 46 Hz unless the server sends one
 
   struct filters filter;
   scha63x_sensor_config sensor_config;
@@ -164,10 +215,19 @@ void setup()
   sensor_config.gyro_filter.Ry2 = filter.FILTER_46HZ;
   sensor_config.gyro_filter.Ry = filter.FILTER_46HZ;
 
+  // Initialize UDP, receive IMU config
+  udp_server = udp_init();
+  startUpSeq(udp_server, &sensor_config);
+
   char serial_num[14];
   int status;
+
+  // Serial number first, the server may have this sensor's cross-axis terms
+  scha63x_read_serial(serial_num);
+  sensor_data specs;
+  bool cac_cached = sendSensorStatus(udp_server, serial_num, &specs) && specs.cac_cached;
   
-  status = initialize_sensor(serial_num, &sensor_config);
+  status = initialize_sensor(&sensor_config, !cac_cached);
   
   if (status != SCHA63X_OK) {
     Serial.print("ERROR: ");
@@ -178,15 +238,21 @@ void setup()
   Serial.println(serial_num);
   Serial.println("!!! Initialization Complete !!!");
 
-  // Clear data_vector
+  // Clear data_vector, both buffers free
   memset(&data_vector, 0, sizeof(data_vector));
+  scha63x_pingpong_init(&buffers, data_vector[0], data_vector[1], BUFFER_SIZE, 1000000 / IMU_SAMPLING_RATE);
 
   pinMode(CAM_TRIGGER_PIN, OUTPUT);
   digitalWrite(CAM_TRIGGER_PIN, LOW);
 
-  // Send sensor information from config and cross-axis terms over UDP
-  // status and serial number needs to be added to struct
-  sendImuInfo(udp_server);
+  // Send cross-axis terms over UDP unless the server has them cached
+  if (!cac_cached) {
+    sendImuInfo(udp_server);
+  }
+
+  // The sample interrupt uses SPI, Ethernet transfers mask interrupts
+  // for the length of one SPI transaction instead of the whole packet
+  SPI.usingInterrupt(255);
 
   // Start sampling
   SampleTimer_Initialize(imu_sampling_callback);
@@ -205,70 +271,18 @@ void loop()
     digitalWrite(CAM_TRIGGER_PIN, LOW);
   }
 
-  if (imu_sampling_flag) {
-    
-    imu_timestamp = micros();
-    imu_sampling_flag = false;
-
-    if (cam_trigger_flag) {
-//      Serial.println("T");
-      microsec_counter = micros();
-      digitalWrite(CAM_TRIGGER_PIN, HIGH);
-    }
-
-    static scha63x_raw_data scha63x_raw_data_last;
-    static int32_t num_samples = 0;
-
-    { // scope for reading sensor
-      ATOMIC_BLOCK_FORCEON;
-      scha63x_read_data(&scha63x_raw_data_last);
-    
-      data_vector[buffer_index].timeStamp = imu_timestamp;
-      data_vector[buffer_index].acc_x_lsb = scha63x_raw_data_last.acc_x_lsb;
-      data_vector[buffer_index].acc_y_lsb = scha63x_raw_data_last.acc_y_lsb;
-      data_vector[buffer_index].acc_z_lsb = scha63x_raw_data_last.acc_z_lsb;
-      data_vector[buffer_index].gyro_x_lsb = scha63x_raw_data_last.gyro_x_lsb;
-      data_vector[buffer_index].gyro_y_lsb = scha63x_raw_data_last.gyro_y_lsb;
-      data_vector[buffer_index].gyro_z_lsb = scha63x_raw_data_last.gyro_z_lsb;
-      data_vector[buffer_index].temp_due_lsb = scha63x_raw_data_last.temp_due_lsb;
-      data_vector[buffer_index].temp_uno_lsb = scha63x_raw_data_last.temp_uno_lsb;
-  
-      // Triggers 
-      if (cam_trigger_flag) {
-        data_vector[buffer_index].cam_trigger = true;
-        cam_trigger_flag = false;
-      } else {
-        data_vector[buffer_index].cam_trigger = false;
-      }
-  
-      if (ubx_trigger_flag) {
-        data_vector[buffer_index].ubx_trigger = true;
-        ubx_trigger_flag = false;
-      } else {
-        data_vector[buffer_index].ubx_trigger = false;
-      }
-    }
-    
-    if (scha63x_raw_data_last.rs_error_due) {
-      DueError = true;
-    }
-    if (scha63x_raw_data_last.rs_error_uno) {
-      UnoError = true;
-    }
+  // Send the full buffer, the sample interrupt fills the other one meanwhile
+  const scha63x_raw_data *batch = scha63x_pingpong_ready(&buffers);
+  if (batch) {
+    sendUDPSamplePacket(udp_server, batch, BUFFER_SIZE, &buffers);
+    scha63x_pingpong_release(&buffers);
+    filter_command();
+  }
 
-    if (++buffer_index >= BUFFER_SIZE) {
-      
-      ATOMIC_BLOCK_FORCEON;
-      
-      // digitalWrite may not be necessary
-      digitalWrite(W5X00_ETHERNET_CS_PIN, LOW);
-      sendUDPpacketWithContent(udp_server, (byte *) data_vector, buf_bytes);
-      digitalWrite(W5X00_ETHERNET_CS_PIN, HIGH);
-      
-      // Housekeeping
-      memset(&data_vector, 0, sizeof(data_vector));
-      buffer_index = 0;
-    }    
+  // Filter change settled, the server gets the answer
+  if (filter_settling && millis() - filter_set_at >= filter_answer.settle_ms) {
+    sendFilterAnswer(udp_server, &filter_answer);
+    filter_settling = false;
   }
 
   if (DueError) {
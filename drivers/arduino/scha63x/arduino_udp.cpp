@@ -5,6 +5,7 @@
 #include "scha63x_driver.h"
 #include "config.h"
 #include "defs.h"
+#include "scha63x_wire.h"
 
 /*!
     @file arduino_udp.cpp
@@ -66,17 +67,17 @@ IPAddress udp_init(void)
     used in IMU initialization
 
     \param address server address
+    \param config  filter configuration from the server, left as it is
+                   if none comes within STATUS_REPLY_TIMEOUT
     \return integer, success 1, failure 0 
 */
-int startUpSeq(IPAddress &address)
+int startUpSeq(IPAddress &address, scha63x_sensor_config *config)
 {
     memset(packetBuffer, 0, PACKET_SIZE_STARTUP);
     memset(outBuffer, 0, PACKET_SIZE_STARTUP);
     sprintf((char *)packetBuffer, "hello");
-    byte *i;
     
     memset(imuConfig, 0, 1000);
-    //scha63x_sensor_config config;
     
     // ping 
     while (true)
@@ -88,16 +89,64 @@ int startUpSeq(IPAddress &address)
         if (strcmp((char *)i, (char *)packetBuffer) == 0)
         {
             Serial.println("PING OK");
+            break;
+        }
+    }
+
+    // CONFIG : filter configuration, sent right after the echo
+    uint32_t start = millis();
+    while (millis() - start < STATUS_REPLY_TIMEOUT)
+    {
+        if (getUDPpacketWithContent(imuConfig, sizeof(imuConfig)))
+        {
+            memcpy(config, imuConfig, sizeof(*config));
+            Serial.println("CONFIG OK");
             return 1;
-            
-            // Receive IMU config, DOES NOT WORK
-            byte *i = getUDPpacketWithContent((byte *) imuConfig, 1000);
-            //Udp.readPacket((byte *) &config, 1000, ip, port);
-            Serial.println((char *)i);
-            //return *i;
-            
         }
     }
+    Serial.println("CONFIG MISSING");
+    return 1;
+}
+
+/*!
+    \brief Send status and serial number, receive the server's settings
+
+    Called between scha63x_read_serial() and the rest of the sensor
+    initialization, reply->cac_cached tells whether the cross-axis
+    compensation values have to be read and sent
+
+    \param address    server address
+    \param serial_num serial number from scha63x_read_serial()
+    \param reply      server's answer, zeroed if there is none
+    \return integer, success 1, no reply within STATUS_REPLY_TIMEOUT 0
+*/
+int sendSensorStatus(IPAddress &address, const char *serial_num, sensor_data *reply)
+{
+    // Anything still queued after CONFIG is not the reply
+    while (Udp.parsePacket())
+        ;
+
+    sensor_data status;
+    memset(&status, 0, sizeof(status));
+    status.status = 1;
+    strncpy(status.serial_num, serial_num, sizeof(status.serial_num) - 1);
+
+    memset(packetBuffer, 0, PACKET_SIZE_STARTUP);
+    memcpy(packetBuffer, &status, sizeof(status));
+    sendUDPpacketWithContent(address, packetBuffer, PACKET_SIZE_STARTUP);
+
+    memset(reply, 0, sizeof(*reply));
+    uint32_t start = millis();
+    while (millis() - start < STATUS_REPLY_TIMEOUT)
+    {
+        if (getUDPpacketWithContent(outBuffer, PACKET_SIZE_STARTUP))
+        {
+            memcpy(reply, outBuffer, sizeof(*reply));
+            return 1;
+        }
+    }
+    Serial.println("STATUS REPLY MISSING");
+    return 0;
 }
 
 /*!
@@ -206,6 +255,95 @@ void sendUDPpacketWithContent(IPAddress &address, unsigned char *packetBuffer, u
 }
 
 
+/*!
+    \brief Send a sample batch to server
+
+    Header and samples are encoded into one UDP packet in the wire
+    format of scha63x_wire.h, the sequence number counts every batch
+    since startup. With WIRE_DELTA_ENCODING batches are delta encoded
+    whenever that is smaller than the raw encoding. Interrupts stay
+    enabled, the Ethernet library masks them per SPI transaction
+
+    \param address server address
+    \param samples pointer to the sample buffer
+    \param count   number of samples in the buffer, at most SCHA63X_WIRE_MAX_SAMPLES
+    \param buffers double buffers the samples come from, their missed
+                   ticks and overruns go into the header, NULL sends zero
+*/
+void sendUDPSamplePacket(IPAddress &address, const scha63x_raw_data *samples, uint8_t count,
+                         const scha63x_pingpong *buffers)
+{
+    static uint32_t sequence = 0;
+    static uint8_t packet[SCHA63X_WIRE_PACKET_SIZE(BUFFER_SIZE)];
+
+    if (count > BUFFER_SIZE)
+        count = BUFFER_SIZE;
+
+    scha63x_packet_header header;
+    header.magic = SCHA63X_PACKET_MAGIC;
+    header.version = SCHA63X_PACKET_VERSION;
+    header.count = count;
+    header.sequence = sequence++;
+    header.send_time = micros();
+    header.encoding = SCHA63X_WIRE_ENCODING_RAW;
+    header.missed_ticks = 0;
+    header.overruns = 0;
+    if (buffers)
+        scha63x_pingpong_stamp(buffers, &header);
+
+    size_t bytes = 0;
+#if WIRE_DELTA_ENCODING
+    bytes = scha63x_wire_put_delta_packet(packet, sizeof(packet), &header, samples);
+#endif
+    if (bytes == 0)
+        bytes = scha63x_wire_put_packet(packet, &header, samples);
+
+    Udp.beginPacket(address, UDPport);
+    Udp.write(packet, bytes);
+    Udp.endPacket();
+}
+
+
+/*!
+    \brief Poll for a filter command of the server
+
+    One look at the Ethernet chip's receive buffer, call it once per
+    sent batch. Other datagrams are dropped.
+
+    \param command output, the command as received
+    \param config  output, its filter configuration
+    \return true if a filter command was received
+*/
+bool getFilterCommand(scha63x_filter_command *command, scha63x_sensor_config *config)
+{
+    memset(packetBuffer, 0, SCHA63X_WIRE_FILTER_SIZE);
+    if (!getUDPpacketWithContent(packetBuffer, SCHA63X_WIRE_FILTER_SIZE) ||
+        !scha63x_wire_get_filter(packetBuffer, SCHA63X_WIRE_FILTER_SIZE, command))
+        return false;
+
+    config->acc_filter.Ax = command->filter[0];
+    config->acc_filter.Ay = command->filter[1];
+    config->acc_filter.Az = command->filter[2];
+    config->gyro_filter.Rz2_Rx2 = command->filter[3];
+    config->gyro_filter.Rz_Rx = command->filter[4];
+    config->gyro_filter.Ry2 = command->filter[5];
+    config->gyro_filter.Ry = command->filter[6];
+    return true;
+}
+
+/*!
+    \brief Answer a filter command with the driver status and settling wait
+
+    \param address server address
+    \param answer  the command with status and settle_ms filled in
+*/
+void sendFilterAnswer(IPAddress &address, const scha63x_filter_command *answer)
+{
+    uint8_t packet[SCHA63X_WIRE_FILTER_SIZE];
+    sendUDPpacketWithContent(address, packet, scha63x_wire_put_filter(packet, answer));
+}
+
+
 /*!
     \brief Receive packet to server
 
@@ -234,4 +372,5 @@ byte* getUDPpacketWithContent(unsigned char *packetBuffer, unsigned int packet_s
         Udp.read(packetBuffer, packet_size);
         return packetBuffer;
     }
+    return 0;
 }
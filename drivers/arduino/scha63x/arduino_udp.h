@@ -8,30 +8,45 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "defs.h"
+#include "scha63x_wire.h"
+#include "scha63x_pingpong.h"
+
 /*!
     @file arduino_udp.h
     @brief UDP communication with server
 */
 
 /*!
-    \brief sensor data, same declaration on server side definitions.h
+    \brief Sensor status, same layout as sensor_data in the server's defs.h
+
+    Sent with status and serial number, the server answers with
+    buffer and trigger settings and whether it has the cross-axis
+    compensation values of this serial number cached
 */
 typedef struct _sensor_data {
     
-    int sensitivity_acc;
-    int sensitivity_gyro_x;
-    int sensitivity_gyro_y;
-    int sensitivity_gyro_z;
-
-    int data_buffer_size;
+    int32_t status;
+    char serial_num[14];
+    uint8_t padding[2];   // server struct is 32 bit aligned, AVR does not pad
+
+    int32_t buffer;
+    int32_t imu_trigger;
+    int32_t cam_trigger;
+    int32_t cac_cached;   // skip the NVM read and sendImuInfo()
     
 } sensor_data;
 
 IPAddress udp_init(void);
-int startUpSeq(IPAddress& address);
+int startUpSeq(IPAddress& address, scha63x_sensor_config *config);
+int sendSensorStatus(IPAddress& address, const char *serial_num, sensor_data *reply);
 int sendImuInfo(IPAddress& address);
 void sendUDPpacketWithContent(IPAddress& address, unsigned char* packetBuffer, unsigned int packet_size);
+void sendUDPSamplePacket(IPAddress& address, const scha63x_raw_data* samples, uint8_t count,
+                         const scha63x_pingpong* buffers = NULL);
 byte* getUDPpacketWithContent(unsigned char* packetBuffer, unsigned int packet_size);
+bool getFilterCommand(scha63x_filter_command *command, scha63x_sensor_config *config);
+void sendFilterAnswer(IPAddress& address, const scha63x_filter_command *answer);
 
 
 #endif // #ifndef ARDUINO_UDP
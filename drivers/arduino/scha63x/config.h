@@ -50,6 +50,8 @@
 #define W5X00_SD_CS_PIN        4
 #define W5X00_ETHERNET_CS_PIN 10
 
+#define SPI_FRAME_GAP_US 1 // CSB high between the frames of a sensor read, n.b. sensor SPI timing
+
 ///@}
 
 
@@ -59,8 +61,8 @@
 */
 
 #define IMU_SAMPLING_RATE 500 // sampling rate, n.b limitations with transfer speed
-#define BUFFER_SIZE 2 // IMU buffer size, n.b limitations with transfer speed
-#define STRUCT_SIZE 26  // 64 + 8 * 16 + 4 * 4
+#define BUFFER_SIZE 2 // IMU buffer size, n.b limitations with transfer speed, at most SCHA63X_WIRE_MAX_SAMPLES
+#define WIRE_DELTA_ENCODING 0 // 1: delta encode batches that get smaller, pays off from BUFFER_SIZE 4 up
 
 // // filter parameters, possible values 13,20,46,200,300
 // #define GYRO_FILTER 46
@@ -107,6 +109,7 @@
 
 #define UDP_SERVER_PORT 5005
 #define PACKET_SIZE_STARTUP 1000
+#define STATUS_REPLY_TIMEOUT 500 // ms to wait for the server's STATUS reply, CAC terms are read without it
 
 ///@}
 
@@ -0,0 +1 @@
+../../common/scha63x_crc.h
\ No newline at end of file
@@ -4,6 +4,8 @@
 #include "scha63x_spi.h"
 #include "arduino_timers.h"
 #include "scha63x_spi_frame.h"
+#include "scha63x_crc.h"
+#include "scha63x_wire.h"
 
 /*!
     @file scha63x_driver.cpp
@@ -22,19 +24,23 @@
 #define SPI_DATA_INT16(a) ((int16_t)(((a) >> 8) & 0xffff))
 #define SPI_DATA_UINT16(a) ((uint16_t)(((a) >> 8) & 0xffff))
 #define SPI_DATA_CHECK_RS_ERROR(a) ((((a) >> 24) & 0x03) != 1 ? true : false) // true = RS error
+#define SPI_DATA_CRC_ERROR(a, bit) (scha63x_crc8_check(a) ? 0 : (bit)) // bit = CRC error
 #define GET_TEMPERATURE(a) (25 + ((a) / 30.0))
 ///@}
 
 // Static function prototypes
+static int scha63x_read_cac(void);
 static bool scha63x_check_init_due(void);
 static bool scha63x_check_init_uno(void);
-static bool scha63x_check_rs_error(uint32_t *data, int size);
-static bool scha63x_check_rs_error_3(uint32_t miso_1, uint32_t miso_2, uint32_t miso_3);
-static bool scha63x_check_rs_error_5(uint32_t miso_1, uint32_t miso_2, uint32_t miso_3,
-                                     uint32_t miso_4, uint32_t miso_5);
+static bool scha63x_check_rs_error(const uint32_t *data, int size);
+static void scha63x_frame_bytes(uint32_t frame, uint8_t *bytes);
+static bool scha63x_check_filter(uint32_t miso, uint32_t written);
 
 // Internal data structures
 static scha63x_cacv scha63x_cac_values; // Cross-axis compensation values
+static scha63x_filter_frames scha63x_filters = {
+    SPI_FRAME_WRITE_FILTER_46HZ_RATE, SPI_FRAME_WRITE_FILTER_46HZ_ACC, FILTER_STARTUP_WAIT, 22
+}; // Filter frames of initialize_sensor and scha63x_set_filter, 46 Hz before
 
 
 // Sensor initialization
@@ -42,33 +48,32 @@ static scha63x_cacv scha63x_cac_values; // Cross-axis compensation values
 /*!
     \brief Wrapper for scha63x_init() 
     
-    Includes generate_filter_frames for filter manipulation
+    Includes generate_filter_frames for filter manipulation,
+    call scha63x_read_serial() first
 
-    \param serial_num pointer to a buffer for storing IMU's serial number
     \param config filter configuration for sensor
+    \param read_cac read the cross-axis compensation values from NVM,
+                    false if the server has them cached for this serial number
     \return sensor status after initialization, check header file for definitions
 */
-int initialize_sensor(char *serial_num, scha63x_sensor_config *config)
+int initialize_sensor(scha63x_sensor_config *config, bool read_cac)
 {   
-    generate_filter_frames(config);
-    return scha63x_init(serial_num);
+    if (!generate_filter_frames(config, &scha63x_filters))
+        return SCHA63X_ERR_FILTER;
+    return scha63x_init(read_cac);
 }
 
 
 /*!
-    \brief Init SCHA63X sensor
+    \brief Reset SCHA63X sensor and read its serial number
 
-    Sensor startup sequence, documentation figure 7
+    First step of the startup sequence, both asics have read their
+    NVM when this returns
     
     \param serial_num pointer to a buffer for storing IMU's serial number
 */
-int scha63x_init(char *serial_num)
+void scha63x_read_serial(char *serial_num)
 {
-    bool status_DUE = false;
-    bool status_UNO = false;
-    int attempt;
-    int const num_attempts = 5;
-
     // HW Reset (reset via SPI)
     SPI_ASIC_UNO(SPI_FRAME_WRITE_RESET);
     SPI_ASIC_DUE(SPI_FRAME_WRITE_REG_BANK_0); // Make sure we are in bank 0, otherwise SPI reset is not available.
@@ -88,7 +93,19 @@ int scha63x_init(char *serial_num)
     uint16_t id_0 = trc_0 & 0xffff;
     uint16_t id_2 = trc_1 & 0xffff;
     snprintf(serial_num, 14, "%05d%01x%04X", id_2, id_1, id_0);
+}
+
+
+/*!
+    \brief Read cross-axis compensation values from DUE asic NVM
+
+    Puts the DUE asic into test mode for the read and resets it
+    afterwards, part of scha63x_init()
 
+    \return SCHA63X_OK or SCHA63X_ERR_TEST_MODE_ACTIVATION
+*/
+static int scha63x_read_cac(void)
+{
     // Activate DUE asic test mode to be able to read cross-axis
     // compensation values from DUE NVM.
     SPI_ASIC_DUE(SPI_FRAME_WRITE_MODE_ASM_010);
@@ -149,17 +166,43 @@ int scha63x_init(char *serial_num)
     SPI_ASIC_DUE(SPI_FRAME_WRITE_REG_BANK_0); // Return to bank 0 to make SPI reset command available.
     SPI_ASIC_DUE(SPI_FRAME_WRITE_RESET);      // Reset DUE after reading cross-axis registers
 
-    // Start UNO & DUE
     Wait_ms(25); // Wait 25ms for the non-volatile memory (NVM) Read
 
-    // DUE asic initial startup
+    return SCHA63X_OK;
+}
+
+
+/*!
+    \brief Init SCHA63X sensor
+
+    Sensor startup sequence, documentation figure 7, continued after
+    scha63x_read_serial(). Without read_cac the DUE asic stays out of
+    test mode, which saves its extra reset and NVM read.
+    
+    \param read_cac read the cross-axis compensation values, get_cacv_ptr()
+*/
+int scha63x_init(bool read_cac)
+{
+    bool status_DUE = false;
+    bool status_UNO = false;
+    int attempt;
+    int const num_attempts = 5;
+
+    if (read_cac)
+    {
+        int status = scha63x_read_cac();
+        if (status != SCHA63X_OK)
+            return status;
+    }
+
+    // Start UNO & DUE, DUE asic initial startup
     SPI_ASIC_UNO(SPI_FRAME_WRITE_OP_MODE_NORMAL); // Set UNO operation mode on
     SPI_ASIC_DUE(SPI_FRAME_WRITE_OP_MODE_NORMAL); // Set DUE operation mode on twice
     SPI_ASIC_DUE(SPI_FRAME_WRITE_OP_MODE_NORMAL);
     Wait_ms(70); // Wait minimum 70ms (includes UNO 50ms 'SPI accessible' wait)
 
-    SPI_ASIC_UNO(SPI_FRAME_WRITE_FILTER_RATE); // Select UNO 46Hz filter for RATE
-    SPI_ASIC_UNO(SPI_FRAME_WRITE_FILTER_ACC);  // Select UNO 46Hz filter for ACC
+    SPI_ASIC_UNO(scha63x_filters.rate); // Select UNO filter for RATE
+    SPI_ASIC_UNO(scha63x_filters.acc);  // Select UNO filter for ACC
 
     // Restart DUE
     SPI_ASIC_DUE(SPI_FRAME_WRITE_RESET); // Reset DUE again
@@ -169,12 +212,12 @@ int scha63x_init(char *serial_num)
     SPI_ASIC_DUE(SPI_FRAME_WRITE_OP_MODE_NORMAL); // DUE operation mode must be set twice
 
     Wait_ms(1);                                     // Wait 1 ms for SPI to be accesible
-    SPI_ASIC_DUE(SPI_FRAME_WRITE_FILTER_RATE); // Select DUE 46Hz filter for RATE
+    SPI_ASIC_DUE(scha63x_filters.rate);             // Select DUE filter for RATE
 
     for (attempt = 0; attempt < num_attempts; attempt++)
     {
         // Wait FILTER_STARTUP_WAIT ms (Gyro and ACC start up)
-        Wait_ms(FILTER_STARTUP_WAIT);
+        Wait_ms(scha63x_filters.startup_wait);
 
         // Set EOI=1 (End of initialization command)
         SPI_ASIC_UNO(SPI_FRAME_WRITE_EOI_BIT); // Set EOI bit for UNO
@@ -196,9 +239,9 @@ int scha63x_init(char *serial_num)
             SPI_ASIC_DUE(SPI_FRAME_WRITE_OP_MODE_NORMAL); // Set DUE operation mode on twice
             SPI_ASIC_DUE(SPI_FRAME_WRITE_OP_MODE_NORMAL);
             Wait_ms(50);                                    // Wait 50ms before communicating with UNO
-            SPI_ASIC_UNO(SPI_FRAME_WRITE_FILTER_RATE); // Select UNO 46Hz filter for RATE
-            SPI_ASIC_UNO(SPI_FRAME_WRITE_FILTER_ACC);  // Select UNO 46Hz filter for ACC
-            SPI_ASIC_DUE(SPI_FRAME_WRITE_FILTER_RATE); // Select DUE 46Hz filter for RATE
+            SPI_ASIC_UNO(scha63x_filters.rate);             // Select UNO filter for RATE
+            SPI_ASIC_UNO(scha63x_filters.acc);              // Select UNO filter for ACC
+            SPI_ASIC_DUE(scha63x_filters.rate);             // Select DUE filter for RATE
             Wait_ms(45);                                    // Adjust restart duration to 500 ms
         }
         else
@@ -216,6 +259,54 @@ int scha63x_init(char *serial_num)
 }
 
 
+/*!
+    \brief Change the filters of the running sensor
+
+    Writes the filter registers and reads them back in one burst per
+    ASIC, no reset or startup wait. The sample interrupt may read in
+    between the two bursts. Samples of the next settle_ms are in
+    transition between the old and the new filters.
+
+    \param config    new filter configuration
+    \param settle_ms output, settling time of the new filters
+    \return SCHA63X_OK, SCHA63X_ERR_FILTER if a filter code is not
+            valid or a register does not read back what was written
+*/
+int scha63x_set_filter(const scha63x_sensor_config *config, uint16_t *settle_ms)
+{
+    scha63x_filter_frames frames;
+    if (!generate_filter_frames(config, &frames))
+        return SCHA63X_ERR_FILTER;
+
+    // Writes first, the reads are answered one frame later
+    const uint32_t read_rate = generate_read_frame(GYRO_REG);
+    const uint32_t read_acc = generate_read_frame(ACC_REG);
+    uint8_t uno_frames[5][4];
+    uint8_t due_frames[3][4];
+    uint32_t uno[5];
+    uint32_t due[3];
+    scha63x_frame_bytes(frames.rate, uno_frames[0]);
+    scha63x_frame_bytes(frames.acc, uno_frames[1]);
+    scha63x_frame_bytes(read_rate, uno_frames[2]);
+    scha63x_frame_bytes(read_acc, uno_frames[3]);
+    scha63x_frame_bytes(read_acc, uno_frames[4]);
+    scha63x_frame_bytes(frames.rate, due_frames[0]);
+    scha63x_frame_bytes(read_rate, due_frames[1]);
+    scha63x_frame_bytes(read_rate, due_frames[2]);
+
+    SPI_ASIC_BURST_UNO(uno_frames, uno, 5);
+    SPI_ASIC_BURST_DUE(due_frames, due, 3);
+
+    if (!scha63x_check_filter(uno[3], frames.rate) || !scha63x_check_filter(uno[4], frames.acc) ||
+        !scha63x_check_filter(due[2], frames.rate))
+        return SCHA63X_ERR_FILTER;
+
+    scha63x_filters = frames;
+    *settle_ms = frames.settle_wait;
+    return SCHA63X_OK;
+}
+
+
 /*!
     \brief CAC struct getter
     \return pointer to a struct, check defs.h
@@ -273,35 +364,41 @@ static bool scha63x_check_init_uno(void)
 /*!
     \brief Read acceleration, rate and temperature data from sensor. 
 
+    Channels whose MISO frame fails its CRC are flagged in crc_errors,
+    their values are passed on as read.
+
     \param data pointer to "raw" data from sensor
 */
 void scha63x_read_data(scha63x_raw_data *data)
 {
-    SPI_ASIC_DUE(SPI_FRAME_READ_GYRO_Y);                       // gyro y
-    uint32_t gyro_y_lsb = SPI_ASIC_DUE(SPI_FRAME_READ_GYRO_Z); // gyro z
-    uint32_t gyro_z_lsb = SPI_ASIC_DUE(SPI_FRAME_READ_TEMP);   // temperature
-    uint32_t temp_due_lsb = SPI_ASIC_DUE(SPI_FRAME_READ_TEMP);
-
-    SPI_ASIC_UNO(SPI_FRAME_READ_GYRO_X);                      // gyro x
-    uint32_t gyro_x_lsb = SPI_ASIC_UNO(SPI_FRAME_READ_ACC_X); // acc x
-    uint32_t acc_x_lsb = SPI_ASIC_UNO(SPI_FRAME_READ_ACC_Y);  // acc y
-    uint32_t acc_y_lsb = SPI_ASIC_UNO(SPI_FRAME_READ_ACC_Z);  // acc z
-    uint32_t acc_z_lsb = SPI_ASIC_UNO(SPI_FRAME_READ_TEMP);   // temperature
-    uint32_t temp_uno_lsb = SPI_ASIC_UNO(SPI_FRAME_READ_TEMP);
-
-    // Get possible errors
-    data->rs_error_due = scha63x_check_rs_error_3(gyro_y_lsb, gyro_z_lsb, temp_due_lsb);
-    data->rs_error_uno = scha63x_check_rs_error_5(gyro_x_lsb, acc_x_lsb, acc_y_lsb, acc_z_lsb, temp_uno_lsb);
+    uint32_t due[SPI_READ_FRAMES_DUE];
+    uint32_t uno[SPI_READ_FRAMES_UNO];
+
+    // One burst per ASIC, see spi_read_due and spi_read_uno
+    SPI_ASIC_BURST_DUE(spi_read_due, due, SPI_READ_FRAMES_DUE);
+    SPI_ASIC_BURST_UNO(spi_read_uno, uno, SPI_READ_FRAMES_UNO);
+
+    // Get possible errors, the first response belongs to the previous read
+    data->rs_error_due = scha63x_check_rs_error(due + 1, SPI_READ_FRAMES_DUE - 1);
+    data->rs_error_uno = scha63x_check_rs_error(uno + 1, SPI_READ_FRAMES_UNO - 1);
+    data->crc_errors = SPI_DATA_CRC_ERROR(uno[2], SCHA63X_WIRE_CRC_ACC_X) |
+                       SPI_DATA_CRC_ERROR(uno[3], SCHA63X_WIRE_CRC_ACC_Y) |
+                       SPI_DATA_CRC_ERROR(uno[4], SCHA63X_WIRE_CRC_ACC_Z) |
+                       SPI_DATA_CRC_ERROR(uno[1], SCHA63X_WIRE_CRC_GYRO_X) |
+                       SPI_DATA_CRC_ERROR(due[1], SCHA63X_WIRE_CRC_GYRO_Y) |
+                       SPI_DATA_CRC_ERROR(due[2], SCHA63X_WIRE_CRC_GYRO_Z) |
+                       SPI_DATA_CRC_ERROR(due[3], SCHA63X_WIRE_CRC_TEMP_DUE) |
+                       SPI_DATA_CRC_ERROR(uno[5], SCHA63X_WIRE_CRC_TEMP_UNO);
 
     // Parse MISO data to structure
-    data->acc_x_lsb = SPI_DATA_INT16(acc_x_lsb);
-    data->acc_y_lsb = SPI_DATA_INT16(acc_y_lsb);
-    data->acc_z_lsb = SPI_DATA_INT16(acc_z_lsb);
-    data->gyro_x_lsb = SPI_DATA_INT16(gyro_x_lsb);
-    data->gyro_y_lsb = SPI_DATA_INT16(gyro_y_lsb);
-    data->gyro_z_lsb = SPI_DATA_INT16(gyro_z_lsb);
-    data->temp_due_lsb = SPI_DATA_INT16(temp_due_lsb);
-    data->temp_uno_lsb = SPI_DATA_INT16(temp_uno_lsb);
+    data->acc_x_lsb = SPI_DATA_INT16(uno[2]);
+    data->acc_y_lsb = SPI_DATA_INT16(uno[3]);
+    data->acc_z_lsb = SPI_DATA_INT16(uno[4]);
+    data->gyro_x_lsb = SPI_DATA_INT16(uno[1]);
+    data->gyro_y_lsb = SPI_DATA_INT16(due[1]);
+    data->gyro_z_lsb = SPI_DATA_INT16(due[2]);
+    data->temp_due_lsb = SPI_DATA_INT16(due[3]);
+    data->temp_uno_lsb = SPI_DATA_INT16(uno[5]);
 }
 
 
@@ -316,7 +413,7 @@ void scha63x_read_data(scha63x_raw_data *data)
     \return true (RS error bits set), false (no RS error)
 
 */
-static bool scha63x_check_rs_error(uint32_t *data, int size)
+static bool scha63x_check_rs_error(const uint32_t *data, int size)
 {
     for (int i = 0; i < size; i++)
     {
@@ -331,30 +428,30 @@ static bool scha63x_check_rs_error(uint32_t *data, int size)
 }
 
 /*!
-    \brief Check if any of three MISO frames have RS error bits set
-
-    \param miso_1 ...miso_3 - MISO words 1...3
-    \return true (RS error bits set), false (no RS error)
+    \brief Split a frame into its bytes for SPI_ASIC_BURST_*, MSB first
 */
-static bool scha63x_check_rs_error_3(uint32_t miso_1, uint32_t miso_2, uint32_t miso_3)
+static void scha63x_frame_bytes(uint32_t frame, uint8_t *bytes)
 {
-    uint32_t miso_words[] = {miso_1, miso_2, miso_3};
-    return scha63x_check_rs_error(miso_words, (sizeof(miso_words) / sizeof(uint32_t)));
+    bytes[0] = (uint8_t)(frame >> 24);
+    bytes[1] = (uint8_t)(frame >> 16);
+    bytes[2] = (uint8_t)(frame >> 8);
+    bytes[3] = (uint8_t)frame;
 }
 
 /*!
-    \brief Check if any of five MISO frames have RS error bits set
+    \brief Check a filter register read back after writing it
 
-    \param miso_1 .. miso_5 - MISO words 1 .. 5
-    \return true (RS error bits set), false (no RS error)
+    \param miso    response to the register read
+    \param written write frame of the register
+    \return true if the response is valid and holds the written value
 */
-static bool scha63x_check_rs_error_5(uint32_t miso_1, uint32_t miso_2, uint32_t miso_3,
-                                     uint32_t miso_4, uint32_t miso_5)
+static bool scha63x_check_filter(uint32_t miso, uint32_t written)
 {
-    uint32_t miso_words[] = {miso_1, miso_2, miso_3, miso_4, miso_5};
-    return scha63x_check_rs_error(miso_words, (sizeof(miso_words) / sizeof(uint32_t)));
+    return scha63x_crc8_check(miso) && !SPI_DATA_CHECK_RS_ERROR(miso) &&
+           SPI_DATA_UINT16(miso) == SPI_DATA_UINT16(written);
 }
 
+
 /*!
     \brief Read sensor status from UNO ASIC
 
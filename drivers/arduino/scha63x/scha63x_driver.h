@@ -17,14 +17,17 @@
 #define SCHA63X_OK                         0
 #define SCHA63X_ERR_TEST_MODE_ACTIVATION   -1 // error, Could not activate test mode during init
 #define SCHA63X_ERR_RS_STATUS_NOK          -2 // error, RS status not OK after all init steps
+#define SCHA63X_ERR_FILTER                 -3 // error, filter code not valid or filter register not written
 
 
 #ifdef __cplusplus 
  extern "C" {   
 #endif
 
-int  initialize_sensor(char *serial_num, scha63x_sensor_config *config);
-int  scha63x_init(char *serial_num);
+int  initialize_sensor(scha63x_sensor_config *config, bool read_cac);
+void scha63x_read_serial(char *serial_num);
+int  scha63x_init(bool read_cac);
+int  scha63x_set_filter(const scha63x_sensor_config *config, uint16_t *settle_ms);
 
 scha63x_cacv* get_cacv_ptr(void);
 
@@ -0,0 +1 @@
+../../common/scha63x_pingpong.h
\ No newline at end of file
@@ -25,6 +25,67 @@ const SPISettings spi_set(transfer_rate, MSBFIRST, SPI_MODE0);
 ///@}
 
 
+/*!
+    \brief Chip select written straight to its port
+
+    digitalWrite looks the pin up on every call, which costs more
+    than a byte transfer. The port and mask are looked up once.
+*/
+typedef struct _csb_port {
+#if defined(ARDUINO_ARCH_SAM)
+  Pio *port;
+  uint32_t mask;
+#else
+  decltype(portOutputRegister(digitalPinToPort(0))) port;
+  decltype(digitalPinToBitMask(0)) mask;
+#endif
+} csb_port;
+
+static csb_port csb_port_uno;
+static csb_port csb_port_due;
+
+
+/*!
+    \brief Look up the port of a chip select pin
+*/
+static void csb_port_init(csb_port *csb, uint8_t pin)
+{
+#if defined(ARDUINO_ARCH_SAM)
+  csb->port = digitalPinToPort(pin);
+#else
+  csb->port = portOutputRegister(digitalPinToPort(pin));
+#endif
+  csb->mask = digitalPinToBitMask(pin);
+}
+
+/*!
+    \brief Set CSB active, within an SPI transaction
+
+    AVR ports are read, modified and written, the transaction keeps
+    interrupts that use SPI out (SPI.usingInterrupt)
+*/
+static inline void csb_low(const csb_port *csb)
+{
+#if defined(ARDUINO_ARCH_SAM)
+  csb->port->PIO_CODR = csb->mask;
+#else
+  *csb->port &= ~csb->mask;
+#endif
+}
+
+/*!
+    \brief Set CSB inactive, within an SPI transaction
+*/
+static inline void csb_high(const csb_port *csb)
+{
+#if defined(ARDUINO_ARCH_SAM)
+  csb->port->PIO_SODR = csb->mask;
+#else
+  *csb->port |= csb->mask;
+#endif
+}
+
+
 /*!
     \brief Initialize SPI pins and start SPI object
 */
@@ -41,6 +102,9 @@ void SPI_Initialize(void)
   digitalWrite( CSB_SD,  HIGH );
   digitalWrite( CSB_ETH, HIGH );
 
+  csb_port_init(&csb_port_uno, CSB_UNO);
+  csb_port_init(&csb_port_due, CSB_DUE);
+
   SPI.begin();
 }
 
@@ -81,6 +145,43 @@ static uint32_t SPI_ASIC(uint32_t dout, uint8_t GPIO_Pin)
 }
 
 
+/*!
+    \brief SPI burst of frames with one ASIC
+
+    Sends precomputed frames in one SPI transaction. CSB still rises
+    after every frame, the sensor takes a frame on the rising edge and
+    answers it in the next one, and stays high for SPI_FRAME_GAP_US
+    between frames. Frames are stored MSB first, no shifts between
+    the byte transfers.
+
+    \param mosi   frames to send, 4 bytes each MSB first
+    \param miso   output, frames received, miso[0] answers the frame before the burst
+    \param frames number of frames
+    \param csb    chip select of the ASIC
+*/
+static void SPI_ASIC_BURST(const uint8_t (*mosi)[4], uint32_t *miso, uint8_t frames, const csb_port *csb)
+{
+  SPI.beginTransaction(spi_set);
+
+  for (uint8_t i = 0; i < frames; i++)
+  {
+    if (i > 0)
+      delayMicroseconds(SPI_FRAME_GAP_US);
+
+    csb_low(csb);
+    uint32_t val = SPI.transfer(mosi[i][0]); val <<= 8;
+    val |= SPI.transfer(mosi[i][1]); val <<= 8;
+    val |= SPI.transfer(mosi[i][2]); val <<= 8;
+    val |= SPI.transfer(mosi[i][3]);
+    csb_high(csb);
+
+    miso[i] = val;
+  }
+
+  SPI.endTransaction();
+}
+
+
 /*!
     \brief Wrapper for SPI_ASIC, accesses DUE
 */
@@ -96,3 +197,19 @@ uint32_t SPI_ASIC_UNO(uint32_t dout)
 {
   return SPI_ASIC(dout, CSB_UNO);
 }
+
+/*!
+    \brief Wrapper for SPI_ASIC_BURST, accesses DUE
+*/
+void SPI_ASIC_BURST_DUE(const uint8_t (*mosi)[4], uint32_t *miso, uint8_t frames)
+{
+  SPI_ASIC_BURST(mosi, miso, frames, &csb_port_due);
+}
+
+/*!
+    \brief Wrapper for SPI_ASIC_BURST, accesses UNO
+*/
+void SPI_ASIC_BURST_UNO(const uint8_t (*mosi)[4], uint32_t *miso, uint8_t frames)
+{
+  SPI_ASIC_BURST(mosi, miso, frames, &csb_port_uno);
+}
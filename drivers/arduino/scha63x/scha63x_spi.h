@@ -19,6 +19,8 @@
 void SPI_Initialize(void);
 uint32_t SPI_ASIC_DUE(uint32_t dout);
 uint32_t SPI_ASIC_UNO(uint32_t dout);
+void SPI_ASIC_BURST_DUE(const uint8_t (*mosi)[4], uint32_t *miso, uint8_t frames);
+void SPI_ASIC_BURST_UNO(const uint8_t (*mosi)[4], uint32_t *miso, uint8_t frames);
 
 #ifdef __cplusplus
 }
@@ -1,30 +1,75 @@
 #include "scha63x_spi_frame.h"
+#include "scha63x_crc.h"
 
 /*!
     @file scha63x_spi_frame.cpp
     @brief SPI frames for the sensor
 */
 
+// Precomputed read of one sample
+
+/*! \brief DUE frames of a sample read */
+const uint8_t spi_read_due[SPI_READ_FRAMES_DUE][4] = {
+    SPI_FRAME_BYTES(SPI_FRAME_READ_GYRO_Y),
+    SPI_FRAME_BYTES(SPI_FRAME_READ_GYRO_Z),
+    SPI_FRAME_BYTES(SPI_FRAME_READ_TEMP),
+    SPI_FRAME_BYTES(SPI_FRAME_READ_TEMP)
+};
+
+/*! \brief UNO frames of a sample read */
+const uint8_t spi_read_uno[SPI_READ_FRAMES_UNO][4] = {
+    SPI_FRAME_BYTES(SPI_FRAME_READ_GYRO_X),
+    SPI_FRAME_BYTES(SPI_FRAME_READ_ACC_X),
+    SPI_FRAME_BYTES(SPI_FRAME_READ_ACC_Y),
+    SPI_FRAME_BYTES(SPI_FRAME_READ_ACC_Z),
+    SPI_FRAME_BYTES(SPI_FRAME_READ_TEMP),
+    SPI_FRAME_BYTES(SPI_FRAME_READ_TEMP)
+};
+
+
 // SPI frame generation
 
+/*!
+    \brief Settling of the outputs after a filter change, per filter code, ms
+
+    About six time constants of a first order filter at the cutoff,
+    1000 ms / cutoff Hz, for 13, 20, 46, 200 and 300 Hz
+*/
+static const uint8_t filter_settle_ms[filters::FILTER_300HZ + 1] = { 77, 50, 22, 5, 4 };
+
 /*!
     \brief Generate SPI frames for gyro and accelerometer filter
 
+    Computed at runtime from the configuration the server sends, the
+    waits follow the narrowest filter for settling and the widest for
+    the startup
+
     \param config pointer to sensor filter configuration values in a struct
+    \param frames output, unchanged if the configuration is not valid
+    \return false if a filter code is not one of struct filters
 */
-void generate_filter_frames(scha63x_sensor_config *config)
+bool generate_filter_frames(const scha63x_sensor_config *config, scha63x_filter_frames *frames)
 {
-    // startup wait of 525ms for 46Hz filters and above 
-    if (config->acc_filter.Ax > 2) {
-        #undef FILTER_STARTUP_WAIT
-        #define FILTER_STARTUP_WAIT 525
+    const uint16_t codes[] = {
+        config->acc_filter.Ax, config->acc_filter.Ay, config->acc_filter.Az,
+        config->gyro_filter.Rz2_Rx2, config->gyro_filter.Rz_Rx, config->gyro_filter.Ry2, config->gyro_filter.Ry
+    };
+    uint16_t widest = 0;
+    uint8_t settle = 0;
+    for (uint8_t i = 0; i < sizeof(codes) / sizeof(codes[0]); i++) {
+        if (codes[i] > filters::FILTER_300HZ)
+            return false;
+        if (codes[i] > widest)
+            widest = codes[i];
+        if (filter_settle_ms[codes[i]] > settle)
+            settle = filter_settle_ms[codes[i]];
     }
 
-    #undef SPI_FRAME_WRITE_FILTER_RATE
-    #define SPI_FRAME_WRITE_FILTER_RATE generate_gyro_frame(config->gyro_filter);
-
-    #undef SPI_FRAME_WRITE_FILTER_ACC
-    #define SPI_FRAME_WRITE_FILTER_ACC generate_acc_frame(config->acc_filter);   
+    frames->rate = generate_gyro_frame(config->gyro_filter);
+    frames->acc = generate_acc_frame(config->acc_filter);
+    frames->startup_wait = widest > filters::FILTER_46HZ ? FILTER_STARTUP_WAIT_WIDE : FILTER_STARTUP_WAIT;
+    frames->settle_wait = settle;
+    return true;
 }
 
 /*!
@@ -44,6 +89,20 @@ uint8_t generate_frame_header(uint8_t rw, uint8_t reg, uint8_t rs){
     return header;
 }
 
+/*!
+    \brief Generate SPI frame reading a register
+
+    \param reg register address
+    \return generated 32-bit SPI frame with checksum
+*/
+uint32_t generate_read_frame(uint8_t reg)
+{
+    uint32_t frame = generate_frame_header(0, reg, 0);
+    shift(frame, 24); frame |= CalculateCRC(frame);
+
+    return frame;
+}
+
 /*!
     \brief Generate SPI frame for RATE
         
@@ -103,7 +162,8 @@ uint32_t generate_acc_frame(_acc_conf FILTER)
     
     Calculated for 24 MSB's of the 32 bit dword (8 LSB's are 
     the CRC field and are not included in CRC calculation). 
-    Documentation 1.5.6
+    Documentation 1.5.6, one table lookup per byte (scha63x_crc.h)
+    instead of CRC8 per bit
 
     \param Data 32-bit dataframe
     \return CRC of a dataframe
@@ -111,21 +171,11 @@ uint32_t generate_acc_frame(_acc_conf FILTER)
 */ 
 uint8_t CalculateCRC(uint32_t Data)
 {
-    uint8_t BitIndex;
-    uint8_t BitValue;
-    uint8_t CRC;
-    CRC = 0xFF;
-    for (BitIndex = 31; BitIndex > 7; BitIndex--)
-    {
-        BitValue = (uint8_t)((Data >> BitIndex) & 0x01);
-        CRC = CRC8(BitValue, CRC);
-    }
-    CRC = (uint8_t)~CRC;
-    return CRC;
+    return scha63x_crc8(Data);
 }
 
 /*!
-    \brief Checksum calculation for 8 bits
+    \brief Checksum calculation for 1 bit, bitwise reference of scha63x_crc8
 
     Check documentation 1.5.6 for CRC formula
 
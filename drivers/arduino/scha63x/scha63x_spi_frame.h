@@ -15,12 +15,11 @@
 #define shift(frame, nbit) ((frame) = (frame << (nbit)))
 
 
-/*! \brief frame variables */
-#define SPI_FRAME_WRITE_FILTER_RATE 0
-#define SPI_FRAME_WRITE_FILTER_ACC 0
-
-/*! \brief wait */
+///@{
+/*! \brief Gyro and acc start up after the filter setting, ms, longer above 46 Hz */
 #define FILTER_STARTUP_WAIT 405
+#define FILTER_STARTUP_WAIT_WIDE 525
+///@}
 
 
 
@@ -44,6 +43,19 @@
 #define SPI_FRAME_READ_ACC_STATUS_1 0x4800009D
 ///@}
 
+///@{
+/*!
+    \brief Read of one sample, one burst per ASIC
+
+    Frames MSB first, answered one frame later: DUE gyro y, gyro z and
+    temperature in responses 1-3, UNO gyro x, acc x, y, z and
+    temperature in responses 1-5
+*/
+#define SPI_FRAME_BYTES(frame) { (uint8_t)((frame) >> 24), (uint8_t)((frame) >> 16), (uint8_t)((frame) >> 8), (uint8_t)(frame) }
+#define SPI_READ_FRAMES_DUE 4
+#define SPI_READ_FRAMES_UNO 6
+///@}
+
 ///@{
 /*! \brief Reset and validation frames */
 #define SPI_FRAME_WRITE_RESET 0xE000017C
@@ -79,16 +91,35 @@
 /*! \brief accelerometer (register 1Ah) */
 #define ACC_REG  0b11010 
 
+/*!
+    \brief Filter frames of a sensor_config, see generate_filter_frames
+
+    Filters are written to the UNO (rate and acc) and the DUE (rate)
+*/
+typedef struct _scha63x_filter_frames {
+
+    uint32_t rate;            // write frame of the rate filter register
+    uint32_t acc;             // write frame of the acc filter register
+    uint16_t startup_wait;    // gyro and acc startup in scha63x_init, ms
+    uint16_t settle_wait;     // output settling after a change while running, ms
+
+} scha63x_filter_frames;
+
 
 #ifdef __cplusplus 
  extern "C" {   
 #endif
 
-void generate_filter_frames(scha63x_sensor_config *config);
+bool generate_filter_frames(const scha63x_sensor_config *config, scha63x_filter_frames *frames);
 
+uint8_t generate_frame_header(uint8_t rw, uint8_t reg, uint8_t rs);
+uint32_t generate_read_frame(uint8_t reg);
 uint32_t generate_acc_frame(_acc_conf FILTER);
 uint32_t generate_gyro_frame(_gyro_conf FILTER);
 
+extern const uint8_t spi_read_due[SPI_READ_FRAMES_DUE][4];
+extern const uint8_t spi_read_uno[SPI_READ_FRAMES_UNO][4];
+
 uint8_t CalculateCRC(uint32_t Data);
 uint8_t CRC8(uint8_t BitValue, uint8_t CRC);
 
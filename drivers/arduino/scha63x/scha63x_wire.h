@@ -0,0 +1 @@
+../../common/scha63x_wire.h
\ No newline at end of file
@@ -0,0 +1,197 @@
+/*!
+    @file scha63x_pingpong.h
+    @brief Double buffered sample batches of the firmware
+
+    The sample timer interrupt fills one buffer while the main loop
+    sends the other with interrupts enabled. A full buffer is handed
+    over only if the previous one has been sent, otherwise its samples
+    are dropped and counted as an overrun. Ticks the interrupt never
+    saw, e.g. while interrupts were masked for longer than a period,
+    are counted as missed. Both counters go to the server in every
+    packet header.
+
+    One writer in interrupt context, one reader in the main loop, no
+    locks: every shared field is a single byte or written by one side
+    only while the other does not read it. Plain C, included by the
+    Arduino firmware and by the host build of its loop
+    (host/udp-recorder/bench/firmware_loop_sim.cpp).
+*/
+
+#ifndef SCHA63X_PINGPONG_H
+#define SCHA63X_PINGPONG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "defs.h"
+#include "scha63x_wire.h"
+
+
+/*! \brief No buffer waiting to be sent */
+#define SCHA63X_PINGPONG_NONE 0xff
+
+
+/*!
+    \brief Two sample buffers and their counters
+*/
+typedef struct _scha63x_pingpong {
+
+    scha63x_raw_data *buffer[2];     // size samples each
+    uint8_t size;                    // samples per batch
+    uint32_t period_us;              // sample timer period
+
+    volatile uint8_t fill;           // buffer the interrupt writes
+    volatile uint8_t count;          // samples in it
+    volatile uint8_t ready;          // full buffer waiting to be sent, SCHA63X_PINGPONG_NONE if none
+
+    uint32_t last_tick;              // expected micros() of the previous tick, interrupt only
+    bool started;                    // a tick was seen, interrupt only
+    volatile uint16_t missed_ticks;  // ticks without a sample, wraps
+    volatile uint8_t overruns;       // batches dropped, wraps
+
+} scha63x_pingpong;
+
+
+/*!
+    \brief Set up empty buffers
+
+    \param pp        buffers to set up
+    \param a         first buffer, size samples
+    \param b         second buffer, size samples
+    \param size      samples per batch, at most SCHA63X_WIRE_MAX_SAMPLES
+    \param period_us sample timer period
+*/
+static inline void scha63x_pingpong_init(scha63x_pingpong *pp, scha63x_raw_data *a, scha63x_raw_data *b,
+                                         uint8_t size, uint32_t period_us)
+{
+    pp->buffer[0] = a;
+    pp->buffer[1] = b;
+    pp->size = size;
+    pp->period_us = period_us;
+    pp->fill = 0;
+    pp->count = 0;
+    pp->ready = SCHA63X_PINGPONG_NONE;
+    pp->last_tick = 0;
+    pp->started = false;
+    pp->missed_ticks = 0;
+    pp->overruns = 0;
+}
+
+/*!
+    \brief Ticks missed since the previous one, interrupt context
+
+    Ticks are expected a whole number of periods after the previous
+    one, an interrupt served late still belongs to its own tick, whole
+    periods in between were missed. The expected time follows the
+    interrupt whenever it comes early or more than half a period late,
+    after a timer restart or a late interrupt and against the rounding
+    of period_us. Shared with scha63x_ring.h.
+
+    \param last_tick expected micros() of the previous tick, updated
+    \param started   a tick was seen, set on the first one
+    \param period_us sample timer period
+    \param now       micros() of this tick
+    \return ticks missed in between
+*/
+static inline uint16_t scha63x_tick_missed(uint32_t *last_tick, bool *started, uint32_t period_us, uint32_t now)
+{
+    const uint32_t elapsed = now - *last_tick;
+    if (!*started || elapsed < period_us)
+    {
+        *started = true;
+        *last_tick = now;
+        return 0;
+    }
+
+    // no division on the usual path, it is slow on 8 bit targets
+    const uint32_t periods = elapsed < 2 * period_us ? 1 : elapsed / period_us;
+    *last_tick += periods * period_us;
+    if (now - *last_tick > period_us / 2)
+        *last_tick = now;
+    return (uint16_t)(periods - 1);
+}
+
+/*!
+    \brief Slot of the next sample, interrupt context
+
+    Counts the ticks missed since the previous call, check
+    scha63x_tick_missed
+
+    \param pp  buffers
+    \param now micros() of this tick
+    \return slot to fill, zeroed, hand it over with scha63x_pingpong_commit
+*/
+static inline scha63x_raw_data *scha63x_pingpong_slot(scha63x_pingpong *pp, uint32_t now)
+{
+    pp->missed_ticks += scha63x_tick_missed(&pp->last_tick, &pp->started, pp->period_us, now);
+
+    scha63x_raw_data *slot = &pp->buffer[pp->fill][pp->count];
+    memset(slot, 0, sizeof(*slot));
+    return slot;
+}
+
+/*!
+    \brief Account the sample written to the slot, interrupt context
+
+    A full buffer is handed to the main loop, or dropped if the
+    previous one is still waiting
+
+    \param pp buffers
+*/
+static inline void scha63x_pingpong_commit(scha63x_pingpong *pp)
+{
+    if (++pp->count < pp->size)
+        return;
+
+    pp->count = 0;
+    if (pp->ready != SCHA63X_PINGPONG_NONE)
+    {
+        pp->overruns++;
+        return;
+    }
+    pp->ready = pp->fill;
+    pp->fill ^= 1;
+}
+
+/*!
+    \brief Full buffer to send, main loop
+
+    \param pp buffers
+    \return size samples, untouched by the interrupt until
+            scha63x_pingpong_release, NULL if none is full
+*/
+static inline const scha63x_raw_data *scha63x_pingpong_ready(const scha63x_pingpong *pp)
+{
+    const uint8_t ready = pp->ready;
+    return ready == SCHA63X_PINGPONG_NONE ? NULL : pp->buffer[ready];
+}
+
+/*!
+    \brief Give the sent buffer back to the interrupt, main loop
+*/
+static inline void scha63x_pingpong_release(scha63x_pingpong *pp)
+{
+    pp->ready = SCHA63X_PINGPONG_NONE;
+}
+
+/*!
+    \brief Counters into a packet header, main loop
+
+    The 16 bit counter is read until two reads agree, 8 bit targets
+    read it byte by byte and the interrupt may change it in between
+*/
+static inline void scha63x_pingpong_stamp(const scha63x_pingpong *pp, scha63x_packet_header *header)
+{
+    uint16_t missed;
+    do
+    {
+        missed = pp->missed_ticks;
+    } while (missed != pp->missed_ticks);
+
+    header->missed_ticks = missed;
+    header->overruns = pp->overruns;
+}
+
+#endif
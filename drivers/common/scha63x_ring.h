@@ -0,0 +1,225 @@
+/*!
+    @file scha63x_ring.h
+    @brief Sample batches handed from the sampling core to the sending core
+
+    The ring of scha63x_pingpong.h for two cores: the sample timer
+    interrupt on one core fills batches of a ring of slots, the other
+    core encodes and sends them. A full batch is published if a free
+    slot is left for the next one, otherwise its samples are dropped
+    and counted as an overrun. With two slots it behaves like the
+    double buffers. Missed ticks are counted like there.
+
+    One writer, one reader, no locks: the interrupt owns head and the
+    slot it fills, the sending core owns tail. Head and tail count
+    slots from 0 and wrap, they are handed over with acquire and
+    release, which the GCC builtins give in C and C++, on Cortex-M0+
+    as a plain load or store and a barrier. Published slots that lie
+    back to back can be sent as one datagram of up to
+    SCHA63X_WIRE_MAX_SAMPLES samples, a sending core that fell behind
+    catches up with fewer, larger datagrams.
+
+    Plain C, included by the Pico firmware and by its host build
+    (host/udp-recorder/bench/dual_core_sim.cpp), where threads stand in
+    for the cores.
+*/
+
+#ifndef SCHA63X_RING_H
+#define SCHA63X_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "defs.h"
+#include "scha63x_wire.h"
+#include "scha63x_pingpong.h"
+
+
+///@{
+/*! \brief Field access across the cores */
+#define SCHA63X_RING_LOAD(field) __atomic_load_n(&(field), __ATOMIC_ACQUIRE)
+#define SCHA63X_RING_STORE(field, value) __atomic_store_n(&(field), (value), __ATOMIC_RELEASE)
+#define SCHA63X_RING_LOAD_RELAXED(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+#define SCHA63X_RING_STORE_RELAXED(field, value) __atomic_store_n(&(field), (value), __ATOMIC_RELAXED)
+///@}
+
+
+/*!
+    \brief Ring of sample batches and its counters
+*/
+typedef struct _scha63x_ring {
+
+    scha63x_raw_data *samples;       // slots * batch samples
+    uint8_t batch;                   // samples per slot
+    uint16_t slots;                  // batches in the ring, a power of two, at least 2
+    uint32_t period_us;              // sample timer period
+
+    uint32_t head;                   // slots published, written by the interrupt
+    uint32_t tail;                   // slots sent, written by the sending core
+    uint32_t sequence;               // datagrams encoded, sending core only
+    uint8_t count;                   // samples in slot head, interrupt only
+
+    uint32_t last_tick;              // expected time of the previous tick, interrupt only
+    bool started;                    // a tick was seen, interrupt only
+    uint16_t missed_ticks;           // ticks without a sample, wraps, written by the interrupt
+    uint8_t overruns;                // batches dropped with the ring full, wraps, written by the interrupt
+
+} scha63x_ring;
+
+
+/*!
+    \brief Set up an empty ring
+
+    \param ring      ring to set up
+    \param samples   slots * batch samples
+    \param batch     samples per slot, at most SCHA63X_WIRE_MAX_SAMPLES
+    \param slots     batches in the ring, a power of two from 2 up, the
+                     slot of head and tail stays the same across their wrap
+    \param period_us sample timer period
+*/
+static inline void scha63x_ring_init(scha63x_ring *ring, scha63x_raw_data *samples, uint8_t batch,
+                                     uint16_t slots, uint32_t period_us)
+{
+    ring->samples = samples;
+    ring->batch = batch;
+    ring->slots = slots;
+    ring->period_us = period_us;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->sequence = 0;
+    ring->count = 0;
+    ring->last_tick = 0;
+    ring->started = false;
+    ring->missed_ticks = 0;
+    ring->overruns = 0;
+}
+
+/*!
+    \brief Slot of the next sample, interrupt context
+
+    \param ring ring
+    \param now  time of this tick, us, its scheduled time keeps the
+                count of missed ticks exact
+    \return slot to fill, zeroed, hand it over with scha63x_ring_commit
+*/
+static inline scha63x_raw_data *scha63x_ring_slot(scha63x_ring *ring, uint32_t now)
+{
+    const uint16_t missed = scha63x_tick_missed(&ring->last_tick, &ring->started, ring->period_us, now);
+    if (missed)
+        SCHA63X_RING_STORE_RELAXED(ring->missed_ticks, (uint16_t)(ring->missed_ticks + missed));
+
+    scha63x_raw_data *slot = &ring->samples[(ring->head % ring->slots) * ring->batch + ring->count];
+    memset(slot, 0, sizeof(*slot));
+    return slot;
+}
+
+/*!
+    \brief Account the sample written to the slot, interrupt context
+
+    A full batch is published, or dropped if the next slot is still
+    waiting to be sent
+
+    \param ring ring
+    \return true if a batch was published, wake the sending core
+*/
+static inline bool scha63x_ring_commit(scha63x_ring *ring)
+{
+    if (++ring->count < ring->batch)
+        return false;
+
+    ring->count = 0;
+    if (ring->head + 1 - SCHA63X_RING_LOAD(ring->tail) >= ring->slots)
+    {
+        SCHA63X_RING_STORE_RELAXED(ring->overruns, (uint8_t)(ring->overruns + 1));
+        return false;
+    }
+    SCHA63X_RING_STORE(ring->head, ring->head + 1);
+    return true;
+}
+
+/*!
+    \brief Published samples to send, sending core
+
+    \param ring        ring
+    \param samples     output, first sample, untouched by the interrupt
+                       until scha63x_ring_release
+    \param max_samples most samples wanted, at least batch
+    \return samples back to back at samples, whole batches up to the
+            end of the ring, 0 if none is published
+*/
+static inline uint16_t scha63x_ring_ready(const scha63x_ring *ring, const scha63x_raw_data **samples,
+                                          uint16_t max_samples)
+{
+    const uint32_t tail = ring->tail;
+    uint32_t ready = SCHA63X_RING_LOAD(ring->head) - tail;
+    const uint32_t first = tail % ring->slots;
+    if (ready > ring->slots - first)
+        ready = ring->slots - first;
+    if (ready > (uint32_t)(max_samples / ring->batch))
+        ready = max_samples / ring->batch;
+
+    *samples = &ring->samples[first * ring->batch];
+    return (uint16_t)(ready * ring->batch);
+}
+
+/*!
+    \brief Give sent samples back to the interrupt, sending core
+
+    \param ring    ring
+    \param samples samples sent, from scha63x_ring_ready
+*/
+static inline void scha63x_ring_release(scha63x_ring *ring, uint16_t samples)
+{
+    SCHA63X_RING_STORE(ring->tail, ring->tail + samples / ring->batch);
+}
+
+/*!
+    \brief Counters into a packet header, sending core
+*/
+static inline void scha63x_ring_stamp(const scha63x_ring *ring, scha63x_packet_header *header)
+{
+    header->missed_ticks = SCHA63X_RING_LOAD_RELAXED(ring->missed_ticks);
+    header->overruns = SCHA63X_RING_LOAD_RELAXED(ring->overruns);
+}
+
+/*!
+    \brief Encode published samples into the next datagram, sending core
+
+    Takes the batches of scha63x_ring_ready, numbers the datagram,
+    stamps the counters and gives the slots back before the datagram
+    goes out, so a slow send does not hold them
+
+    \param ring        ring
+    \param packet      output, SCHA63X_WIRE_PACKET_SIZE(max_samples) bytes
+    \param max_samples most samples per datagram, batch to SCHA63X_WIRE_MAX_SAMPLES
+    \param send_time   device time in the header, us
+    \param delta       delta encode if that is smaller
+    \return datagram size, 0 if no batch is published
+*/
+static inline size_t scha63x_ring_packet(scha63x_ring *ring, uint8_t *packet, uint16_t max_samples,
+                                         uint32_t send_time, bool delta)
+{
+    const scha63x_raw_data *samples;
+    const uint16_t count = scha63x_ring_ready(ring, &samples, max_samples);
+    if (count == 0)
+        return 0;
+
+    scha63x_packet_header header;
+    header.magic = SCHA63X_PACKET_MAGIC;
+    header.version = SCHA63X_PACKET_VERSION;
+    header.count = (uint8_t)count;
+    header.sequence = ring->sequence++;
+    header.send_time = send_time;
+    header.encoding = SCHA63X_WIRE_ENCODING_RAW;
+    scha63x_ring_stamp(ring, &header);
+
+    size_t bytes = delta ? scha63x_wire_put_delta_packet(packet, SCHA63X_WIRE_PACKET_SIZE(count), &header, samples) : 0;
+    if (bytes == 0)
+        bytes = scha63x_wire_put_packet(packet, &header, samples);
+
+    scha63x_ring_release(ring, count);
+    return bytes;
+}
+
+#endif
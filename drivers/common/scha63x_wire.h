@@ -0,0 +1,685 @@
+/*!
+    @file scha63x_wire.h
+    @brief UDP wire format of sample batches, shared by firmware and server
+
+    Datagrams are encoded byte by byte in little endian, independent
+    of struct padding, alignment and byte order of the compiler.
+    Plain C, included by the Arduino and Pico firmware and the server.
+
+    Datagram layout:
+
+        offset  size  field
+        0       2     magic, SCHA63X_PACKET_MAGIC
+        2       1     version, SCHA63X_PACKET_VERSION
+        3       1     count, samples after the header
+        4       4     sequence, packet number since startup
+        8       4     send_time, device micros() right before sending
+        12      1     encoding, SCHA63X_WIRE_ENCODING_*
+        13      2     missed_ticks, sample timer ticks without a sample
+        15      1     overruns, batches dropped on the device
+        16            samples
+
+    Raw encoding, 26 bytes per sample:
+
+        16      26    sample 0
+        42      26    sample 1 ...
+
+    Sample layout:
+
+        offset  size  field
+        0       8     timeStamp, int64
+        8       2     acc_x_lsb, acc_y_lsb, acc_z_lsb,
+        ...           gyro_x_lsb, gyro_y_lsb, gyro_z_lsb,
+        22      2     temp_due_lsb, temp_uno_lsb, int16 each
+        24      1     flags, SCHA63X_WIRE_FLAG_*
+        25      1     crc_errors, SCHA63X_WIRE_CRC_* of channels whose
+                      MISO frame failed its CRC
+
+    missed_ticks and overruns count up from 0 after startup and wrap,
+    the server takes differences. Firmware without double buffering
+    sends zero. So does firmware that does not check the CRC of the
+    frames it reads.
+
+    Delta encoding, for links where bytes are scarce:
+
+        16      26    sample 0, like a raw sample
+        42      4     timestamp step d, int32, sample 1 - sample 0
+        46      1     bit width of the timestamp column
+        47      8     bit widths of the eight int16 columns, acc x first
+        55            bit columns, least significant bit first:
+                      count - 1 timestamp residuals zigzag(step - d)
+                      count - 1 deltas zigzag(int16(value - previous))
+                      per channel, count - 1 flag nibbles, zero padded
+                      to a whole byte
+
+    Samples 1 to count - 1 are stored column by column at a fixed bit
+    width per column, e.g. 7 bits per acc delta of a resting sensor
+    instead of 16 bits. Batches of a single sample end after sample 0.
+    Only sample 0 carries CRC errors, a batch with CRC errors in a later
+    sample is sent raw.
+
+    Filter command, server to a streaming board, sent back by the board
+    with status and settle_ms once the new filters have settled:
+
+        0       2     magic, SCHA63X_FILTER_MAGIC
+        2       1     version, SCHA63X_PACKET_VERSION
+        3       1     status, int8, 0 in the command, driver status
+                      SCHA63X_OK or SCHA63X_ERR_* in the answer
+        4       2     sequence, the answer carries the command's
+        6       2     settle_ms, 0 in the command, wait of the board
+        8       7     filter codes, struct filters: acc Ax, Ay, Az,
+                      gyro Rz2_Rx2, Rz_Rx, Ry2, Ry
+
+    A repeated command with the sequence of the last one is answered
+    again without touching the sensor.
+*/
+
+#ifndef SCHA63X_WIRE_H
+#define SCHA63X_WIRE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "defs.h"
+
+
+#define SCHA63X_PACKET_MAGIC 0xA63C
+#define SCHA63X_PACKET_VERSION 2
+#define SCHA63X_FILTER_MAGIC 0xA63D
+
+///@{
+/*! \brief Encoded sizes in bytes */
+#define SCHA63X_WIRE_HEADER_SIZE 16
+#define SCHA63X_WIRE_SAMPLE_SIZE 26
+#define SCHA63X_WIRE_MAX_PAYLOAD 1472 // Ethernet MTU 1500 - IPv4 20 - UDP 8
+///@}
+
+/*! \brief Most samples fitting into an unfragmented datagram */
+#define SCHA63X_WIRE_MAX_SAMPLES ((SCHA63X_WIRE_MAX_PAYLOAD - SCHA63X_WIRE_HEADER_SIZE) / SCHA63X_WIRE_SAMPLE_SIZE)
+
+///@{
+/*! \brief Filter command size and filter codes in it */
+#define SCHA63X_WIRE_FILTER_SIZE 15
+#define SCHA63X_WIRE_FILTER_CODES 7
+///@}
+
+/*! \brief Datagram size of a raw batch */
+#define SCHA63X_WIRE_PACKET_SIZE(count) (SCHA63X_WIRE_HEADER_SIZE + (count) * SCHA63X_WIRE_SAMPLE_SIZE)
+
+///@{
+/*! \brief Sample encodings */
+#define SCHA63X_WIRE_ENCODING_RAW 0
+#define SCHA63X_WIRE_ENCODING_DELTA 1
+///@}
+
+///@{
+/*! \brief Delta encoding, step and widths in front of the bit columns */
+#define SCHA63X_WIRE_DELTA_INFO_SIZE 13
+#define SCHA63X_WIRE_DELTA_CHANNELS 8
+///@}
+
+///@{
+/*! \brief Bits of the sample flags byte */
+#define SCHA63X_WIRE_FLAG_RS_ERROR_DUE 0x01
+#define SCHA63X_WIRE_FLAG_RS_ERROR_UNO 0x02
+#define SCHA63X_WIRE_FLAG_CAM_TRIGGER  0x04
+#define SCHA63X_WIRE_FLAG_UBX_TRIGGER  0x08
+///@}
+
+///@{
+/*! \brief Bits of the sample CRC error byte, one per channel in column order */
+#define SCHA63X_WIRE_CRC_ACC_X    0x01
+#define SCHA63X_WIRE_CRC_ACC_Y    0x02
+#define SCHA63X_WIRE_CRC_ACC_Z    0x04
+#define SCHA63X_WIRE_CRC_GYRO_X   0x08
+#define SCHA63X_WIRE_CRC_GYRO_Y   0x10
+#define SCHA63X_WIRE_CRC_GYRO_Z   0x20
+#define SCHA63X_WIRE_CRC_TEMP_DUE 0x40
+#define SCHA63X_WIRE_CRC_TEMP_UNO 0x80
+///@}
+
+
+/*!
+    \brief Header in front of every sample batch sent over UDP
+
+    Lets the server detect lost and reordered packets and measure
+    delays. In memory form, encoded with scha63x_wire_put_header.
+*/
+typedef struct _scha63x_packet_header {
+
+    uint16_t magic;         // SCHA63X_PACKET_MAGIC
+    uint8_t version;        // SCHA63X_PACKET_VERSION
+    uint8_t count;          // number of samples after the header
+    uint32_t sequence;      // packet number, counts up from 0 after startup
+    uint32_t send_time;     // micros() right before sending
+    uint8_t encoding;       // SCHA63X_WIRE_ENCODING_*
+    uint16_t missed_ticks;  // sample timer ticks the device did not sample, wraps
+    uint8_t overruns;       // batches the device dropped with both buffers full, wraps
+
+} scha63x_packet_header;
+
+/*!
+    \brief Filter command and its answer, encoded with scha63x_wire_put_filter
+*/
+typedef struct _scha63x_filter_command {
+
+    int8_t status;          // 0 in the command, driver status in the answer
+    uint16_t sequence;      // command number, repeated commands keep it
+    uint16_t settle_ms;     // 0 in the command, settling wait of the board in the answer
+    uint8_t filter[SCHA63X_WIRE_FILTER_CODES]; // acc Ax, Ay, Az, gyro Rz2_Rx2, Rz_Rx, Ry2, Ry
+
+} scha63x_filter_command;
+
+
+///@{
+/*! \brief Little endian field access */
+static inline void scha63x_wire_put16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static inline void scha63x_wire_put32(uint8_t *p, uint32_t v)
+{
+    scha63x_wire_put16(p, (uint16_t)v);
+    scha63x_wire_put16(p + 2, (uint16_t)(v >> 16));
+}
+
+static inline void scha63x_wire_put64(uint8_t *p, uint64_t v)
+{
+    scha63x_wire_put32(p, (uint32_t)v);
+    scha63x_wire_put32(p + 4, (uint32_t)(v >> 32));
+}
+
+static inline uint16_t scha63x_wire_get16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t scha63x_wire_get32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t scha63x_wire_get64(const uint8_t *p)
+{
+    return (uint64_t)scha63x_wire_get32(p) | ((uint64_t)scha63x_wire_get32(p + 4) << 32);
+}
+///@}
+
+
+/*!
+    \brief Encode a packet header
+
+    \param p      output, SCHA63X_WIRE_HEADER_SIZE bytes
+    \param header header to encode
+*/
+static inline void scha63x_wire_put_header(uint8_t *p, const scha63x_packet_header *header)
+{
+    scha63x_wire_put16(p, header->magic);
+    p[2] = header->version;
+    p[3] = header->count;
+    scha63x_wire_put32(p + 4, header->sequence);
+    scha63x_wire_put32(p + 8, header->send_time);
+    p[12] = header->encoding;
+    scha63x_wire_put16(p + 13, header->missed_ticks);
+    p[15] = header->overruns;
+}
+
+/*!
+    \brief Decode a packet header, no validation
+
+    \param p      input, SCHA63X_WIRE_HEADER_SIZE bytes
+    \param header output
+*/
+static inline void scha63x_wire_get_header(const uint8_t *p, scha63x_packet_header *header)
+{
+    header->magic = scha63x_wire_get16(p);
+    header->version = p[2];
+    header->count = p[3];
+    header->sequence = scha63x_wire_get32(p + 4);
+    header->send_time = scha63x_wire_get32(p + 8);
+    header->encoding = p[12];
+    header->missed_ticks = scha63x_wire_get16(p + 13);
+    header->overruns = p[15];
+}
+
+/*!
+    \brief Encode one sample
+
+    \param p      output, SCHA63X_WIRE_SAMPLE_SIZE bytes
+    \param sample sample to encode
+*/
+static inline void scha63x_wire_put_sample(uint8_t *p, const scha63x_raw_data *sample)
+{
+    scha63x_wire_put64(p, (uint64_t)sample->timeStamp);
+    scha63x_wire_put16(p + 8, (uint16_t)sample->acc_x_lsb);
+    scha63x_wire_put16(p + 10, (uint16_t)sample->acc_y_lsb);
+    scha63x_wire_put16(p + 12, (uint16_t)sample->acc_z_lsb);
+    scha63x_wire_put16(p + 14, (uint16_t)sample->gyro_x_lsb);
+    scha63x_wire_put16(p + 16, (uint16_t)sample->gyro_y_lsb);
+    scha63x_wire_put16(p + 18, (uint16_t)sample->gyro_z_lsb);
+    scha63x_wire_put16(p + 20, (uint16_t)sample->temp_due_lsb);
+    scha63x_wire_put16(p + 22, (uint16_t)sample->temp_uno_lsb);
+    p[24] = (sample->rs_error_due ? SCHA63X_WIRE_FLAG_RS_ERROR_DUE : 0) |
+            (sample->rs_error_uno ? SCHA63X_WIRE_FLAG_RS_ERROR_UNO : 0) |
+            (sample->cam_trigger ? SCHA63X_WIRE_FLAG_CAM_TRIGGER : 0) |
+            (sample->ubx_trigger ? SCHA63X_WIRE_FLAG_UBX_TRIGGER : 0);
+    p[25] = sample->crc_errors;
+}
+
+/*!
+    \brief Decode one sample
+
+    \param p      input, SCHA63X_WIRE_SAMPLE_SIZE bytes
+    \param sample output
+*/
+static inline void scha63x_wire_get_sample(const uint8_t *p, scha63x_raw_data *sample)
+{
+    sample->timeStamp = (int64_t)scha63x_wire_get64(p);
+    sample->acc_x_lsb = (int16_t)scha63x_wire_get16(p + 8);
+    sample->acc_y_lsb = (int16_t)scha63x_wire_get16(p + 10);
+    sample->acc_z_lsb = (int16_t)scha63x_wire_get16(p + 12);
+    sample->gyro_x_lsb = (int16_t)scha63x_wire_get16(p + 14);
+    sample->gyro_y_lsb = (int16_t)scha63x_wire_get16(p + 16);
+    sample->gyro_z_lsb = (int16_t)scha63x_wire_get16(p + 18);
+    sample->temp_due_lsb = (int16_t)scha63x_wire_get16(p + 20);
+    sample->temp_uno_lsb = (int16_t)scha63x_wire_get16(p + 22);
+    sample->rs_error_due = (p[24] & SCHA63X_WIRE_FLAG_RS_ERROR_DUE) != 0;
+    sample->rs_error_uno = (p[24] & SCHA63X_WIRE_FLAG_RS_ERROR_UNO) != 0;
+    sample->cam_trigger = (p[24] & SCHA63X_WIRE_FLAG_CAM_TRIGGER) != 0;
+    sample->ubx_trigger = (p[24] & SCHA63X_WIRE_FLAG_UBX_TRIGGER) != 0;
+    sample->crc_errors = p[25];
+}
+
+/*!
+    \brief Encode a sample batch into a datagram, raw encoding
+
+    \param p       output, SCHA63X_WIRE_PACKET_SIZE(header->count) bytes
+    \param header  header, count gives the number of samples
+    \param samples samples to encode
+    \return datagram size in bytes
+*/
+static inline size_t scha63x_wire_put_packet(uint8_t *p, const scha63x_packet_header *header,
+                                             const scha63x_raw_data *samples)
+{
+    scha63x_packet_header raw = *header;
+    raw.encoding = SCHA63X_WIRE_ENCODING_RAW;
+    scha63x_wire_put_header(p, &raw);
+    for (int i = 0; i < header->count; i++)
+        scha63x_wire_put_sample(p + SCHA63X_WIRE_PACKET_SIZE(i), &samples[i]);
+    return SCHA63X_WIRE_PACKET_SIZE(header->count);
+}
+
+/*!
+    \brief Zigzag mapping, small magnitudes of either sign to small codes
+*/
+static inline uint32_t scha63x_wire_zigzag(int32_t v)
+{
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t scha63x_wire_unzigzag(uint32_t z)
+{
+    return (int32_t)(z >> 1) ^ -(int32_t)(z & 1);
+}
+
+/*! \brief Number of significant bits */
+static inline uint8_t scha63x_wire_bit_width(uint32_t v)
+{
+    uint8_t n = 0;
+    while (v)
+    {
+        n++;
+        v >>= 1;
+    }
+    return n;
+}
+
+/*! \brief int16 channel c of a sample, acc x first */
+static inline int16_t scha63x_wire_channel(const scha63x_raw_data *s, int c)
+{
+    switch (c)
+    {
+    case 0: return s->acc_x_lsb;
+    case 1: return s->acc_y_lsb;
+    case 2: return s->acc_z_lsb;
+    case 3: return s->gyro_x_lsb;
+    case 4: return s->gyro_y_lsb;
+    case 5: return s->gyro_z_lsb;
+    case 6: return s->temp_due_lsb;
+    default: return s->temp_uno_lsb;
+    }
+}
+
+static inline void scha63x_wire_set_channel(scha63x_raw_data *s, int c, int16_t v)
+{
+    switch (c)
+    {
+    case 0: s->acc_x_lsb = v; break;
+    case 1: s->acc_y_lsb = v; break;
+    case 2: s->acc_z_lsb = v; break;
+    case 3: s->gyro_x_lsb = v; break;
+    case 4: s->gyro_y_lsb = v; break;
+    case 5: s->gyro_z_lsb = v; break;
+    case 6: s->temp_due_lsb = v; break;
+    default: s->temp_uno_lsb = v; break;
+    }
+}
+
+/*! \brief Zigzag code of the wrapping int16 difference of channel c */
+static inline uint32_t scha63x_wire_channel_delta(const scha63x_raw_data *s, const scha63x_raw_data *prev, int c)
+{
+    int16_t d = (int16_t)(uint16_t)(scha63x_wire_channel(s, c) - scha63x_wire_channel(prev, c));
+    return scha63x_wire_zigzag(d) & 0xFFFF;
+}
+
+/*! \brief Sample flags as one SCHA63X_WIRE_FLAG_* nibble */
+static inline uint8_t scha63x_wire_flags(const scha63x_raw_data *s)
+{
+    return (s->rs_error_due ? SCHA63X_WIRE_FLAG_RS_ERROR_DUE : 0) |
+           (s->rs_error_uno ? SCHA63X_WIRE_FLAG_RS_ERROR_UNO : 0) |
+           (s->cam_trigger ? SCHA63X_WIRE_FLAG_CAM_TRIGGER : 0) |
+           (s->ubx_trigger ? SCHA63X_WIRE_FLAG_UBX_TRIGGER : 0);
+}
+
+/*! \brief Sample flags from a SCHA63X_WIRE_FLAG_* nibble, no CRC errors */
+static inline void scha63x_wire_set_flags(scha63x_raw_data *s, uint8_t flags)
+{
+    s->rs_error_due = (flags & SCHA63X_WIRE_FLAG_RS_ERROR_DUE) != 0;
+    s->rs_error_uno = (flags & SCHA63X_WIRE_FLAG_RS_ERROR_UNO) != 0;
+    s->cam_trigger = (flags & SCHA63X_WIRE_FLAG_CAM_TRIGGER) != 0;
+    s->ubx_trigger = (flags & SCHA63X_WIRE_FLAG_UBX_TRIGGER) != 0;
+    s->crc_errors = 0;
+}
+
+/*!
+    \brief Append width bits of v at bit position *bit, LSB first
+
+    \return false if the bits do not fit into capacity bytes
+*/
+static inline bool scha63x_wire_put_bits(uint8_t *p, size_t capacity, size_t *bit, uint32_t v, int width)
+{
+    while (width > 0)
+    {
+        const size_t byte = *bit >> 3;
+        const int shift = *bit & 7;
+        if (byte >= capacity)
+            return false;
+        if (shift == 0)
+            p[byte] = 0;
+
+        int n = 8 - shift;
+        if (n > width)
+            n = width;
+        p[byte] |= (uint8_t)((v & ((1u << n) - 1)) << shift);
+        v >>= n;
+        width -= n;
+        *bit += n;
+    }
+    return true;
+}
+
+/*! \brief Read width bits at bit position *bit, LSB first, no bounds check */
+static inline uint32_t scha63x_wire_get_bits(const uint8_t *p, size_t *bit, int width)
+{
+    uint32_t v = 0;
+    int done = 0;
+    while (done < width)
+    {
+        const int shift = *bit & 7;
+        int n = 8 - shift;
+        if (n > width - done)
+            n = width - done;
+        v |= (uint32_t)((p[*bit >> 3] >> shift) & ((1u << n) - 1)) << done;
+        done += n;
+        *bit += n;
+    }
+    return v;
+}
+
+/*!
+    \brief Encode a sample batch with the delta encoding
+
+    Returns 0 when the batch does not fit into capacity, timestamps
+    jump by more than an int32 or a sample after the first has CRC
+    errors, the caller sends it raw then
+
+    \param p        output
+    \param capacity bytes available at p
+    \param header   header, count gives the number of samples
+    \param samples  samples to encode
+    \return datagram size in bytes, 0 if the batch can not be encoded
+*/
+static inline size_t scha63x_wire_put_delta_packet(uint8_t *p, size_t capacity, const scha63x_packet_header *header,
+                                                   const scha63x_raw_data *samples)
+{
+    const int count = header->count;
+    const size_t start = SCHA63X_WIRE_PACKET_SIZE(1) + SCHA63X_WIRE_DELTA_INFO_SIZE;
+    scha63x_packet_header delta = *header;
+    delta.encoding = SCHA63X_WIRE_ENCODING_DELTA;
+
+    if (capacity < (size_t)SCHA63X_WIRE_PACKET_SIZE(count < 1 ? count : 1) || (count > 1 && capacity < start))
+        return 0;
+    scha63x_wire_put_header(p, &delta);
+    if (count == 0)
+        return SCHA63X_WIRE_HEADER_SIZE;
+    scha63x_wire_put_sample(p + SCHA63X_WIRE_HEADER_SIZE, &samples[0]);
+    if (count == 1)
+        return SCHA63X_WIRE_PACKET_SIZE(1);
+
+    // widths from the largest code per column, timestamp differences wrap like the decoder's sums
+    const int64_t step = (int64_t)((uint64_t)samples[1].timeStamp - (uint64_t)samples[0].timeStamp);
+    if (step != (int32_t)step)
+        return 0;
+
+    uint32_t ts_codes = 0;
+    uint32_t codes[SCHA63X_WIRE_DELTA_CHANNELS] = {0};
+    for (int i = 1; i < count; i++)
+    {
+        if (samples[i].crc_errors)
+            return 0;
+        const int64_t residual = (int64_t)((uint64_t)samples[i].timeStamp - (uint64_t)samples[i - 1].timeStamp -
+                                           (uint64_t)step);
+        if (residual != (int32_t)residual)
+            return 0;
+        ts_codes |= scha63x_wire_zigzag((int32_t)residual);
+        for (int c = 0; c < SCHA63X_WIRE_DELTA_CHANNELS; c++)
+            codes[c] |= scha63x_wire_channel_delta(&samples[i], &samples[i - 1], c);
+    }
+
+    uint8_t *info = p + SCHA63X_WIRE_PACKET_SIZE(1);
+    scha63x_wire_put32(info, (uint32_t)(int32_t)step);
+    const uint8_t ts_width = scha63x_wire_bit_width(ts_codes);
+    info[4] = ts_width;
+    for (int c = 0; c < SCHA63X_WIRE_DELTA_CHANNELS; c++)
+        info[5 + c] = scha63x_wire_bit_width(codes[c]);
+
+    // columns
+    uint8_t *bits = p + start;
+    const size_t room = capacity - start;
+    size_t bit = 0;
+    bool fits = true;
+
+    for (int i = 1; i < count; i++)
+    {
+        const int32_t residual = (int32_t)((uint64_t)samples[i].timeStamp - (uint64_t)samples[i - 1].timeStamp -
+                                           (uint64_t)step);
+        fits = fits && scha63x_wire_put_bits(bits, room, &bit, scha63x_wire_zigzag(residual), ts_width);
+    }
+    for (int c = 0; c < SCHA63X_WIRE_DELTA_CHANNELS; c++)
+    {
+        for (int i = 1; i < count; i++)
+            fits = fits && scha63x_wire_put_bits(bits, room, &bit,
+                                                 scha63x_wire_channel_delta(&samples[i], &samples[i - 1], c), info[5 + c]);
+    }
+    for (int i = 1; i < count; i++)
+        fits = fits && scha63x_wire_put_bits(bits, room, &bit, scha63x_wire_flags(&samples[i]), 4);
+
+    return fits ? start + (bit + 7) / 8 : 0;
+}
+
+/*!
+    \brief Size of a delta encoded datagram from its widths
+
+    \param p     datagram
+    \param bytes datagram length
+    \param count samples in the datagram
+    \return expected datagram size, 0 if widths are missing or invalid
+*/
+static inline size_t scha63x_wire_delta_size(const uint8_t *p, size_t bytes, int count)
+{
+    if (count < 2)
+        return SCHA63X_WIRE_PACKET_SIZE(count);
+
+    const size_t start = SCHA63X_WIRE_PACKET_SIZE(1) + SCHA63X_WIRE_DELTA_INFO_SIZE;
+    if (bytes < start)
+        return 0;
+
+    const uint8_t *info = p + SCHA63X_WIRE_PACKET_SIZE(1);
+    if (info[4] > 32)
+        return 0;
+    size_t width = info[4] + 4;
+    for (int c = 0; c < SCHA63X_WIRE_DELTA_CHANNELS; c++)
+    {
+        if (info[5 + c] > 16)
+            return 0;
+        width += info[5 + c];
+    }
+    return start + ((count - 1) * width + 7) / 8;
+}
+
+/*!
+    \brief Decode the samples of a delta encoded datagram
+
+    Reference decoder, the datagram must have passed scha63x_wire_check
+
+    \param p     datagram
+    \param count samples in the datagram
+    \param out   destination for count samples
+*/
+static inline void scha63x_wire_get_delta_samples(const uint8_t *p, int count, scha63x_raw_data *out)
+{
+    if (count < 1)
+        return;
+    scha63x_wire_get_sample(p + SCHA63X_WIRE_HEADER_SIZE, &out[0]);
+    if (count < 2)
+        return;
+
+    const uint8_t *info = p + SCHA63X_WIRE_PACKET_SIZE(1);
+    const uint8_t *bits = info + SCHA63X_WIRE_DELTA_INFO_SIZE;
+    const int32_t step = (int32_t)scha63x_wire_get32(info);
+    size_t bit = 0;
+
+    for (int i = 1; i < count; i++)
+    {
+        const int64_t d = (int64_t)step + scha63x_wire_unzigzag(scha63x_wire_get_bits(bits, &bit, info[4]));
+        out[i].timeStamp = (int64_t)((uint64_t)out[i - 1].timeStamp + (uint64_t)d);
+    }
+    for (int c = 0; c < SCHA63X_WIRE_DELTA_CHANNELS; c++)
+    {
+        for (int i = 1; i < count; i++)
+        {
+            const int32_t d = scha63x_wire_unzigzag(scha63x_wire_get_bits(bits, &bit, info[5 + c]));
+            scha63x_wire_set_channel(&out[i], c,
+                                     (int16_t)(uint16_t)(scha63x_wire_channel(&out[i - 1], c) + d));
+        }
+    }
+    for (int i = 1; i < count; i++)
+        scha63x_wire_set_flags(&out[i], (uint8_t)scha63x_wire_get_bits(bits, &bit, 4));
+}
+
+/*!
+    \brief Validate a received datagram and decode its header
+
+    \param p      datagram
+    \param bytes  datagram length
+    \param header output, valid if the datagram is a sample batch
+    \return number of samples in the datagram, -1 if it is no sample
+            batch of this version or shorter than its encoding needs
+*/
+static inline int scha63x_wire_check(const uint8_t *p, size_t bytes, scha63x_packet_header *header)
+{
+    if (bytes < SCHA63X_WIRE_HEADER_SIZE)
+        return -1;
+
+    scha63x_wire_get_header(p, header);
+    if (header->magic != SCHA63X_PACKET_MAGIC || header->version != SCHA63X_PACKET_VERSION)
+        return -1;
+
+    size_t size;
+    if (header->encoding == SCHA63X_WIRE_ENCODING_RAW)
+        size = SCHA63X_WIRE_PACKET_SIZE(header->count);
+    else if (header->encoding == SCHA63X_WIRE_ENCODING_DELTA)
+        size = scha63x_wire_delta_size(p, bytes, header->count);
+    else
+        return -1;
+
+    if (size == 0 || bytes < size)
+        return -1;
+
+    return header->count;
+}
+
+/*!
+    \brief Decode the samples of a checked datagram in either encoding
+
+    \param p      datagram
+    \param header header from scha63x_wire_check
+    \param out    destination for header->count samples
+*/
+static inline void scha63x_wire_get_packet(const uint8_t *p, const scha63x_packet_header *header,
+                                           scha63x_raw_data *out)
+{
+    if (header->encoding == SCHA63X_WIRE_ENCODING_DELTA)
+    {
+        scha63x_wire_get_delta_samples(p, header->count, out);
+        return;
+    }
+    for (int i = 0; i < header->count; i++)
+        scha63x_wire_get_sample(p + SCHA63X_WIRE_PACKET_SIZE(i), &out[i]);
+}
+
+/*!
+    \brief Encode a filter command or its answer
+
+    \param p       output, SCHA63X_WIRE_FILTER_SIZE bytes
+    \param command command
+    \return datagram size
+*/
+static inline size_t scha63x_wire_put_filter(uint8_t *p, const scha63x_filter_command *command)
+{
+    scha63x_wire_put16(p, SCHA63X_FILTER_MAGIC);
+    p[2] = SCHA63X_PACKET_VERSION;
+    p[3] = (uint8_t)command->status;
+    scha63x_wire_put16(p + 4, command->sequence);
+    scha63x_wire_put16(p + 6, command->settle_ms);
+    for (int i = 0; i < SCHA63X_WIRE_FILTER_CODES; i++)
+        p[8 + i] = command->filter[i];
+    return SCHA63X_WIRE_FILTER_SIZE;
+}
+
+/*!
+    \brief Decode a filter command or its answer
+
+    \param p       datagram
+    \param bytes   datagram length
+    \param command output
+    \return false if the datagram is no filter command of this version
+*/
+static inline bool scha63x_wire_get_filter(const uint8_t *p, size_t bytes, scha63x_filter_command *command)
+{
+    if (bytes < SCHA63X_WIRE_FILTER_SIZE || scha63x_wire_get16(p) != SCHA63X_FILTER_MAGIC ||
+        p[2] != SCHA63X_PACKET_VERSION)
+        return false;
+
+    command->status = (int8_t)p[3];
+    command->sequence = scha63x_wire_get16(p + 4);
+    command->settle_ms = scha63x_wire_get16(p + 6);
+    for (int i = 0; i < SCHA63X_WIRE_FILTER_CODES; i++)
+        command->filter[i] = p[8 + i];
+    return true;
+}
+
+#endif
@@ -46,8 +46,18 @@
 */
 
 #define IMU_SAMPLING_RATE 500 // sampling rate, n.b limitations with transfer speed
-#define BUFFER_SIZE 2 // IMU buffer size, n.b limitations with transfer speed
-#define STRUCT_SIZE 26  // 64 + 8 * 16 + 4 * 4
+#define BUFFER_SIZE 2 // IMU buffer size, n.b limitations with transfer speed, at most SCHA63X_WIRE_MAX_SAMPLES
+
+///@}
+
+///@{
+/*!
+    \brief Streaming, check scha63x_stream.c
+*/
+
+#define RING_SLOTS 64 // batches between the cores, a power of two, 256 ms at 500 Hz and BUFFER_SIZE 2
+#define STREAM_MAX_SAMPLES 28 // most samples per datagram when core 1 catches up, at most SCHA63X_WIRE_MAX_SAMPLES
+#define WIRE_DELTA_ENCODING 0 // 1: delta encode datagrams that get smaller
 
 ///@}
 
@@ -48,6 +48,8 @@ typedef struct _scha63x_raw_data {
 
     bool cam_trigger;
     bool ubx_trigger;
+
+    uint8_t crc_errors; // channels whose MISO frame failed its CRC, SCHA63X_WIRE_CRC_*
     
 } scha63x_raw_data;
 
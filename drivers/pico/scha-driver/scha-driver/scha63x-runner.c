@@ -1,11 +1,19 @@
 #include "scha63x-runner.h"
 
+#include "config.h"
 #include "scha63x_spi.h"
 #include "scha63x_driver.h"
+#include "scha63x_stream.h"
 
 #include "pico/stdlib.h"
 #include "pico/binary_info.h"
 
+/*!
+    \brief Initialize the sensor and start streaming
+
+    Returns once sampling runs on core 0 and sending on core 1,
+    check scha63x_stream.h
+*/
 void scha63x_runner(void)
 {
     printf("bruh\n");
@@ -33,19 +41,9 @@ void scha63x_runner(void)
     }
 
     printf("serial number: %s\n", serial_num);
-    while(true) {
-        scha63x_raw_data data;
-        scha63x_read_data(&data);
-        printf("gyro: %d,%d,%d\tacc: %d,%d,%d, temp: %d\n",
-            data.gyro_x_lsb,
-            data.gyro_y_lsb,
-            data.gyro_z_lsb,
-            data.acc_x_lsb,
-            data.acc_y_lsb,
-            data.acc_z_lsb,
-            data.temp_due_lsb);
-        sleep_ms(10);
-        break;
-    }
 
+    // stdout carries the datagrams from here on
+    printf("Streaming at %d Hz\n", IMU_SAMPLING_RATE);
+    stdio_flush();
+    scha63x_stream_start();
 }
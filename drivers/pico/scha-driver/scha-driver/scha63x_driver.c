@@ -3,6 +3,8 @@
 #include "scha63x_driver.h"
 #include "scha63x_spi.h"
 #include "scha63x_spi_frame.h"
+#include "scha63x_crc.h"
+#include "scha63x_wire.h"
 
 /*!
     @file scha63x_driver.cpp
@@ -21,6 +23,7 @@
 #define SPI_DATA_INT16(a) ((int16_t)(((a) >> 8) & 0xffff))
 #define SPI_DATA_UINT16(a) ((uint16_t)(((a) >> 8) & 0xffff))
 #define SPI_DATA_CHECK_RS_ERROR(a) ((((a) >> 24) & 0x03) != 1 ? true : false) // true = RS error
+#define SPI_DATA_CRC_ERROR(a, bit) (scha63x_crc8_check(a) ? 0 : (bit)) // bit = CRC error
 #define GET_TEMPERATURE(a) (25 + ((a) / 30.0))
 ///@}
 
@@ -172,6 +175,14 @@ int initialize_sensor(char *serial_num, scha63x_sensor_config *config)
         uint32_t byz_bzx = SPI_ASIC_DUE(0x700000B9);
         uint32_t bzy_bzz = SPI_ASIC_DUE(0x700000B9);
 
+        // Compensation values from corrupted frames would skew every sample
+        if (!scha63x_crc8_check(cxx_cxy) || !scha63x_crc8_check(cxz_cyx) || !scha63x_crc8_check(cyy_cyz) ||
+            !scha63x_crc8_check(czx_czy) || !scha63x_crc8_check(czz_bxx) || !scha63x_crc8_check(bxy_bxz) ||
+            !scha63x_crc8_check(byx_byy) || !scha63x_crc8_check(byz_bzx) || !scha63x_crc8_check(bzy_bzz))
+        {
+            return SCHA63X_ERR_CRC_FAIL;
+        }
+
         scha63x_cac_values.cxx = SPI_DATA_INT8_LOWER(cxx_cxy) / 4096.0 + 1;
         scha63x_cac_values.cxy = SPI_DATA_INT8_UPPER(cxx_cxy) / 4096.0;
         scha63x_cac_values.cxz = SPI_DATA_INT8_LOWER(cxz_cyx) / 4096.0;
@@ -338,6 +349,9 @@ static bool scha63x_check_init_uno(void)
 /*!
     \brief Read acceleration, rate and temperature data from sensor. 
 
+    Channels whose MISO frame fails its CRC are flagged in crc_errors,
+    their values are passed on as read.
+
     \param data pointer to "raw" data from sensor
 */
 void scha63x_read_data(scha63x_raw_data *data)
@@ -357,6 +371,14 @@ void scha63x_read_data(scha63x_raw_data *data)
     // Get possible errors
     data->rs_error_due = scha63x_check_rs_error_3(gyro_y_lsb, gyro_z_lsb, temp_due_lsb);
     data->rs_error_uno = scha63x_check_rs_error_5(gyro_x_lsb, acc_x_lsb, acc_y_lsb, acc_z_lsb, temp_uno_lsb);
+    data->crc_errors = SPI_DATA_CRC_ERROR(acc_x_lsb, SCHA63X_WIRE_CRC_ACC_X) |
+                       SPI_DATA_CRC_ERROR(acc_y_lsb, SCHA63X_WIRE_CRC_ACC_Y) |
+                       SPI_DATA_CRC_ERROR(acc_z_lsb, SCHA63X_WIRE_CRC_ACC_Z) |
+                       SPI_DATA_CRC_ERROR(gyro_x_lsb, SCHA63X_WIRE_CRC_GYRO_X) |
+                       SPI_DATA_CRC_ERROR(gyro_y_lsb, SCHA63X_WIRE_CRC_GYRO_Y) |
+                       SPI_DATA_CRC_ERROR(gyro_z_lsb, SCHA63X_WIRE_CRC_GYRO_Z) |
+                       SPI_DATA_CRC_ERROR(temp_due_lsb, SCHA63X_WIRE_CRC_TEMP_DUE) |
+                       SPI_DATA_CRC_ERROR(temp_uno_lsb, SCHA63X_WIRE_CRC_TEMP_UNO);
 
     // Parse MISO data to structure
     data->acc_x_lsb = SPI_DATA_INT16(acc_x_lsb);
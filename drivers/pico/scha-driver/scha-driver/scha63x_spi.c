@@ -27,7 +27,7 @@ const uint32_t transfer_rate = 1 * 1000 * 1000; // 1 MHz
 #define SPI_PORT spi1
 ///@}
 
-#define ENABLE_SPI_DEBUG
+// ENABLE_SPI_DEBUG prints every frame, set with -DSCHA63X_SPI_DEBUG=ON, streaming is off then
 #ifdef ENABLE_SPI_DEBUG
 #include "scha63x_spi_frame.h"
 #endif
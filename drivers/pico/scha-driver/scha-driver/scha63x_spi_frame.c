@@ -1,4 +1,5 @@
 #include "scha63x_spi_frame.h"
+#include "scha63x_crc.h"
 
 /*!
     @file scha63x_spi_frame.cpp
@@ -118,7 +119,8 @@ uint32_t generate_sys_test_write(uint16_t data) {
     
     Calculated for 24 MSB's of the 32 bit dword (8 LSB's are 
     the CRC field and are not included in CRC calculation). 
-    Documentation 1.5.6
+    Documentation 1.5.6, one table lookup per byte (scha63x_crc.h)
+    instead of CRC8 per bit
 
     \param Data 32-bit dataframe
     \return CRC of a dataframe
@@ -126,21 +128,11 @@ uint32_t generate_sys_test_write(uint16_t data) {
 */ 
 uint8_t CalculateCRC(uint32_t Data)
 {
-    uint8_t BitIndex;
-    uint8_t BitValue;
-    uint8_t CRC;
-    CRC = 0xFF;
-    for (BitIndex = 31; BitIndex > 7; BitIndex--)
-    {
-        BitValue = (uint8_t)((Data >> BitIndex) & 0x01);
-        CRC = CRC8(BitValue, CRC);
-    }
-    CRC = (uint8_t)~CRC;
-    return CRC;
+    return scha63x_crc8(Data);
 }
 
 /*!
-    \brief Checksum calculation for 8 bits
+    \brief Checksum calculation for 1 bit, bitwise reference of scha63x_crc8
 
     Check documentation 1.5.6 for CRC formula
 
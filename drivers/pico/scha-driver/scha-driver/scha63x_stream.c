@@ -0,0 +1,121 @@
+/*!
+    @file scha63x_stream.c
+    @brief Sample stream, sampling on core 0, sending on core 1
+
+    Core 0 only runs the sample interrupt, at the highest priority so
+    the USB interrupts main() set up on core 0 do not delay it. Nothing
+    reachable from the interrupt may print: stdio blocks on its lock,
+    which core 1 holds while sending, and the text would end up between
+    the datagrams on USB. Ticks
+    lie on a fixed grid of the 64 bit microsecond timer, a late
+    interrupt does not shift the following ones. SPI belongs to core
+    0, the ring to both, the network to core 1.
+*/
+
+#include "scha63x_stream.h"
+
+#include "config.h"
+#include "scha63x_driver.h"
+#include "scha63x_ring.h"
+
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "hardware/irq.h"
+#include "hardware/timer.h"
+
+
+static scha63x_raw_data ring_samples[RING_SLOTS * BUFFER_SIZE];
+static scha63x_ring ring;              // batches from core 0 to core 1
+static uint64_t next_tick;             // time_us_64() of the next sample, interrupt only
+static uint32_t period_us;
+
+
+/*!
+    \brief Sample timer interrupt on core 0
+
+    Reads the sensor into the ring and wakes core 1 for a full batch.
+    The FIFO is only written if it has room, core 1 sends everything
+    published when it wakes, a wake-up more or less does not matter.
+    Ticks already past when the alarm is set again are skipped, the
+    ring counts them as missed from the scheduled tick times.
+
+    \param alarm hardware alarm of the sample timer
+*/
+static void sample_callback(uint alarm)
+{
+    const uint32_t now = time_us_32();
+    scha63x_raw_data *sample = scha63x_ring_slot(&ring, (uint32_t)next_tick);
+    scha63x_read_data(sample);
+    sample->timeStamp = now;
+
+    if (scha63x_ring_commit(&ring) && multicore_fifo_wready())
+        multicore_fifo_push_blocking(ring.head);
+
+    do {
+        next_tick += period_us;
+    } while (hardware_alarm_set_target(alarm, from_us_since_boot(next_tick)));
+}
+
+/*!
+    \brief Sender on core 1
+
+    Sleeps in the FIFO until a batch is published, then encodes and
+    sends all published batches, several per datagram up to
+    STREAM_MAX_SAMPLES if it fell behind
+*/
+static void sender_core1(void)
+{
+    static uint8_t packet[SCHA63X_WIRE_PACKET_SIZE(STREAM_MAX_SAMPLES)];
+
+    while (true) {
+        multicore_fifo_pop_blocking();
+
+        size_t bytes;
+        while ((bytes = scha63x_ring_packet(&ring, packet, STREAM_MAX_SAMPLES, time_us_32(), WIRE_DELTA_ENCODING)) > 0)
+            scha63x_stream_send(packet, bytes);
+    }
+}
+
+/*!
+    \brief Start sampling on core 0 and sending on core 1
+
+    Call on core 0 after initialize_sensor, returns right away
+*/
+void scha63x_stream_start(void)
+{
+#ifdef ENABLE_SPI_DEBUG
+    // every read would print its frames from the sample interrupt
+    printf("SPI debug build, not streaming\n");
+    return;
+#endif
+
+    period_us = 1000000 / IMU_SAMPLING_RATE;
+    scha63x_ring_init(&ring, ring_samples, BUFFER_SIZE, RING_SLOTS, period_us);
+    multicore_launch_core1(sender_core1);
+
+    const uint alarm = (uint)hardware_alarm_claim_unused(true);
+    hardware_alarm_set_callback(alarm, sample_callback);
+    irq_set_priority(TIMER_IRQ_0 + alarm, PICO_HIGHEST_IRQ_PRIORITY);
+
+    next_tick = time_us_64() + period_us;
+    while (hardware_alarm_set_target(alarm, from_us_since_boot(next_tick)))
+        next_tick += period_us;
+}
+
+/*!
+    \brief Send a datagram, core 1
+
+    Ethernet is not part of this driver, its UDP send replaces this
+    function. Until then datagrams go out over USB stdio, each behind
+    its size as 16 bit little endian.
+
+    \param packet datagram in the wire format of scha63x_wire.h
+    \param size   datagram size
+*/
+__attribute__((weak)) void scha63x_stream_send(const uint8_t *packet, size_t size)
+{
+    putchar_raw((int)(size & 0xff));
+    putchar_raw((int)(size >> 8));
+    for (size_t i = 0; i < size; i++)
+        putchar_raw(packet[i]);
+}
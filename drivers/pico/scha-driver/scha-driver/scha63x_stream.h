@@ -0,0 +1,31 @@
+#ifndef SCHA63X_STREAM_H
+#define SCHA63X_STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*!
+    @file scha63x_stream.h
+    @brief Sample stream, sampling on core 0, sending on core 1
+
+    A hardware alarm interrupt on core 0 reads the sensor at
+    IMU_SAMPLING_RATE into the batches of scha63x_ring.h and wakes core
+    1 through the multicore FIFO for every full batch. Core 1 encodes
+    the batches in the wire format of scha63x_wire.h and hands the
+    datagrams to scha63x_stream_send. Nothing core 1 does delays the
+    sample interrupt, a slow send fills the ring and drops batches,
+    counted in the packet headers.
+*/
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+void scha63x_stream_start(void);
+void scha63x_stream_send(const uint8_t *packet, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
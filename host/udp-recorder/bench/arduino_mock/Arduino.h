@@ -0,0 +1,69 @@
+#ifndef ARDUINO_MOCK_ARDUINO_H
+#define ARDUINO_MOCK_ARDUINO_H
+
+/*!
+    @file Arduino.h
+    @brief Host stand-in of the Arduino core for the firmware's SPI layer
+
+    Just what drivers/arduino/scha63x needs to compile on the host. Pin
+    writes, delays and port writes go to the mocked SPI bus of
+    arduino_mock.h, which keeps the time they take on the target.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT  0x0
+#define OUTPUT 0x1
+
+#define MSBFIRST 1
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+void delayMicroseconds(unsigned int us);
+unsigned long micros(void);
+
+
+/*!
+    \brief Output register of a port, one pin per port
+
+    Writes through it cost a port write instead of a digitalWrite,
+    only bit 0 is wired to the pin.
+*/
+class MockPortRegister
+{
+public:
+    explicit MockPortRegister(uint8_t pin) : pin_(pin) {}
+
+    MockPortRegister &operator|=(int mask);
+    MockPortRegister &operator&=(int mask);
+
+private:
+    uint8_t pin_;
+};
+
+MockPortRegister *portOutputRegister(uint8_t port);
+#define digitalPinToPort(pin) ((uint8_t)(pin))
+#define digitalPinToBitMask(pin) ((uint8_t)1)
+
+
+/*!
+    \brief Serial monitor, output dropped
+*/
+class MockSerial
+{
+public:
+    template <typename T> size_t print(T, int = 0) { return 0; }
+    template <typename T> size_t println(T, int = 0) { return 0; }
+    size_t println(void) { return 0; }
+};
+
+extern MockSerial Serial;
+
+#endif
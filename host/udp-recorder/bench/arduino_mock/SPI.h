@@ -0,0 +1,32 @@
+#ifndef ARDUINO_MOCK_SPI_H
+#define ARDUINO_MOCK_SPI_H
+
+/*!
+    @file SPI.h
+    @brief Host stand-in of the Arduino SPI library, see arduino_mock.h
+*/
+
+#include "Arduino.h"
+
+#define SPI_MODE0 0x00
+
+class SPISettings
+{
+public:
+    SPISettings() {}
+    SPISettings(uint32_t, uint8_t, uint8_t) {}
+};
+
+class SPIClass
+{
+public:
+    void begin(void);
+    void usingInterrupt(uint8_t) {}
+    void beginTransaction(SPISettings settings);
+    void endTransaction(void);
+    uint8_t transfer(uint8_t data);
+};
+
+extern SPIClass SPI;
+
+#endif
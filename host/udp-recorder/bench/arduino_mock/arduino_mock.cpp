@@ -0,0 +1,313 @@
+/*!
+    @file arduino_mock.cpp
+    @brief Mocked SPI bus and SCHA63X sensor behind the Arduino stand-ins
+*/
+
+#include <stdarg.h>
+
+#include <SPI.h>
+
+#include "config.h"
+#include "arduino_timers.h"
+#include "scha63x_spi_frame.h"
+#include "arduino_mock.h"
+
+
+/*! \brief Pins of the boards */
+#define mock_pins 70
+
+/*! \brief Protocol violations printed */
+#define mock_errors_printed 10
+
+
+MockSerial Serial;
+SPIClass SPI;
+
+
+/*!
+    \brief One ASIC of the sensor behind its chip select
+*/
+typedef struct _mock_asic {
+
+    uint8_t pin;              // chip select
+    uint16_t value[32];       // register contents
+    uint8_t rs[32];           // return status of a register read
+    bool bad_crc[32];         // answer reads with a wrong CRC
+    bool selected;            // CSB went low
+    int bits;                 // bits of the current frame
+    uint32_t mosi;            // frame received so far
+    uint32_t response;        // frame shifted out, answer to the previous one
+    bool framed;              // a frame ended before
+    double high_at;           // time CSB rose after the last frame
+
+} mock_asic;
+
+static spi_mock_costs costs;
+static spi_mock_counters counters;
+static uint8_t level[mock_pins];
+static bool in_transaction;
+static mock_asic asics[2];
+
+
+/*!
+    \brief Count and print a protocol violation
+*/
+static void violation(const char *format, ...)
+{
+    if (counters.errors++ >= mock_errors_printed)
+        return;
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "spi mock at %.0f ns: ", counters.time_ns);
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+}
+
+/*!
+    \brief Answer of the sensor to a frame, sent in the next one
+
+    Reads return the register with its return status, writes are
+    echoed with status 1 and stored in the register
+*/
+static uint32_t answer(mock_asic &asic, uint32_t frame)
+{
+    uint32_t response;
+    const uint8_t address = (frame >> 26) & 0x1f;
+    if (frame & 0x80000000)
+    {
+        response = (frame & 0xfcffff00) | (1UL << 24);
+        asic.value[address] = (uint16_t)(frame >> 8);
+    }
+    else
+    {
+        response = (frame & 0xfc000000) | ((uint32_t)(asic.rs[address] & 3) << 24) |
+                   ((uint32_t)asic.value[address] << 8);
+        if (asic.bad_crc[address])
+            return response | (uint8_t)~CalculateCRC(response);
+    }
+    return response | CalculateCRC(response);
+}
+
+/*!
+    \brief Drive a pin, the ASICs see CSB edges
+*/
+static void setPin(uint8_t pin, uint8_t val)
+{
+    if (pin >= mock_pins)
+        return;
+    const uint8_t previous = level[pin];
+    level[pin] = val ? HIGH : LOW;
+
+    for (mock_asic &asic : asics)
+    {
+        if (asic.pin != pin || previous == level[pin])
+            continue;
+
+        if (level[pin] == LOW)
+        {
+            if (asic.framed && counters.time_ns - asic.high_at < counters.min_gap_ns)
+                counters.min_gap_ns = counters.time_ns - asic.high_at;
+            asic.selected = true;
+            asic.bits = 0;
+            asic.mosi = 0;
+        }
+        else if (asic.selected)
+        {
+            asic.selected = false;
+            if (asic.bits != 32)
+            {
+                violation("frame of %d bits on pin %d", asic.bits, pin);
+                continue;
+            }
+            if (CalculateCRC(asic.mosi) != (asic.mosi & 0xff))
+                violation("frame %08x with a wrong CRC on pin %d", (unsigned int)asic.mosi, pin);
+            counters.frames++;
+            asic.response = answer(asic, asic.mosi);
+            asic.framed = true;
+            asic.high_at = counters.time_ns;
+        }
+    }
+}
+
+
+/*!
+    \brief Start over with empty counters and registers
+
+    \param target time of the Arduino calls on the board
+*/
+void spiMockReset(const spi_mock_costs &target)
+{
+    costs = target;
+    memset(&counters, 0, sizeof(counters));
+    counters.min_gap_ns = 1e18;
+    memset(level, LOW, sizeof(level));
+    in_transaction = false;
+
+    memset(asics, 0, sizeof(asics));
+    asics[SPI_MOCK_DUE].pin = MURATA_ASIC_DUE_CS;
+    asics[SPI_MOCK_UNO].pin = MURATA_ASIC_UNO_CS;
+    for (mock_asic &asic : asics)
+        memset(asic.rs, 1, sizeof(asic.rs));
+}
+
+/*!
+    \brief Set a register of the sensor
+
+    \param asic    SPI_MOCK_DUE or SPI_MOCK_UNO
+    \param address register address
+    \param value   register contents
+    \param rs      return status of reads, 1 is OK
+*/
+void spiMockSetRegister(int asic, uint8_t address, uint16_t value, uint8_t rs)
+{
+    asics[asic].value[address & 0x1f] = value;
+    asics[asic].rs[address & 0x1f] = rs;
+}
+
+/*!
+    \brief Corrupt the CRC of reads of a register
+
+    \param asic    SPI_MOCK_DUE or SPI_MOCK_UNO
+    \param address register address
+    \param bad     answer with a wrong CRC from now on
+*/
+void spiMockSetBadCrc(int asic, uint8_t address, bool bad)
+{
+    asics[asic].bad_crc[address & 0x1f] = bad;
+}
+
+/*!
+    \return register contents, last write or spiMockSetRegister
+*/
+uint16_t spiMockRegister(int asic, uint8_t address)
+{
+    return asics[asic].value[address & 0x1f];
+}
+
+/*!
+    \return counters since spiMockReset
+*/
+const spi_mock_counters &spiMockCounters(void)
+{
+    return counters;
+}
+
+
+void pinMode(uint8_t, uint8_t)
+{
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+    counters.pin_writes++;
+    counters.time_ns += costs.pin_write_ns;
+    setPin(pin, val);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    counters.time_ns += 1000.0 * us;
+}
+
+unsigned long micros(void)
+{
+    return (unsigned long)(counters.time_ns / 1000);
+}
+
+void Wait_ms(volatile uint32_t ms)
+{
+    counters.time_ns += 1e6 * ms;
+}
+
+
+MockPortRegister &MockPortRegister::operator|=(int mask)
+{
+    counters.port_writes++;
+    counters.time_ns += costs.port_write_ns;
+    if (mask & 1)
+        setPin(pin_, HIGH);
+    return *this;
+}
+
+MockPortRegister &MockPortRegister::operator&=(int mask)
+{
+    counters.port_writes++;
+    counters.time_ns += costs.port_write_ns;
+    if (!(mask & 1))
+        setPin(pin_, LOW);
+    return *this;
+}
+
+MockPortRegister *portOutputRegister(uint8_t port)
+{
+    static MockPortRegister *registers[mock_pins];
+    if (port >= mock_pins)
+        return nullptr;
+    if (!registers[port])
+        registers[port] = new MockPortRegister(port);
+    return registers[port];
+}
+
+
+void SPIClass::begin(void)
+{
+}
+
+void SPIClass::beginTransaction(SPISettings)
+{
+    if (in_transaction)
+        violation("transaction started within a transaction");
+    in_transaction = true;
+    counters.transactions++;
+    counters.time_ns += costs.begin_ns;
+}
+
+void SPIClass::endTransaction(void)
+{
+    if (!in_transaction)
+        violation("transaction ended outside a transaction");
+    in_transaction = false;
+    counters.time_ns += costs.end_ns;
+}
+
+/*!
+    \brief Shift a byte out to and in from the selected ASIC
+*/
+uint8_t SPIClass::transfer(uint8_t data)
+{
+    counters.bytes++;
+    counters.time_ns += costs.byte_ns;
+    if (!in_transaction)
+        violation("transfer outside a transaction");
+    if (level[W5X00_ETHERNET_CS_PIN] == LOW || level[W5X00_SD_CS_PIN] == LOW)
+        violation("transfer with the Ethernet shield selected");
+
+    mock_asic *selected = nullptr;
+    for (mock_asic &asic : asics)
+    {
+        if (!asic.selected)
+            continue;
+        if (selected)
+        {
+            violation("transfer with both ASICs selected");
+            return 0xff;
+        }
+        selected = &asic;
+    }
+    if (!selected)
+    {
+        violation("transfer without a chip selected");
+        return 0xff;
+    }
+    if (selected->bits >= 32)
+    {
+        violation("frame longer than 32 bits on pin %d", selected->pin);
+        return 0xff;
+    }
+
+    const uint8_t out = (uint8_t)(selected->response >> (24 - selected->bits));
+    selected->mosi = (selected->mosi << 8) | data;
+    selected->bits += 8;
+    return out;
+}
@@ -0,0 +1,68 @@
+#ifndef ARDUINO_MOCK_H
+#define ARDUINO_MOCK_H
+
+/*!
+    @file arduino_mock.h
+    @brief Mocked SPI bus and SCHA63X sensor behind the Arduino stand-ins
+
+    The firmware's scha63x_spi.cpp and scha63x_driver.cpp run unchanged
+    against Arduino.h and SPI.h of this directory. Every call into the
+    core costs the time it takes on the target, so the time of a
+    sensor read adds up like on the board. Behind the chip selects sit
+    the two ASICs of the sensor: they take a 32 bit frame on the
+    rising CSB edge and answer it in the next frame, as in the data
+    sheet, reads of chosen registers with a wrong CRC. Writes change
+    the register, spiMockRegister reads it back. The bus counts transactions, frames and bytes and reports
+    protocol violations: transfers outside a transaction or with no or
+    several chips selected, frames that are not 32 bits, frames with a
+    wrong CRC.
+*/
+
+#include <stdint.h>
+
+
+///@{
+/*! \brief ASICs of the mocked sensor */
+#define SPI_MOCK_DUE 0
+#define SPI_MOCK_UNO 1
+///@}
+
+
+/*!
+    \brief Time the Arduino calls take on the target, ns
+*/
+typedef struct _spi_mock_costs {
+
+    const char *name;         // target board
+    double begin_ns;          // SPI.beginTransaction
+    double end_ns;            // SPI.endTransaction
+    double byte_ns;           // SPI.transfer of one byte, SCK and library
+    double pin_write_ns;      // digitalWrite
+    double port_write_ns;     // write to a port output register
+
+} spi_mock_costs;
+
+/*!
+    \brief What the bus saw since spiMockReset
+*/
+typedef struct _spi_mock_counters {
+
+    uint64_t transactions;    // SPI.beginTransaction
+    uint64_t frames;          // sensor frames, CSB low to high
+    uint64_t bytes;           // SPI.transfer
+    uint64_t pin_writes;      // digitalWrite
+    uint64_t port_writes;     // port register writes
+    uint64_t errors;          // protocol violations, printed to stderr
+    double time_ns;           // time on the target
+    double min_gap_ns;        // shortest CSB high time between two frames of one ASIC
+
+} spi_mock_counters;
+
+
+void spiMockReset(const spi_mock_costs &costs);
+void spiMockSetRegister(int asic, uint8_t address, uint16_t value, uint8_t rs);
+void spiMockSetBadCrc(int asic, uint8_t address, bool bad);
+uint16_t spiMockRegister(int asic, uint8_t address);
+const spi_mock_counters &spiMockCounters(void);
+
+#endif
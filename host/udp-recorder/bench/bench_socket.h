@@ -0,0 +1,46 @@
+#ifndef BENCH_SOCKET_H
+#define BENCH_SOCKET_H
+
+/*!
+    @file bench_socket.h
+    @brief Loopback receive socket of the benchmarks
+
+    The recorder side of the loopback benchmarks, boards or sender
+    threads send to the bound address.
+*/
+
+#include <stdexcept>
+
+#include <string.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+
+/*!
+    \brief Bind a receive socket to an ephemeral loopback port
+
+    \param addr filled with the bound address
+    \return socket descriptor
+    \exception socket can not be bound, throws std::runtime_error
+*/
+static inline int bindLoopback(sockaddr_in &addr)
+{
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0)
+        throw std::runtime_error("Can not create socket");
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = 0;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(sock, (sockaddr *)&addr, sizeof(addr)) < 0)
+        throw std::runtime_error("Can not bind");
+
+    socklen_t len = sizeof(addr);
+    getsockname(sock, (sockaddr *)&addr, &len);
+    return sock;
+}
+
+#endif
@@ -0,0 +1,206 @@
+/*!
+    @file calibration_check.cpp
+    @brief Handshake with the calibration cache and old firmware
+
+    Simulated boards (board_simulator.h) on loopback connect twice to
+    one FanInRecorder with a calibration store in a new temporary
+    directory, the second time with their CAC terms cached, and stream
+    a few batches after each handshake. The Arduino firmware sends no
+    timestamp and streams right away, older firmware sends one, and
+    firmware that ignores cac_cached sends CAC TERMS anyway where the
+    recorder expects the timestamp. The first byte of those packets is
+    the low mantissa byte of cxx, the boards cover all ten values that
+    are ASCII digits and one that is not. Checks that every handshake
+    completes with the board's first timestamp and CAC terms, read
+    again from firmware ignoring the cache and taken from the cache
+    otherwise, and that every sample streamed is written. Exits with 1
+    on failure.
+
+    usage: calibration_check
+*/
+
+#include <chrono>
+#include <iostream>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "defs.h"
+#include "config.h"
+#include "fan_in.h"
+#include "filter_config.h"
+#include "calibration_store.h"
+#include "board_simulator.h"
+#include "bench_socket.h"
+
+
+/*! \brief Longest wait for a board's writer, ms */
+#define writer_timeout_ms 1000
+
+/*! \brief Streaming after each handshake, s */
+#define stream_s 0.02
+
+
+/*!
+    \brief Handshake of a firmware generation
+*/
+typedef struct _firmware {
+
+    const char *name;
+    bool use_cac_cache;   // honours cac_cached
+    bool send_timestamp;  // TIMESTAMP packet before streaming
+
+} firmware;
+
+static const firmware firmwares[] = {
+    {"arduino", true, false},    // murata.ino
+    {"timestamp", true, true},
+    {"ignores", false, true},
+    {"ignores-nots", false, false},
+};
+
+/*!
+    \brief One session as the recorder's writer saw it
+*/
+typedef struct _session_result {
+
+    board_info info;
+    std::shared_ptr<std::atomic<uint64_t>> written;
+
+} session_result;
+
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        printf("usage: %s\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    char directory[] = "/tmp/calibration_check_XXXXXX";
+    if (!mkdtemp(directory))
+    {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+
+    bool ok = true;
+
+    try
+    {
+        sockaddr_in addr;
+        int sock = bindLoopback(addr);
+
+        // handshake results and samples written of every session per serial number
+        std::mutex lock;
+        std::map<std::string, std::vector<session_result>> boards;
+        FanInRecorder::writer_factory factory = [&](const board_info &board) {
+            std::lock_guard<std::mutex> guard(lock);
+            session_result session = {board, std::make_shared<std::atomic<uint64_t>>(0)};
+            boards[board.serial].push_back(session);
+            std::shared_ptr<std::atomic<uint64_t>> written = session.written;
+            return FanInRecorder::sample_writer([written](const scha63x_raw_data *, size_t count) {
+                *written += count;
+            });
+        };
+
+        CalibrationStore store(directory);
+
+        printf("%8s %14s %10s %12s %12s %8s\n", "cxx[0]", "firmware", "connect", "CAC terms", "timestamp",
+               "written");
+        for (int b = 0; b < 11; b++)
+        {
+            // boards stay connected, a recorder per cxx keeps them below max_boards
+            FanInRecorder fanIn(sock, generateConfig(), factory, 1, board_ring_size, 0);
+            fanIn.setCalibrationStore(&store);
+            fanIn.start();
+
+            for (int f = 0; f < (int)(sizeof(firmwares) / sizeof(firmwares[0])); f++)
+            {
+                // cxx just above 1, its low byte '0' to '9', then 0x80
+                simulator_options options = BoardSimulator::defaultOptions();
+                uint32_t bits = 0x3f800000u | (b < 10 ? '0' + b : 0x80);
+                memcpy(&options.cacv.cxx, &bits, sizeof(bits));
+                options.cacv.cxy = 0.001f * (b + 1);
+                char serial[16];
+                snprintf(serial, sizeof(serial), "CAL%02d%c", b, 'A' + f);
+                options.server = addr;
+                options.serial = serial;
+                options.use_cac_cache = firmwares[f].use_cac_cache;
+                options.send_timestamp = firmwares[f].send_timestamp;
+                options.start_timestamp = 1000000 + 1000 * b + 100 * f;
+                options.seconds = stream_s;
+                BoardSimulator board(options);
+
+                // the second handshake from the same socket is a reboot
+                for (int connect = 0; connect < 2; connect++)
+                {
+                    const uint64_t before = board.stats().samples;
+                    const bool connected = board.handshake();
+                    if (connected)
+                        board.stream();
+                    const uint64_t sent = board.stats().samples - before;
+
+                    session_result session;
+                    bool found = false;
+                    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(writer_timeout_ms);
+                    while (connected && !found && std::chrono::steady_clock::now() < deadline)
+                    {
+                        {
+                            std::lock_guard<std::mutex> guard(lock);
+                            auto it = boards.find(serial);
+                            found = it != boards.end() && it->second.size() == (size_t)connect + 1 &&
+                                    *it->second.back().written == sent;
+                            if (found)
+                                session = it->second.back();
+                        }
+                        if (!found)
+                            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                    }
+
+                    // cached only on the second connect of firmware honouring the cache
+                    const board_info &info = session.info;
+                    const bool cached = connect == 1 && firmwares[f].use_cac_cache;
+                    const bool good = connected && found && memcmp(&info.cacv, &options.cacv, sizeof(info.cacv)) == 0 &&
+                                      info.cac_cached == cached && info.first_timestamp == options.start_timestamp;
+                    printf("%8s %14s %10d %12s %12s %8s%s\n", b < 10 ? std::string(1, (char)('0' + b)).c_str() : "0x80",
+                           firmwares[f].name, connect + 1, !found ? "-" : info.cac_cached ? "cached" : "read",
+                           found ? std::to_string(info.first_timestamp).c_str() : "-",
+                           found ? std::to_string(session.written->load()).c_str() : "-", good ? "" : "  FAILED");
+                    ok &= good;
+                }
+            }
+
+            fanIn.stop();
+        }
+        close(sock);
+    }
+    catch (std::runtime_error &e)
+    {
+        std::cerr << e.what() << '\n';
+        ok = false;
+    }
+
+    std::string command = std::string("rm -rf ") + directory;
+    if (system(command.c_str()) != 0)
+        fprintf(stderr, "Can not remove %s\n", directory);
+
+    if (!ok)
+        fprintf(stderr, "Calibration check failed\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,135 @@
+/*!
+    @file clock_sync_check.cpp
+    @brief Accuracy of ClockSync against synthetic drifting boards
+
+    Simulates boards whose micros() runs off the host clock by a
+    constant or temperature driven skew, starts them shortly before
+    the 32 bit wrap and sends a datagram every few milliseconds over a
+    link with random queuing delay, delay spikes and host stalls
+    delaying whole windows. Every datagram's send time is mapped back
+    to host time and compared to the true send time plus the smallest
+    link delay. Reports the mapping error after the fit settled and
+    the error of the offset only mapping used before, exits with 1 if
+    a scenario misses its bounds.
+
+    usage: clock_sync_check [hours] [seed]
+*/
+
+#include <math.h>
+#include <random>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "clock_sync.h"
+#include "telemetry.h"
+
+
+/*! \brief Seconds before the mapping error counts, the fit needs clock_sync_min_windows */
+#define settle_seconds 30
+
+
+/*!
+    \brief One synthetic board and link
+*/
+typedef struct _scenario {
+
+    const char *name;
+    double skew_ppm;       // device clock runs fast by this much
+    double swing_ppm;      // plus a sine of this amplitude
+    double swing_period_s; // over this period
+    double period_ms;      // datagram spacing
+    double spike_rate;     // fraction of datagrams delayed 1-50 ms
+    double stall_every_s;  // host stalls delay every datagram for stall_s, 0 never
+    double stall_s;
+    double max_error_us;   // bound on the largest mapping error after settling
+    double max_skew_ppm;   // bound on the skew error at the end
+
+} scenario;
+
+
+static bool run(const scenario &sc, double hours, uint32_t seed)
+{
+    std::mt19937_64 rng(seed);
+    std::exponential_distribution<double> queuing(1.0 / 150.0);   // us
+    std::uniform_real_distribution<double> unit(0, 1);
+
+    const double base_delay_us = 120;
+    const int64_t host_start = 5000000000000LL;                   // ns
+    const double device_start = 4294967296.0 - 20e6;              // wraps after 20 s, then every 71 min
+
+    ClockSync clock;
+    Histogram error;     // |mapped - true| after settling, ns
+    double worst_naive = 0;
+    double device = device_start;
+    const double dt = sc.period_ms * 1000;                        // us
+    const uint64_t packets = (uint64_t)(hours * 3600e6 / dt);
+    double skew = 0;
+
+    for (uint64_t i = 0; i < packets; i++)
+    {
+        const double t = i * dt;                                  // host us since start
+        skew = 1e-6 * (sc.skew_ppm + sc.swing_ppm * sin(2 * M_PI * t / (1e6 * sc.swing_period_s)));
+        device += dt * (1 + skew);
+
+        double delay = base_delay_us + queuing(rng);
+        if (unit(rng) < sc.spike_rate)
+            delay += 1000 + 49000 * unit(rng);
+        if (sc.stall_every_s > 0 && fmod(t / 1e6, sc.stall_every_s) > sc.stall_every_s - sc.stall_s)
+            delay += 100000;
+
+        const uint32_t send_time = (uint32_t)(uint64_t)device;
+        const int64_t send_host = host_start + (int64_t)llround(1000 * t);
+        clock.add(send_time, send_host + (int64_t)llround(1000 * delay));
+
+        const clock_model model = clock.model();
+        const double err = ClockSync::map(model, send_time) - send_host - 1000 * base_delay_us;
+        if (t > settle_seconds * 1e6)
+            error.add((uint64_t)fabs(err));
+
+        // what the recorder did before: offset at the first datagram, no skew
+        const double naive = (device - device_start) - t;
+        worst_naive = std::max(worst_naive, fabs(naive));
+    }
+
+    const clock_model model = clock.model();
+    const double true_skew = 1 / (1 + skew) - 1;
+    const double skew_error = 1e6 * fabs(model.skew - true_skew);
+    const bool ok = error.max() <= 1000 * sc.max_error_us && skew_error <= sc.max_skew_ppm && model.fitted;
+
+    printf("%-22s error p50/p99/p99.9/max %6.1f/%6.1f/%6.1f/%6.1f us, skew %+8.3f ppm (true %+8.3f), "
+           "fit rms %.1f us, %d outliers | offset only: %.1f ms  %s\n",
+           sc.name, 1e-3 * error.percentile(50), 1e-3 * error.percentile(99), 1e-3 * error.percentile(99.9),
+           1e-3 * error.max(), 1e6 * model.skew, 1e6 * true_skew, clock.fitStats().rms_us,
+           clock.fitStats().outliers, 1e-3 * worst_naive, ok ? "ok" : "FAIL");
+    return ok;
+}
+
+
+int main(int argc, char **argv)
+{
+    const double hours = argc > 1 ? strtod(argv[1], nullptr) : 2;
+    const uint32_t seed = argc > 2 ? strtoul(argv[2], nullptr, 10) : 1;
+
+    // name, skew, swing, period, packet ms, spikes, stall every, stall, max error us, max skew error ppm
+    const scenario scenarios[] = {
+        {"constant +80 ppm", 80, 0, 1, 8, 0.0, 0, 0, 60, 0.2},
+        {"constant -35 ppm", -35, 0, 1, 4, 0.0, 0, 0, 60, 0.2},
+        {"temperature swing", 20, 10, 1800, 8, 0.0, 0, 0, 60, 1.5},
+        {"2 % delay spikes", 50, 0, 1, 8, 0.02, 0, 0, 60, 0.2},
+        {"host stalls", 50, 0, 1, 8, 0.02, 600, 10, 60, 0.2},
+    };
+
+    printf("%.1f h per scenario, datagram send times start 20 s before the micros() wrap\n", hours);
+    bool ok = true;
+    for (const scenario &sc : scenarios)
+        ok &= run(sc, hours, seed);
+
+    if (!ok)
+    {
+        printf("clock sync out of bounds\n");
+        return EXIT_FAILURE;
+    }
+    printf("all scenarios within bounds\n");
+    return EXIT_SUCCESS;
+}
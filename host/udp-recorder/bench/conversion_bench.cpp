@@ -0,0 +1,141 @@
+/*!
+    @file conversion_bench.cpp
+    @brief Per-sample versus batch conversion microbenchmark
+
+    Converts the same synthetic samples with scha63x_convert_data +
+    scha63x_cross_axis_compensation and with scha63x_convert_batch,
+    checks that the results agree within tolerance and reports the
+    time per sample of both paths.
+
+    usage: conversion_bench [samples] [repeats]
+*/
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+#include "conversion.h"
+
+
+/*! \brief allowed difference relative to the magnitude of the value */
+#define relative_tolerance 1e-5f
+
+
+/*!
+    \brief Cross-axis terms close to identity, like real sensors
+*/
+static scha63x_cacv randomCacv(std::mt19937 &rng)
+{
+    std::uniform_real_distribution<float> off(-0.03f, 0.03f);
+    scha63x_cacv k;
+    k.cxx = 1 + off(rng); k.cxy = off(rng);     k.cxz = off(rng);
+    k.cyx = off(rng);     k.cyy = 1 + off(rng); k.cyz = off(rng);
+    k.czx = off(rng);     k.czy = off(rng);     k.czz = 1 + off(rng);
+    k.bxx = 1 + off(rng); k.bxy = off(rng);     k.bxz = off(rng);
+    k.byx = off(rng);     k.byy = 1 + off(rng); k.byz = off(rng);
+    k.bzx = off(rng);     k.bzy = off(rng);     k.bzz = 1 + off(rng);
+    return k;
+}
+
+/*!
+    \brief Largest tolerance-scaled difference of one channel
+*/
+static float channelError(const float *batch, const std::vector<scha63x_real_data> &ref,
+                          size_t offset, size_t count)
+{
+    float worst = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        float expected;
+        memcpy(&expected, (const char *)&ref[i] + offset, sizeof(float));
+        float err = fabsf(batch[i] - expected) / (relative_tolerance * (fabsf(expected) + 1.0f));
+        if (err > worst)
+            worst = err;
+    }
+    return worst;
+}
+
+
+int main(int argc, char **argv)
+{
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 4096;
+    int repeats = argc > 2 ? atoi(argv[2]) : 2000;
+
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> lsb(-32768, 32767);
+
+    std::vector<scha63x_raw_data> raw(count);
+    memset(raw.data(), 0, raw.size() * sizeof(scha63x_raw_data));
+    for (size_t i = 0; i < count; i++)
+    {
+        raw[i].timeStamp = i;
+        raw[i].acc_x_lsb = lsb(rng);
+        raw[i].acc_y_lsb = lsb(rng);
+        raw[i].acc_z_lsb = lsb(rng);
+        raw[i].gyro_x_lsb = lsb(rng);
+        raw[i].gyro_y_lsb = lsb(rng);
+        raw[i].gyro_z_lsb = lsb(rng);
+        raw[i].temp_due_lsb = lsb(rng);
+        raw[i].temp_uno_lsb = lsb(rng);
+    }
+    cacvValues(randomCacv(rng));
+
+    std::vector<scha63x_real_data> single(count);
+    std::vector<float> channels[8];
+    for (auto &channel : channels)
+        channel.resize(count);
+    scha63x_real_batch batch = { channels[0].data(), channels[1].data(), channels[2].data(), channels[3].data(),
+                                 channels[4].data(), channels[5].data(), channels[6].data(), channels[7].data() };
+
+    // per-sample path
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; r++)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            scha63x_convert_data(&raw[i], &single[i]);
+            scha63x_cross_axis_compensation(&single[i]);
+        }
+        asm volatile("" : : "r"(single.data()) : "memory");
+    }
+    double single_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // batch path
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; r++)
+    {
+        scha63x_convert_batch(raw.data(), count, &batch);
+        asm volatile("" : : "r"(batch.acc_x) : "memory");
+    }
+    double batch_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // agreement of the two paths
+    const size_t offsets[8] = {
+        offsetof(scha63x_real_data, acc_x), offsetof(scha63x_real_data, acc_y),
+        offsetof(scha63x_real_data, acc_z), offsetof(scha63x_real_data, gyro_x),
+        offsetof(scha63x_real_data, gyro_y), offsetof(scha63x_real_data, gyro_z),
+        offsetof(scha63x_real_data, temp_due), offsetof(scha63x_real_data, temp_uno)
+    };
+    const char *names[8] = { "acc_x", "acc_y", "acc_z", "gyro_x", "gyro_y", "gyro_z", "temp_due", "temp_uno" };
+    bool ok = true;
+    for (int c = 0; c < 8; c++)
+    {
+        float err = channelError(channels[c].data(), single, offsets[c], count);
+        printf("%-8s max error %.3f x tolerance\n", names[c], err);
+        ok = ok && err <= 1.0f;
+    }
+
+    const double samples = (double)count * repeats;
+    printf("per-sample: %.2f ns/sample\n", 1e9 * single_s / samples);
+    printf("batch (%s): %.2f ns/sample, speedup %.1fx\n",
+           scha63x_convert_batch_isa(), 1e9 * batch_s / samples, single_s / batch_s);
+    printf("%s\n", ok ? "OK: batch matches per-sample path" : "FAIL: batch differs from per-sample path");
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,166 @@
+/*!
+    @file crc_check.cpp
+    @brief Table driven CRC8 of the drivers against the bitwise reference
+
+    Compares scha63x_crc8 (drivers/common/scha63x_crc.h) and the
+    Arduino driver's CalculateCRC built on it with the bitwise CRC8 of
+    the data sheet for all 2^24 frame payloads, checks the CRC byte of
+    the driver's precomputed frames and that scha63x_crc8_check catches
+    every single bit error of a frame. Then times both over random
+    frames, in ns and, on x86, TSC cycles per frame. Exits with 1 on
+    any mismatch.
+
+    usage: crc_check [frames]
+*/
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+/*! \brief TSC cycle counts next to the times */
+#define CRC_CHECK_TSC
+#endif
+
+#include "scha63x_spi_frame.h"
+#include "scha63x_crc.h"
+
+
+/*!
+    \brief CRC of the data sheet, one CRC8 step per bit
+
+    The driver's CalculateCRC before the table
+*/
+static uint8_t crcBitwise(uint32_t frame)
+{
+    uint8_t crc = 0xFF;
+    for (int bit = 31; bit > 7; bit--)
+        crc = CRC8((uint8_t)((frame >> bit) & 1), crc);
+    return (uint8_t)~crc;
+}
+
+/*!
+    \brief Time a CRC function over frames
+
+    \param crc    function to time
+    \param frames input
+    \param ns     output, ns per frame of the fastest of five runs
+    \param cycles output, TSC cycles per frame of that run, 0 without a TSC
+    \return xor of all CRCs, keeps the calls
+*/
+template <typename F>
+static uint8_t timeCrc(F crc, const std::vector<uint32_t> &frames, double &ns, double &cycles)
+{
+    uint8_t sink = 0;
+    ns = 1e18;
+    cycles = 0;
+    for (int run = 0; run < 5; run++)
+    {
+#ifdef CRC_CHECK_TSC
+        const uint64_t tsc = __rdtsc();
+#endif
+        const auto start = std::chrono::steady_clock::now();
+        for (uint32_t frame : frames)
+            sink ^= crc(frame);
+        const double took = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+#ifdef CRC_CHECK_TSC
+        const double tsc_took = (double)(__rdtsc() - tsc);
+#else
+        const double tsc_took = 0;
+#endif
+        if (took / frames.size() < ns)
+        {
+            ns = took / frames.size();
+            cycles = tsc_took / frames.size();
+        }
+    }
+    return sink;
+}
+
+
+int main(int argc, char **argv)
+{
+    const long count = argc > 1 ? atol(argv[1]) : 10000000;
+    if (count <= 0)
+    {
+        printf("usage: %s [frames]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    bool ok = true;
+
+    // every payload, the CRC field does not take part
+    uint64_t mismatches = 0;
+    for (uint32_t payload = 0; payload < (1u << 24); payload++)
+    {
+        const uint32_t frame = payload << 8 | (payload & 0xff);
+        const uint8_t reference = crcBitwise(frame);
+        mismatches += scha63x_crc8(frame) != reference;
+        mismatches += CalculateCRC(frame) != reference;
+        mismatches += !scha63x_crc8_check((frame & 0xffffff00) | reference);
+    }
+    printf("%u payloads, %llu mismatches against the bitwise CRC\n", 1u << 24, (unsigned long long)mismatches);
+    ok &= mismatches == 0;
+
+    // precomputed frames of the driver
+    const uint32_t frames[] = {
+        SPI_FRAME_READ_GYRO_X, SPI_FRAME_READ_GYRO_Y, SPI_FRAME_READ_GYRO_Z, SPI_FRAME_READ_ACC_X,
+        SPI_FRAME_READ_ACC_Y, SPI_FRAME_READ_ACC_Z, SPI_FRAME_READ_TEMP, SPI_FRAME_READ_SUMMARY_STATUS,
+        SPI_FRAME_READ_RATE_STATUS_1, SPI_FRAME_READ_RATE_STATUS_2, SPI_FRAME_READ_COMMON_STATUS_1,
+        SPI_FRAME_READ_COMMON_STATUS_2, SPI_FRAME_READ_ACC_STATUS_1, SPI_FRAME_WRITE_RESET,
+        SPI_FRAME_WRITE_REG_BANK_0, SPI_FRAME_READ_TRC_0, SPI_FRAME_READ_TRC_1, SPI_FRAME_READ_TRC_2,
+        SPI_FRAME_READ_MODE, SPI_FRAME_WRITE_MODE_ASM_010, SPI_FRAME_WRITE_MODE_ASM_001,
+        SPI_FRAME_WRITE_MODE_ASM_100, SPI_FRAME_WRITE_OP_MODE_NORMAL, SPI_FRAME_WRITE_EOI_BIT,
+        SPI_FRAME_WRITE_FILTER_46HZ_RATE, SPI_FRAME_WRITE_FILTER_46HZ_ACC,
+    };
+    for (uint32_t frame : frames)
+    {
+        if (!scha63x_crc8_check(frame))
+        {
+            fprintf(stderr, "frame %08x has CRC %02x, expected %02x\n", (unsigned int)frame, frame & 0xff,
+                    scha63x_crc8(frame));
+            ok = false;
+        }
+    }
+
+    // a CRC8 catches every single bit error of a 32 bit frame
+    std::mt19937 random(1);
+    uint64_t missed = 0;
+    for (int i = 0; i < 100000; i++)
+    {
+        const uint32_t payload = random() & 0xffffff00;
+        const uint32_t frame = payload | scha63x_crc8(payload);
+        for (int bit = 0; bit < 32; bit++)
+            missed += scha63x_crc8_check(frame ^ (1u << bit));
+    }
+    if (missed)
+    {
+        fprintf(stderr, "%llu single bit errors passed the CRC check\n", (unsigned long long)missed);
+        ok = false;
+    }
+
+    // cycle bench
+    std::vector<uint32_t> input(count);
+    for (uint32_t &frame : input)
+        frame = random();
+    double bitwise_ns, bitwise_cycles, table_ns, table_cycles;
+    uint8_t sink = timeCrc(crcBitwise, input, bitwise_ns, bitwise_cycles);
+    sink ^= timeCrc(scha63x_crc8, input, table_ns, table_cycles);
+    printf("bitwise %.2f ns", bitwise_ns);
+#ifdef CRC_CHECK_TSC
+    printf(" (%.1f TSC cycles)", bitwise_cycles);
+#endif
+    printf(", table %.2f ns", table_ns);
+#ifdef CRC_CHECK_TSC
+    printf(" (%.1f TSC cycles)", table_cycles);
+#endif
+    printf(" per frame, %.1fx, %ld frames, %02x\n", bitwise_ns / table_ns, count, sink);
+
+    if (!ok)
+        fprintf(stderr, "CRC check failed\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
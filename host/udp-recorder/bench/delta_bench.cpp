@@ -0,0 +1,217 @@
+/*!
+    @file delta_bench.cpp
+    @brief Raw versus delta encoded datagrams over real or synthetic samples
+
+    Cuts the samples of a binary recording (or a synthetic stationary
+    IMU at the default sample rate) into batches of 2 to
+    SCHA63X_WIRE_MAX_SAMPLES samples, encodes every batch in both
+    encodings and reports bytes per sample, the sample rate the same
+    link carries with delta encoding, encoder time and decoder time of
+    the reference and the server decoder. Every batch must decode back
+    to its samples, exits with 1 otherwise.
+
+    usage: delta_bench [recording.bin]
+*/
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+#include "config.h"
+#include "scha63x_wire.h"
+#include "session_reader.h"
+#include "wire_decode.h"
+
+
+/*!
+    \brief Seconds since a start time
+*/
+static double since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/*!
+    \brief Stationary board with sensor noise of a few LSB, 1 g on z
+*/
+static std::vector<scha63x_raw_data> syntheticSamples(size_t count)
+{
+    std::mt19937 rng(1);
+    std::normal_distribution<double> noise(0.0, 3.0);
+    std::vector<scha63x_raw_data> samples(count);
+
+    const int64_t period = 1000000 / imu_trigger_rate;
+    for (size_t i = 0; i < count; i++)
+    {
+        scha63x_raw_data &s = samples[i];
+        memset(&s, 0, sizeof(s));
+        s.timeStamp = 1000000 + (int64_t)i * period + (int64_t)(rng() % 5) - 2;
+        s.acc_x_lsb = (int16_t)lround(noise(rng));
+        s.acc_y_lsb = (int16_t)lround(noise(rng));
+        s.acc_z_lsb = (int16_t)lround(5886 + noise(rng));
+        s.gyro_x_lsb = (int16_t)lround(noise(rng));
+        s.gyro_y_lsb = (int16_t)lround(noise(rng));
+        s.gyro_z_lsb = (int16_t)lround(noise(rng));
+        s.temp_due_lsb = s.temp_uno_lsb = (int16_t)(-1000 + i / 100000);
+        s.cam_trigger = i % (imu_trigger_rate / 30) == 0;
+    }
+    return samples;
+}
+
+/*! \brief keeps the decode loops from being optimized away */
+static volatile uint64_t checksum = 0;
+
+static bool sameSample(const scha63x_raw_data &a, const scha63x_raw_data &b)
+{
+    return a.timeStamp == b.timeStamp &&
+           a.acc_x_lsb == b.acc_x_lsb && a.acc_y_lsb == b.acc_y_lsb && a.acc_z_lsb == b.acc_z_lsb &&
+           a.gyro_x_lsb == b.gyro_x_lsb && a.gyro_y_lsb == b.gyro_y_lsb && a.gyro_z_lsb == b.gyro_z_lsb &&
+           a.temp_due_lsb == b.temp_due_lsb && a.temp_uno_lsb == b.temp_uno_lsb &&
+           a.rs_error_due == b.rs_error_due && a.rs_error_uno == b.rs_error_uno &&
+           a.cam_trigger == b.cam_trigger && a.ubx_trigger == b.ubx_trigger && a.crc_errors == b.crc_errors;
+}
+
+/*!
+    \brief Encode and decode all samples in batches of one size
+
+    \return false if a batch does not decode back to its samples
+*/
+static bool benchBatch(const std::vector<scha63x_raw_data> &samples, int batch)
+{
+    const size_t batches = samples.size() / batch;
+    const size_t stride = SCHA63X_WIRE_PACKET_SIZE(batch);
+    std::vector<uint8_t> delta(batches * stride);
+    std::vector<size_t> delta_bytes(batches);
+    std::vector<scha63x_raw_data> out(batch);
+
+    scha63x_packet_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SCHA63X_PACKET_MAGIC;
+    header.version = SCHA63X_PACKET_VERSION;
+    header.count = (uint8_t)batch;
+
+    // encoder, falling back to raw like the firmware
+    auto start = std::chrono::steady_clock::now();
+    uint64_t total = 0, fallbacks = 0;
+    for (size_t b = 0; b < batches; b++)
+    {
+        uint8_t *p = &delta[b * stride];
+        size_t bytes = scha63x_wire_put_delta_packet(p, stride, &header, &samples[b * batch]);
+        if (bytes == 0)
+        {
+            bytes = scha63x_wire_put_packet(p, &header, &samples[b * batch]);
+            fallbacks++;
+        }
+        delta_bytes[b] = bytes;
+        total += bytes;
+    }
+    const double encode = since(start);
+
+    start = std::chrono::steady_clock::now();
+    uint64_t sum = 0;
+    bool ok = true;
+    for (size_t b = 0; b < batches; b++)
+    {
+        scha63x_packet_header h;
+        if (scha63x_wire_check(&delta[b * stride], delta_bytes[b], &h) != batch)
+        {
+            ok = false;
+            continue;
+        }
+        scha63x_wire_get_packet(&delta[b * stride], &h, out.data());
+        sum += out[batch - 1].timeStamp;
+    }
+    const double reference = since(start);
+
+    start = std::chrono::steady_clock::now();
+    for (size_t b = 0; b < batches; b++)
+    {
+        scha63x_packet_header h;
+        if (scha63x_wire_check(&delta[b * stride], delta_bytes[b], &h) != batch)
+        {
+            ok = false;
+            continue;
+        }
+        scha63x_decode_samples(&delta[b * stride], &h, 0, batch, out.data());
+        sum += out[batch - 1].timeStamp;
+    }
+    const double fast = since(start);
+    checksum += sum;
+
+    for (size_t b = 0; b < batches && ok; b++)
+    {
+        scha63x_packet_header h;
+        if (scha63x_wire_check(&delta[b * stride], delta_bytes[b], &h) != batch)
+            break;
+        scha63x_decode_samples(&delta[b * stride], &h, 0, batch, out.data());
+        for (int s = 0; s < batch; s++)
+            ok &= sameSample(samples[b * batch + s], out[s]);
+    }
+
+    const double n = 1.0 * batches * batch;
+    const double raw_per_sample = 1.0 * stride / batch;
+    const double delta_per_sample = total / n;
+    printf("%8d %10.1f %10.1f %7.2fx %9lu %10.1f %10.1f %11.1f %s\n",
+           batch, raw_per_sample, delta_per_sample, raw_per_sample / delta_per_sample,
+           (unsigned long)fallbacks, 1e9 * encode / n, 1e9 * reference / n, 1e9 * fast / n,
+           ok ? "" : "MISMATCH");
+    return ok;
+}
+
+
+int main(int argc, char **argv)
+{
+    std::vector<scha63x_raw_data> samples;
+
+    try
+    {
+        if (argc > 1)
+        {
+            BinarySession session(argv[1]);
+            session.query(-INFINITY, INFINITY, [&samples](const scha63x_raw_data *s, size_t count) {
+                samples.insert(samples.end(), s, s + count);
+            });
+            printf("%s: %lu samples\n", argv[1], (unsigned long)samples.size());
+        }
+        else
+        {
+            samples = syntheticSamples(200 * imu_trigger_rate);
+            printf("synthetic stationary board: %lu samples\n", (unsigned long)samples.size());
+        }
+    }
+    catch (std::runtime_error &e)
+    {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    if (samples.size() < SCHA63X_WIRE_MAX_SAMPLES)
+    {
+        std::cerr << "Need at least " << SCHA63X_WIRE_MAX_SAMPLES << " samples\n";
+        return EXIT_FAILURE;
+    }
+
+    printf("server decoder: %s\n", scha63x_decode_isa());
+    printf("   batch  raw B/smp delta B/smp    rate  fallback enc ns/smp ref ns/smp %s ns/smp\n",
+           scha63x_decode_isa());
+
+    bool ok = true;
+    const int batches[] = {2, 4, 8, 16, 32, SCHA63X_WIRE_MAX_SAMPLES};
+    for (int batch : batches)
+        ok &= benchBatch(samples, batch);
+
+    if (!ok)
+    {
+        printf("round trip mismatch\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,399 @@
+/*!
+    @file dual_core_sim.cpp
+    @brief Host build of the Pico's sampling and sending cores
+
+    Runs the ring of drivers/common/scha63x_ring.h the way
+    scha63x_stream.c does, with one thread per core: the sampling
+    thread spins on a fixed tick grid like the hardware alarm, fills
+    the ring and wakes the sending thread through a mocked multicore
+    FIFO of eight words that it never waits for. The sending thread
+    encodes datagrams with scha63x_ring_packet and sends them over a
+    mocked network that takes --send-us per datagram and stalls for
+    --stall-us every --stall-every datagrams.
+
+    Runs twice, without and with the stalls, and reports the sampling
+    jitter against the tick grid, lost ticks, dropped batches and
+    datagram sizes of both. Every datagram is decoded and checked:
+    samples in order and intact, gaps only of whole dropped batches,
+    and the counters of the headers, accounted by StreamTelemetry
+    like on the server, equal to the simulation. Exits with 1 on any
+    mismatch.
+
+    usage: dual_core_sim [--seconds S] [--rate HZ] [--batch N] [--slots N] [--max-samples N]
+                         [--send-us US] [--stall-every N] [--stall-us US] [--delta]
+*/
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+#include "config.h"
+#include "scha63x_wire.h"
+#include "scha63x_ring.h"
+#include "telemetry.h"
+
+
+/*! \brief Words in each direction of the RP2040 inter-core FIFO */
+#define sio_fifo_depth 8
+
+/*! \brief Device time at the start, wraps 1 s in */
+#define sim_micros_start (0xffffffffu - 1000000u)
+
+
+/*!
+    \brief Run settings
+*/
+typedef struct _core_settings {
+
+    double seconds;           // run time per variant
+    int rate;                 // sample timer rate, Hz
+    int batch;                // samples per ring slot, BUFFER_SIZE
+    int slots;                // ring slots, RING_SLOTS
+    int max_samples;          // samples per datagram when catching up, STREAM_MAX_SAMPLES
+    double send_us;           // network time per datagram
+    int stall_every;          // every Nth datagram stalls, 0 never
+    double stall_us;          // added to a stalled datagram
+    bool delta;               // WIRE_DELTA_ENCODING
+
+} core_settings;
+
+/*!
+    \brief Outcome of one run
+*/
+typedef struct _core_result {
+
+    uint64_t ticks;           // ticks of the grid
+    uint64_t sampled;         // samples taken
+    uint64_t skipped;         // ticks passed before the alarm was set again
+    uint64_t sent;            // samples decoded from datagrams
+    uint64_t dropped;         // samples missing between datagrams
+    uint64_t datagrams;       // datagrams sent
+    uint64_t bytes;           // datagram bytes
+    uint64_t full_fifo;       // wake-ups skipped with the FIFO full
+    uint64_t errors;          // samples out of order, torn or misplaced
+    Histogram jitter;         // interrupt time - tick, ns
+    Histogram interrupt;      // time in the sample interrupt, ns
+
+} core_result;
+
+
+/*!
+    \brief RP2040 inter-core FIFO, core 0 to core 1
+
+    One pusher, one popper. A pop waits for a word like
+    multicore_fifo_pop_blocking, a push is only done with room left,
+    like the sample interrupt does after multicore_fifo_wready.
+*/
+class SioFifo
+{
+public:
+    SioFifo() : head_(0), tail_(0) {}
+
+    bool wready(void) const { return head_.load(std::memory_order_relaxed) - tail_.load(std::memory_order_acquire) < sio_fifo_depth; }
+
+    void push(uint32_t word)
+    {
+        const uint32_t head = head_.load(std::memory_order_relaxed);
+        words_[head % sio_fifo_depth] = word;
+        head_.store(head + 1, std::memory_order_release);
+    }
+
+    /*!
+        \return false if stop was set while waiting
+    */
+    bool popBlocking(const std::atomic<bool> &stop)
+    {
+        const uint32_t tail = tail_.load(std::memory_order_relaxed);
+        while (head_.load(std::memory_order_acquire) == tail)
+        {
+            if (stop.load(std::memory_order_relaxed))
+                return false;
+            std::this_thread::yield();
+        }
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    uint32_t words_[sio_fifo_depth];
+    std::atomic<uint32_t> head_;
+    std::atomic<uint32_t> tail_;
+};
+
+
+/*!
+    \brief Print command line usage
+*/
+static void printUsage(const char *program)
+{
+    printf("usage: %s [--seconds S] [--rate HZ] [--batch N] [--slots N] [--max-samples N]\n"
+           "       [--send-us US] [--stall-every N] [--stall-us US] [--delta]\n"
+           "  --seconds S       run time of each variant, default 2\n"
+           "  --rate HZ         sample timer, default 10000\n"
+           "  --batch N         samples per ring slot, default 2\n"
+           "  --slots N         ring slots, a power of two, default 64\n"
+           "  --max-samples N   samples per datagram when catching up, default 28\n"
+           "  --send-us US      network time per datagram, default 20\n"
+           "  --stall-every N   every Nth datagram stalls, default 200\n"
+           "  --stall-us US     length of a stall, default 30000\n"
+           "  --delta           delta encoded datagrams\n",
+           program);
+}
+
+/*!
+    \brief Busy wait like a core does, sleeping is too coarse for the grid
+*/
+static void spinUntil(std::chrono::steady_clock::time_point until)
+{
+    while (std::chrono::steady_clock::now() < until)
+        ;
+}
+
+/*!
+    \brief Sample contents from its number, checked after decoding
+*/
+static void fillSample(scha63x_raw_data *sample, uint64_t index)
+{
+    sample->acc_x_lsb = (int16_t)index;
+    sample->acc_y_lsb = (int16_t)(index >> 16);
+    sample->gyro_x_lsb = (int16_t)~index;
+    sample->gyro_y_lsb = (int16_t)(~index >> 16);
+    sample->cam_trigger = index % 7 == 0;
+}
+
+/*!
+    \return number of a decoded sample, -1 if its contents are torn
+*/
+static int64_t sampleIndex(const scha63x_raw_data &sample)
+{
+    const uint32_t index = (uint16_t)sample.acc_x_lsb | (uint32_t)(uint16_t)sample.acc_y_lsb << 16;
+    const uint32_t check = (uint16_t)sample.gyro_x_lsb | (uint32_t)(uint16_t)sample.gyro_y_lsb << 16;
+    if (check != ~index || sample.cam_trigger != (index % 7 == 0))
+        return -1;
+    return index;
+}
+
+/*!
+    \brief One run, sampling thread and sending thread on one ring
+
+    \param settings  run settings
+    \param stalls    network stalls on
+    \param result    output
+    \param telemetry server side accounting of the datagrams
+*/
+static void run(const core_settings &settings, bool stalls, core_result &result, StreamTelemetry &telemetry)
+{
+    const uint32_t period_us = 1000000 / settings.rate;
+    std::vector<scha63x_raw_data> samples(settings.slots * settings.batch);
+    scha63x_ring ring;
+    scha63x_ring_init(&ring, samples.data(), (uint8_t)settings.batch, (uint16_t)settings.slots, period_us);
+
+    SioFifo fifo;
+    std::atomic<bool> stop(false);
+    const auto start = std::chrono::steady_clock::now();
+
+    // core 1, the sender
+    std::thread sender([&]() {
+        std::vector<uint8_t> packet(SCHA63X_WIRE_PACKET_SIZE(settings.max_samples));
+        std::vector<scha63x_raw_data> decoded(SCHA63X_WIRE_MAX_SAMPLES);
+        int64_t next = 0;
+
+        while (fifo.popBlocking(stop))
+        {
+            size_t bytes;
+            while ((bytes = scha63x_ring_packet(&ring, packet.data(), (uint16_t)settings.max_samples,
+                                                 sim_micros_start + (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                                                     std::chrono::steady_clock::now() - start).count(),
+                                                 settings.delta)) > 0)
+            {
+                // what the server gets
+                scha63x_packet_header header;
+                const int count = scha63x_wire_check(packet.data(), bytes, &header);
+                if (count <= 0 || count % settings.batch != 0 || count > settings.max_samples)
+                {
+                    result.errors++;
+                    continue;
+                }
+                scha63x_wire_get_packet(packet.data(), &header, decoded.data());
+                for (int i = 0; i < count; i++)
+                {
+                    const int64_t index = sampleIndex(decoded[i]);
+                    // batches dropped between the slots of a datagram too
+                    if (index < next || (index - next) % settings.batch != 0 || (i % settings.batch != 0 && index != next))
+                        result.errors++;
+                    if (index > next)
+                        result.dropped += index - next;
+                    next = index + 1;
+                }
+                telemetry.add(header, count, decoded[0].timeStamp,
+                              std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                  std::chrono::steady_clock::now() - start).count());
+                result.sent += count;
+                result.datagrams++;
+                result.bytes += bytes;
+
+                // the network
+                double send_us = settings.send_us;
+                if (stalls && settings.stall_every > 0 && result.datagrams % settings.stall_every == 0)
+                    send_us += settings.stall_us;
+                spinUntil(std::chrono::steady_clock::now() + std::chrono::nanoseconds((int64_t)(1000 * send_us)));
+            }
+        }
+    });
+
+    // core 0, the sample interrupt on the tick grid
+    const auto period = std::chrono::microseconds(period_us);
+    auto tick = start + period;
+    const auto end = start + std::chrono::nanoseconds((int64_t)(1e9 * settings.seconds));
+    uint64_t index = 0;
+    // Ends right after a published batch once the run time is over, its
+    // datagram carries all counters. Skipped ticks are only counted by
+    // the ring with the next sample, so the run never ends on them.
+    while (true)
+    {
+        spinUntil(tick);
+        const auto entered = std::chrono::steady_clock::now();
+        result.jitter.add(std::chrono::duration_cast<std::chrono::nanoseconds>(entered - tick).count());
+
+        const uint32_t scheduled = sim_micros_start + (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(tick - start).count();
+        scha63x_raw_data *sample = scha63x_ring_slot(&ring, scheduled);
+        fillSample(sample, index++);
+        sample->timeStamp = sim_micros_start + (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(entered - start).count();
+        const bool published = scha63x_ring_commit(&ring);
+        if (published)
+        {
+            if (fifo.wready())
+                fifo.push(ring.head);
+            else
+                result.full_fifo++;
+        }
+        result.interrupt.add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - entered).count());
+        result.ticks++;
+        if (tick >= end && published)
+            break;
+
+        // the alarm is set again, ticks already past are skipped
+        tick += period;
+        while (tick <= std::chrono::steady_clock::now())
+        {
+            tick += period;
+            result.ticks++;
+            result.skipped++;
+        }
+    }
+    result.sampled = index;
+
+    // last published batches, then the sender stops
+    while (ring.tail != __atomic_load_n(&ring.head, __ATOMIC_ACQUIRE))
+    {
+        if (fifo.wready())
+            fifo.push(ring.head);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    stop = true;
+    sender.join();
+
+    // every sample sent or dropped in whole batches, every skipped tick in the ring
+    if (result.sampled != result.sent + result.dropped || ring.count != 0 ||
+        ring.missed_ticks != (uint16_t)result.skipped)
+        result.errors++;
+}
+
+/*!
+    \brief One line per run
+*/
+static void printResult(const char *name, const core_result &result, const StreamTelemetry &telemetry)
+{
+    printf("%-8s %8llu ticks, %8llu sent, %5llu lost ticks, %5llu samples dropped, %6llu datagrams "
+           "(%.1f samples, %.0f bytes), %llu FIFO full\n"
+           "         sampling jitter p50/p99/max %llu/%llu/%llu ns, interrupt p50/p99 %llu/%llu ns, "
+           "server counted %llu missed ticks, %llu overruns, %llu lost datagrams\n",
+           name, (unsigned long long)result.ticks, (unsigned long long)result.sent,
+           (unsigned long long)result.skipped, (unsigned long long)result.dropped,
+           (unsigned long long)result.datagrams, result.datagrams ? 1.0 * result.sent / result.datagrams : 0.0,
+           result.datagrams ? 1.0 * result.bytes / result.datagrams : 0.0, (unsigned long long)result.full_fifo,
+           (unsigned long long)result.jitter.percentile(50), (unsigned long long)result.jitter.percentile(99),
+           (unsigned long long)result.jitter.max(), (unsigned long long)result.interrupt.percentile(50),
+           (unsigned long long)result.interrupt.percentile(99),
+           (unsigned long long)telemetry.counters().missed_ticks, (unsigned long long)telemetry.counters().overruns,
+           (unsigned long long)telemetry.counters().lost);
+}
+
+
+int main(int argc, char **argv)
+{
+    core_settings settings = { 2, 10000, 2, 64, 28, 20, 200, 30000, false };
+
+    for (int i = 1; i < argc; i++)
+    {
+        const bool value = i + 1 < argc;
+        if (strcmp(argv[i], "--seconds") == 0 && value)
+            settings.seconds = atof(argv[++i]);
+        else if (strcmp(argv[i], "--rate") == 0 && value)
+            settings.rate = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--batch") == 0 && value)
+            settings.batch = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--slots") == 0 && value)
+            settings.slots = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--max-samples") == 0 && value)
+            settings.max_samples = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--send-us") == 0 && value)
+            settings.send_us = atof(argv[++i]);
+        else if (strcmp(argv[i], "--stall-every") == 0 && value)
+            settings.stall_every = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--stall-us") == 0 && value)
+            settings.stall_us = atof(argv[++i]);
+        else if (strcmp(argv[i], "--delta") == 0)
+            settings.delta = true;
+        else
+        {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (settings.seconds <= 0 || settings.rate <= 0 || settings.rate > 1000000 || settings.batch < 1 ||
+        settings.max_samples < settings.batch || settings.max_samples > SCHA63X_WIRE_MAX_SAMPLES ||
+        settings.slots < 2 || settings.slots > 65536 / 2 || (settings.slots & (settings.slots - 1)) != 0)
+    {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("%g s at %d Hz, %d samples per slot, %d slots, up to %d samples per datagram, "
+           "send %.0f us, every %dth %.0f us longer with stalls\n",
+           settings.seconds, settings.rate, settings.batch, settings.slots, settings.max_samples,
+           settings.send_us, settings.stall_every, settings.stall_us);
+    if (std::thread::hardware_concurrency() < 2)
+        printf("one CPU, both threads share it, jitter and lost ticks show the host scheduler\n");
+
+    bool ok = true;
+    const char *names[] = { "idle", "stalls" };
+    for (int stalls = 0; stalls < 2; stalls++)
+    {
+        core_result result = {};
+        StreamTelemetry telemetry;
+        run(settings, stalls, result, telemetry);
+        printResult(names[stalls], result, telemetry);
+
+        // the server sees every datagram and the counters of the last one
+        const stream_counters &counters = telemetry.counters();
+        const bool counted = counters.lost == 0 && counters.missed_ticks == result.skipped &&
+                             counters.overruns * settings.batch == result.dropped;
+        if (result.errors || !counted)
+        {
+            fprintf(stderr, "%s: %llu samples out of order, torn or unaccounted, server counters %s\n", names[stalls],
+                    (unsigned long long)result.errors, counted ? "match" : "differ");
+            ok = false;
+        }
+    }
+
+    if (!ok)
+        fprintf(stderr, "dual core accounting failed\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,198 @@
+/*!
+    @file fan_in_bench.cpp
+    @brief Multi-board scaling run for the fan-in recorder
+
+    Simulated boards (board_simulator.h) on loopback run the startup
+    handshake and stream samples at a fixed rate into one FanInRecorder, for 1, 2, 4 ... up
+    to the given number of boards. Every board reports its own CAC
+    values and the writers check that each board's samples arrive in
+    order and are compensated with that board's values, and that every
+    sample carries its datagram's kernel arrival time. Reports the
+    datagrams the socket dropped. Exits with failure on a mismatch.
+
+    usage: fan_in_bench [max boards] [samples/s per board] [seconds] [workers]
+*/
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "defs.h"
+#include "config.h"
+#include "conversion.h"
+#include "fan_in.h"
+#include "receiver.h"
+#include "board_simulator.h"
+#include "bench_socket.h"
+
+
+/*!
+    \brief Simulated board, handshake then paced sample stream
+
+    The acc_x gain of the CAC terms is board + 1, which identifies
+    the board in the writer check
+
+    \param addr    recorder address
+    \param board   board number, part of the serial number and CAC values
+    \param rate    samples per second
+    \param seconds duration of the stream
+    \return number of samples sent, 0 if the handshake failed
+*/
+static uint64_t runBoard(sockaddr_in addr, int board, int rate, double seconds)
+{
+    simulator_options options = BoardSimulator::defaultOptions();
+    char serial[16];
+    snprintf(serial, sizeof(serial), "BENCH%02d", board);
+
+    options.server = addr;
+    options.serial = serial;
+    options.cacv.bxx = board + 1;
+    options.rate = rate;
+    options.seconds = seconds;
+    options.seed = board + 1;
+
+    BoardSimulator simulator(options);
+    if (!simulator.handshake())
+        return 0;
+
+    simulator.stream();
+    return simulator.stats().samples - simulator.stats().dropped * options.batch;
+}
+
+
+int main(int argc, char **argv)
+{
+    int maxBoards = argc > 1 ? atoi(argv[1]) : 16;
+    int rate = argc > 2 ? atoi(argv[2]) : 20000;
+    double seconds = argc > 3 ? strtod(argv[3], nullptr) : 2;
+    unsigned int workers = argc > 4 ? atoi(argv[4]) : fan_in_workers;
+
+    if (maxBoards > max_boards)
+        maxBoards = max_boards;
+
+    printf("%d samples/s per board, %g s, %u workers, %s batch kernel\n",
+           rate, seconds, workers, scha63x_convert_batch_isa());
+    printf("%6s %12s %12s %10s %10s %12s %12s\n", "boards", "sent", "written", "loss %", "high water", "samples/s",
+           "kernel drops");
+
+    bool failed = false;
+
+    try
+    {
+        for (int boards = 1; boards <= maxBoards; boards *= 2)
+        {
+            sockaddr_in addr;
+            int sock = bindLoopback(addr);
+            enableKernelTimestamps(sock);
+
+            scha63x_sensor_config config;
+            memset(&config, 0, sizeof(config));
+            std::atomic<int> errors(0);
+
+            // Writers check order and per-board compensation
+            FanInRecorder::writer_factory factory = [&](const board_info &board) {
+                std::shared_ptr<int64_t> last(new int64_t(0));
+                std::shared_ptr<int64_t> lastArrival(new int64_t(0));
+                std::shared_ptr<std::vector<float>> channels(new std::vector<float>(8 * 256));
+                const float gain = atoi(board.serial.c_str() + 5) + 1;
+                const scha63x_cacv cacv = board.cacv;
+
+                return FanInRecorder::sample_writer([&errors, last, lastArrival, channels, gain, cacv](const scha63x_raw_data *samples, size_t count) {
+                    float *c = channels->data();
+                    scha63x_real_batch batch = { c, c + 256, c + 512, c + 768, c + 1024, c + 1280, c + 1536, c + 1792 };
+                    scha63x_convert_batch_cacv(samples, count, &cacv, &batch);
+
+                    for (size_t i = 0; i < count; i++)
+                    {
+                        const float expected = gain * (samples[i].acc_x_lsb * (1.0f / SENSITIVITY_ACC));
+                        if (samples[i].timeStamp <= *last || fabsf(batch.acc_x[i] - expected) > 1e-5f * (1 + fabsf(expected)))
+                            errors++;
+                        // every sample carries its datagram's kernel arrival time, in order per board
+                        if (samples[i].receiveTime <= 0 || samples[i].receiveTime < *lastArrival)
+                            errors++;
+                        *last = samples[i].timeStamp;
+                        *lastArrival = samples[i].receiveTime;
+                    }
+                });
+            };
+
+            FanInRecorder fanIn(sock, config, factory, workers, board_ring_size, 0);
+            fanIn.start();
+
+            auto start = std::chrono::steady_clock::now();
+            std::vector<std::thread> senders;
+            std::vector<uint64_t> sent(boards, 0);
+            for (int b = 0; b < boards; b++)
+                senders.push_back(std::thread([&, b]() { sent[b] = runBoard(addr, b, rate, seconds); }));
+            for (auto &sender : senders)
+                sender.join();
+
+            uint64_t total = 0;
+            int connected = 0;
+            for (uint64_t n : sent)
+            {
+                total += n;
+                connected += n > 0;
+            }
+
+            // let the workers catch up before stopping
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+            uint64_t written = 0, highWater = 0;
+            while (std::chrono::steady_clock::now() < deadline)
+            {
+                written = 0;
+                for (int b = 0; b < fanIn.boards(); b++)
+                    written += fanIn.stats(b).written;
+                if (written >= total)
+                    break;
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            fanIn.stop();
+
+            written = 0;
+            for (int b = 0; b < fanIn.boards(); b++)
+            {
+                board_stats s = fanIn.stats(b);
+                written += s.written;
+                if (s.high_water > highWater)
+                    highWater = s.high_water;
+            }
+            close(sock);
+
+            printf("%6d %12lu %12lu %10.3f %10lu %12.0f %12lu\n", boards, (unsigned long)total,
+                   (unsigned long)written, total ? 100.0 * (total - written) / total : 0.0,
+                   (unsigned long)highWater, written / elapsed, (unsigned long)fanIn.kernelDrops());
+            fflush(stdout);
+
+            if (connected != boards || errors > 0)
+            {
+                std::cerr << boards << " boards: " << connected << " connected, "
+                          << errors << " samples out of order, with wrong CAC values or no arrival time\n";
+                failed = true;
+            }
+        }
+    }
+    catch (std::runtime_error &e)
+    {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
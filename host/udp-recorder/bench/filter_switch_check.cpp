@@ -0,0 +1,212 @@
+/*!
+    @file filter_switch_check.cpp
+    @brief Live filter change of streaming boards
+
+    Simulated boards (board_simulator.h) on loopback stream into one
+    FanInRecorder while setFilter() switches their filters. The first
+    board ignores its first filter command, so the recorder has to
+    repeat it, the last one ignores all of them and has to be given up.
+    Checks that every other board answered with the new filters, took
+    them over, kept streaming without losing a sample and that the
+    change took a fraction of the sensor startup a restart would cost.
+    Exits with 1 on failure.
+
+    usage: filter_switch_check [boards] [samples/s per board] [filter ACC[,GYRO]]
+*/
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "defs.h"
+#include "config.h"
+#include "fan_in.h"
+#include "filter_config.h"
+#include "board_simulator.h"
+#include "bench_socket.h"
+
+
+/*! \brief Streaming before and after the change, ms */
+#define stream_margin_ms 300
+
+/*! \brief Longest wait for the answers, ms */
+#define answer_timeout_ms 3000
+
+
+/*!
+    \brief Wait until a condition holds
+
+    \return false on timeout
+*/
+template <typename F>
+static bool waitFor(F condition, int timeout_ms)
+{
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (!condition())
+    {
+        if (std::chrono::steady_clock::now() > deadline)
+            return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return true;
+}
+
+static bool sameFilter(const scha63x_sensor_config &a, const scha63x_sensor_config &b)
+{
+    uint8_t codes_a[SCHA63X_WIRE_FILTER_CODES], codes_b[SCHA63X_WIRE_FILTER_CODES];
+    filterCodes(a, codes_a);
+    filterCodes(b, codes_b);
+    return memcmp(codes_a, codes_b, sizeof(codes_a)) == 0;
+}
+
+
+int main(int argc, char **argv)
+{
+    const int boards = argc > 1 ? atoi(argv[1]) : 4;
+    const int rate = argc > 2 ? atoi(argv[2]) : imu_trigger_rate;
+    scha63x_sensor_config target = filterConfig(3, 4);
+    if (boards < 3 || boards > max_boards || rate <= 0 || (argc > 3 && !parseFilter(argv[3], target)))
+    {
+        printf("usage: %s [boards, 3 to %d] [samples/s per board] [filter ACC[,GYRO]]\n", argv[0], max_boards);
+        return EXIT_FAILURE;
+    }
+
+    bool ok = true;
+
+    try
+    {
+        sockaddr_in addr;
+        int sock = bindLoopback(addr);
+
+        const scha63x_sensor_config initial = generateConfig();
+        std::atomic<uint64_t> written(0);
+        FanInRecorder::writer_factory factory = [&](const board_info &) {
+            return FanInRecorder::sample_writer([&written](const scha63x_raw_data *, size_t count) {
+                written += count;
+            });
+        };
+        FanInRecorder fanIn(sock, initial, factory, 2, board_ring_size, 0);
+        fanIn.start();
+
+        // board 0 loses its first command, the last one every command
+        std::vector<std::unique_ptr<BoardSimulator>> simulators;
+        for (int b = 0; b < boards; b++)
+        {
+            simulator_options options = BoardSimulator::defaultOptions();
+            char serial[16];
+            snprintf(serial, sizeof(serial), "FILTER%02d", b);
+            options.server = addr;
+            options.serial = serial;
+            options.rate = rate;
+            options.seed = b + 1;
+            options.filter_drop = b == 0 ? 1 : b == boards - 1 ? filter_send_attempts : 0;
+            simulators.emplace_back(new BoardSimulator(options));
+        }
+
+        std::atomic<bool> stop(false);
+        std::atomic<int> connected(0);
+        std::vector<std::thread> senders;
+        for (auto &simulator : simulators)
+        {
+            BoardSimulator *s = simulator.get();
+            senders.push_back(std::thread([&, s]() {
+                if (s->handshake())
+                {
+                    connected++;
+                    s->stream(&stop);
+                }
+            }));
+        }
+
+        if (!waitFor([&]() { return fanIn.streamingBoards() == boards; }, answer_timeout_ms))
+            throw std::runtime_error("Boards did not connect");
+        std::this_thread::sleep_for(std::chrono::milliseconds(stream_margin_ms));
+
+        // invalid codes are refused before anything is sent
+        scha63x_sensor_config invalid = target;
+        invalid.gyro_filter.Ry = 5;
+        if (fanIn.setFilter(invalid))
+        {
+            fprintf(stderr, "setFilter took filter code 5\n");
+            ok = false;
+        }
+
+        fanIn.setFilter(target);
+        const bool answered = waitFor([&]() {
+            for (int b = 0; b < boards; b++)
+            {
+                const board_stats s = fanIn.stats(b);
+                if (s.filter_changes + s.filter_failures == 0)
+                    return false;
+            }
+            return true;
+        }, answer_timeout_ms);
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(stream_margin_ms));
+        stop = true;
+        for (auto &sender : senders)
+            sender.join();
+
+        uint64_t sent = 0;
+        for (auto &simulator : simulators)
+            sent += simulator->stats().samples;
+        waitFor([&]() { return written >= sent; }, answer_timeout_ms);
+        fanIn.stop();
+        close(sock);
+
+        char text[32];
+        snprintf(text, sizeof(text), "%d,%d", filterHz(target.acc_filter.Ax), filterHz(target.gyro_filter.Ry));
+        printf("%d boards at %d samples/s, filters %s Hz, %g ms settling, startup would take %d ms\n",
+               boards, rate, text, BoardSimulator::defaultOptions().filter_settle_ms, simulator_init_ms);
+        printf("%6s %10s %8s %9s %10s %12s\n", "board", "commands", "changed", "failures", "change ms", "filters");
+
+        for (int b = 0; b < boards; b++)
+        {
+            // boards connect in any order
+            const board_info info = fanIn.info(b);
+            int index = atoi(info.serial.c_str() + 6);
+            const BoardSimulator &simulator = *simulators[index];
+            const board_stats s = fanIn.stats(b);
+            const bool given_up = index == boards - 1;
+            const bool changed = sameFilter(simulator.config(), target);
+            printf("%6d %10llu %8llu %9llu %10.1f %12s\n", index, (unsigned long long)simulator.stats().filter_commands,
+                   (unsigned long long)s.filter_changes, (unsigned long long)s.filter_failures, s.filter_ms,
+                   changed ? "new" : "initial");
+
+            // one repeat after filter_retry_ms for board 0, none for the others
+            const double expected_ms = simulator.stats().filter_commands > 1 ? filter_retry_ms : 0;
+            if (given_up)
+                ok &= s.filter_failures == 1 && s.filter_changes == 0 && sameFilter(simulator.config(), initial) &&
+                      simulator.stats().filter_commands == filter_send_attempts;
+            else
+                ok &= s.filter_changes == 1 && s.filter_failures == 0 && changed &&
+                      simulator.stats().filter_commands == (index == 0 ? 2u : 1u) &&
+                      s.filter_ms < expected_ms + simulator_init_ms / 4.0;
+        }
+
+        printf("%llu samples sent, %llu written\n", (unsigned long long)sent, (unsigned long long)written.load());
+        ok &= answered && connected == boards && written == sent;
+    }
+    catch (std::runtime_error &e)
+    {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    if (!ok)
+        fprintf(stderr, "Filter switch check failed\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
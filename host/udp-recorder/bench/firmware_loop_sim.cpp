@@ -0,0 +1,353 @@
+/*!
+    @file firmware_loop_sim.cpp
+    @brief Host build of the Arduino sampling and transmit loop
+
+    Runs the sample timer, the sensor read and the UDP transmit of
+    murata.ino against a simulated clock that wraps like micros(), with
+    mocked timer, SPI and Ethernet costs, twice:
+
+    - atomic: the previous loop. The timer interrupt only raises a
+      flag, loop() reads the sensor and sends every full buffer with
+      interrupts disabled, ticks during the transfer are delayed and
+      all but one of them lost.
+    - pingpong: the timer interrupt reads the sensor into the double
+      buffers of scha63x_pingpong.h, loop() sends the other buffer with
+      interrupts enabled, masked only for one Ethernet SPI transaction.
+
+    Every send can stall, e.g. while the W5500 resolves the server's
+    address. Reports lost ticks, dropped batches and the jitter of the
+    sample timestamps against the ideal tick. The pingpong packets are
+    encoded with the firmware's header counters and accounted by
+    StreamTelemetry like on the server; exits with 1 if those counters
+    or the sample count do not match the simulation.
+
+    usage: firmware_loop_sim [--seconds S] [--rate HZ] [--batch N] [--read-us US]
+                             [--send-us US] [--mask-us US] [--stall-every N]
+                             [--stall-us US] [--seed N]
+*/
+
+#include <random>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+#include "config.h"
+#include "scha63x_wire.h"
+#include "scha63x_pingpong.h"
+#include "telemetry.h"
+
+
+/*! \brief micros() at the start of the simulation, wraps 10 s in */
+#define sim_micros_start (4294967296.0 - 10e6)
+
+
+/*!
+    \brief Mocked costs of the firmware, us
+*/
+typedef struct _loop_costs {
+
+    double seconds;       // simulated run time
+    int rate;             // sample timer rate, Hz
+    int batch;            // samples per packet, BUFFER_SIZE
+    double read_us;       // scha63x_read_data, ten SPI frames
+    double poll_us;       // loop() turnaround until it sees a flag
+    double send_us;       // sendUDPSamplePacket without stall
+    double mask_us;       // longest Ethernet SPI transaction, interrupts masked
+    int stall_every;      // every Nth send stalls, 0 never
+    double stall_us;      // added to a stalled send
+    unsigned int seed;    // send time variation
+
+} loop_costs;
+
+/*!
+    \brief Outcome of one loop variant
+*/
+typedef struct _loop_result {
+
+    uint64_t ticks;       // sample timer ticks
+    uint64_t sampled;     // samples read
+    uint64_t sent;        // samples in sent packets
+    uint64_t lost;        // ticks never sampled
+    uint64_t overruns;    // batches dropped, both buffers full
+    uint16_t missed;      // missed ticks counted by the firmware
+    scha63x_packet_header last;  // header of the last packet sent
+    Histogram jitter;     // timestamp - ideal tick, us
+
+} loop_result;
+
+
+/*!
+    \brief Print command line usage
+*/
+static void printUsage(const char *program)
+{
+    printf("usage: %s [--seconds S] [--rate HZ] [--batch N] [--read-us US] [--send-us US]\n"
+           "       [--mask-us US] [--stall-every N] [--stall-us US] [--seed N]\n"
+           "  --seconds S     simulated time, default 60\n"
+           "  --rate HZ       sample timer, default %d\n"
+           "  --batch N       samples per packet, default %d\n"
+           "  --read-us US    sensor read, default 50\n"
+           "  --send-us US    packet transmit, default 600\n"
+           "  --mask-us US    interrupts masked per Ethernet SPI transaction, default 60\n"
+           "  --stall-every N every Nth transmit stalls, default 100, 0 never\n"
+           "  --stall-us US   length of a stall, default 5000\n"
+           "  --seed N        random seed of the transmit times\n",
+           program, imu_trigger_rate, imu_buffer_size);
+}
+
+/*!
+    \brief Duration of the next transmit
+
+    \param costs  mocked costs
+    \param index  transmit number
+    \param random send time variation, +-10 %
+*/
+static double sendTime(const loop_costs &costs, uint64_t index, std::mt19937 &random)
+{
+    std::uniform_real_distribution<double> vary(0.9, 1.1);
+    double t = costs.send_us * vary(random);
+    if (costs.stall_every > 0 && index % costs.stall_every == (uint64_t)costs.stall_every - 1)
+        t += costs.stall_us;
+    return t;
+}
+
+/*!
+    \brief The previous loop, sampling and transmit in loop() with interrupts off
+
+    A tick arriving with interrupts off raises its flag when they come
+    back on, a second one in the same window finds the flag pending
+    and is lost.
+*/
+static void runAtomic(const loop_costs &costs, loop_result &result)
+{
+    std::mt19937 random(costs.seed);
+    const double period = 1e6 / costs.rate;
+    double loop_free = 0;     // loop() done with the previous sample, interrupts off until then
+    double pending_at = -1;   // end of the masked window a flag is pending for
+    int fill = 0;
+    uint64_t sends = 0;
+
+    for (uint64_t k = 0; k * period < costs.seconds * 1e6; k++)
+    {
+        const double tick = k * period;
+        result.ticks++;
+
+        double isr = tick;
+        if (tick < pending_at)
+        {
+            result.lost++;
+            continue;
+        }
+        if (tick < loop_free)
+        {
+            pending_at = loop_free;
+            isr = loop_free;
+        }
+
+        // loop() sees the flag, stamps micros() and reads inside ATOMIC_BLOCK
+        const double stamp = isr + costs.poll_us;
+        result.jitter.add((uint64_t)(stamp - tick));
+        result.sampled++;
+        loop_free = stamp + costs.read_us;
+
+        // full buffer sent inside ATOMIC_BLOCK
+        if (++fill == costs.batch)
+        {
+            loop_free += sendTime(costs, sends++, random);
+            result.sent += fill;
+            fill = 0;
+        }
+    }
+}
+
+/*!
+    \brief The double buffered loop of murata.ino
+
+    The interrupt is delayed only by one masked SPI transaction at a
+    random point of a transmit, loop() sends with the firmware's buffer code
+    and the packets go through the wire encoding into StreamTelemetry
+
+    \param telemetry server side accounting of the sent packets
+*/
+static void runPingPong(const loop_costs &costs, loop_result &result, StreamTelemetry &telemetry)
+{
+    std::mt19937 random(costs.seed);
+    const double period = 1e6 / costs.rate;
+
+    std::vector<scha63x_raw_data> a(costs.batch), b(costs.batch);
+    scha63x_pingpong buffers;
+    scha63x_pingpong_init(&buffers, a.data(), b.data(), (uint8_t)costs.batch, (uint32_t)period);
+
+    std::uniform_real_distribution<double> offset(0, costs.send_us);
+    bool sending = false;
+    double mask_start = 0, send_end = 0, previous_isr = -1;
+    uint32_t sequence = 0;
+    uint8_t packet[SCHA63X_WIRE_PACKET_SIZE(SCHA63X_WIRE_MAX_SAMPLES)];
+
+    // loop() picks up a full buffer and sends it
+    auto startSend = [&](double now) {
+        const scha63x_raw_data *batch = scha63x_pingpong_ready(&buffers);
+        if (!batch)
+            return;
+
+        scha63x_packet_header header;
+        memset(&header, 0, sizeof(header));
+        header.magic = SCHA63X_PACKET_MAGIC;
+        header.version = SCHA63X_PACKET_VERSION;
+        header.count = (uint8_t)costs.batch;
+        header.sequence = sequence++;
+        header.send_time = (uint32_t)(uint64_t)(sim_micros_start + now);
+        scha63x_pingpong_stamp(&buffers, &header);
+        scha63x_wire_put_packet(packet, &header, batch);
+        result.last = header;
+
+        sending = true;
+        mask_start = now + offset(random);
+        send_end = now + sendTime(costs, header.sequence, random);
+
+        scha63x_packet_header received;
+        scha63x_wire_check(packet, SCHA63X_WIRE_PACKET_SIZE(costs.batch), &received);
+        telemetry.add(received, received.count, batch[0].timeStamp, (int64_t)(send_end * 1000));
+        result.sent += costs.batch;
+    };
+
+    for (uint64_t k = 0; k * period < costs.seconds * 1e6; k++)
+    {
+        const double tick = k * period;
+        result.ticks++;
+
+        // transmits ending before this tick, the next full buffer follows
+        while (sending && send_end <= tick)
+        {
+            sending = false;
+            scha63x_pingpong_release(&buffers);
+            startSend(send_end + costs.poll_us);
+        }
+
+        // interrupts masked for one SPI transaction of a transmit
+        double isr = tick;
+        if (sending && tick >= mask_start && tick < mask_start + costs.mask_us)
+            isr = mask_start + costs.mask_us;
+        if (isr == previous_isr)
+        {
+            result.lost++;
+            continue;
+        }
+        previous_isr = isr;
+
+        const uint32_t micros_now = (uint32_t)(uint64_t)(sim_micros_start + isr);
+        scha63x_raw_data *sample = scha63x_pingpong_slot(&buffers, micros_now);
+        sample->timeStamp = micros_now;
+        result.jitter.add((uint64_t)(isr - tick));
+        result.sampled++;
+        const uint8_t overruns = buffers.overruns;
+        scha63x_pingpong_commit(&buffers);
+        result.overruns += (uint8_t)(buffers.overruns - overruns);
+
+        // the interrupt preempts a running transmit
+        if (sending)
+            send_end += costs.read_us;
+        else
+            startSend(isr + costs.read_us + costs.poll_us);
+    }
+    result.missed = buffers.missed_ticks;
+}
+
+/*!
+    \brief One line per loop variant
+*/
+static void printResult(const char *name, const loop_result &result, int batch)
+{
+    printf("%-8s %8llu ticks, %8llu sent, %6llu lost (%.3f %%), %4llu batches dropped (%llu samples), "
+           "jitter p50/p99/max %llu/%llu/%llu us\n",
+           name, (unsigned long long)result.ticks, (unsigned long long)result.sent,
+           (unsigned long long)result.lost, 100.0 * result.lost / result.ticks,
+           (unsigned long long)result.overruns, (unsigned long long)result.overruns * batch,
+           (unsigned long long)result.jitter.percentile(50), (unsigned long long)result.jitter.percentile(99),
+           (unsigned long long)result.jitter.max());
+}
+
+
+int main(int argc, char **argv)
+{
+    loop_costs costs = { 60, imu_trigger_rate, imu_buffer_size, 50, 5, 600, 60, 100, 5000, 1 };
+
+    for (int i = 1; i < argc; i++)
+    {
+        const bool value = i + 1 < argc;
+        if (strcmp(argv[i], "--seconds") == 0 && value)
+            costs.seconds = atof(argv[++i]);
+        else if (strcmp(argv[i], "--rate") == 0 && value)
+            costs.rate = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--batch") == 0 && value)
+            costs.batch = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--read-us") == 0 && value)
+            costs.read_us = atof(argv[++i]);
+        else if (strcmp(argv[i], "--send-us") == 0 && value)
+            costs.send_us = atof(argv[++i]);
+        else if (strcmp(argv[i], "--mask-us") == 0 && value)
+            costs.mask_us = atof(argv[++i]);
+        else if (strcmp(argv[i], "--stall-every") == 0 && value)
+            costs.stall_every = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--stall-us") == 0 && value)
+            costs.stall_us = atof(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && value)
+            costs.seed = strtoul(argv[++i], nullptr, 10);
+        else
+        {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (costs.seconds <= 0 || costs.rate <= 0 || costs.batch < 1 || costs.batch > SCHA63X_WIRE_MAX_SAMPLES)
+    {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("%.0f s at %d Hz, %d samples per packet: read %.0f us, send %.0f us, masked %.0f us, "
+           "every %dth send %.0f us longer\n",
+           costs.seconds, costs.rate, costs.batch, costs.read_us, costs.send_us, costs.mask_us,
+           costs.stall_every, costs.stall_us);
+
+    loop_result atomic = {}, pingpong = {};
+    StreamTelemetry telemetry;
+
+    runAtomic(costs, atomic);
+    runPingPong(costs, pingpong, telemetry);
+
+    printResult("atomic", atomic, costs.batch);
+    printResult("pingpong", pingpong, costs.batch);
+    telemetry.print(stdout, "server");
+
+    // every tick is sampled or lost, every sample sent, dropped or still buffered
+    bool ok = pingpong.sampled + pingpong.lost == pingpong.ticks &&
+              pingpong.sampled - pingpong.sent - pingpong.overruns * costs.batch < 2 * (uint64_t)costs.batch;
+    if (!ok)
+        fprintf(stderr, "samples do not add up\n");
+
+    // the firmware counts lost ticks from the gaps between interrupts
+    if (pingpong.missed != (uint16_t)pingpong.lost)
+    {
+        fprintf(stderr, "firmware counted %u missed ticks\n", pingpong.missed);
+        ok = false;
+    }
+
+    // the server sees the counters of the last packet
+    const stream_counters &counters = telemetry.counters();
+    if (counters.lost != 0 || counters.missed_ticks > pingpong.lost || counters.overruns > pingpong.overruns ||
+        (uint16_t)counters.missed_ticks != pingpong.last.missed_ticks ||
+        (uint8_t)counters.overruns != pingpong.last.overruns)
+    {
+        fprintf(stderr, "server counted %llu missed ticks and %llu overruns\n",
+                (unsigned long long)counters.missed_ticks, (unsigned long long)counters.overruns);
+        ok = false;
+    }
+
+    if (!ok)
+        fprintf(stderr, "firmware loop accounting failed\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,222 @@
+/*!
+    @file frame_trigger_check.cpp
+    @brief Allocations and trigger detection of FrameTrigger
+
+    Streams synthetic samples at imu_trigger_rate with camera triggers
+    at cam_trigger_rate across the 32 bit wrap of micros(), with
+    dropped triggers, pulses held over several samples and early
+    triggers, through FrameTrigger. Global operator new is counted,
+    the trigger stage must not allocate after construction; the
+    previous per-trigger std::vector is counted for comparison.
+    Checks the detected triggers, missed, early and wide pulses,
+    the frame sequence of the index, and the frame groups handed out.
+    Exits with 1 on any mismatch.
+
+    usage: frame_trigger_check [seconds] [cameras]
+*/
+
+#include <atomic>
+#include <new>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <jsonl-recorder/recorder.hpp>
+
+#include "defs.h"
+#include "config.h"
+#include "frame_trigger.h"
+
+
+/*! \brief allocations by operator new since start */
+static std::atomic<uint64_t> allocations(0);
+
+void *operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void *p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+
+/*!
+    \brief Trigger of the synthetic stream, as expected from FrameTrigger
+*/
+typedef struct _expected_trigger {
+
+    uint64_t sequence;
+    int64_t timestamp;
+    uint32_t width;
+
+} expected_trigger;
+
+
+int main(int argc, char **argv)
+{
+    const double seconds = argc > 1 ? atof(argv[1]) : 600;
+    const int cameras = argc > 2 ? atoi(argv[2]) : cam_count;
+    if (seconds <= 0 || cameras < 1)
+    {
+        printf("usage: %s [seconds] [cameras]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // micros() wraps 20 s in
+    const int64_t sample_us = 1000000 / imu_trigger_rate;
+    const double trigger_us = 1e6 / cam_trigger_rate;
+    const uint64_t start = 4294967296ULL - 20000000ULL;
+    const size_t count = (size_t)(seconds * imu_trigger_rate);
+
+    // every 100th trigger dropped, every 37th held for 3 samples and
+    // every 500th followed by an early one 3 samples later
+    std::vector<scha63x_raw_data> samples(count);
+    std::vector<expected_trigger> expected;
+    uint64_t missed = 0, early = 0, wide = 0, sequence = 0;
+    size_t k = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        memset(&samples[i], 0, sizeof(samples[i]));
+        samples[i].timeStamp = (uint32_t)(start + i * sample_us);
+    }
+    for (;; k++)
+    {
+        const size_t i = (size_t)((k * trigger_us + sample_us - 1) / sample_us);
+        if (i + 4 >= count)
+            break;
+        if (k % 100 == 50)
+        {
+            missed++;
+            continue;
+        }
+        if (!expected.empty())
+            sequence = expected.back().sequence + 1 + (k % 100 == 51);
+
+        const uint32_t width = k % 37 == 5 ? 3 : 1;
+        for (uint32_t w = 0; w < width; w++)
+            samples[i + w].cam_trigger = true;
+        wide += width > 1;
+        expected.push_back({ sequence, samples[i].timeStamp, width });
+
+        if (k % 500 == 300 && width == 1)
+        {
+            samples[i + 3].cam_trigger = true;
+            expected.push_back({ sequence + 1, samples[i + 3].timeStamp, 1 });
+            early++;
+        }
+    }
+
+    FrameTrigger trigger(cameras);
+    std::vector<const std::vector<recorder::FrameData> *> groups;
+    groups.reserve(expected.size());
+    bool ok = true;
+
+    const uint64_t before = allocations.load();
+    for (size_t i = 0; i < count; i++)
+    {
+        const double time = 1e-6 * (i * sample_us);
+        const std::vector<recorder::FrameData> *group = trigger.update(samples[i], time);
+        if (!group)
+            continue;
+
+        // one frame per camera at the trigger time
+        ok &= (int)group->size() == cameras;
+        for (int c = 0; c < cameras && c < (int)group->size(); c++)
+            ok &= (*group)[c].cameraInd == c && (*group)[c].t == time;
+        if (groups.size() < groups.capacity())
+            groups.push_back(group);
+    }
+    const uint64_t stage = allocations.load() - before;
+
+    // the previous frame group code, a fresh vector per trigger
+    const uint64_t legacy_before = allocations.load();
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!samples[i].cam_trigger)
+            continue;
+        std::vector<recorder::FrameData> frameGroup;
+        for (int index = 0; index < cameras; index++)
+        {
+            recorder::FrameData frameData({ .t = 0, .cameraInd = index });
+            frameGroup.push_back(frameData);
+        }
+        ok &= frameGroup.size() == (size_t)cameras;
+    }
+    const uint64_t legacy = allocations.load() - legacy_before;
+
+    const frame_trigger_stats &stats = trigger.stats();
+    printf("%.0f s at %d Hz, %d cameras: %llu triggers, %llu missed, %llu early, %llu wide, longest %u samples\n",
+           seconds, imu_trigger_rate, cameras, (unsigned long long)stats.triggers,
+           (unsigned long long)stats.missed, (unsigned long long)stats.early,
+           (unsigned long long)stats.wide, stats.max_width);
+    printf("allocations: %llu in the trigger stage, %llu with a vector per trigger\n",
+           (unsigned long long)stage, (unsigned long long)legacy);
+
+    if (stage != 0)
+    {
+        fprintf(stderr, "trigger stage allocated %llu times\n", (unsigned long long)stage);
+        ok = false;
+    }
+    if (stats.triggers != expected.size() || stats.missed != missed || stats.early != early ||
+        stats.wide != wide || stats.max_width != (wide ? 3u : 1u))
+    {
+        fprintf(stderr, "expected %lu triggers, %llu missed, %llu early, %llu wide\n",
+                (unsigned long)expected.size(), (unsigned long long)missed,
+                (unsigned long long)early, (unsigned long long)wide);
+        ok = false;
+    }
+
+    // index holds the last frame_index_size frames, dropped ones are not found
+    size_t indexed = 0;
+    for (size_t t = expected.size() > frame_index_size / 2 ? expected.size() - frame_index_size / 2 : 0;
+         t < expected.size(); t++)
+    {
+        const frame_trigger_entry *entry = trigger.find(expected[t].sequence);
+        if (!entry || entry->timestamp != expected[t].timestamp || entry->width != expected[t].width)
+        {
+            fprintf(stderr, "frame %llu not indexed as expected\n", (unsigned long long)expected[t].sequence);
+            ok = false;
+            break;
+        }
+        if (t > 0 && expected[t].sequence > expected[t - 1].sequence + 1 &&
+            trigger.find(expected[t].sequence - 1))
+        {
+            fprintf(stderr, "missed frame %llu found in the index\n", (unsigned long long)expected[t].sequence - 1);
+            ok = false;
+            break;
+        }
+        indexed++;
+    }
+    if (!expected.empty() && trigger.find(expected.front().sequence) && expected.size() > frame_index_size)
+    {
+        fprintf(stderr, "frame %llu outlived the index\n", (unsigned long long)expected.front().sequence);
+        ok = false;
+    }
+
+    // groups come from the pool in turn
+    for (size_t g = 0; g + frame_group_pool < groups.size(); g++)
+    {
+        ok &= groups[g] == groups[g + frame_group_pool];
+        for (int d = 1; d < frame_group_pool; d++)
+            ok &= groups[g] != groups[g + d];
+    }
+
+    printf("%lu frames checked in the index, %lu frame groups from a pool of %d\n",
+           (unsigned long)indexed, (unsigned long)groups.size(), frame_group_pool);
+    if (!ok)
+        fprintf(stderr, "frame trigger check failed\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,248 @@
+/*!
+    @file gnss_time_check.cpp
+    @brief GPS time of week of synthetic PPS flagged streams
+
+    Decodes well formed and broken timepoint messages, then streams
+    samples at imu_trigger_rate from a device clock off by a few ppm
+    through GpsClock, the way JsonlSampleWriter does. PPS flags are
+    set on the first sample after every whole GPS second, timepoints
+    arrive with random latency and start a few seconds late, device
+    time wraps like micros(), GPS time of week rolls over into the
+    next week, one spurious PPS flag is added and the board resets
+    half way through. Checks the host to GPS offset, the counters and
+    the GPS time of every sample once the fit has settled against the
+    true one. Exits with 1 on any mismatch.
+
+    usage: gnss_time_check [seconds] [ppm]
+*/
+
+#include <math.h>
+#include <random>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+#include "config.h"
+#include "gnss_time.h"
+
+
+/*!
+    \brief Encode a protobuf varint
+*/
+static void putVarint(std::vector<uint8_t> &out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((uint8_t)value);
+}
+
+/*!
+    \brief Timepoint decode of valid and broken messages
+
+    \return false on a mismatch
+*/
+static bool checkParse(void)
+{
+    bool ok = true;
+    int32_t itow;
+
+    std::vector<uint8_t> message;
+    putVarint(message, 1 << 3);
+    putVarint(message, 604799999);
+    ok &= gnssParseTimepoint(message.data(), message.size(), itow) && itow == 604799999;
+
+    // unknown fields of every wire type are skipped
+    std::vector<uint8_t> extended;
+    putVarint(extended, (2 << 3) | 0);
+    putVarint(extended, 300);
+    putVarint(extended, (3 << 3) | 2);
+    putVarint(extended, 3);
+    extended.insert(extended.end(), { 'a', 'b', 'c' });
+    extended.insert(extended.end(), message.begin(), message.end());
+    putVarint(extended, (4 << 3) | 5);
+    extended.insert(extended.end(), { 0, 0, 0, 0 });
+    putVarint(extended, (5 << 3) | 1);
+    extended.insert(extended.end(), 8, 0);
+    ok &= gnssParseTimepoint(extended.data(), extended.size(), itow) && itow == 604799999;
+
+    // truncated, missing, out of the week, the hello
+    ok &= !gnssParseTimepoint(message.data(), message.size() - 1, itow);
+    ok &= !gnssParseTimepoint(extended.data(), extended.size() - 1, itow);
+    ok &= !gnssParseTimepoint(extended.data(), 2, itow);
+    std::vector<uint8_t> late;
+    putVarint(late, 1 << 3);
+    putVarint(late, gnss_week_ms);
+    ok &= !gnssParseTimepoint(late.data(), late.size(), itow);
+    ok &= !gnssParseTimepoint((const uint8_t *)"hello", 6, itow);
+    ok &= !gnssParseTimepoint(nullptr, 0, itow);
+
+    if (!ok)
+        fprintf(stderr, "timepoint decode failed\n");
+    return ok;
+}
+
+
+int main(int argc, char **argv)
+{
+    const double seconds = argc > 1 ? atof(argv[1]) : 240;
+    const double ppm = argc > 2 ? atof(argv[2]) : 37.5;
+    if (seconds < 60)
+    {
+        printf("usage: %s [seconds >= 60] [ppm]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    bool ok = checkParse();
+
+    // true time t in s: GPS time of week rolls over 45 s in, micros()
+    // wraps 30 s in, the board resets and jumps its clock half way
+    const double week = gnss_week_ms / 1000.0;
+    const double tow0 = week - 45.3;
+    const int64_t host0 = 5000000000000LL;
+    const double device_rate = 1 + 1e-6 * ppm;
+    const double reset_t = seconds / 2;
+    const int64_t reset_jump = 123456789;
+    const int64_t sample_us = 1000000 / imu_trigger_rate;
+
+    std::mt19937 random(7);
+    std::uniform_real_distribution<double> latency(0.05, 0.15);
+    std::uniform_real_distribution<double> delay(0.0005, 0.01);
+
+    auto hostNs = [&](double t) { return host0 + (int64_t)llround(t * 1e9); };
+    auto gpsTow = [&](double t) { return fmod(tow0 + t, week); };
+
+    // timepoints of the whole GPS seconds from 2 s on
+    struct timepoint { double arrival; int32_t itow; };
+    std::vector<timepoint> timepoints;
+    for (double epoch = ceil(tow0 + 2) - tow0; epoch < seconds; epoch += 1)
+        timepoints.push_back({ epoch + latency(random), (int32_t)(llround(gpsTow(epoch) * 1000) % gnss_week_ms) });
+    size_t next_timepoint = 0;
+
+    GnssTimepoints gnss;
+    GpsClock clock(gnss);
+
+    uint64_t samples = 0, skipped = 0, checked = 0, pps = 0, unpaired = 0;
+    double max_error_us = 0, sum_error2 = 0, max_offset_error_ms = 0;
+    int settle = 0;
+    int64_t last_timestamp = -1;
+    bool reset = false, spurious = false;
+    double previous_t = 0;
+
+    const uint64_t device0 = 4294967296ULL - 30000000ULL;
+    for (uint64_t i = 0;; i++)
+    {
+        // device time of sample i, the clock jumps on the reset
+        int64_t device = device0 + i * sample_us + (reset ? reset_jump : 0);
+        const double t = (double)(i * sample_us) / 1e6 / device_rate;
+        if (t >= seconds)
+            break;
+        if (!reset && t >= reset_t)
+        {
+            reset = true;
+            settle = 0;
+            device += reset_jump;
+        }
+        samples++;
+
+        while (next_timepoint < timepoints.size() && timepoints[next_timepoint].arrival <= t)
+        {
+            gnss.add(timepoints[next_timepoint].itow, hostNs(timepoints[next_timepoint].arrival));
+            next_timepoint++;
+        }
+
+        // PPS at every whole GPS second since the previous sample
+        const double next_pps = ceil(tow0 + previous_t) - tow0;
+        bool flag = i > 0 && next_pps > previous_t && next_pps <= t;
+        if (!spurious && t > seconds / 4 && t - (floor(tow0 + t) - tow0) > 0.1)
+        {
+            spurious = true;
+            flag = true;
+        }
+        previous_t = t;
+
+        scha63x_raw_data sample;
+        memset(&sample, 0, sizeof(sample));
+        sample.timeStamp = (uint32_t)device;
+        sample.ubx_trigger = flag;
+        sample.receiveTime = hostNs(t + delay(random));
+
+        // as in JsonlSampleWriter::write
+        const int64_t ts = sample.timeStamp;
+        if (sample.ubx_trigger)
+        {
+            const uint32_t gap = last_timestamp < 0 ? sample_us : (uint32_t)(ts - last_timestamp);
+            clock.addPps((uint32_t)(ts - gap / 2), sample.receiveTime);
+            pps++;
+            settle++;
+            unpaired += next_timepoint == 0;
+
+            int64_t offset_ns;
+            if (gnss.offset(offset_ns))
+            {
+                // offset is short by the smallest latency
+                const double truth = gpsTow(t) * 1e9 - hostNs(t);
+                const double error = fmod(truth - offset_ns + 1.5 * week * 1e9, week * 1e9) - 0.5 * week * 1e9;
+                if (error / 1e6 > max_offset_error_ms)
+                    max_offset_error_ms = error / 1e6;
+                ok &= error >= 0 && error < 0.151e9;
+            }
+        }
+        last_timestamp = (uint32_t)ts;
+
+        if (!clock.model().valid)
+        {
+            skipped++;
+            continue;
+        }
+
+        // settled ten PPS into a fit
+        if (settle < 10)
+            continue;
+        const double mapped = GpsClock::map(clock.model(), ts);
+        double error = fabs(mapped - gpsTow(t));
+        if (error > week / 2)
+            error = week - error;
+        sum_error2 += error * error;
+        if (error * 1e6 > max_error_us)
+            max_error_us = error * 1e6;
+        checked++;
+    }
+
+    const gps_fit_stats &stats = clock.fitStats();
+    printf("%.0f s at %d Hz, device clock %+.1f ppm: %llu samples, %llu before GPS time, %llu checked\n",
+           seconds, imu_trigger_rate, ppm, (unsigned long long)samples, (unsigned long long)skipped,
+           (unsigned long long)checked);
+    printf("%llu timepoints, host to GPS offset short by at most %.1f ms\n",
+           (unsigned long long)gnss.count(), max_offset_error_ms);
+    clock.print(stdout, "check");
+    printf("GPS time error: max %.1f us, rms %.1f us\n", max_error_us,
+           checked ? 1e6 * sqrt(sum_error2 / checked) : 0.0);
+
+    // the spurious PPS and the three after the reset leave the fit
+    if (stats.pps != pps || stats.unpaired != unpaired || unpaired == 0 || stats.outliers != 4)
+    {
+        fprintf(stderr, "expected %llu PPS, %llu without timepoints, 4 outliers\n",
+                (unsigned long long)pps, (unsigned long long)unpaired);
+        ok = false;
+    }
+
+    // the flag puts a PPS anywhere within a sample, the error of the
+    // midpoint drifts through the sample with the device clock
+    const double max_ppm_error = (double)sample_us / gnss_fit_pps;
+    if (fabs(1e6 * (clock.model().rate - 1) + ppm / device_rate) > max_ppm_error ||
+        max_error_us > 0.75 * sample_us || checked == 0)
+    {
+        fprintf(stderr, "device to GPS fit off\n");
+        ok = false;
+    }
+
+    if (!ok)
+        fprintf(stderr, "GNSS time check failed\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,116 @@
+/*!
+    @file pipeline_stress.cpp
+    @brief Writer stall stress run for the receive/writer pipeline
+
+    A simulated board (board_simulator.h) on loopback streams into a
+    FanInRecorder at a fixed rate while the board's writer stalls
+    periodically, emulating blocking disk I/O. Exits with failure if
+    any sample is lost or reordered.
+
+    usage: pipeline_stress [samples/s] [seconds] [stall ms] [ring capacity]
+*/
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "defs.h"
+#include "config.h"
+#include "fan_in.h"
+#include "filter_config.h"
+#include "board_simulator.h"
+#include "bench_socket.h"
+
+
+/*! \brief time between writer stalls */
+#define stall_period_ms 500
+
+
+int main(int argc, char **argv)
+{
+    int rate = argc > 1 ? atoi(argv[1]) : 4000;
+    int seconds = argc > 2 ? atoi(argv[2]) : 5;
+    int stall_ms = argc > 3 ? atoi(argv[3]) : 50;
+    size_t capacity = argc > 4 ? strtoul(argv[4], nullptr, 10) : board_ring_size;
+
+    try
+    {
+        sockaddr_in addr;
+        int sock = bindLoopback(addr);
+
+        // Writer: checks ordering and stalls every stall_period_ms
+        uint64_t gaps = 0;
+        std::atomic<uint64_t> written(0);
+        FanInRecorder::writer_factory factory = [&](const board_info &) {
+            auto lastStall = std::chrono::steady_clock::now();
+            bool first = true;
+            uint32_t last = 0;
+            return FanInRecorder::sample_writer([&, lastStall, first, last](const scha63x_raw_data *samples,
+                                                                           size_t count) mutable {
+                for (size_t i = 0; i < count; i++)
+                {
+                    // device time wraps like micros()
+                    if (!first && (int32_t)(samples[i].timeStamp - last) <= 0)
+                        gaps++;
+                    first = false;
+                    last = samples[i].timeStamp;
+                }
+                written += count;
+
+                auto now = std::chrono::steady_clock::now();
+                if (now - lastStall >= std::chrono::milliseconds(stall_period_ms))
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(stall_ms));
+                    lastStall = std::chrono::steady_clock::now();
+                }
+            });
+        };
+
+        FanInRecorder fanIn(sock, generateConfig(), factory, 1, capacity, 0);
+        fanIn.start();
+
+        printf("%d samples/s for %d s, writer stalls %d ms every %d ms, ring %lu samples\n",
+               rate, seconds, stall_ms, stall_period_ms, (unsigned long)capacity);
+
+        simulator_options options = BoardSimulator::defaultOptions();
+        options.server = addr;
+        options.rate = rate;
+        options.seconds = seconds;
+        BoardSimulator board(options);
+        if (!board.handshake())
+            throw std::runtime_error("Board did not connect");
+        board.stream();
+
+        const uint64_t sent = board.stats().samples;
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(1000 + stall_ms);
+        while (written < sent && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        fanIn.stop();
+        close(sock);
+
+        board_stats stats = fanIn.stats(0);
+        printf("sent %lu, queued %lu, written %lu, overflows %lu, gaps %lu, high water %lu\n",
+               (unsigned long)sent, (unsigned long)stats.received, (unsigned long)stats.written,
+               (unsigned long)stats.overflows, (unsigned long)gaps, (unsigned long)stats.high_water);
+
+        bool ok = stats.written == sent && stats.overflows == 0 && gaps == 0;
+        printf("%s\n", ok ? "OK: no samples lost" : "FAIL: samples lost");
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    catch (std::runtime_error &e)
+    {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,212 @@
+/*!
+    @file receive_bench.cpp
+    @brief Receive throughput benchmark over loopback
+
+    Local sender threads blast sample batches at a loopback socket,
+    which is drained either with one recvfrom per datagram or with
+    the batched recvmmsg engine.
+
+    usage: receive_bench [datagrams per sender] [senders]
+*/
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "defs.h"
+#include "config.h"
+#include "receiver.h"
+#include "bench_socket.h"
+
+
+/*! \brief bytes in a single sample batch datagram */
+static const int packet_bytes = SCHA63X_WIRE_PACKET_SIZE(imu_buffer_size);
+
+
+/*!
+    \brief Result of one benchmark run
+*/
+typedef struct _bench_result {
+
+    uint64_t sent;
+    uint64_t received;
+    uint64_t bytes;
+    uint64_t calls;
+    double seconds;
+
+} bench_result;
+
+
+/*!
+    \brief Receive socket on an ephemeral loopback port, large buffer and short timeout
+
+    \param addr filled with the bound address
+    \return socket descriptor
+*/
+static int receiveSocket(sockaddr_in &addr)
+{
+    int sock = bindLoopback(addr);
+
+    int rcvbuf = 8 * 1024 * 1024;
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    timeval timeout = {0, 200 * 1000};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    return sock;
+}
+
+/*!
+    \brief Sender thread, one datagram per sample batch
+
+    \param addr  target address
+    \param count number of datagrams to send
+*/
+static void sender(sockaddr_in addr, uint64_t count)
+{
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    scha63x_packet_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SCHA63X_PACKET_MAGIC;
+    header.version = SCHA63X_PACKET_VERSION;
+    header.count = imu_buffer_size;
+
+    scha63x_raw_data batch[imu_buffer_size];
+    memset(batch, 0, sizeof(batch));
+    uint8_t packet[packet_bytes];
+
+    for (uint64_t i = 0; i < count; i++)
+    {
+        header.sequence = i;
+        batch[0].timeStamp = i + 1;
+        scha63x_wire_put_packet(packet, &header, batch);
+        sendto(sock, packet, packet_bytes, 0, (sockaddr *)&addr, sizeof(addr));
+    }
+    close(sock);
+}
+
+/*!
+    \brief Run one benchmark pass
+
+    \param batched  use the recvmmsg engine instead of recvfrom
+    \param count    datagrams per sender
+    \param senders  number of sender threads
+    \return counters and elapsed time from first to last datagram
+*/
+static bench_result run(bool batched, uint64_t count, int senders)
+{
+    sockaddr_in addr;
+    int sock = receiveSocket(addr);
+
+    bench_result result;
+    memset(&result, 0, sizeof(result));
+    result.sent = count * senders;
+
+    std::atomic<int> running(senders);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < senders; i++)
+    {
+        threads.emplace_back([&running, addr, count]() {
+            sender(addr, count);
+            running--;
+        });
+    }
+
+    BatchReceiver receiver(sock);
+    uint8_t single[SCHA63X_WIRE_MAX_PAYLOAD];
+    std::chrono::steady_clock::time_point first, last;
+
+    while (result.received < result.sent)
+    {
+        int n;
+        if (batched)
+        {
+            n = receiver.receive();
+        }
+        else
+        {
+            int bytes = recv(sock, single, sizeof(single), 0);
+            n = bytes > 0 ? 1 : 0;
+            if (n)
+            {
+                result.bytes += bytes;
+                result.calls++;
+            }
+        }
+
+        if (n == 0)
+        {
+            if (running == 0)
+                break; // timed out after all senders finished, rest was dropped
+            continue;
+        }
+
+        last = std::chrono::steady_clock::now();
+        if (result.received == 0)
+            first = last;
+        result.received += n;
+    }
+
+    for (auto &thread : threads)
+        thread.join();
+    close(sock);
+
+    if (batched)
+    {
+        result.bytes = receiver.stats().bytes;
+        result.calls = receiver.stats().calls;
+    }
+    result.seconds = std::chrono::duration<double>(last - first).count();
+
+    return result;
+}
+
+/*!
+    \brief Print a benchmark result line
+*/
+static void print(const char *name, const bench_result &r)
+{
+    printf("%-9s received %lu/%lu datagrams (loss %.2f %%), %.0f datagrams/s, "
+           "%.1f MB/s, %lu syscalls, %.2f datagrams/syscall\n",
+           name, (unsigned long)r.received, (unsigned long)r.sent,
+           100.0 * (r.sent - r.received) / r.sent,
+           r.seconds > 0 ? r.received / r.seconds : 0.0,
+           r.seconds > 0 ? r.bytes / r.seconds / 1e6 : 0.0,
+           (unsigned long)r.calls,
+           r.calls ? 1.0 * r.received / r.calls : 0.0);
+}
+
+
+int main(int argc, char **argv)
+{
+    uint64_t count = argc > 1 ? strtoull(argv[1], nullptr, 10) : 200000;
+    int senders = argc > 2 ? atoi(argv[2]) : 4;
+
+    try
+    {
+        printf("%d senders x %lu datagrams of %d bytes\n",
+               senders, (unsigned long)count, packet_bytes);
+        print("recvfrom", run(false, count, senders));
+        print("recvmmsg", run(true, count, senders));
+    }
+    catch (std::runtime_error &e)
+    {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
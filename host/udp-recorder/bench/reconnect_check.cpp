@@ -0,0 +1,122 @@
+/*!
+    @file reconnect_check.cpp
+    @brief Boards rebooting more often than the recorder has session slots
+
+    Simulated boards (board_simulator.h) on loopback stream into one
+    FanInRecorder, one of them reboots again and again from the same
+    address: a new handshake closes its streaming session, which the
+    worker drains. Checks that more reboots than max_boards all get
+    their handshake through on reused slots, that the number of slots
+    stays small, and that every sample of every session is written.
+    Exits with 1 on failure.
+
+    usage: reconnect_check [reboots] [samples/s per board]
+*/
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "defs.h"
+#include "config.h"
+#include "fan_in.h"
+#include "filter_config.h"
+#include "board_simulator.h"
+#include "bench_socket.h"
+
+
+/*! \brief Streaming between two reboots, s */
+#define reboot_interval_s 0.05
+
+/*! \brief Longest wait for the writers, ms */
+#define drain_timeout_ms 3000
+
+
+int main(int argc, char **argv)
+{
+    const int reboots = argc > 1 ? atoi(argv[1]) : 2 * max_boards;
+    const int rate = argc > 2 ? atoi(argv[2]) : imu_trigger_rate;
+    if (reboots < 1 || rate <= 0)
+    {
+        printf("usage: %s [reboots] [samples/s per board]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    bool ok = true;
+
+    try
+    {
+        sockaddr_in addr;
+        int sock = bindLoopback(addr);
+
+        std::atomic<uint64_t> written(0);
+        FanInRecorder::writer_factory factory = [&](const board_info &) {
+            return FanInRecorder::sample_writer([&written](const scha63x_raw_data *, size_t count) {
+                written += count;
+            });
+        };
+        FanInRecorder fanIn(sock, generateConfig(), factory, 2, board_ring_size, 0);
+        fanIn.start();
+
+        // one board streams throughout, the other reboots from the same socket
+        simulator_options options = BoardSimulator::defaultOptions();
+        options.server = addr;
+        options.rate = rate;
+        options.serial = "STEADY01";
+        BoardSimulator steady(options);
+        options.serial = "REBOOT01";
+        options.seed = 2;
+        options.seconds = reboot_interval_s;
+        BoardSimulator rebooting(options);
+
+        if (!steady.handshake())
+            throw std::runtime_error("Steady board did not connect");
+        std::atomic<bool> stop(false);
+        std::thread steadyThread([&]() { steady.stream(&stop); });
+
+        int connected = 0;
+        for (int i = 0; i < reboots; i++)
+        {
+            if (!rebooting.handshake())
+                break;
+            connected++;
+            rebooting.stream();
+        }
+        stop = true;
+        steadyThread.join();
+
+        const uint64_t sent = steady.stats().samples + rebooting.stats().samples;
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(drain_timeout_ms);
+        while (written < sent && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        fanIn.stop();
+        close(sock);
+
+        printf("%d of %d reboots connected, %d session slots of %d used, %llu samples sent, %llu written\n",
+               connected, reboots, fanIn.boards(), max_boards, (unsigned long long)sent,
+               (unsigned long long)written.load());
+
+        // a closed session may still drain while the next one starts, more are not needed
+        ok &= connected == reboots && fanIn.boards() < max_boards && written == sent;
+    }
+    catch (std::runtime_error &e)
+    {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    if (!ok)
+        fprintf(stderr, "Reconnect check failed\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,168 @@
+/*!
+    @file recording_bench.cpp
+    @brief JSONL versus binary recording throughput
+
+    Records the same synthetic samples through the JSONL path
+    (conversion + jsonl-recorder) and the binary chunk writer, and
+    reports file size, bytes/s and CPU time per sample.
+
+    usage: recording_bench [samples] [output directory]
+*/
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include <jsonl-recorder/recorder.hpp>
+
+#include "defs.h"
+#include "config.h"
+#include "conversion.h"
+#include "jsonl_output.h"
+#include "binary_recording.h"
+
+
+/*! \brief samples handed to the writer at a time, like the pipeline writer */
+#define bench_batch 256
+
+
+/*!
+    \brief Result of one recording run
+*/
+typedef struct _recording_result {
+
+    double wall_s;
+    double cpu_s;
+    uint64_t bytes;
+
+} recording_result;
+
+
+/*!
+    \brief Process CPU time in seconds
+*/
+static double cpuSeconds(void)
+{
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+/*!
+    \brief Size of a file in bytes
+*/
+static uint64_t fileSize(const std::string &path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? st.st_size : 0;
+}
+
+/*!
+    \brief Time a recording run, the writer is destroyed inside the timing
+
+    \param write function recording all samples and closing the output
+    \param path  output file, measured afterwards
+*/
+template <typename F>
+static recording_result timeRun(F write, const std::string &path)
+{
+    recording_result result;
+    double cpu = cpuSeconds();
+    auto start = std::chrono::steady_clock::now();
+
+    write();
+
+    result.wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.cpu_s = cpuSeconds() - cpu;
+    result.bytes = fileSize(path);
+    return result;
+}
+
+/*!
+    \brief Print a result line
+*/
+static void print(const char *name, const recording_result &r, size_t samples)
+{
+    printf("%-6s %8.1f MB, %6.1f bytes/sample, %7.1f MB/s, %7.1f ns CPU/sample\n",
+           name, r.bytes / 1e6, 1.0 * r.bytes / samples, r.bytes / r.wall_s / 1e6,
+           1e9 * r.cpu_s / samples);
+}
+
+
+int main(int argc, char **argv)
+{
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+    std::string dir = argc > 2 ? argv[2] : "/tmp";
+
+    // synthetic samples at the default sample and camera rates
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> noise(-200, 200);
+    std::vector<scha63x_raw_data> samples(count);
+    memset(samples.data(), 0, samples.size() * sizeof(scha63x_raw_data));
+    const int cam_period = imu_trigger_rate / cam_trigger_rate;
+    for (size_t i = 0; i < count; i++)
+    {
+        samples[i].timeStamp = 1000 + i * (1000000 / imu_trigger_rate);
+        samples[i].acc_x_lsb = noise(rng);
+        samples[i].acc_y_lsb = noise(rng);
+        samples[i].acc_z_lsb = SENSITIVITY_ACC + noise(rng);
+        samples[i].gyro_x_lsb = noise(rng);
+        samples[i].gyro_y_lsb = noise(rng);
+        samples[i].gyro_z_lsb = noise(rng);
+        samples[i].temp_due_lsb = 300 + noise(rng) / 50;
+        samples[i].temp_uno_lsb = 300 + noise(rng) / 50;
+        samples[i].cam_trigger = (i % cam_period) == 0;
+    }
+
+    scha63x_cacv cacv;
+    memset(&cacv, 0, sizeof(cacv));
+    cacv.bxx = cacv.byy = cacv.bzz = cacv.cxx = cacv.cyy = cacv.czz = 1;
+    cacvValues(cacv);
+
+    scha63x_sensor_config config;
+    memset(&config, 0, sizeof(config));
+
+    try
+    {
+        const std::string jsonlPath = dir + "/recording_bench.jsonl";
+        const std::string binPath = dir + "/recording_bench.bin";
+
+        recording_result jsonl = timeRun([&]() {
+            auto recorder = recorder::Recorder::build(jsonlPath);
+            JsonlSampleWriter writer(*recorder, 0);
+            for (size_t i = 0; i < count; i += bench_batch)
+                writer.write(&samples[i], std::min<size_t>(bench_batch, count - i));
+        }, jsonlPath);
+
+        recording_result binary = timeRun([&]() {
+            BinaryRecorder writer(binPath, makeBinaryHeader("bench", cacv, config, 0));
+            for (size_t i = 0; i < count; i += bench_batch)
+                writer.addSamples(&samples[i], std::min<size_t>(bench_batch, count - i));
+        }, binPath);
+
+        printf("%lu samples\n", (unsigned long)count);
+        print("jsonl", jsonl, count);
+        print("binary", binary, count);
+        printf("binary: %.1fx smaller, %.1fx less CPU per sample\n",
+               1.0 * jsonl.bytes / binary.bytes, jsonl.cpu_s / binary.cpu_s);
+
+        remove(jsonlPath.c_str());
+        remove(binPath.c_str());
+    }
+    catch (std::runtime_error &e)
+    {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,140 @@
+/*!
+    @file session_bench.cpp
+    @brief Indexed window extraction versus a linear scan
+
+    Writes a synthetic JSONL session of the given size in jsonl-recorder's
+    line format, then extracts a window from the middle of it with a
+    linear getline scan, with a fresh index build and with the sidecar
+    index loaded. The three results must match.
+
+    usage: session_bench [size GB] [window s] [path]
+*/
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "config.h"
+#include "session_reader.h"
+
+
+/*!
+    \brief Write a synthetic session, one gyroscope and one accelerometer
+    line per sample at the default sample rate
+
+    \return duration of the session in seconds
+*/
+static double writeSession(const std::string &path, uint64_t bytes)
+{
+    FILE *file = fopen(path.c_str(), "wb");
+    if (!file)
+        throw std::runtime_error("Can not open " + path);
+    setvbuf(file, nullptr, _IOFBF, 1 << 20);
+
+    uint64_t written = 0;
+    double time = 0;
+    for (uint64_t i = 0; written < bytes; i++)
+    {
+        time = 1.0 * i / imu_trigger_rate;
+        written += fprintf(file, "{\"sensor\":{\"type\":\"gyroscope\",\"values\":[%g,%g,%g]},\"time\":%g}\n",
+                           0.001 * (i % 97), -0.002 * (i % 89), 0.0005 * (i % 83), time);
+        written += fprintf(file, "{\"sensor\":{\"type\":\"accelerometer\",\"values\":[%g,%g,%g]},\"time\":%g}\n",
+                           0.01 * (i % 71), -0.02 * (i % 67), 9.81, time);
+    }
+
+    if (fclose(file) != 0)
+        throw std::runtime_error("Can not write " + path);
+    return time;
+}
+
+/*!
+    \brief Extract a window by reading every line
+*/
+static size_t linearScan(const std::string &path, double t0, double t1)
+{
+    std::ifstream in(path);
+    std::string line;
+    size_t matches = 0;
+    while (std::getline(in, line))
+    {
+        double time;
+        if (JsonlSession::lineTime(line.data(), line.size(), time) && time >= t0 && time <= t1)
+            matches++;
+    }
+    return matches;
+}
+
+/*!
+    \brief Seconds since a start time
+*/
+static double since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+int main(int argc, char **argv)
+{
+    double gigabytes = argc > 1 ? strtod(argv[1], nullptr) : 4;
+    double window = argc > 2 ? strtod(argv[2], nullptr) : 10;
+    std::string path = argc > 3 ? argv[3] : "/tmp/session_bench.jsonl";
+    const std::string indexPath = path + ".idx";
+
+    try
+    {
+        remove(indexPath.c_str());
+        double duration = writeSession(path, (uint64_t)(gigabytes * 1e9));
+        double t0 = duration / 2;
+        double t1 = t0 + window;
+        printf("%.1f GB session of %.0f s, window [%g, %g]\n", gigabytes, duration, t0, t1);
+
+        auto start = std::chrono::steady_clock::now();
+        size_t linear = linearScan(path, t0, t1);
+        double linear_s = since(start);
+
+        size_t lines = 0;
+        auto count = [&](const char *, size_t) { lines++; };
+
+        start = std::chrono::steady_clock::now();
+        size_t built;
+        {
+            JsonlSession session(path);
+            double build_s = since(start);
+            start = std::chrono::steady_clock::now();
+            built = session.query(t0, t1, count);
+            printf("index build   %8.3f s, %lu blocks\n", build_s, (unsigned long)session.index().size());
+            printf("query         %8.3f s\n", since(start));
+        }
+
+        start = std::chrono::steady_clock::now();
+        JsonlSession session(path);
+        size_t loaded = session.query(t0, t1, count);
+        double loaded_s = since(start);
+
+        printf("linear scan   %8.3f s, %lu lines\n", linear_s, (unsigned long)linear);
+        printf("sidecar+query %8.3f s, %lu lines, %.0fx faster than the scan%s\n",
+               loaded_s, (unsigned long)loaded, linear_s / loaded_s,
+               session.indexLoaded() ? "" : " (sidecar not used)");
+
+        remove(path.c_str());
+        remove(indexPath.c_str());
+
+        if (linear != built || linear != loaded)
+        {
+            std::cerr << "Indexed extraction differs from the linear scan\n";
+            return EXIT_FAILURE;
+        }
+    }
+    catch (std::runtime_error &e)
+    {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,301 @@
+/*!
+    @file shm_bus_bench.cpp
+    @brief Latency and integrity of the shared memory sample bus
+
+    One writer publishes synthetic samples for two boards in batches
+    at a fixed rate, forked reader processes consume them through
+    ShmBusReader, spinning on read() in the first phase and sleeping
+    in wait() in the second. Every sample carries its publish time,
+    readers report the publish to read latency. A last phase floods a
+    small ring so readers are lapped while they copy. Every record's
+    payload is derived from its record number, readers check it, the
+    order, and that records read plus overruns account for every
+    record published. A last check hands a ring on to a new board
+    session like a reused slot does and reads across the hand-over.
+    Exits with 1 if a reader finds a torn or misplaced record or
+    records under the wrong board.
+
+    usage: shm_bus_bench [readers] [samples/s per board] [seconds] [batch]
+*/
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "shm_bus.h"
+#include "shm_publisher.h"
+#include "telemetry.h"
+
+
+#define bench_name "/udp_recorder_bench"
+#define bench_boards 2
+#define end_flag (1u << 31) // last record of a phase
+
+
+static int64_t monotonicNs(void)
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/*!
+    \brief Payload of record n, the reader recomputes it
+*/
+static shm_bus_sample makeSample(uint32_t board, uint64_t n)
+{
+    shm_bus_sample s;
+    s.device_time_us = (int64_t)n;
+    s.host_time_ns = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        s.acc[i] = (float)((n * 7 + i) & 0xffff);
+        s.gyro[i] = (float)((n * 13 + i) & 0xffff);
+    }
+    s.temp_due = (float)board;
+    s.temp_uno = (float)(n & 0xff);
+    s.flags = n & 0xf;
+    s.sequence = 0;
+    return s;
+}
+
+static bool intact(uint32_t board, const shm_bus_sample &s)
+{
+    const uint64_t n = (uint64_t)s.device_time_us;
+    shm_bus_sample expected = makeSample(board, n);
+    expected.flags |= s.flags & end_flag;
+    return s.sequence == (uint32_t)n && s.temp_due == expected.temp_due && s.temp_uno == expected.temp_uno &&
+           s.flags == expected.flags && memcmp(s.acc, expected.acc, sizeof(s.acc)) == 0 &&
+           memcmp(s.gyro, expected.gyro, sizeof(s.gyro)) == 0;
+}
+
+
+/*!
+    \brief Reader process, consumes both boards until their end records
+
+    \param id    reader number
+    \param spin  poll read() instead of sleeping in wait()
+    \param ready written once the reader is attached
+    \return exit status
+*/
+static int runReader(int id, bool spin, int ready)
+{
+    alarm(120);
+    ShmBusReader bus(bench_name);
+    if (write(ready, "r", 1) != 1)
+        return EXIT_FAILURE;
+    close(ready);
+
+    Histogram latency;   // ns
+    uint64_t received = 0, corrupt = 0, misordered = 0, published = 0;
+    int64_t last[bench_boards] = {-1, -1};
+    int ended = 0;
+    shm_bus_sample samples[256];
+
+    while (ended < bench_boards)
+    {
+        if (!spin)
+            bus.wait(100000);
+
+        for (unsigned int b = 0; b < bus.boards() && b < bench_boards; b++)
+        {
+            const size_t n = bus.read(b, samples, 256);
+            const int64_t now = monotonicNs();
+            for (size_t i = 0; i < n; i++)
+            {
+                const shm_bus_sample &s = samples[i];
+                if (!intact(b, s))
+                {
+                    corrupt++;
+                    continue;
+                }
+                if (s.device_time_us <= last[b])
+                    misordered++;
+                last[b] = s.device_time_us;
+                latency.add(now - s.host_time_ns);
+                received++;
+                if (s.flags & end_flag)
+                {
+                    published += s.device_time_us + 1;
+                    ended++;
+                }
+            }
+        }
+    }
+
+    const bool accounted = received + bus.overruns() == published;
+    const bool ok = !corrupt && !misordered && accounted;
+    printf("  reader %d: %9llu read, %9llu overruns, latency p50/p99/p99.9/max %6.1f/%6.1f/%6.1f/%8.1f us%s%s\n",
+           id, (unsigned long long)received, (unsigned long long)bus.overruns(), 1e-3 * latency.percentile(50),
+           1e-3 * latency.percentile(99), 1e-3 * latency.percentile(99.9), 1e-3 * latency.max(),
+           ok ? "" : "  FAIL", accounted ? "" : " (records unaccounted)");
+    if (corrupt || misordered)
+        printf("  reader %d: %llu torn, %llu out of order\n", id, (unsigned long long)corrupt,
+               (unsigned long long)misordered);
+    fflush(stdout);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*!
+    \brief One phase: fork readers, publish, collect their results
+
+    \param rate     samples per second per board, 0 as fast as possible
+    \param capacity ring slots
+    \return all readers passed
+*/
+static bool runPhase(const char *name, int readers, bool spin, int rate, double seconds, int batch,
+                     uint32_t capacity)
+{
+    printf("%s: %d readers, %s, ", name, readers, spin ? "spinning" : "futex wait");
+    if (rate)
+        printf("%d samples/s per board in batches of %d, %u slots\n", rate, batch, capacity);
+    else
+        printf("flooding, batches of %d, %u slots\n", batch, capacity);
+    fflush(stdout);
+
+    ShmBusPublisher bus(bench_name, bench_boards, capacity);
+    for (uint32_t b = 0; b < bench_boards; b++)
+        bus.addBoard(b, "BENCH0" + std::to_string(b));
+
+    int ready[2];
+    if (pipe(ready) < 0)
+        throw std::runtime_error("pipe failed");
+    std::vector<pid_t> children;
+    for (int r = 0; r < readers; r++)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            close(ready[0]);
+            _exit(runReader(r, spin, ready[1]));
+        }
+        children.push_back(pid);
+    }
+    close(ready[1]);
+    char c;
+    for (int r = 0; r < readers; r++)
+    {
+        if (read(ready[0], &c, 1) != 1)
+            throw std::runtime_error("reader failed to attach");
+    }
+    close(ready[0]);
+
+    std::vector<shm_bus_sample> samples(batch);
+    const auto period = std::chrono::nanoseconds(rate ? 1000000000LL * batch / rate : 0);
+    auto next = std::chrono::steady_clock::now();
+    const int64_t end = monotonicNs() + (int64_t)(seconds * 1e9);
+    uint64_t n = 0;
+    bool last = false;
+
+    while (!last)
+    {
+        last = monotonicNs() >= end;
+        const int64_t now = monotonicNs();
+        for (uint32_t b = 0; b < bench_boards; b++)
+        {
+            for (int i = 0; i < batch; i++)
+            {
+                samples[i] = makeSample(b, n + i);
+                samples[i].host_time_ns = now;
+            }
+            if (last)
+                samples[batch - 1].flags |= end_flag;
+            bus.publish(b, samples.data(), batch);
+        }
+        n += batch;
+
+        if (rate)
+        {
+            next += period;
+            std::this_thread::sleep_until(next);
+        }
+    }
+
+    bool ok = true;
+    for (pid_t pid : children)
+    {
+        int status = 0;
+        waitpid(pid, &status, 0);
+        ok &= WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+    }
+    printf("  writer: %llu records per board\n", (unsigned long long)n);
+    return ok;
+}
+
+/*!
+    \brief A ring handed on to the next board session
+
+    The reader is behind the hand-over, it has to get the first
+    board's records under its serial number and generation first.
+
+    \return records and owners as expected
+*/
+static bool runHandOver(void)
+{
+    printf("hand-over: ring 0 from BENCH00 to BENCH10\n");
+    ShmBusPublisher bus(bench_name, 1, 64);
+    bus.addBoard(0, "BENCH00");
+    ShmBusReader reader(bench_name);
+
+    shm_bus_sample samples[8];
+    for (int i = 0; i < 8; i++)
+        samples[i] = makeSample(0, i);
+    bus.publish(0, samples, 5);
+    const uint32_t first = reader.generation(0);
+    bus.addBoard(0, "BENCH10");
+    bus.publish(0, samples + 5, 3);
+
+    shm_bus_sample out[8];
+    const size_t old = reader.read(0, out, 8);
+    const bool oldOk = old == 5 && out[4].device_time_us == 4 && strcmp(reader.serial(0), "BENCH00") == 0 &&
+                       reader.generation(0) == first;
+    const size_t now = reader.read(0, out, 8);
+    const bool newOk = now == 3 && out[0].device_time_us == 5 && strcmp(reader.serial(0), "BENCH10") == 0 &&
+                       reader.generation(0) != first && reader.boards() == 1;
+    printf("  %zu records of %s, then %zu of %s, generation %u%s\n", old, oldOk ? "BENCH00" : "?", now,
+           reader.serial(0), reader.generation(0), oldOk && newOk ? "" : "  FAIL");
+    return oldOk && newOk;
+}
+
+
+int main(int argc, char **argv)
+{
+    const int readers = argc > 1 ? atoi(argv[1]) : 4;
+    const int rate = argc > 2 ? atoi(argv[2]) : 2000;
+    const double seconds = argc > 3 ? strtod(argv[3], nullptr) : 3;
+    const int batch = argc > 4 ? atoi(argv[4]) : 4;
+
+    if (readers < 1 || rate < 1 || batch < 1 || batch > 256)
+    {
+        printf("usage: shm_bus_bench [readers] [samples/s per board] [seconds] [batch <= 256]\n");
+        return EXIT_FAILURE;
+    }
+
+    bool ok = true;
+    try
+    {
+        ok &= runPhase("spin", readers, true, rate, seconds, batch, shm_bus_capacity);
+        ok &= runPhase("wait", readers, false, rate, seconds, batch, shm_bus_capacity);
+        ok &= runPhase("overrun", readers, true, 0, seconds, 64, 256);
+        ok &= runHandOver();
+    }
+    catch (std::runtime_error &e)
+    {
+        printf("%s\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    if (!ok)
+    {
+        printf("sample bus check failed\n");
+        return EXIT_FAILURE;
+    }
+    printf("all readers intact\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,391 @@
+/*!
+    @file spi_burst_sim.cpp
+    @brief Host build of the firmware's sensor read against a mocked SPI bus
+
+    Compiles scha63x_spi.cpp, scha63x_driver.cpp and scha63x_spi_frame.cpp
+    of drivers/arduino/scha63x against the Arduino stand-ins of
+    bench/arduino_mock and reads random sensor registers, with an RS
+    error or a wrong CRC now and then, twice per target board:
+
+    - legacy: the previous scha63x_read_data, ten SPI_ASIC_DUE/UNO
+      calls, each its own transaction with two digitalWrites.
+    - burst: scha63x_read_data, the precomputed frames of
+      spi_read_due/spi_read_uno in one transaction per ASIC with the
+      chip select written to its port.
+
+    Reports transactions, frames, pin and port writes and the time of a
+    read on the target from rough per-call costs of the Arduino cores.
+    Then changes the filters with scha63x_set_filter and checks the
+    filter registers of both ASICs against the data sheet layout.
+    Exits with 1 if a read returns other values than the registers
+    hold, the burst read flags other CRC errors than injected, the bus sees a protocol violation, CSB stays high shorter
+    than SPI_FRAME_GAP_US between frames or the burst is not two
+    transactions of ten frames and faster than the legacy read, or if
+    a filter change writes other registers than expected, takes more
+    than one transaction per ASIC or misses an invalid code or a bad
+    read back.
+
+    usage: spi_burst_sim [--reads N] [--target mega|due] [--seed N]
+*/
+
+#include <random>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "scha63x_driver.h"
+#include "scha63x_spi.h"
+#include "scha63x_spi_frame.h"
+#include "scha63x_wire.h"
+#include "arduino_mock.h"
+
+
+/*!
+    \brief Rough cost of the Arduino calls, from the cores' code paths
+
+    Not measured, replace with scope readings of a board for absolute
+    numbers. Transaction and frame counts do not depend on them.
+*/
+static const spi_mock_costs targets[] = {
+    // ATmega2560 at 16 MHz, SCK at most 8 MHz
+    { "mega", 750, 250, 1500, 3400, 250 },
+    // SAM3X8E at 84 MHz, SCK 84 / 9 MHz
+    { "due", 1000, 200, 1500, 1000, 25 },
+};
+
+/*!
+    \brief Registers a sample read covers
+*/
+typedef struct _read_register {
+
+    int asic;                 // SPI_MOCK_DUE or SPI_MOCK_UNO
+    uint8_t address;          // register address in the read frame
+    int16_t scha63x_raw_data::*field;  // sample field it lands in
+    uint8_t crc;              // SCHA63X_WIRE_CRC_* bit of the field
+
+} read_register;
+
+static const read_register registers[] = {
+    { SPI_MOCK_DUE, (SPI_FRAME_READ_GYRO_Y >> 26) & 0x1f, &scha63x_raw_data::gyro_y_lsb, SCHA63X_WIRE_CRC_GYRO_Y },
+    { SPI_MOCK_DUE, (SPI_FRAME_READ_GYRO_Z >> 26) & 0x1f, &scha63x_raw_data::gyro_z_lsb, SCHA63X_WIRE_CRC_GYRO_Z },
+    { SPI_MOCK_DUE, (SPI_FRAME_READ_TEMP >> 26) & 0x1f, &scha63x_raw_data::temp_due_lsb, SCHA63X_WIRE_CRC_TEMP_DUE },
+    { SPI_MOCK_UNO, (SPI_FRAME_READ_GYRO_X >> 26) & 0x1f, &scha63x_raw_data::gyro_x_lsb, SCHA63X_WIRE_CRC_GYRO_X },
+    { SPI_MOCK_UNO, (SPI_FRAME_READ_ACC_X >> 26) & 0x1f, &scha63x_raw_data::acc_x_lsb, SCHA63X_WIRE_CRC_ACC_X },
+    { SPI_MOCK_UNO, (SPI_FRAME_READ_ACC_Y >> 26) & 0x1f, &scha63x_raw_data::acc_y_lsb, SCHA63X_WIRE_CRC_ACC_Y },
+    { SPI_MOCK_UNO, (SPI_FRAME_READ_ACC_Z >> 26) & 0x1f, &scha63x_raw_data::acc_z_lsb, SCHA63X_WIRE_CRC_ACC_Z },
+    { SPI_MOCK_UNO, (SPI_FRAME_READ_TEMP >> 26) & 0x1f, &scha63x_raw_data::temp_uno_lsb, SCHA63X_WIRE_CRC_TEMP_UNO },
+};
+
+/*!
+    \brief Outcome of one read variant on one target
+*/
+typedef struct _read_result {
+
+    spi_mock_counters bus;    // counters of the reads, without SPI_Initialize
+    double max_ns;            // slowest read
+    uint64_t mismatches;      // reads with other values, RS or CRC errors than expected
+    uint64_t crc_errors;      // reads with a CRC error injected
+
+} read_result;
+
+
+/*!
+    \brief Print command line usage
+*/
+static void printUsage(const char *program)
+{
+    printf("usage: %s [--reads N] [--target mega|due] [--seed N]\n"
+           "  --reads N      sensor reads per variant, default 10000\n"
+           "  --target NAME  cost model of one board, default all\n"
+           "  --seed N       random seed of the register contents\n",
+           program);
+}
+
+/*!
+    \brief The previous scha63x_read_data, one SPI transaction per frame
+
+    Did not check the CRC of the frames it read
+*/
+static void readLegacy(scha63x_raw_data *data)
+{
+    SPI_ASIC_DUE(SPI_FRAME_READ_GYRO_Y);
+    uint32_t gyro_y_lsb = SPI_ASIC_DUE(SPI_FRAME_READ_GYRO_Z);
+    uint32_t gyro_z_lsb = SPI_ASIC_DUE(SPI_FRAME_READ_TEMP);
+    uint32_t temp_due_lsb = SPI_ASIC_DUE(SPI_FRAME_READ_TEMP);
+
+    SPI_ASIC_UNO(SPI_FRAME_READ_GYRO_X);
+    uint32_t gyro_x_lsb = SPI_ASIC_UNO(SPI_FRAME_READ_ACC_X);
+    uint32_t acc_x_lsb = SPI_ASIC_UNO(SPI_FRAME_READ_ACC_Y);
+    uint32_t acc_y_lsb = SPI_ASIC_UNO(SPI_FRAME_READ_ACC_Z);
+    uint32_t acc_z_lsb = SPI_ASIC_UNO(SPI_FRAME_READ_TEMP);
+    uint32_t temp_uno_lsb = SPI_ASIC_UNO(SPI_FRAME_READ_TEMP);
+
+    auto rs_error = [](uint32_t miso) { return ((miso >> 24) & 3) != 1; };
+    data->rs_error_due = rs_error(gyro_y_lsb) || rs_error(gyro_z_lsb) || rs_error(temp_due_lsb);
+    data->rs_error_uno = rs_error(gyro_x_lsb) || rs_error(acc_x_lsb) || rs_error(acc_y_lsb) ||
+                         rs_error(acc_z_lsb) || rs_error(temp_uno_lsb);
+
+    data->acc_x_lsb = (int16_t)(acc_x_lsb >> 8);
+    data->acc_y_lsb = (int16_t)(acc_y_lsb >> 8);
+    data->acc_z_lsb = (int16_t)(acc_z_lsb >> 8);
+    data->gyro_x_lsb = (int16_t)(gyro_x_lsb >> 8);
+    data->gyro_y_lsb = (int16_t)(gyro_y_lsb >> 8);
+    data->gyro_z_lsb = (int16_t)(gyro_z_lsb >> 8);
+    data->temp_due_lsb = (int16_t)(temp_due_lsb >> 8);
+    data->temp_uno_lsb = (int16_t)(temp_uno_lsb >> 8);
+}
+
+/*!
+    \brief Read random registers through one read function
+
+    \param costs  target board
+    \param read   readLegacy or scha63x_read_data
+    \param crc    read checks CRCs, inject CRC errors
+    \param reads  number of reads
+    \param seed   register contents, the same for both variants
+    \param result output
+*/
+static void run(const spi_mock_costs &costs, void (*read)(scha63x_raw_data *), bool crc, uint64_t reads,
+                unsigned int seed, read_result &result)
+{
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int> value(-32768, 32767);
+    std::uniform_int_distribution<int> pick(0, sizeof(registers) / sizeof(registers[0]) - 1);
+
+    memset(&result, 0, sizeof(result));
+    spiMockReset(costs);
+    SPI_Initialize();
+    const spi_mock_counters start = spiMockCounters();
+
+    for (uint64_t i = 0; i < reads; i++)
+    {
+        scha63x_raw_data expected;
+        memset(&expected, 0, sizeof(expected));
+        for (const read_register &r : registers)
+        {
+            expected.*r.field = (int16_t)value(random);
+            spiMockSetRegister(r.asic, r.address, (uint16_t)(expected.*r.field), 1);
+        }
+
+        // an RS error on one register of every 64th read
+        if (random() % 64 == 0)
+        {
+            const read_register &r = registers[pick(random)];
+            spiMockSetRegister(r.asic, r.address, (uint16_t)(expected.*r.field), random() % 2 ? 2 : 0);
+            (r.asic == SPI_MOCK_DUE ? expected.rs_error_due : expected.rs_error_uno) = true;
+        }
+
+        // a wrong CRC on one register of every 64th read, drawn for both variants
+        for (const read_register &r : registers)
+            spiMockSetBadCrc(r.asic, r.address, false);
+        if (random() % 64 == 0)
+        {
+            const read_register &r = registers[pick(random)];
+            if (crc)
+            {
+                spiMockSetBadCrc(r.asic, r.address, true);
+                expected.crc_errors = r.crc;
+                result.crc_errors++;
+            }
+        }
+
+        const double before = spiMockCounters().time_ns;
+        scha63x_raw_data data;
+        memset(&data, 0, sizeof(data));
+        read(&data);
+        const double took = spiMockCounters().time_ns - before;
+        if (took > result.max_ns)
+            result.max_ns = took;
+
+        bool same = data.rs_error_due == expected.rs_error_due && data.rs_error_uno == expected.rs_error_uno &&
+                    data.crc_errors == expected.crc_errors;
+        for (const read_register &r : registers)
+            same &= data.*r.field == expected.*r.field;
+        result.mismatches += !same;
+    }
+
+    result.bus = spiMockCounters();
+    result.bus.transactions -= start.transactions;
+    result.bus.frames -= start.frames;
+    result.bus.bytes -= start.bytes;
+    result.bus.pin_writes -= start.pin_writes;
+    result.bus.port_writes -= start.port_writes;
+    result.bus.time_ns -= start.time_ns;
+}
+
+/*!
+    \brief Filter register contents, data sheet 6.2.8 and 6.2.12
+
+    \param config filter configuration
+    \param rate   output, register 16h
+    \param acc    output, register 1Ah
+*/
+static void filterRegisters(const scha63x_sensor_config &config, uint16_t &rate, uint16_t &acc)
+{
+    rate = (uint16_t)(config.gyro_filter.Rz2_Rx2 << 11 | config.gyro_filter.Rz_Rx << 8 |
+                      config.gyro_filter.Ry << 3 | config.gyro_filter.Ry2);
+    acc = (uint16_t)(config.acc_filter.Ax << 8 | config.acc_filter.Ay << 4 | config.acc_filter.Az);
+}
+
+/*!
+    \brief Live filter changes through scha63x_set_filter
+
+    \param costs target board
+    \return false if a register, the bus use or a status is wrong
+*/
+static bool checkFilter(const spi_mock_costs &costs)
+{
+    // all 46 Hz like the precomputed frames, acc and gyro apart, every axis its own
+    const scha63x_sensor_config configs[] = {
+        { { 2, 2, 2 }, { 2, 2, 2, 2 } },
+        { { 3, 3, 3 }, { 4, 4, 4, 4 } },
+        { { 0, 1, 2 }, { 3, 4, 0, 1 } },
+    };
+    const uint16_t settle[] = { 22, 5, 77 };
+
+    spiMockReset(costs);
+    SPI_Initialize();
+    bool ok = true;
+    double max_ns = 0;
+    for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++)
+    {
+        const spi_mock_counters before = spiMockCounters();
+        uint16_t settle_ms = 0;
+        const int status = scha63x_set_filter(&configs[i], &settle_ms);
+        const spi_mock_counters &after = spiMockCounters();
+        if (after.time_ns - before.time_ns > max_ns)
+            max_ns = after.time_ns - before.time_ns;
+
+        uint16_t rate, acc;
+        filterRegisters(configs[i], rate, acc);
+        if (status != SCHA63X_OK || settle_ms != settle[i] || spiMockRegister(SPI_MOCK_UNO, GYRO_REG) != rate ||
+            spiMockRegister(SPI_MOCK_DUE, GYRO_REG) != rate || spiMockRegister(SPI_MOCK_UNO, ACC_REG) != acc ||
+            after.transactions - before.transactions != 2 || after.errors != before.errors)
+        {
+            fprintf(stderr, "%s: filter change %zu status %d, settling %u ms, rate %04x %04x, acc %04x\n",
+                    costs.name, i, status, settle_ms, spiMockRegister(SPI_MOCK_UNO, GYRO_REG),
+                    spiMockRegister(SPI_MOCK_DUE, GYRO_REG), spiMockRegister(SPI_MOCK_UNO, ACC_REG));
+            ok = false;
+        }
+    }
+
+    // the layout above against the precomputed 46 Hz frames
+    uint16_t rate, acc;
+    filterRegisters(configs[0], rate, acc);
+    ok &= rate == (uint16_t)(SPI_FRAME_WRITE_FILTER_46HZ_RATE >> 8) &&
+          acc == (uint16_t)(SPI_FRAME_WRITE_FILTER_46HZ_ACC >> 8);
+
+    // nothing goes out for an invalid code
+    scha63x_sensor_config invalid = configs[1];
+    invalid.gyro_filter.Ry = 5;
+    uint16_t settle_ms = 0;
+    const uint64_t frames = spiMockCounters().frames;
+    ok &= scha63x_set_filter(&invalid, &settle_ms) == SCHA63X_ERR_FILTER && spiMockCounters().frames == frames;
+
+    // a read back with a wrong CRC fails the change
+    spiMockSetBadCrc(SPI_MOCK_DUE, GYRO_REG, true);
+    ok &= scha63x_set_filter(&configs[0], &settle_ms) == SCHA63X_ERR_FILTER;
+    spiMockSetBadCrc(SPI_MOCK_DUE, GYRO_REG, false);
+
+    printf("  filter  %.1f us per change, 2 transactions, startup skipped\n", max_ns / 1000);
+    if (!ok)
+        fprintf(stderr, "%s: filter change check failed\n", costs.name);
+    return ok;
+}
+
+/*!
+    \brief Print one variant, per read
+*/
+static void print(const char *name, const read_result &result, uint64_t reads)
+{
+    const spi_mock_counters &bus = result.bus;
+    printf("  %-7s %4.1f transactions, %4.1f frames, %4.1f pin writes, %4.1f port writes, %4.1f bytes, "
+           "%6.1f us per read (max %.1f), CSB high >= %.2f us\n",
+           name, (double)bus.transactions / reads, (double)bus.frames / reads, (double)bus.pin_writes / reads,
+           (double)bus.port_writes / reads, (double)bus.bytes / reads, bus.time_ns / reads / 1000,
+           result.max_ns / 1000, bus.min_gap_ns / 1000);
+}
+
+
+int main(int argc, char **argv)
+{
+    uint64_t reads = 10000;
+    const char *target = nullptr;
+    unsigned int seed = 1;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (strcmp(argv[i], "--reads") == 0 && value)
+            reads = strtoull(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--target") == 0 && value)
+            target = argv[++i];
+        else if (strcmp(argv[i], "--seed") == 0 && value)
+            seed = (unsigned int)strtoul(argv[++i], nullptr, 10);
+        else
+        {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (reads == 0)
+    {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    bool ok = true, found = false;
+    for (const spi_mock_costs &costs : targets)
+    {
+        if (target && strcmp(target, costs.name) != 0)
+            continue;
+        found = true;
+
+        read_result legacy, burst;
+        run(costs, readLegacy, false, reads, seed, legacy);
+        run(costs, scha63x_read_data, true, reads, seed, burst);
+
+        printf("%s, %llu reads, %llu with a CRC error\n", costs.name, (unsigned long long)reads,
+               (unsigned long long)burst.crc_errors);
+        print("legacy", legacy, reads);
+        print("burst", burst, reads);
+        const double burst_us = burst.bus.time_ns / reads / 1000;
+        printf("  burst %.2fx faster, a read takes %.1f %% of the %d Hz sample period\n",
+               legacy.bus.time_ns / burst.bus.time_ns, burst_us * IMU_SAMPLING_RATE / 1e4,
+               IMU_SAMPLING_RATE);
+
+        if (legacy.mismatches || burst.mismatches || legacy.bus.errors || burst.bus.errors)
+        {
+            fprintf(stderr, "%s: %llu legacy and %llu burst reads wrong, %llu and %llu bus errors\n", costs.name,
+                    (unsigned long long)legacy.mismatches, (unsigned long long)burst.mismatches,
+                    (unsigned long long)legacy.bus.errors, (unsigned long long)burst.bus.errors);
+            ok = false;
+        }
+        if (burst.bus.transactions != 2 * reads ||
+            burst.bus.frames != (uint64_t)(SPI_READ_FRAMES_DUE + SPI_READ_FRAMES_UNO) * reads ||
+            burst.bus.pin_writes != 0 || burst.bus.time_ns >= legacy.bus.time_ns)
+        {
+            fprintf(stderr, "%s: burst is not two transactions of port written frames, faster than legacy\n",
+                    costs.name);
+            ok = false;
+        }
+        ok &= checkFilter(costs);
+        if (burst.bus.min_gap_ns < 1000.0 * SPI_FRAME_GAP_US)
+        {
+            fprintf(stderr, "%s: CSB high for %.0f ns between frames, SPI_FRAME_GAP_US is %d\n", costs.name,
+                    burst.bus.min_gap_ns, SPI_FRAME_GAP_US);
+            ok = false;
+        }
+    }
+
+    if (!found)
+    {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (!ok)
+        fprintf(stderr, "SPI burst check failed\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,563 @@
+/*!
+    @file udp_recorder_bench.cpp
+    @brief Stage by stage throughput of the recorder's data path
+
+    Encodes the samples of a binary recording (or a synthetic
+    stationary board at the default sample rate) once into raw and
+    delta datagrams of the boards' batch size, then replays them
+    through every stage of the data path: wire decode, scalar
+    conversion, scalar cross-axis compensation, the batch kernel with
+    a board's CAC values, camera frame group creation, and the JSONL,
+    binary and shared memory sinks. Every case runs several times,
+    the fastest run counts.
+
+    Results are written as JSON (--json), a stored result is the
+    baseline of a later run (--baseline): cases slower than the
+    baseline by more than the tolerance are reported and the bench
+    exits with 1. Also exits with 1 if a datagram does not decode
+    back to its samples.
+
+    usage: udp_recorder_bench [options], check printUsage()
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <jsonl-recorder/recorder.hpp>
+
+#include "defs.h"
+#include "config.h"
+#include "conversion.h"
+#include "scha63x_wire.h"
+#include "wire_decode.h"
+#include "jsonl_output.h"
+#include "binary_recording.h"
+#include "session_reader.h"
+#include "shm_publisher.h"
+#include "fan_in.h"
+
+
+/*! \brief samples handed to a writer at a time, like the fan-in workers */
+#define bench_batch 256
+
+/*! \brief version of the JSON result, baselines of another version are refused */
+#define bench_format 1
+
+
+/*!
+    \brief Timing of one case
+*/
+typedef struct _bench_case {
+
+    std::string name;
+    const char *unit;     // what an item is
+    uint64_t items;       // per run
+    double best_ns;       // fastest run, per item
+    double median_ns;     // median run, per item
+
+} bench_case;
+
+/*!
+    \brief Datagrams of all samples in one encoding
+*/
+typedef struct _bench_datagrams {
+
+    std::vector<uint8_t> bytes;    // datagrams back to back
+    std::vector<size_t> offset;    // start of every datagram in bytes
+    std::vector<size_t> size;      // length of every datagram
+
+} bench_datagrams;
+
+
+/*! \brief keeps the timed loops from being optimized away */
+static volatile double checksum = 0;
+
+
+/*!
+    \brief Print command line usage
+*/
+static void printUsage(const char *program)
+{
+    printf("usage: %s [options]\n"
+           "  --input FILE       replay the samples of a binary recording, default synthetic\n"
+           "  --samples N        synthetic samples, default 100000\n"
+           "  --batch N          samples per datagram, default %d, at most %d\n"
+           "  --repeat N         runs per case, default 5\n"
+           "  --dir DIR          sink output files, default /tmp\n"
+           "  --json FILE        write the results as JSON, - for stdout\n"
+           "  --baseline FILE    compare against a stored JSON result\n"
+           "  --tolerance F      allowed slowdown against the baseline, default 0.15\n",
+           program, imu_buffer_size, SCHA63X_WIRE_MAX_SAMPLES);
+}
+
+/*!
+    \brief Stationary board with sensor noise of a few LSB, 1 g on z
+*/
+static std::vector<scha63x_raw_data> syntheticSamples(size_t count)
+{
+    std::mt19937 rng(1);
+    std::normal_distribution<double> noise(0.0, 3.0);
+    std::vector<scha63x_raw_data> samples(count);
+    const int64_t period = 1000000 / imu_trigger_rate;
+    for (size_t i = 0; i < count; i++)
+    {
+        scha63x_raw_data &s = samples[i];
+        memset(&s, 0, sizeof(s));
+        s.timeStamp = 1000000 + (int64_t)i * period + (int64_t)(rng() % 5) - 2;
+        s.acc_x_lsb = (int16_t)lround(noise(rng));
+        s.acc_y_lsb = (int16_t)lround(noise(rng));
+        s.acc_z_lsb = (int16_t)lround(SENSITIVITY_ACC + noise(rng));
+        s.gyro_x_lsb = (int16_t)lround(noise(rng));
+        s.gyro_y_lsb = (int16_t)lround(noise(rng));
+        s.gyro_z_lsb = (int16_t)lround(noise(rng));
+        s.temp_due_lsb = s.temp_uno_lsb = (int16_t)(-1000 + i / 100000);
+        s.cam_trigger = i % (imu_trigger_rate / cam_trigger_rate) == 0;
+    }
+    return samples;
+}
+
+/*!
+    \brief Cut the samples into datagrams of batch samples
+
+    \param delta delta encoded, falling back to raw like the firmware
+*/
+static bench_datagrams encode(const std::vector<scha63x_raw_data> &samples, int batch, bool delta)
+{
+    bench_datagrams out;
+    const size_t stride = SCHA63X_WIRE_PACKET_SIZE(batch);
+    const size_t packets = samples.size() / batch;
+    out.bytes.resize(packets * stride);
+
+    scha63x_packet_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SCHA63X_PACKET_MAGIC;
+    header.version = SCHA63X_PACKET_VERSION;
+    header.count = (uint8_t)batch;
+
+    size_t used = 0;
+    for (size_t b = 0; b < packets; b++)
+    {
+        header.sequence = (uint32_t)b;
+        header.send_time = (uint32_t)samples[b * batch + batch - 1].timeStamp;
+
+        uint8_t *p = &out.bytes[used];
+        size_t bytes = delta ? scha63x_wire_put_delta_packet(p, stride, &header, &samples[b * batch]) : 0;
+        if (bytes == 0)
+            bytes = scha63x_wire_put_packet(p, &header, &samples[b * batch]);
+        out.offset.push_back(used);
+        out.size.push_back(bytes);
+        used += bytes;
+    }
+    out.bytes.resize(used);
+    return out;
+}
+
+static bool sameSample(const scha63x_raw_data &a, const scha63x_raw_data &b)
+{
+    return a.timeStamp == b.timeStamp &&
+           a.acc_x_lsb == b.acc_x_lsb && a.acc_y_lsb == b.acc_y_lsb && a.acc_z_lsb == b.acc_z_lsb &&
+           a.gyro_x_lsb == b.gyro_x_lsb && a.gyro_y_lsb == b.gyro_y_lsb && a.gyro_z_lsb == b.gyro_z_lsb &&
+           a.temp_due_lsb == b.temp_due_lsb && a.temp_uno_lsb == b.temp_uno_lsb &&
+           a.rs_error_due == b.rs_error_due && a.rs_error_uno == b.rs_error_uno &&
+           a.cam_trigger == b.cam_trigger && a.ubx_trigger == b.ubx_trigger && a.crc_errors == b.crc_errors;
+}
+
+/*!
+    \brief Decode all datagrams back to back, as the receive thread does
+
+    \return number of samples decoded, datagrams that fail the check are skipped
+*/
+static size_t decode(const bench_datagrams &datagrams, scha63x_raw_data *out)
+{
+    size_t n = 0;
+    for (size_t d = 0; d < datagrams.offset.size(); d++)
+    {
+        const uint8_t *p = &datagrams.bytes[datagrams.offset[d]];
+        scha63x_packet_header header;
+        const int count = scha63x_wire_check(p, datagrams.size[d], &header);
+        if (count <= 0)
+            continue;
+        scha63x_decode_samples(p, &header, 0, count, out + n);
+        n += count;
+    }
+    return n;
+}
+
+/*!
+    \brief Time a case, the fastest and the median run are kept
+
+    \param name    case name in the results
+    \param unit    what an item is
+    \param items   items processed by one run
+    \param repeats runs
+    \param run     one run
+*/
+static bench_case timeCase(const char *name, const char *unit, uint64_t items, int repeats,
+                           const std::function<void()> &run)
+{
+    std::vector<double> runs;
+    for (int r = 0; r < repeats; r++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        runs.push_back(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::sort(runs.begin(), runs.end());
+
+    bench_case result;
+    result.name = name;
+    result.unit = unit;
+    result.items = items;
+    result.best_ns = runs.front() / items;
+    result.median_ns = runs[runs.size() / 2] / items;
+    return result;
+}
+
+/*!
+    \brief Write the results as JSON, one case per line
+*/
+static void writeJson(FILE *file, const std::vector<bench_case> &cases, const std::string &input,
+                      size_t samples, int batch, int repeats)
+{
+    fprintf(file, "{\n");
+    fprintf(file, "  \"bench\": \"udp_recorder_bench\",\n");
+    fprintf(file, "  \"format\": %d,\n", bench_format);
+    fprintf(file, "  \"input\": \"%s\",\n", input.c_str());
+    fprintf(file, "  \"samples\": %lu,\n", (unsigned long)samples);
+    fprintf(file, "  \"batch\": %d,\n", batch);
+    fprintf(file, "  \"repeats\": %d,\n", repeats);
+    fprintf(file, "  \"convert_isa\": \"%s\",\n", scha63x_convert_batch_isa());
+    fprintf(file, "  \"decode_isa\": \"%s\",\n", scha63x_decode_isa());
+    fprintf(file, "  \"cases\": [\n");
+    for (size_t i = 0; i < cases.size(); i++)
+    {
+        const bench_case &c = cases[i];
+        fprintf(file, "    {\"name\": \"%s\", \"unit\": \"%s\", \"items\": %llu, \"ns_per_item\": %.3f, "
+                "\"median_ns_per_item\": %.3f, \"items_per_s\": %.0f}%s\n",
+                c.name.c_str(), c.unit, (unsigned long long)c.items, c.best_ns, c.median_ns,
+                c.best_ns > 0 ? 1e9 / c.best_ns : 0.0, i + 1 < cases.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+}
+
+/*!
+    \brief Read the cases of a JSON result written by writeJson()
+
+    \param path      stored result
+    \param cases     output, name and ns_per_item of every case
+    \param convert   output, convert_isa of the stored run
+    \return false if the file can not be read or is of another format
+*/
+static bool readBaseline(const std::string &path, std::vector<bench_case> &cases, std::string &convert)
+{
+    FILE *file = fopen(path.c_str(), "r");
+    if (!file)
+        return false;
+
+    int format = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), file))
+    {
+        char text[64];
+        const char *value;
+        if (sscanf(line, " \"format\": %d", &format) == 1)
+            continue;
+        if (sscanf(line, " \"convert_isa\": \"%63[^\"]\"", text) == 1)
+            convert = text;
+        else if (sscanf(line, " {\"name\": \"%63[^\"]\"", text) == 1 && (value = strstr(line, "\"ns_per_item\": ")))
+        {
+            bench_case c;
+            c.name = text;
+            c.unit = "";
+            c.items = 0;
+            c.best_ns = strtod(value + strlen("\"ns_per_item\": "), nullptr);
+            c.median_ns = 0;
+            cases.push_back(c);
+        }
+    }
+    fclose(file);
+    return format == bench_format;
+}
+
+/*!
+    \brief Print the change of every case against the baseline
+
+    \param out table output
+
+    \return number of cases slower than the baseline by more than tolerance
+*/
+static int compare(FILE *out, const std::vector<bench_case> &cases, const std::vector<bench_case> &baseline,
+                   double tolerance)
+{
+    int regressions = 0;
+    fprintf(out, "\n%-20s %14s %14s %9s\n", "case", "baseline ns", "now ns", "change");
+    for (const bench_case &c : cases)
+    {
+        auto b = std::find_if(baseline.begin(), baseline.end(),
+                              [&c](const bench_case &x) { return x.name == c.name; });
+        if (b == baseline.end() || b->best_ns <= 0)
+        {
+            fprintf(out, "%-20s %14s %14.2f %9s\n", c.name.c_str(), "-", c.best_ns, "new");
+            continue;
+        }
+        const double change = c.best_ns / b->best_ns - 1;
+        const bool slower = change > tolerance;
+        regressions += slower;
+        fprintf(out, "%-20s %14.2f %14.2f %+8.1f%%%s\n", c.name.c_str(), b->best_ns, c.best_ns, 100 * change,
+               slower ? "  REGRESSION" : "");
+    }
+    return regressions;
+}
+
+
+int main(int argc, char **argv)
+{
+    std::string input, dir = "/tmp", json, baselinePath;
+    size_t count = 100000;
+    int batch = imu_buffer_size, repeats = 5;
+    double tolerance = 0.15;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const bool value = i + 1 < argc;
+        if (strcmp(argv[i], "--input") == 0 && value)
+            input = argv[++i];
+        else if (strcmp(argv[i], "--samples") == 0 && value)
+            count = strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--batch") == 0 && value)
+            batch = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--repeat") == 0 && value)
+            repeats = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--dir") == 0 && value)
+            dir = argv[++i];
+        else if (strcmp(argv[i], "--json") == 0 && value)
+            json = argv[++i];
+        else if (strcmp(argv[i], "--baseline") == 0 && value)
+            baselinePath = argv[++i];
+        else if (strcmp(argv[i], "--tolerance") == 0 && value)
+            tolerance = strtod(argv[++i], nullptr);
+        else
+        {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (batch < 1 || batch > SCHA63X_WIRE_MAX_SAMPLES || repeats < 1)
+    {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // with the JSON on stdout the table goes to stderr
+    FILE *out = json == "-" ? stderr : stdout;
+
+    std::vector<scha63x_raw_data> samples;
+    scha63x_cacv cacv;
+    memset(&cacv, 0, sizeof(cacv));
+    cacv.bxx = cacv.byy = cacv.bzz = cacv.cxx = cacv.cyy = cacv.czz = 1;
+    cacv.cxy = cacv.byx = 0.01f;
+    cacv.czx = cacv.bzy = -0.005f;
+
+    try
+    {
+        if (!input.empty())
+        {
+            BinarySession session(input);
+            session.query(-INFINITY, INFINITY, [&samples](const scha63x_raw_data *s, size_t n) {
+                samples.insert(samples.end(), s, s + n);
+            });
+            cacv = session.header().cacv;
+        }
+        else
+            samples = syntheticSamples(count);
+    }
+    catch (std::runtime_error &e)
+    {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    // whole datagrams only
+    samples.resize(samples.size() / batch * batch);
+    if (samples.size() < bench_batch)
+    {
+        std::cerr << "Need at least " << bench_batch << " samples\n";
+        return EXIT_FAILURE;
+    }
+    count = samples.size();
+    cacvValues(cacv);
+
+    fprintf(out, "%s: %lu samples, %d per datagram, best of %d runs, convert %s, decode %s\n",
+            input.empty() ? "synthetic stationary board" : input.c_str(), (unsigned long)count, batch,
+            repeats, scha63x_convert_batch_isa(), scha63x_decode_isa());
+
+    std::vector<bench_case> cases;
+    bool ok = true;
+
+    // wire decode, every datagram checked and decoded into one buffer
+    std::vector<scha63x_raw_data> decoded(count);
+    for (int delta = 0; delta < 2; delta++)
+    {
+        const bench_datagrams datagrams = encode(samples, batch, delta);
+        cases.push_back(timeCase(delta ? "decode_delta" : "decode_raw", "sample", count, repeats, [&]() {
+            checksum += decode(datagrams, decoded.data());
+        }));
+
+        memset(decoded.data(), 0, count * sizeof(scha63x_raw_data));
+        size_t mismatch = decode(datagrams, decoded.data()) == count ? 0 : count;
+        for (size_t i = 0; i < count && mismatch == 0; i++)
+            mismatch += !sameSample(samples[i], decoded[i]);
+        if (mismatch)
+        {
+            fprintf(stderr, "%s datagrams do not decode back to their samples\n", delta ? "delta" : "raw");
+            ok = false;
+        }
+    }
+
+    // scalar path, one sample at a time with the global CAC values
+    std::vector<scha63x_real_data> real(count);
+    cases.push_back(timeCase("convert_scalar", "sample", count, repeats, [&]() {
+        for (size_t i = 0; i < count; i++)
+            scha63x_convert_data(&samples[i], &real[i]);
+        checksum += real[count - 1].acc_z;
+    }));
+    std::vector<scha63x_real_data> converted = real;
+    cases.push_back(timeCase("compensate_scalar", "sample", count, repeats, [&]() {
+        for (size_t i = 0; i < count; i++)
+        {
+            real[i] = converted[i];
+            scha63x_cross_axis_compensation(&real[i]);
+        }
+        checksum += real[count - 1].acc_z;
+    }));
+
+    // batch kernel with the board's CAC values, as the writers use it
+    std::vector<float> channels[8];
+    for (auto &channel : channels)
+        channel.resize(bench_batch);
+    scha63x_real_batch out_batch = { channels[0].data(), channels[1].data(), channels[2].data(), channels[3].data(),
+                                     channels[4].data(), channels[5].data(), channels[6].data(), channels[7].data() };
+    cases.push_back(timeCase("convert_batch", "sample", count, repeats, [&]() {
+        for (size_t i = 0; i < count; i += bench_batch)
+            scha63x_convert_batch_cacv(&samples[i], std::min<size_t>(bench_batch, count - i), &cacv, &out_batch);
+        checksum += out_batch.acc_z[0];
+    }));
+
+    try
+    {
+        const std::string jsonlPath = dir + "/udp_recorder_bench.jsonl";
+        const std::string binPath = dir + "/udp_recorder_bench.bin";
+
+        auto recordJsonl = [&](const std::vector<scha63x_raw_data> &data) {
+            auto recorder = recorder::Recorder::build(jsonlPath);
+            JsonlSampleWriter writer(*recorder, data[0].timeStamp, &cacv);
+            for (size_t i = 0; i < count; i += bench_batch)
+                writer.write(&data[i], std::min<size_t>(bench_batch, count - i));
+        };
+
+        // frame groups: the same samples with a camera trigger on every
+        // other sample, a rising edge each, and on none, the difference
+        // is the cost of the groups
+        std::vector<scha63x_raw_data> triggered = samples, untriggered = samples;
+        for (size_t i = 0; i < count; i++)
+        {
+            triggered[i].cam_trigger = i % 2 == 0;
+            untriggered[i].cam_trigger = 0;
+        }
+        const uint64_t groups = (count + 1) / 2;
+        bench_case with = timeCase("frame_group", "frame group", groups, repeats, [&]() { recordJsonl(triggered); });
+        bench_case without = timeCase("frame_group", "frame group", groups, repeats, [&]() { recordJsonl(untriggered); });
+        with.best_ns = std::max(0.0, with.best_ns - without.best_ns);
+        with.median_ns = std::max(0.0, with.median_ns - without.median_ns);
+        cases.push_back(with);
+
+        // sinks, writer construction and closing the file included
+        cases.push_back(timeCase("sink_jsonl", "sample", count, repeats, [&]() { recordJsonl(samples); }));
+
+        scha63x_sensor_config config;
+        memset(&config, 0, sizeof(config));
+        cases.push_back(timeCase("sink_binary", "sample", count, repeats, [&]() {
+            BinaryRecorder writer(binPath, makeBinaryHeader("bench", cacv, config, samples[0].timeStamp));
+            for (size_t i = 0; i < count; i += bench_batch)
+                writer.addSamples(&samples[i], std::min<size_t>(bench_batch, count - i));
+        }));
+
+        ShmBusPublisher bus("/udp_recorder_bench", 1);
+        board_info board;
+        memset(&board.from, 0, sizeof(board.from));
+        memset(&board.specs, 0, sizeof(board.specs));
+        board.index = 0;
+        board.serial = "bench";
+        board.config = config;
+        board.cacv = cacv;
+        board.cac_cached = false;
+        board.first_timestamp = samples[0].timeStamp;
+        board.clock = nullptr;
+        ShmSampleWriter shm(bus, board);
+        cases.push_back(timeCase("sink_shm", "sample", count, repeats, [&]() {
+            for (size_t i = 0; i < count; i += bench_batch)
+                shm.write(&samples[i], std::min<size_t>(bench_batch, count - i));
+        }));
+
+        remove(jsonlPath.c_str());
+        remove(binPath.c_str());
+    }
+    catch (std::runtime_error &e)
+    {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    fprintf(out, "%-20s %12s %12s %14s\n", "case", "ns/item", "median ns", "items/s");
+    for (const bench_case &c : cases)
+        fprintf(out, "%-20s %12.2f %12.2f %14.0f  per %s\n", c.name.c_str(), c.best_ns, c.median_ns,
+                c.best_ns > 0 ? 1e9 / c.best_ns : 0.0, c.unit);
+
+    if (!json.empty())
+    {
+        FILE *file = json == "-" ? stdout : fopen(json.c_str(), "w");
+        if (!file)
+        {
+            fprintf(stderr, "Can not write %s\n", json.c_str());
+            return EXIT_FAILURE;
+        }
+        writeJson(file, cases, input.empty() ? "synthetic" : input, count, batch, repeats);
+        if (file != stdout)
+            fclose(file);
+    }
+
+    if (!baselinePath.empty())
+    {
+        std::vector<bench_case> baseline;
+        std::string convert;
+        if (!readBaseline(baselinePath, baseline, convert))
+        {
+            fprintf(stderr, "Can not read baseline %s\n", baselinePath.c_str());
+            return EXIT_FAILURE;
+        }
+        if (convert != scha63x_convert_batch_isa())
+            fprintf(stderr, "Baseline converts with %s, this run with %s\n", convert.c_str(),
+                    scha63x_convert_batch_isa());
+
+        const int regressions = compare(out, cases, baseline, tolerance);
+        if (regressions)
+        {
+            fprintf(stderr, "%d cases slower than the baseline by more than %.0f%%\n", regressions, 100 * tolerance);
+            ok = false;
+        }
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
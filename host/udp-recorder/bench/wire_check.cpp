@@ -0,0 +1,480 @@
+/*!
+    @file wire_check.cpp
+    @brief Round-trip and fuzz checks of the UDP wire format
+
+    Checks the byte layout against fixed datagrams and a filter
+    command, encodes and
+    decodes random batches of every size in both encodings, feeds
+    random and mutated datagrams through scha63x_wire_check, both
+    delta decoders and a loopback BatchReceiver, and reports the raw
+    decoder throughput. Exits with 1 on any mismatch.
+
+    usage: wire_check [iterations] [seed]
+*/
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "defs.h"
+#include "config.h"
+#include "receiver.h"
+#include "scha63x_wire.h"
+#include "wire_decode.h"
+
+
+static int failures = 0;
+
+/*!
+    \brief Count and report a failed check
+*/
+static void check(bool ok, const char *what, uint64_t iteration)
+{
+    if (ok)
+        return;
+    if (failures < 20)
+        fprintf(stderr, "FAIL %s, iteration %lu\n", what, (unsigned long)iteration);
+    failures++;
+}
+
+/*!
+    \brief Field by field comparison, padding bytes are not transmitted
+*/
+static bool sameSample(const scha63x_raw_data &a, const scha63x_raw_data &b)
+{
+    return a.timeStamp == b.timeStamp &&
+           a.acc_x_lsb == b.acc_x_lsb && a.acc_y_lsb == b.acc_y_lsb && a.acc_z_lsb == b.acc_z_lsb &&
+           a.gyro_x_lsb == b.gyro_x_lsb && a.gyro_y_lsb == b.gyro_y_lsb && a.gyro_z_lsb == b.gyro_z_lsb &&
+           a.temp_due_lsb == b.temp_due_lsb && a.temp_uno_lsb == b.temp_uno_lsb &&
+           a.rs_error_due == b.rs_error_due && a.rs_error_uno == b.rs_error_uno &&
+           a.cam_trigger == b.cam_trigger && a.ubx_trigger == b.ubx_trigger && a.crc_errors == b.crc_errors;
+}
+
+static scha63x_packet_header makeHeader(int count, uint32_t sequence)
+{
+    scha63x_packet_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SCHA63X_PACKET_MAGIC;
+    header.version = SCHA63X_PACKET_VERSION;
+    header.count = (uint8_t)count;
+    header.sequence = sequence;
+    return header;
+}
+
+/*!
+    \brief Any values, worst case for the delta encoding
+*/
+static void randomSample(std::mt19937_64 &rng, scha63x_raw_data &s)
+{
+    memset(&s, 0, sizeof(s));
+    s.timeStamp = (int64_t)rng();
+    s.acc_x_lsb = (int16_t)rng();
+    s.acc_y_lsb = (int16_t)rng();
+    s.acc_z_lsb = (int16_t)rng();
+    s.gyro_x_lsb = (int16_t)rng();
+    s.gyro_y_lsb = (int16_t)rng();
+    s.gyro_z_lsb = (int16_t)rng();
+    s.temp_due_lsb = (int16_t)rng();
+    s.temp_uno_lsb = (int16_t)rng();
+    const uint64_t flags = rng();
+    s.rs_error_due = flags & 1;
+    s.rs_error_uno = flags & 2;
+    s.cam_trigger = flags & 4;
+    s.ubx_trigger = flags & 8;
+    s.crc_errors = flags % 64 == 0 ? (uint8_t)(flags >> 8) : 0;
+}
+
+/*!
+    \brief Batch of random samples or a random walk of random roughness
+
+    Walks cover every bit width from 0 up to full int16 jumps
+*/
+static void randomBatch(std::mt19937_64 &rng, int count, std::vector<scha63x_raw_data> &samples)
+{
+    if (rng() % 4 == 0)
+    {
+        for (int s = 0; s < count; s++)
+            randomSample(rng, samples[s]);
+        return;
+    }
+
+    const int bits = rng() % 17;
+    const int ts_bits = rng() % 24;
+    for (int s = 0; s < count; s++)
+    {
+        randomSample(rng, samples[s]);
+        if (s == 0)
+            continue;
+
+        const scha63x_raw_data &prev = samples[s - 1];
+        const int64_t ts_noise = ts_bits ? (int64_t)(rng() % (1ULL << ts_bits)) - (1 << (ts_bits - 1)) : 0;
+        samples[s].timeStamp = prev.timeStamp + 2000 + ts_noise;
+        for (int c = 0; c < SCHA63X_WIRE_DELTA_CHANNELS; c++)
+        {
+            const int noise = bits ? (int)(rng() % (1u << bits)) - (1 << (bits - 1)) : 0;
+            scha63x_wire_set_channel(&samples[s], c, (int16_t)(uint16_t)(scha63x_wire_channel(&prev, c) + noise));
+        }
+    }
+}
+
+/*!
+    \brief Encode like the firmware, delta if asked for and possible
+
+    \return datagram size
+*/
+static size_t encode(uint8_t *p, size_t capacity, const scha63x_packet_header &header,
+                     const scha63x_raw_data *samples, bool delta)
+{
+    size_t bytes = delta ? scha63x_wire_put_delta_packet(p, capacity, &header, samples) : 0;
+    return bytes ? bytes : scha63x_wire_put_packet(p, &header, samples);
+}
+
+/*!
+    \brief Encoding of fixed batches, byte by byte
+*/
+static void checkLayout(void)
+{
+    scha63x_packet_header header = makeHeader(1, 0x04030201);
+    header.send_time = 0x08070605;
+    scha63x_raw_data sample[2];
+    memset(sample, 0, sizeof(sample));
+    sample[0].timeStamp = 0x1112131415161718LL;
+    sample[0].acc_x_lsb = 0x2122;
+    sample[0].acc_y_lsb = -2;
+    sample[0].temp_uno_lsb = 0x3132;
+    sample[0].cam_trigger = true;
+    sample[0].ubx_trigger = true;
+    sample[0].crc_errors = SCHA63X_WIRE_CRC_GYRO_Z | SCHA63X_WIRE_CRC_TEMP_UNO;
+
+    const uint8_t raw[SCHA63X_WIRE_PACKET_SIZE(1)] = {
+        0x3C, 0xA6, SCHA63X_PACKET_VERSION, 1, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0, 0, 0, 0,
+        0x18, 0x17, 0x16, 0x15, 0x14, 0x13, 0x12, 0x11,
+        0x22, 0x21, 0xFE, 0xFF, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x32, 0x31,
+        0x0C, 0xA0};
+
+    uint8_t packet[SCHA63X_WIRE_PACKET_SIZE(2)];
+    check(scha63x_wire_put_packet(packet, &header, sample) == sizeof(raw), "layout size", 0);
+    check(memcmp(packet, raw, sizeof(raw)) == 0, "layout bytes", 0);
+
+    // second sample 2000 us later, acc x down by 3 (zigzag 5, 3 bits), camera trigger
+    header.count = 2;
+    sample[1] = sample[0];
+    sample[1].timeStamp += 2000;
+    sample[1].acc_x_lsb -= 3;
+    sample[1].ubx_trigger = false;
+    sample[1].crc_errors = 0;
+    const uint8_t delta[] = {
+        0xD0, 0x07, 0x00, 0x00,  // step
+        0,                       // timestamp residual width
+        3, 0, 0, 0, 0, 0, 0, 0,  // channel widths
+        0x05 | (0x04 << 3)};     // acc x code 5, flags nibble 0x4
+
+    const size_t bytes = scha63x_wire_put_delta_packet(packet, sizeof(packet), &header, sample);
+    check(bytes == SCHA63X_WIRE_PACKET_SIZE(1) + sizeof(delta), "delta layout size", 0);
+    check(packet[12] == SCHA63X_WIRE_ENCODING_DELTA, "delta layout encoding", 0);
+    check(memcmp(packet + SCHA63X_WIRE_HEADER_SIZE, raw + SCHA63X_WIRE_HEADER_SIZE, SCHA63X_WIRE_SAMPLE_SIZE) == 0,
+          "delta layout first sample", 0);
+    check(memcmp(packet + SCHA63X_WIRE_PACKET_SIZE(1), delta, sizeof(delta)) == 0, "delta layout bytes", 0);
+
+    // CRC errors after the first sample do not fit the flags nibble
+    sample[1].crc_errors = SCHA63X_WIRE_CRC_ACC_X;
+    check(scha63x_wire_put_delta_packet(packet, sizeof(packet), &header, sample) == 0, "delta CRC errors", 0);
+
+    // filter answer, sequence 0x0201, 22 ms settling, SCHA63X_ERR_FILTER
+    scha63x_filter_command command = { -3, 0x0201, 22, { 0, 1, 2, 3, 4, 3, 2 } };
+    const uint8_t filter[SCHA63X_WIRE_FILTER_SIZE] = {
+        0x3D, 0xA6, SCHA63X_PACKET_VERSION, 0xFD, 0x01, 0x02, 22, 0, 0, 1, 2, 3, 4, 3, 2};
+    check(scha63x_wire_put_filter(packet, &command) == sizeof(filter), "filter layout size", 0);
+    check(memcmp(packet, filter, sizeof(filter)) == 0, "filter layout bytes", 0);
+
+    scha63x_filter_command decoded;
+    memset(&decoded, 0, sizeof(decoded));
+    check(scha63x_wire_get_filter(filter, sizeof(filter), &decoded) && decoded.status == command.status &&
+          decoded.sequence == command.sequence && decoded.settle_ms == command.settle_ms &&
+          memcmp(decoded.filter, command.filter, sizeof(command.filter)) == 0, "filter round trip", 0);
+    check(!scha63x_wire_get_filter(filter, sizeof(filter) - 1, &decoded), "filter short", 0);
+    check(!scha63x_wire_get_filter(raw, sizeof(raw), &decoded), "filter sample packet", 0);
+    check(scha63x_wire_check(filter, sizeof(filter), &header) < 0, "filter as sample packet", 0);
+}
+
+/*!
+    \brief Check both delta decoders on a checked datagram
+
+    \param expected encoded samples, nullptr to only compare the decoders
+*/
+static void checkDecoders(const uint8_t *packet, const scha63x_packet_header &header,
+                          const scha63x_raw_data *expected, std::mt19937_64 &rng, uint64_t i)
+{
+    std::vector<scha63x_raw_data> reference(header.count + 1), fast(header.count + 1);
+    scha63x_wire_get_packet(packet, &header, reference.data());
+
+    // whole batch and a random span, like a ring push that wraps
+    scha63x_decode_samples(packet, &header, 0, header.count, fast.data());
+    for (int s = 0; s < header.count; s++)
+    {
+        check(sameSample(reference[s], fast[s]), "decoders agree", i);
+        if (expected)
+            check(sameSample(expected[s], fast[s]), "round trip sample", i);
+    }
+
+    if (header.count == 0)
+        return;
+    const unsigned int first = rng() % header.count;
+    const unsigned int count = 1 + rng() % (header.count - first);
+    scha63x_decode_samples(packet, &header, first, count, fast.data());
+    for (unsigned int s = 0; s < count; s++)
+        check(sameSample(reference[first + s], fast[s]), "decode span", i);
+}
+
+/*!
+    \brief Encode and decode random batches of 0 to SCHA63X_WIRE_MAX_SAMPLES samples
+*/
+static void checkRoundTrip(std::mt19937_64 &rng, uint64_t iterations)
+{
+    std::vector<scha63x_raw_data> in(SCHA63X_WIRE_MAX_SAMPLES);
+    std::vector<uint8_t> packet(SCHA63X_WIRE_MAX_PAYLOAD);
+    uint64_t delta_packets = 0, delta_bytes = 0, raw_bytes = 0;
+
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        scha63x_packet_header header = makeHeader(i % (SCHA63X_WIRE_MAX_SAMPLES + 1), (uint32_t)rng());
+        header.send_time = (uint32_t)rng();
+        randomBatch(rng, header.count, in);
+
+        const bool delta = i % 2 == 1;
+        size_t bytes = encode(packet.data(), packet.size(), header, in.data(), delta);
+        check(bytes <= SCHA63X_WIRE_MAX_PAYLOAD, "round trip fits MTU", i);
+
+        scha63x_packet_header decoded;
+        memset(&decoded, 0, sizeof(decoded));
+        check(scha63x_wire_check(packet.data(), bytes, &decoded) == header.count, "round trip count", i);
+        check(decoded.sequence == header.sequence && decoded.send_time == header.send_time,
+              "round trip header", i);
+        if (decoded.encoding == SCHA63X_WIRE_ENCODING_DELTA)
+        {
+            delta_packets++;
+            delta_bytes += bytes;
+            raw_bytes += SCHA63X_WIRE_PACKET_SIZE(header.count);
+        }
+
+        checkDecoders(packet.data(), decoded, in.data(), rng, i);
+
+        // one byte short of the announced count is rejected
+        if (header.count > 0)
+            check(scha63x_wire_check(packet.data(), bytes - 1, &decoded) < 0, "short datagram", i);
+    }
+
+    printf("round trip: %lu batches, %lu delta encoded at %.1f %% of their raw size\n",
+           (unsigned long)iterations, (unsigned long)delta_packets,
+           raw_bytes ? 100.0 * delta_bytes / raw_bytes : 0.0);
+}
+
+/*!
+    \brief Random and mutated datagrams, each in a buffer of exactly its length
+
+    A sanitizer build catches reads past the datagram
+*/
+static void checkFuzz(std::mt19937_64 &rng, uint64_t iterations)
+{
+    std::vector<scha63x_raw_data> samples(SCHA63X_WIRE_MAX_SAMPLES);
+    std::vector<uint8_t> valid(SCHA63X_WIRE_MAX_PAYLOAD);
+    uint64_t accepted = 0;
+
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        size_t length;
+        std::vector<uint8_t> datagram;
+
+        if (i % 2 == 0)
+        {
+            // random bytes, half of them behind a valid magic, version and encoding
+            length = rng() % (SCHA63X_WIRE_MAX_PAYLOAD + 64);
+            datagram.resize(length);
+            for (auto &b : datagram)
+                b = (uint8_t)rng();
+            if (i % 4 == 0 && length >= SCHA63X_WIRE_HEADER_SIZE)
+            {
+                datagram[0] = 0x3C;
+                datagram[1] = 0xA6;
+                datagram[2] = SCHA63X_PACKET_VERSION;
+                datagram[12] = rng() % 2;
+            }
+        }
+        else
+        {
+            // valid batch in either encoding with flipped bits and a random cut
+            scha63x_packet_header header = makeHeader(rng() % (SCHA63X_WIRE_MAX_SAMPLES + 1), (uint32_t)i);
+            randomBatch(rng, header.count, samples);
+            size_t bytes = encode(valid.data(), valid.size(), header, samples.data(), rng() % 2);
+            length = rng() % 8 == 0 ? bytes : rng() % (bytes + 1);
+            datagram.assign(valid.begin(), valid.begin() + length);
+            for (int flips = rng() % 4; flips > 0 && length > 0; flips--)
+                datagram[rng() % length] ^= 1 << (rng() % 8);
+        }
+
+        scha63x_packet_header header;
+        int n = scha63x_wire_check(datagram.data(), length, &header);
+        if (n < 0)
+            continue;
+
+        accepted++;
+        if (header.encoding == SCHA63X_WIRE_ENCODING_RAW)
+            check((size_t)SCHA63X_WIRE_PACKET_SIZE(n) <= length, "fuzz bounds", i);
+        else
+            check(scha63x_wire_delta_size(datagram.data(), length, n) <= length, "fuzz delta bounds", i);
+        check(header.magic == SCHA63X_PACKET_MAGIC && header.version == SCHA63X_PACKET_VERSION,
+              "fuzz header", i);
+        checkDecoders(datagram.data(), header, nullptr, rng, i);
+    }
+
+    printf("fuzz: %lu datagrams, %lu accepted as sample batches\n",
+           (unsigned long)iterations, (unsigned long)accepted);
+}
+
+/*!
+    \brief Send fuzzed and valid datagrams through a loopback BatchReceiver
+
+    The receiver must accept exactly the datagrams scha63x_wire_check
+    accepts and decode them like the encoder wrote them
+*/
+static void checkReceiver(std::mt19937_64 &rng, uint64_t iterations)
+{
+    int rx = socket(AF_INET, SOCK_DGRAM, 0);
+    int tx = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (rx < 0 || tx < 0 || bind(rx, (sockaddr *)&addr, sizeof(addr)) < 0 ||
+        getsockname(rx, (sockaddr *)&addr, &len) < 0)
+    {
+        check(false, "receiver socket", 0);
+        return;
+    }
+    timeval timeout = {1, 0};
+    setsockopt(rx, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    BatchReceiver receiver(rx, 1, 4);
+    std::vector<scha63x_raw_data> samples(SCHA63X_WIRE_MAX_SAMPLES), decoded(SCHA63X_WIRE_MAX_SAMPLES);
+    std::vector<uint8_t> datagram(SCHA63X_WIRE_MAX_PAYLOAD + 64);
+
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        scha63x_packet_header header = makeHeader(rng() % (SCHA63X_WIRE_MAX_SAMPLES + 1), (uint32_t)i);
+        randomBatch(rng, header.count, samples);
+        size_t bytes = encode(datagram.data(), SCHA63X_WIRE_MAX_PAYLOAD, header, samples.data(), i % 2);
+
+        // every third datagram is corrupted, cut short or oversized
+        const bool intact = i % 3 != 0;
+        if (!intact)
+        {
+            switch (rng() % 3)
+            {
+            case 0: datagram[rng() % SCHA63X_WIRE_HEADER_SIZE] ^= 0xFF; break;
+            case 1: bytes = rng() % (bytes + 1); break;
+            case 2: bytes = SCHA63X_WIRE_MAX_PAYLOAD + 1 + rng() % 63; break;
+            }
+        }
+
+        sendto(tx, datagram.data(), bytes, 0, (sockaddr *)&addr, sizeof(addr));
+        if (receiver.receive() != 1)
+        {
+            check(false, "receiver timeout", i);
+            break;
+        }
+
+        scha63x_packet_header expected;
+        const size_t kept = bytes < SCHA63X_WIRE_MAX_PAYLOAD ? bytes : SCHA63X_WIRE_MAX_PAYLOAD;
+        const int n = scha63x_wire_check(datagram.data(), kept, &expected);
+        check(receiver.isSamplePacket(0) == (n >= 0), "receiver validation", i);
+        if (intact)
+            check(receiver.isSamplePacket(0) && receiver.samples(0) == header.count, "receiver count", i);
+
+        if (!receiver.isSamplePacket(0))
+            continue;
+
+        const unsigned int count = receiver.samples(0);
+        receiver.decode(0, 0, count, decoded.data());
+        for (unsigned int s = 0; s < count && intact; s++)
+            check(sameSample(samples[s], decoded[s]), "receiver sample", i);
+        if (count > 0 && intact)
+            check(receiver.firstTimestamp(0) == samples[0].timeStamp, "receiver first timestamp", i);
+    }
+
+    close(rx);
+    close(tx);
+}
+
+/*!
+    \brief Raw decoder throughput over MTU sized batches
+*/
+static void benchDecode(std::mt19937_64 &rng)
+{
+    const int packets = 4096;
+    const int count = SCHA63X_WIRE_MAX_SAMPLES;
+    std::vector<uint8_t> buffer((size_t)packets * SCHA63X_WIRE_PACKET_SIZE(count));
+    std::vector<scha63x_raw_data> samples(count), out(count);
+
+    for (int p = 0; p < packets; p++)
+    {
+        scha63x_packet_header header = makeHeader(count, p);
+        for (int s = 0; s < count; s++)
+            randomSample(rng, samples[s]);
+        scha63x_wire_put_packet(&buffer[(size_t)p * SCHA63X_WIRE_PACKET_SIZE(count)], &header, samples.data());
+    }
+
+    const int rounds = 20;
+    uint64_t sum = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+    {
+        for (int p = 0; p < packets; p++)
+        {
+            const uint8_t *packet = &buffer[(size_t)p * SCHA63X_WIRE_PACKET_SIZE(count)];
+            scha63x_packet_header header;
+            int n = scha63x_wire_check(packet, SCHA63X_WIRE_PACKET_SIZE(count), &header);
+            scha63x_decode_samples(packet, &header, 0, n, out.data());
+            sum += (uint64_t)out[n - 1].timeStamp;
+        }
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const double total = 1.0 * rounds * packets * count;
+    printf("raw decode: %d samples per datagram, %.1f M samples/s, %.2f ns/sample (checksum %ld)\n",
+           count, total / seconds / 1e6, 1e9 * seconds / total, (long)(sum & 0xFF));
+}
+
+
+int main(int argc, char **argv)
+{
+    uint64_t iterations = argc > 1 ? strtoull(argv[1], nullptr, 10) : 100000;
+    uint64_t seed = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1;
+    std::mt19937_64 rng(seed);
+
+    printf("wire format: %d byte header, %d bytes per raw sample, up to %d raw samples per %d byte datagram\n",
+           SCHA63X_WIRE_HEADER_SIZE, SCHA63X_WIRE_SAMPLE_SIZE, SCHA63X_WIRE_MAX_SAMPLES, SCHA63X_WIRE_MAX_PAYLOAD);
+
+    checkLayout();
+    checkRoundTrip(rng, iterations);
+    checkFuzz(rng, iterations);
+    checkReceiver(rng, iterations / 10 + 1);
+    benchDecode(rng);
+
+    if (failures > 0)
+    {
+        printf("%d checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("all checks passed\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,276 @@
+/*!
+    @file binary_recording.cpp
+    @brief Compact chunked binary recording format
+*/
+
+#include <stddef.h>
+#include <string.h>
+#include <chrono>
+#include <stdexcept>
+
+#include "binary_recording.h"
+#include "trace.h"
+
+
+static_assert(sizeof(binary_file_header) == 176, "binary file header layout changed");
+static_assert(sizeof(binary_chunk_header) == 24, "binary chunk header layout changed");
+static_assert(sizeof(scha63x_raw_data) == 40, "sample layout differs from the recording format");
+static_assert(offsetof(scha63x_raw_data, receiveTime) == BINARY_FORMAT_V1_SAMPLE_SIZE,
+              "version 1 samples must be a prefix of version 2 samples");
+
+
+/*!
+    \brief Fill a file header from handshake results and config.h
+
+    \param serial_num      sensor serial number, may be empty
+    \param cacv            cross-axis compensation values from the sensor
+    \param config          filter configuration sent to the sensor
+    \param first_timestamp device timestamp received in the handshake
+    \return header ready to be written
+*/
+binary_file_header makeBinaryHeader(const char *serial_num, const scha63x_cacv &cacv,
+                                    const scha63x_sensor_config &config, int64_t first_timestamp)
+{
+    binary_file_header header;
+    memset(&header, 0, sizeof(header));
+
+    memcpy(header.magic, BINARY_FILE_MAGIC, sizeof(header.magic));
+    header.version = BINARY_FORMAT_VERSION;
+    header.header_size = sizeof(binary_file_header);
+    header.sample_size = sizeof(scha63x_raw_data);
+
+    strncpy(header.serial_num, serial_num, sizeof(header.serial_num) - 1);
+    header.cacv = cacv;
+    header.filter_config = config;
+
+    header.sensitivity_acc = SENSITIVITY_ACC;
+    header.sensitivity_gyro_x = SENSITIVITY_GYRO_X;
+    header.sensitivity_gyro_y = SENSITIVITY_GYRO_Y;
+    header.sensitivity_gyro_z = SENSITIVITY_GYRO_Z;
+
+    header.imu_buffer = imu_buffer_size;
+    header.imu_trigger = imu_trigger_rate;
+    header.cam_trigger = cam_trigger_rate;
+
+    header.first_timestamp = first_timestamp;
+    header.start_time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    return header;
+}
+
+/*!
+    \brief Validate magic, version and record sizes of a file header
+
+    \exception header does not match this build, throws std::runtime_error
+*/
+void checkBinaryHeader(const binary_file_header &header)
+{
+    if (memcmp(header.magic, BINARY_FILE_MAGIC, sizeof(header.magic)) != 0)
+        throw std::runtime_error("Not a binary IMU recording");
+    if (header.version != BINARY_FORMAT_VERSION && header.version != 1)
+        throw std::runtime_error("Unsupported binary recording version");
+    const uint32_t sample_size = header.version == 1 ? BINARY_FORMAT_V1_SAMPLE_SIZE : sizeof(scha63x_raw_data);
+    if (header.header_size != sizeof(binary_file_header) || header.sample_size != sample_size)
+        throw std::runtime_error("Binary recording layout does not match this build");
+}
+
+/*!
+    \brief Copy samples of any supported version out of a recording
+
+    \param data        first sample in the file
+    \param count       number of samples
+    \param sample_size sample size from the file header
+    \param out         destination for count samples
+*/
+void readBinarySamples(const uint8_t *data, size_t count, uint32_t sample_size, scha63x_raw_data *out)
+{
+    if (sample_size == sizeof(scha63x_raw_data))
+    {
+        memcpy(out, data, count * sizeof(scha63x_raw_data));
+        return;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        memcpy(&out[i], data + i * sample_size, BINARY_FORMAT_V1_SAMPLE_SIZE);
+        out[i].receiveTime = 0;
+    }
+}
+
+
+
+// Writer
+
+/*!
+    \brief Create the file and write the file header
+
+    \param path   output file
+    \param header file header, see makeBinaryHeader(), version and sample size are set to this build's
+    \exception file can not be opened or written, throws std::runtime_error
+*/
+BinaryRecorder::BinaryRecorder(const std::string &path, const binary_file_header &header)
+    : bytes_(0)
+{
+    file_ = fopen(path.c_str(), "wb");
+    if (!file_)
+        throw std::runtime_error("Can not open " + path);
+
+    setvbuf(file_, nullptr, _IOFBF, 1 << 20);
+    chunk_.reserve(binary_chunk_samples);
+
+    // samples are always written in the current layout, also when copied from an older recording
+    binary_file_header current = header;
+    current.version = BINARY_FORMAT_VERSION;
+    current.sample_size = sizeof(scha63x_raw_data);
+    if (fwrite(&current, sizeof(current), 1, file_) != 1)
+    {
+        // the destructor does not run for a throwing constructor
+        fclose(file_);
+        throw std::runtime_error("Can not write binary recording header");
+    }
+    bytes_ += sizeof(header);
+}
+
+BinaryRecorder::~BinaryRecorder()
+{
+    try
+    {
+        flush();
+    }
+    catch (std::runtime_error &)
+    {
+    }
+    fclose(file_);
+}
+
+/*!
+    \brief Append raw samples, full chunks are written out
+
+    \param samples raw samples as received
+    \param count   number of samples
+*/
+void BinaryRecorder::addSamples(const scha63x_raw_data *samples, size_t count)
+{
+    TRACE_SCOPE_ARG(trace_record, count);
+    while (count > 0)
+    {
+        size_t n = binary_chunk_samples - chunk_.size();
+        if (n > count)
+            n = count;
+
+        chunk_.insert(chunk_.end(), samples, samples + n);
+        samples += n;
+        count -= n;
+
+        if (chunk_.size() == binary_chunk_samples)
+            writeChunk();
+    }
+}
+
+/*!
+    \brief Write the pending partial chunk and flush stdio buffers
+*/
+void BinaryRecorder::flush(void)
+{
+    writeChunk();
+    fflush(file_);
+}
+
+/*!
+    \brief Write pending samples as one chunk
+
+    \exception write failed, throws std::runtime_error
+*/
+void BinaryRecorder::writeChunk(void)
+{
+    if (chunk_.empty())
+        return;
+
+    binary_chunk_header chunk;
+    chunk.magic = BINARY_CHUNK_MAGIC;
+    chunk.samples = chunk_.size();
+    chunk.first_timestamp = chunk_.front().timeStamp;
+    chunk.last_timestamp = chunk_.back().timeStamp;
+
+    if (fwrite(&chunk, sizeof(chunk), 1, file_) != 1 ||
+        fwrite(chunk_.data(), sizeof(scha63x_raw_data), chunk_.size(), file_) != chunk_.size())
+    {
+        throw std::runtime_error("Can not write binary recording chunk");
+    }
+
+    bytes_ += sizeof(chunk) + chunk_.size() * sizeof(scha63x_raw_data);
+    chunk_.clear();
+}
+
+
+
+// Reader
+
+/*!
+    \brief Open a recording and read its file header
+
+    \param path recording file
+    \exception file missing or not a valid recording, throws std::runtime_error
+*/
+BinaryRecordingReader::BinaryRecordingReader(const std::string &path)
+{
+    file_ = fopen(path.c_str(), "rb");
+    if (!file_)
+        throw std::runtime_error("Can not open " + path);
+
+    if (fread(&header_, sizeof(header_), 1, file_) != 1)
+    {
+        fclose(file_);
+        throw std::runtime_error("Can not read binary recording header");
+    }
+
+    try
+    {
+        checkBinaryHeader(header_);
+    }
+    catch (std::runtime_error &)
+    {
+        fclose(file_);
+        throw;
+    }
+}
+
+BinaryRecordingReader::~BinaryRecordingReader()
+{
+    fclose(file_);
+}
+
+/*!
+    \brief Read the next chunk
+
+    A chunk cut short by an interrupted recording is returned with
+    the samples that are complete
+
+    \param samples replaced with the samples of the chunk
+    \return false at the end of the file
+    \exception corrupted chunk header, throws std::runtime_error
+*/
+bool BinaryRecordingReader::nextChunk(std::vector<scha63x_raw_data> &samples)
+{
+    binary_chunk_header chunk;
+    if (fread(&chunk, sizeof(chunk), 1, file_) != 1)
+        return false;
+    if (chunk.magic != BINARY_CHUNK_MAGIC)
+        throw std::runtime_error("Corrupted binary recording chunk");
+
+    samples.resize(chunk.samples);
+    size_t n;
+    if (header_.sample_size == sizeof(scha63x_raw_data))
+    {
+        n = fread(samples.data(), sizeof(scha63x_raw_data), chunk.samples, file_);
+    }
+    else
+    {
+        v1_chunk_.resize((size_t)chunk.samples * header_.sample_size);
+        n = fread(v1_chunk_.data(), header_.sample_size, chunk.samples, file_);
+        readBinarySamples(v1_chunk_.data(), n, header_.sample_size, samples.data());
+    }
+    samples.resize(n);
+
+    return n > 0;
+}
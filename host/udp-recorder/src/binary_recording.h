@@ -0,0 +1,139 @@
+#ifndef BINARY_RECORDING_H
+#define BINARY_RECORDING_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "defs.h"
+#include "config.h"
+
+/*!
+    @file binary_recording.h
+    @brief Compact chunked binary recording format
+
+    File layout, all values in host byte order (little-endian on
+    every supported host):
+
+    binary_file_header
+    binary_chunk_header, chunk.samples x scha63x_raw_data
+    binary_chunk_header, chunk.samples x scha63x_raw_data
+    ...
+
+    Samples are stored exactly as received, conversion to real
+    values happens offline (see tools/bin2jsonl.cpp). Chunks carry
+    their first and last device timestamps, so a reader can skip
+    through the file without touching sample data.
+
+    Version 2 adds the host arrival time of every sample's datagram.
+    Version 1 samples are the first 32 bytes of a version 2 sample,
+    readers return them with receiveTime 0.
+*/
+
+
+///@{
+/*! \brief Magic values and version */
+#define BINARY_FILE_MAGIC "SCHA63XR"
+#define BINARY_CHUNK_MAGIC 0x4b4e4843 // "CHNK"
+#define BINARY_FORMAT_VERSION 2
+#define BINARY_FORMAT_V1_SAMPLE_SIZE 32
+///@}
+
+/*! \brief samples buffered per chunk by the writer */
+#define binary_chunk_samples 4096
+
+
+/*!
+    \brief File header, everything needed to convert the samples
+*/
+typedef struct _binary_file_header {
+
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;  // sizeof(binary_file_header)
+    uint32_t sample_size;  // sizeof(scha63x_raw_data)
+    uint32_t reserved;
+
+    char serial_num[16];
+    scha63x_cacv cacv;
+    scha63x_sensor_config filter_config;
+    uint16_t reserved_filter;
+
+    int32_t sensitivity_acc;
+    int32_t sensitivity_gyro_x;
+    int32_t sensitivity_gyro_y;
+    int32_t sensitivity_gyro_z;
+
+    int32_t imu_buffer;
+    int32_t imu_trigger;
+    int32_t cam_trigger;
+    int32_t reserved_trigger;
+
+    int64_t first_timestamp;   // device time of the handshake, microseconds
+    int64_t start_time_ns;     // host realtime clock at recording start
+
+} binary_file_header;
+
+/*!
+    \brief Header in front of every chunk of samples
+*/
+typedef struct _binary_chunk_header {
+
+    uint32_t magic;
+    uint32_t samples;
+    int64_t first_timestamp;
+    int64_t last_timestamp;
+
+} binary_chunk_header;
+
+
+binary_file_header makeBinaryHeader(const char *serial_num, const scha63x_cacv &cacv,
+                                    const scha63x_sensor_config &config, int64_t first_timestamp);
+
+
+/*!
+    \brief Buffered chunk writer
+*/
+class BinaryRecorder
+{
+public:
+    BinaryRecorder(const std::string &path, const binary_file_header &header);
+    ~BinaryRecorder();
+
+    void addSamples(const scha63x_raw_data *samples, size_t count);
+    void flush(void);
+
+    uint64_t bytesWritten(void) const { return bytes_; }
+
+private:
+    void writeChunk(void);
+
+    FILE *file_;
+    std::vector<scha63x_raw_data> chunk_;
+    uint64_t bytes_;
+};
+
+
+/*!
+    \brief Sequential reader, used by the offline converter
+*/
+class BinaryRecordingReader
+{
+public:
+    explicit BinaryRecordingReader(const std::string &path);
+    ~BinaryRecordingReader();
+
+    const binary_file_header &header(void) const { return header_; }
+    bool nextChunk(std::vector<scha63x_raw_data> &samples);
+
+private:
+    FILE *file_;
+    binary_file_header header_;
+    std::vector<uint8_t> v1_chunk_;
+};
+
+void checkBinaryHeader(const binary_file_header &header);
+void readBinarySamples(const uint8_t *data, size_t count, uint32_t sample_size, scha63x_raw_data *out);
+
+#endif
@@ -0,0 +1,503 @@
+/*!
+    @file board_simulator.cpp
+    @brief Software IMU board speaking the Arduino UDP protocol
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include "board_simulator.h"
+#include "filter_config.h"
+
+
+/*!
+    \brief Open a socket connected to the recorder
+
+    \param options board and stream settings, check board_simulator.h
+    \exception socket creation failed, throws std::runtime_error
+*/
+BoardSimulator::BoardSimulator(const simulator_options &options)
+    : options_(options), rng_(options.seed)
+{
+    if (options_.rate <= 0 || options_.batch <= 0)
+        throw std::runtime_error("Simulator rate and batch size must be positive");
+    if (options_.batch > SCHA63X_WIRE_MAX_SAMPLES)
+        throw std::runtime_error("Simulator batch does not fit into one datagram");
+    if (options_.speed < 0 || options_.loops < 1)
+        throw std::runtime_error("Replay speed must not be negative and loops at least 1");
+
+    sock_ = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock_ < 0)
+        throw std::runtime_error("Can not create simulator socket");
+    if (connect(sock_, (const sockaddr *)&options_.server, sizeof(options_.server)) < 0)
+    {
+        close(sock_);
+        throw std::runtime_error("Can not connect simulator socket");
+    }
+
+    memset(&config_, 0, sizeof(config_));
+    memset(&specs_, 0, sizeof(specs_));
+    memset(&stats_, 0, sizeof(stats_));
+
+    current_.resize(SCHA63X_WIRE_PACKET_SIZE(SCHA63X_WIRE_MAX_SAMPLES));
+    held_.resize(current_.size());
+    held_size_ = 0;
+    holding_ = false;
+
+    memset(&filter_answer_, 0, sizeof(filter_answer_));
+    filter_received_ = false;
+    filter_settling_ = false;
+}
+
+BoardSimulator::~BoardSimulator()
+{
+    close(sock_);
+}
+
+/*!
+    \brief Production-like settings against a local recorder
+
+    \return one board at imu_trigger_rate, imu_buffer_size samples
+            per datagram, no jitter, loss or reordering
+*/
+simulator_options BoardSimulator::defaultOptions(void)
+{
+    simulator_options options;
+
+    memset(&options.server, 0, sizeof(options.server));
+    options.server.sin_family = AF_INET;
+    options.server.sin_port = htons(port);
+    options.server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    options.serial = "SIM000000001";
+    memset(&options.cacv, 0, sizeof(options.cacv));
+    options.cacv.bxx = options.cacv.byy = options.cacv.bzz = 1;
+    options.cacv.cxx = options.cacv.cyy = options.cacv.czz = 1;
+    options.start_timestamp = 1000000;
+    options.drift_ppm = 0;
+
+    options.serial_read_ms = 0;
+    options.nvm_read_ms = 0;
+    options.init_ms = 0;
+    options.use_cac_cache = true;
+    options.send_timestamp = false;
+
+    options.rate = imu_trigger_rate;
+    options.batch = imu_buffer_size;
+    options.jitter_us = 0;
+    options.loss = 0;
+    options.reorder = 0;
+    options.seconds = 0;
+    options.delta = false;
+    options.seed = 1;
+
+    options.filter_settle_ms = 22;
+    options.filter_drop = 0;
+
+    options.speed = 1;
+    options.loops = 1;
+
+    return options;
+}
+
+/*!
+    \brief Simulated sensor startup wait
+*/
+static void sleepMs(double ms)
+{
+    if (ms > 0)
+        std::this_thread::sleep_for(std::chrono::microseconds((int64_t)(1000 * ms)));
+}
+
+/*!
+    \brief Send a datagram, zero padded to packet_size
+*/
+void BoardSimulator::sendPacket(const void *data, size_t size, size_t packet_size)
+{
+    std::vector<char> packet(packet_size, 0);
+    memcpy(packet.data(), data, size < packet_size ? size : packet_size);
+    send(sock_, packet.data(), packet.size(), 0);
+}
+
+/*!
+    \brief Wait for one reply from the recorder
+
+    \return false on timeout
+*/
+bool BoardSimulator::expectPacket(void *buffer, size_t size)
+{
+    char packet[buffer_size];
+    ssize_t n = recv(sock_, packet, sizeof(packet), 0);
+    if (n < 0)
+        return false;
+
+    memset(buffer, 0, size);
+    memcpy(buffer, packet, (size_t)n < size ? n : size);
+    return true;
+}
+
+/*!
+    \brief Run the startup handshake, starting over from hello on timeouts
+
+    Handshake packets can be lost while other boards stream to the
+    same recorder, the firmware keeps pinging the same way
+
+    \param attempts   handshakes tried before giving up
+    \param timeout_ms reply timeout
+    \return true once the handshake is through, with send_timestamp once the recorder echoed it
+*/
+bool BoardSimulator::handshake(int attempts, int timeout_ms)
+{
+    timeval timeout = {timeout_ms / 1000, (timeout_ms % 1000) * 1000};
+    setsockopt(sock_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    for (int attempt = 0; attempt < attempts; attempt++)
+    {
+        if (handshakeOnce())
+            return true;
+    }
+    return false;
+}
+
+/*!
+    \brief One pass of the startup handshake
+
+    \return false if a reply timed out or did not match
+*/
+bool BoardSimulator::handshakeOnce(void)
+{
+    char packet[buffer_size];
+
+    // PING : "hello", echoed back
+    hello_time_ = std::chrono::steady_clock::now();
+    sendPacket("hello", 6, simulator_packet_size);
+    if (!expectPacket(packet, sizeof(packet)) || strcmp(packet, "hello") != 0)
+        return false;
+
+    // CONFIG : filter configuration for initialize_sensor
+    if (!expectPacket(&config_, sizeof(config_)))
+        return false;
+
+    // STATUS : status and serial number, answered with buffer and trigger info
+    // and whether the recorder has the CAC terms of this serial number
+    sleepMs(options_.serial_read_ms);
+    sensor_data specs;
+    memset(&specs, 0, sizeof(specs));
+    specs.status = 1;
+    strncpy(specs.serial_num, options_.serial.c_str(), sizeof(specs.serial_num) - 1);
+    sendPacket(&specs, sizeof(specs), sizeof(specs));
+    if (!expectPacket(&specs_, sizeof(specs_)))
+        return false;
+
+    // CAC TERMS : read from NVM and sent like sendImuInfo, no reply
+    const bool cached = options_.use_cac_cache && specs_.cac_cached;
+    if (!cached)
+        sleepMs(options_.nvm_read_ms);
+    sleepMs(options_.init_ms);
+    if (!cached)
+        sendPacket(&options_.cacv, sizeof(options_.cacv), simulator_packet_size);
+
+    // The Arduino firmware streams from here, its first sample ends the handshake
+    if (!options_.send_timestamp)
+        return true;
+
+    // TIMESTAMP : echoed back, samples follow
+    char timestamp[buffer_size];
+    snprintf(timestamp, sizeof(timestamp), "%lu", (unsigned long)(uint32_t)options_.start_timestamp);
+    sendPacket(timestamp, strlen(timestamp) + 1, simulator_packet_size);
+    if (!expectPacket(packet, sizeof(packet)))
+        return false;
+
+    return strcmp(packet, timestamp) == 0;
+}
+
+/*!
+    \brief Synthetic sample, gravity on z, slow rotation and noise
+
+    Camera triggers follow cam_trigger_rate and the GNSS trigger
+    comes once per second, both relative to the simulated rate
+
+    \param sample output
+    \param index  sample number since the handshake
+*/
+void BoardSimulator::fillSample(scha63x_raw_data &sample, uint64_t index)
+{
+    std::uniform_int_distribution<int> noise(-20, 20);
+    const double t = index / options_.rate;
+    const uint64_t cam_period = (uint64_t)llround(options_.rate / cam_trigger_rate);
+    const uint64_t ubx_period = (uint64_t)llround(options_.rate);
+
+    memset(&sample, 0, sizeof(sample));
+    sample.timeStamp = (uint32_t)(options_.start_timestamp + (int64_t)llround(1e6 * t));
+
+    sample.acc_x_lsb = (int16_t)(0.1 * SENSITIVITY_ACC * sin(2 * M_PI * 0.5 * t) + noise(rng_));
+    sample.acc_y_lsb = (int16_t)noise(rng_);
+    sample.acc_z_lsb = (int16_t)(SENSITIVITY_ACC + noise(rng_));
+    sample.gyro_x_lsb = (int16_t)noise(rng_);
+    sample.gyro_y_lsb = (int16_t)noise(rng_);
+    sample.gyro_z_lsb = (int16_t)(10 * SENSITIVITY_GYRO_Z * sin(2 * M_PI * 0.2 * t) + noise(rng_));
+    sample.temp_due_lsb = 300;
+    sample.temp_uno_lsb = 300;
+
+    sample.cam_trigger = cam_period > 0 && index % cam_period == 0;
+    sample.ubx_trigger = ubx_period > 0 && index % ubx_period == 0;
+}
+
+/*!
+    \brief Encode and send one batch, with datagram loss and reordering
+
+    A reordered datagram is held back and sent right after its
+    successor. Datagrams are encoded in the wire format like on the
+    firmware, dropped datagrams still use up their sequence number.
+
+    \param samples   samples of the batch
+    \param count     number of samples, at most SCHA63X_WIRE_MAX_SAMPLES
+    \param sequence  datagram number
+    \param send_time device micros() in the header
+*/
+void BoardSimulator::sendBatch(const scha63x_raw_data *samples, int count, uint32_t sequence, uint32_t send_time)
+{
+    std::uniform_real_distribution<double> unit(0, 1);
+
+    scha63x_packet_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SCHA63X_PACKET_MAGIC;
+    header.version = SCHA63X_PACKET_VERSION;
+    header.count = (uint8_t)count;
+    header.sequence = sequence;
+    header.send_time = send_time;
+    size_t size = options_.delta ? scha63x_wire_put_delta_packet(current_.data(), current_.size(), &header, samples) : 0;
+    if (size == 0)
+        size = scha63x_wire_put_packet(current_.data(), &header, samples);
+
+    if (options_.loss > 0 && unit(rng_) < options_.loss)
+    {
+        stats_.dropped++;
+        return;
+    }
+
+    if (holding_)
+    {
+        send(sock_, current_.data(), size, 0);
+        send(sock_, held_.data(), held_size_, 0);
+        stats_.datagrams += 2;
+        stats_.bytes += size + held_size_;
+        stats_.reordered++;
+        holding_ = false;
+    }
+    else if (options_.reorder > 0 && unit(rng_) < options_.reorder)
+    {
+        current_.swap(held_);
+        held_size_ = size;
+        holding_ = true;
+    }
+    else
+    {
+        send(sock_, current_.data(), size, 0);
+        stats_.datagrams++;
+        stats_.bytes += size;
+    }
+}
+
+/*!
+    \brief Send a datagram still held back for reordering
+*/
+void BoardSimulator::flushHeld(void)
+{
+    if (holding_)
+    {
+        send(sock_, held_.data(), held_size_, 0);
+        stats_.datagrams++;
+        stats_.bytes += held_size_;
+        holding_ = false;
+    }
+}
+
+/*!
+    \brief Take over a filter command of the recorder, answer settled ones
+
+    Like filter_command and loop() of murata.ino: invalid filter codes
+    are answered right away with SCHA63X_ERR_FILTER, valid ones after
+    filter_settle_ms, a repeated command again once it settled.
+*/
+void BoardSimulator::filterCommand(void)
+{
+    uint8_t packet[buffer_size];
+    const ssize_t n = recv(sock_, packet, sizeof(packet), MSG_DONTWAIT);
+    scha63x_filter_command command;
+    if (n > 0 && scha63x_wire_get_filter(packet, (size_t)n, &command))
+    {
+        stats_.filter_commands++;
+        if (options_.filter_drop > 0)
+        {
+            options_.filter_drop--;
+        }
+        else if (filter_received_ && command.sequence == filter_answer_.sequence)
+        {
+            if (!filter_settling_)
+                send(sock_, packet, scha63x_wire_put_filter(packet, &filter_answer_), 0);
+        }
+        else
+        {
+            // SCHA63X_OK or SCHA63X_ERR_FILTER of scha63x_set_filter
+            const scha63x_sensor_config config = filterFromCodes(command.filter);
+            const bool valid = validFilter(config);
+            filter_answer_ = command;
+            filter_answer_.status = valid ? 0 : -3;
+            filter_answer_.settle_ms = valid ? (uint16_t)ceil(options_.filter_settle_ms) : 0;
+            if (valid)
+                config_ = config;
+            filter_received_ = true;
+            filter_settling_ = true;
+            filter_set_at_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    if (filter_settling_ &&
+        std::chrono::steady_clock::now() - filter_set_at_ >= std::chrono::milliseconds(filter_answer_.settle_ms))
+    {
+        send(sock_, packet, scha63x_wire_put_filter(packet, &filter_answer_), 0);
+        filter_settling_ = false;
+    }
+}
+
+/*!
+    \brief Stream sample batches until the duration elapses or stop is set
+
+    Datagrams are scheduled at a fixed period from the start, jitter
+    moves single send times without accumulating.
+
+    \param stop optional flag ending the stream from another thread
+*/
+void BoardSimulator::stream(const std::atomic<bool> *stop)
+{
+    std::uniform_real_distribution<double> jitter(-options_.jitter_us, options_.jitter_us);
+
+    // samples are due at device clock periods, sent by the host clock
+    const double drift = 1 + 1e-6 * options_.drift_ppm;
+    const double period_us = 1e6 * options_.batch / options_.rate / drift;
+    const uint64_t total = (uint64_t)(options_.rate * options_.seconds);
+
+    std::vector<scha63x_raw_data> samples(options_.batch);
+
+    const auto start = std::chrono::steady_clock::now();
+    stats_.startup_ms = std::chrono::duration<double, std::milli>(start - hello_time_).count();
+    uint64_t sample = 0;
+    uint64_t slot = 0;
+    uint32_t sequence = 0;
+
+    while (!(stop && stop->load(std::memory_order_relaxed)))
+    {
+        if (options_.seconds > 0 && sample >= total)
+            break;
+
+        for (int i = 0; i < options_.batch; i++)
+            fillSample(samples[i], sample++);
+        stats_.samples += options_.batch;
+
+        double offset = slot++ * period_us + (options_.jitter_us > 0 ? jitter(rng_) : 0);
+        std::this_thread::sleep_until(start + std::chrono::nanoseconds((int64_t)(1000 * offset)));
+
+        const uint32_t send_time = (uint32_t)(options_.start_timestamp + (int64_t)llround(drift *
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count()));
+        sendBatch(samples.data(), options_.batch, sequence++, send_time);
+        filterCommand();
+    }
+    flushHeld();
+
+    stats_.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/*!
+    \brief Stream recorded samples in their original datagrams and timing
+
+    Consecutive samples with the same receive time arrived in one
+    datagram and are sent in one again, up to options.batch samples.
+    Samples without a receive time (version 1 recordings) are cut
+    into batches of options.batch. Every datagram is sent at its
+    original receive time, or at the device time of its last sample
+    without one, relative to the first and divided by options.speed,
+    speed 0 sends back to back. The header carries the device time of
+    the last sample as send time.
+
+    Later loops shift the device timestamps by the recorded span plus
+    one sample period, wrapping at 32 bits like micros(), so the
+    recorder sees one continuous stream.
+
+    \param samples recorded samples of one board, in recorded order
+    \param stop    optional flag ending the stream from another thread
+*/
+void BoardSimulator::replay(const std::vector<scha63x_raw_data> &samples, const std::atomic<bool> *stop)
+{
+    // datagram boundaries and send offsets from the first datagram, ns,
+    // device time of the last sample in us since the first, across wraps
+    std::vector<size_t> begin;
+    std::vector<int64_t> offset;
+    int64_t device = 0;
+    for (size_t i = 0; i < samples.size();)
+    {
+        size_t end = i + 1;
+        while (end < samples.size() && end - i < (size_t)options_.batch &&
+               (samples[i].receiveTime == 0 || samples[end].receiveTime == samples[i].receiveTime))
+            end++;
+        for (size_t k = i > 0 ? i : 1; k < end; k++)
+            device += (uint32_t)(samples[k].timeStamp - samples[k - 1].timeStamp);
+
+        const scha63x_raw_data &last = samples[end - 1];
+        begin.push_back(i);
+        offset.push_back(samples[0].receiveTime != 0 && last.receiveTime != 0
+                             ? last.receiveTime - samples[0].receiveTime
+                             : 1000 * device);
+        i = end;
+    }
+    begin.push_back(samples.size());
+
+    const int64_t period = samples.size() > 1 ? device / (int64_t)(samples.size() - 1) : 0;
+    const int64_t span = device + period;
+    const int64_t span_ns = offset.empty() ? 0 : offset.back() + 1000 * period;
+    std::vector<scha63x_raw_data> batch(options_.batch);
+
+    const auto start = std::chrono::steady_clock::now();
+    stats_.startup_ms = std::chrono::duration<double, std::milli>(start - hello_time_).count();
+    uint32_t sequence = 0;
+
+    for (int loop = 0; loop < options_.loops; loop++)
+    {
+        for (size_t d = 0; d + 1 < begin.size(); d++)
+        {
+            if (stop && stop->load(std::memory_order_relaxed))
+            {
+                loop = options_.loops;
+                break;
+            }
+
+            const int count = (int)(begin[d + 1] - begin[d]);
+            for (int i = 0; i < count; i++)
+            {
+                batch[i] = samples[begin[d] + i];
+                if (loop > 0)
+                    batch[i].timeStamp = (uint32_t)(batch[i].timeStamp + loop * span);
+            }
+            stats_.samples += count;
+
+            if (options_.speed > 0)
+            {
+                const double due = (loop * span_ns + offset[d]) / options_.speed;
+                std::this_thread::sleep_until(start + std::chrono::nanoseconds((int64_t)due));
+            }
+            sendBatch(batch.data(), count, sequence++, (uint32_t)batch[count - 1].timeStamp);
+        }
+    }
+    flushHeld();
+
+    stats_.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
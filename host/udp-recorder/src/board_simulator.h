@@ -0,0 +1,154 @@
+#ifndef BOARD_SIMULATOR_H
+#define BOARD_SIMULATOR_H
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <netinet/in.h>
+
+#include "defs.h"
+#include "config.h"
+#include "scha63x_wire.h"
+
+/*!
+    @file board_simulator.h
+    @brief Software IMU board speaking the Arduino UDP protocol
+
+    Runs the board side of the startup handshake (hello ping, filter
+    config, sensor_data, CAC terms unless cached) like startUpSeq,
+    sendSensorStatus and sendImuInfo in the Arduino library, which
+    send no timestamp, or with the timestamp of older firmware,
+    optionally with the sensor startup waits, then streams synthetic
+    sample batches in the wire format of scha63x_wire.h at a configurable rate with send time
+    jitter, datagram loss and reordering. Timestamps come from a
+    drifting device clock and wrap at 32 bits like micros().
+
+    While streaming it answers filter commands like filter_command in
+    murata.ino: after every sent batch it looks for one, takes over its
+    filters and answers once filter_settle_ms have passed.
+
+    replay() streams recorded samples instead, in their original
+    datagrams and at their original times scaled by a speed factor,
+    with the same loss and reordering.
+*/
+
+
+/*! \brief Size of handshake packets sent by the firmware, PACKET_SIZE_STARTUP */
+#define simulator_packet_size 1000
+
+///@{
+/*! \brief Sensor startup waits of scha63x_init, simulated with --firmware-timing, ms */
+#define simulator_serial_read_ms 25  // reset and NVM read before the serial number
+#define simulator_nvm_read_ms 35     // test mode CAC read, DUE reset and NVM read, CAC TERMS send delay
+#define simulator_init_ms 621        // operation mode, filter startup and EOI
+///@}
+
+
+/*!
+    \brief Simulated board and stream settings
+*/
+typedef struct _simulator_options {
+
+    sockaddr_in server;       // recorder address
+    std::string serial;       // serial number reported in the handshake
+    scha63x_cacv cacv;        // cross-axis terms reported in the handshake
+    int64_t start_timestamp;  // device clock at the end of the handshake, us
+    double drift_ppm;         // device clock runs fast against the host clock by this much
+
+    double serial_read_ms;    // sensor startup until the serial number is known
+    double nvm_read_ms;       // CAC read from NVM, skipped if the recorder has them cached
+    double init_ms;           // rest of the sensor startup
+    bool use_cac_cache;       // honour cac_cached, false sends CAC TERMS like older firmware
+    bool send_timestamp;      // TIMESTAMP packet echoed before streaming like older firmware
+
+    double rate;              // samples per second
+    int batch;                // samples per datagram, at most SCHA63X_WIRE_MAX_SAMPLES
+    double jitter_us;         // send times vary uniformly by +-jitter_us
+    double loss;              // probability a datagram is not sent
+    double reorder;           // probability a datagram is sent after the next one
+    double seconds;           // stream duration, 0 streams until stopped
+    bool delta;               // delta encoded datagrams, raw if a batch does not compress
+    uint32_t seed;            // random generator seed
+
+    double filter_settle_ms;  // settling of changed filters before the answer
+    int filter_drop;          // filter commands ignored first, as if lost
+
+    double speed;             // replay() time scale, 2 replays twice as fast, 0 as fast as possible
+    int loops;                // replay() passes over the samples, later ones shifted in device time
+
+} simulator_options;
+
+/*!
+    \brief Stream counters
+*/
+typedef struct _simulator_stats {
+
+    uint64_t samples;         // samples generated, including dropped ones
+    uint64_t datagrams;       // datagrams sent
+    uint64_t bytes;           // datagram bytes sent
+    uint64_t dropped;         // datagrams dropped on purpose
+    uint64_t reordered;       // datagrams sent after their successor
+    double seconds;           // wall time of the stream
+    double startup_ms;        // first hello to first sample of the last handshake
+    uint64_t filter_commands; // filter commands received, including dropped and repeated ones
+
+} simulator_stats;
+
+
+/*!
+    \brief One simulated board with its own socket
+*/
+class BoardSimulator
+{
+public:
+    explicit BoardSimulator(const simulator_options &options);
+    ~BoardSimulator();
+
+    BoardSimulator(const BoardSimulator &) = delete;
+    BoardSimulator &operator=(const BoardSimulator &) = delete;
+
+    static simulator_options defaultOptions(void);
+
+    bool handshake(int attempts = 5, int timeout_ms = 500);
+    void stream(const std::atomic<bool> *stop = nullptr);
+    void replay(const std::vector<scha63x_raw_data> &samples, const std::atomic<bool> *stop = nullptr);
+
+    const simulator_stats &stats(void) const { return stats_; }
+    const scha63x_sensor_config &config(void) const { return config_; }
+    const sensor_data &specs(void) const { return specs_; }
+    const std::string &serial(void) const { return options_.serial; }
+
+private:
+    bool handshakeOnce(void);
+    bool expectPacket(void *buffer, size_t size);
+    void sendPacket(const void *data, size_t size, size_t packet_size);
+    void fillSample(scha63x_raw_data &sample, uint64_t index);
+    void sendBatch(const scha63x_raw_data *samples, int count, uint32_t sequence, uint32_t send_time);
+    void flushHeld(void);
+    void filterCommand(void);
+
+    simulator_options options_;
+    int sock_;
+    std::mt19937 rng_;
+    std::chrono::steady_clock::time_point hello_time_;
+
+    scha63x_sensor_config config_; // filter configuration from the recorder
+    sensor_data specs_;            // buffer and trigger info from the recorder
+    simulator_stats stats_;
+
+    std::vector<uint8_t> current_; // datagram being sent
+    std::vector<uint8_t> held_;    // datagram held back to be sent after its successor
+    size_t held_size_;
+    bool holding_;
+
+    scha63x_filter_command filter_answer_; // last filter command with its answer
+    bool filter_received_;
+    bool filter_settling_;                 // answer not sent yet
+    std::chrono::steady_clock::time_point filter_set_at_;
+};
+
+#endif
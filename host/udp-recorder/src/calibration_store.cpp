@@ -0,0 +1,199 @@
+/*!
+    @file calibration_store.cpp
+    @brief Per-sensor calibration kept between recorder runs
+*/
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <cmath>
+
+#include <sys/stat.h>
+
+#include "calibration_store.h"
+
+
+/*! \brief Largest cross-axis term the NVM can hold, int8 / 4096 */
+#define cacv_limit (128.0 / 4096.0)
+
+
+/*!
+    \param directory calibration files, created on the first save
+*/
+CalibrationStore::CalibrationStore(const std::string &directory)
+    : directory_(directory)
+{
+}
+
+/*!
+    \brief File of a serial number, anything unsafe in file names replaced
+
+    \param serial serial number from the handshake
+    \return <directory>/<serial>.cal
+*/
+std::string CalibrationStore::path(const std::string &serial) const
+{
+    std::string name = serial;
+    for (auto &c : name)
+    {
+        if (!isalnum((unsigned char)c) && c != '-' && c != '_')
+            c = '_';
+    }
+    return directory_ + "/" + name + ".cal";
+}
+
+/*!
+    \brief Check CAC terms are what the sensor NVM can hold
+
+    Diagonal terms are 1 + int8 / 4096, the others int8 / 4096, an
+    all zero struct of a failed read is rejected
+
+    \param cacv cross-axis compensation values
+    \return true if every term is in range
+*/
+bool CalibrationStore::validCacv(const scha63x_cacv &cacv)
+{
+    const float *terms = (const float *)&cacv;
+
+    for (int i = 0; i < 18; i++)
+    {
+        // cxx cyy czz bxx byy bzz
+        const bool diagonal = i == 0 || i == 4 || i == 8 || i == 9 || i == 13 || i == 17;
+        const float term = terms[i] - (diagonal ? 1 : 0);
+        if (!std::isfinite(term) || fabs(term) > cacv_limit)
+            return false;
+    }
+    return true;
+}
+
+/*!
+    \brief Read the entry of a serial number
+
+    Lines that do not parse are skipped, the entry keeps what was read,
+    e.g. the user calibration of a file whose CAC terms are missing
+
+    \param serial serial number from the handshake
+    \param entry  output, fields missing from the file are zero
+    \return true if the file is of this version, for this serial number
+            and holds valid CAC terms
+*/
+bool CalibrationStore::load(const std::string &serial, calibration_entry &entry) const
+{
+    memset(&entry.cacv, 0, sizeof(entry.cacv));
+    memset(&entry.config, 0, sizeof(entry.config));
+    memset(entry.acc_bias, 0, sizeof(entry.acc_bias));
+    memset(entry.gyro_bias, 0, sizeof(entry.gyro_bias));
+    entry.serial = serial;
+    entry.updated = 0;
+
+    FILE *file = fopen(path(serial).c_str(), "r");
+    if (!file)
+        return false;
+
+    int version = 0;
+    bool serial_ok = false, cacv_ok = false;
+    char line[512];
+    while (fgets(line, sizeof(line), file))
+    {
+        char key[32];
+        int used = 0;
+        if (line[0] == '#' || sscanf(line, "%31s %n", key, &used) != 1)
+            continue;
+        const char *values = line + used;
+
+        scha63x_cacv cacv;
+        float *c = (float *)&cacv;
+        unsigned int f[7];
+        float v[3];
+        long long updated;
+        char text[64];
+
+        if (strcmp(key, "version") == 0)
+            sscanf(values, "%d", &version);
+        else if (strcmp(key, "serial") == 0 && sscanf(values, "%63s", text) == 1)
+            serial_ok = serial == text;
+        else if (strcmp(key, "cacv") == 0 &&
+                 sscanf(values, "%f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f",
+                        &c[0], &c[1], &c[2], &c[3], &c[4], &c[5], &c[6], &c[7], &c[8],
+                        &c[9], &c[10], &c[11], &c[12], &c[13], &c[14], &c[15], &c[16], &c[17]) == 18)
+        {
+            entry.cacv = cacv;
+            cacv_ok = validCacv(cacv);
+        }
+        else if (strcmp(key, "filter") == 0 &&
+                 sscanf(values, "%u %u %u %u %u %u %u", &f[0], &f[1], &f[2], &f[3], &f[4], &f[5], &f[6]) == 7)
+        {
+            entry.config.acc_filter.Ax = f[0];
+            entry.config.acc_filter.Ay = f[1];
+            entry.config.acc_filter.Az = f[2];
+            entry.config.gyro_filter.Rz2_Rx2 = f[3];
+            entry.config.gyro_filter.Rz_Rx = f[4];
+            entry.config.gyro_filter.Ry2 = f[5];
+            entry.config.gyro_filter.Ry = f[6];
+        }
+        else if (strcmp(key, "acc_bias") == 0 && sscanf(values, "%f %f %f", &v[0], &v[1], &v[2]) == 3)
+            memcpy(entry.acc_bias, v, sizeof(v));
+        else if (strcmp(key, "gyro_bias") == 0 && sscanf(values, "%f %f %f", &v[0], &v[1], &v[2]) == 3)
+            memcpy(entry.gyro_bias, v, sizeof(v));
+        else if (strcmp(key, "updated") == 0 && sscanf(values, "%lld", &updated) == 1)
+            entry.updated = updated;
+    }
+    fclose(file);
+
+    return version == CALIBRATION_FORMAT_VERSION && serial_ok && cacv_ok;
+}
+
+/*!
+    \brief Write the entry of a serial number
+
+    Written to a temporary file and renamed over the old one, a crash
+    leaves either the old or the new entry. Failures are reported on
+    stderr, the recorder carries on without the cache.
+
+    \param entry calibration of one sensor
+    \return false if the file could not be written
+*/
+bool CalibrationStore::save(const calibration_entry &entry)
+{
+    if (mkdir(directory_.c_str(), 0755) < 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "Can not create calibration directory %s: %s\n", directory_.c_str(), strerror(errno));
+        return false;
+    }
+
+    const std::string target = path(entry.serial);
+    const std::string temporary = target + ".tmp";
+    FILE *file = fopen(temporary.c_str(), "w");
+    if (!file)
+    {
+        fprintf(stderr, "Can not write %s: %s\n", temporary.c_str(), strerror(errno));
+        return false;
+    }
+
+    // %.9g round-trips every float
+    const float *c = (const float *)&entry.cacv;
+    const scha63x_sensor_config &f = entry.config;
+    fprintf(file, "# scha63x calibration, written by udp_recorder\n");
+    fprintf(file, "version %d\n", CALIBRATION_FORMAT_VERSION);
+    fprintf(file, "serial %s\n", entry.serial.c_str());
+    fprintf(file, "cacv");
+    for (int i = 0; i < 18; i++)
+        fprintf(file, " %.9g", c[i]);
+    fprintf(file, "\nfilter %u %u %u %u %u %u %u\n", f.acc_filter.Ax, f.acc_filter.Ay, f.acc_filter.Az,
+            f.gyro_filter.Rz2_Rx2, f.gyro_filter.Rz_Rx, f.gyro_filter.Ry2, f.gyro_filter.Ry);
+    fprintf(file, "acc_bias %.9g %.9g %.9g\n", entry.acc_bias[0], entry.acc_bias[1], entry.acc_bias[2]);
+    fprintf(file, "gyro_bias %.9g %.9g %.9g\n", entry.gyro_bias[0], entry.gyro_bias[1], entry.gyro_bias[2]);
+    fprintf(file, "updated %lld\n", (long long)entry.updated);
+
+    bool ok = fflush(file) == 0 && fsync(fileno(file)) == 0;
+    ok &= fclose(file) == 0;
+    if (!ok || rename(temporary.c_str(), target.c_str()) < 0)
+    {
+        fprintf(stderr, "Can not write %s: %s\n", target.c_str(), strerror(errno));
+        unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
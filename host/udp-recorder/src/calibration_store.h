@@ -0,0 +1,70 @@
+#ifndef CALIBRATION_STORE_H
+#define CALIBRATION_STORE_H
+
+#include <stdint.h>
+#include <string>
+
+#include "defs.h"
+#include "config.h"
+
+/*!
+    @file calibration_store.h
+    @brief Per-sensor calibration kept between recorder runs
+
+    One text file per serial number, <directory>/<serial>.cal, holding
+    the cross-axis compensation values read from the sensor's NVM, the
+    filter configuration the board last ran with and an optional user
+    calibration. Bias offsets are kept for post-processing, the
+    recorder does not apply them. Boards whose serial number has a
+    valid entry are told in the handshake to skip the test mode NVM
+    read. Files are replaced atomically and can be edited by hand,
+    e.g. to enter bias offsets:
+
+        version 1
+        serial 12345a1B2C
+        cacv cxx cxy cxz cyx cyy cyz czx czy czz bxx bxy bxz byx byy byz bzx bzy bzz
+        filter Ax Ay Az Rz2_Rx2 Rz_Rx Ry2 Ry
+        acc_bias x y z
+        gyro_bias x y z
+        updated unix_time
+*/
+
+
+/*! \brief Calibration file format version */
+#define CALIBRATION_FORMAT_VERSION 1
+
+
+/*!
+    \brief Everything stored for one sensor
+*/
+typedef struct _calibration_entry {
+
+    std::string serial;           // serial number from the handshake
+    scha63x_cacv cacv;            // cross-axis compensation values from NVM
+    scha63x_sensor_config config; // filter configuration of the last run
+    float acc_bias[3];            // user calibration, accelerometer bias in g
+    float gyro_bias[3];           // user calibration, gyro bias in dps
+    int64_t updated;              // unix time of the last NVM read
+
+} calibration_entry;
+
+
+/*!
+    \brief Directory of calibration files, used from the receive thread only
+*/
+class CalibrationStore
+{
+public:
+    explicit CalibrationStore(const std::string &directory = calibration_dir);
+
+    bool load(const std::string &serial, calibration_entry &entry) const;
+    bool save(const calibration_entry &entry);
+    std::string path(const std::string &serial) const;
+
+    static bool validCacv(const scha63x_cacv &cacv);
+
+private:
+    std::string directory_;
+};
+
+#endif
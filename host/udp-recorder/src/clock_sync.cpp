@@ -0,0 +1,314 @@
+/*!
+    @file clock_sync.cpp
+    @brief Device to host clock synchronization
+*/
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include "clock_sync.h"
+
+
+/*!
+    \brief Host minus device time of a pair, ns
+*/
+template <typename Pair>
+static int64_t offset(const Pair &p)
+{
+    return p.host - p.device * 1000;
+}
+
+/*!
+    \brief Window number of a device time, rounding towards minus infinity
+*/
+static int64_t windowOf(int64_t device)
+{
+    return device >= 0 ? device / clock_sync_window_us : -((-device - 1) / clock_sync_window_us) - 1;
+}
+
+/*!
+    \brief Median by partial sort, reorders values
+*/
+static double median(std::vector<double> &values)
+{
+    const size_t mid = values.size() / 2;
+    std::nth_element(values.begin(), values.begin() + mid, values.end());
+    double m = values[mid];
+    if (values.size() % 2 == 0)
+        m = 0.5 * (m + *std::max_element(values.begin(), values.begin() + mid));
+    return m;
+}
+
+
+ClockSync::ClockSync()
+    : pairs_(0), latest_(0), window_open_(false), window_(0), next_(0)
+{
+    memset(&window_min_, 0, sizeof(window_min_));
+    memset(&offset_min_, 0, sizeof(offset_min_));
+    memset(&model_, 0, sizeof(model_));
+    memset(&fit_stats_, 0, sizeof(fit_stats_));
+    shared_ = model_;
+
+    minima_.reserve(clock_sync_windows);
+    slopes_.reserve(clock_sync_windows * (clock_sync_windows - 1) / 2);
+}
+
+/*!
+    \brief Account the send and receive time of one datagram
+
+    micros() wraps every 71 minutes, send times are extended around
+    the latest one. Reordered datagrams of a closed window only count
+    towards the residuals.
+
+    \param send_time       device micros() in the packet header
+    \param receive_time_ns host receive time, CLOCK_MONOTONIC
+*/
+void ClockSync::add(uint32_t send_time, int64_t receive_time_ns)
+{
+    pairs_++;
+    const int64_t device = pairs_ == 1 ? send_time : latest_ + (int32_t)(send_time - (uint32_t)latest_);
+    if (pairs_ == 1 || device > latest_)
+        latest_ = device;
+
+    const pair p = {device, receive_time_ns};
+    const int64_t window = windowOf(device);
+
+    if (window_open_ && window > window_)
+    {
+        closeWindow();
+        window_open_ = false;
+    }
+    if (!window_open_)
+    {
+        window_open_ = true;
+        window_ = window;
+        window_min_ = p;
+    }
+    else if (window == window_ && offset(p) < offset(window_min_))
+    {
+        window_min_ = p;
+    }
+
+    // Offset only until enough windows for a skew estimate
+    if (!model_.fitted && (pairs_ == 1 || offset(p) < offset(offset_min_)))
+    {
+        offset_min_ = p;
+        clock_model model;
+        model.device_ref = p.device;
+        model.host_ref = p.host;
+        model.skew = 0;
+        model.fitted = false;
+        publish(model);
+    }
+
+    const int64_t residual = receive_time_ns - map(model_, device);
+    residuals_.add(residual > 0 ? residual / 1000 : 0);
+}
+
+/*!
+    \brief Keep the smallest delay of the window that ended, refit
+*/
+void ClockSync::closeWindow(void)
+{
+    if (minima_.size() < clock_sync_windows)
+        minima_.push_back(window_min_);
+    else
+        minima_[next_] = window_min_;
+    next_ = (next_ + 1) % clock_sync_windows;
+
+    if (minima_.size() >= clock_sync_min_windows)
+        fit();
+}
+
+/*!
+    \brief Line through the window minima
+
+    A Theil-Sen line (median of the slopes between all pairs of minima
+    at least half a window apart, median intercept) tolerates almost a
+    third of the windows without a single undelayed datagram, e.g.
+    during a host stall. Minima within clock_sync_outlier_us of it are
+    then fitted by least squares, which is less noisy.
+*/
+void ClockSync::fit(void)
+{
+    const size_t n = minima_.size();
+    const pair &base = minima_[0];
+    const pair &newest = minima_[(next_ + clock_sync_windows - 1) % clock_sync_windows];
+
+    // x in us since the base minimum, y in ns of offset change
+    slopes_.clear();
+    for (size_t i = 0; i < n; i++)
+    {
+        for (size_t j = i + 1; j < n; j++)
+        {
+            const double dx = (double)(minima_[j].device - minima_[i].device);
+            if (fabs(dx) < clock_sync_window_us / 2)
+                continue;
+            slopes_.push_back((double)(offset(minima_[j]) - offset(minima_[i])) / dx);
+        }
+    }
+    if (slopes_.empty())
+        return;
+    double slope = median(slopes_);
+
+    slopes_.clear();
+    for (size_t i = 0; i < n; i++)
+        slopes_.push_back((double)(offset(minima_[i]) - offset(base)) - slope * (minima_[i].device - base.device));
+    double intercept = median(slopes_);
+
+    // least squares over the inliers
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    int inliers = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        const double x = (double)(minima_[i].device - base.device);
+        const double y = (double)(offset(minima_[i]) - offset(base));
+        if (fabs(y - intercept - slope * x) > 1000.0 * clock_sync_outlier_us)
+            continue;
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+        inliers++;
+    }
+    const double det = inliers * sxx - sx * sx;
+    if (inliers >= 2 && det > 0)
+    {
+        slope = (inliers * sxy - sx * sy) / det;
+        intercept = (sy - slope * sx) / inliers;
+    }
+
+    double sum = 0, max = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        const double r = (double)(offset(minima_[i]) - offset(base)) - intercept -
+                         slope * (minima_[i].device - base.device);
+        if (fabs(r) > 1000.0 * clock_sync_outlier_us)
+            continue;
+        sum += r * r;
+        max = std::max(max, fabs(r));
+    }
+    fit_stats_.windows = (int)n;
+    fit_stats_.outliers = (int)n - inliers;
+    fit_stats_.rms_us = inliers ? sqrt(sum / inliers) / 1000 : 0;
+    fit_stats_.max_us = max / 1000;
+
+    clock_model model;
+    model.device_ref = newest.device;
+    model.host_ref = newest.device * 1000 + offset(base) +
+                     llround(intercept + slope * (newest.device - base.device));
+    model.skew = slope / 1000;
+    model.fitted = true;
+    publish(model);
+}
+
+/*!
+    \brief Make a new model visible to model()
+*/
+void ClockSync::publish(const clock_model &model)
+{
+    model_ = model;
+    std::lock_guard<std::mutex> guard(lock_);
+    shared_ = model;
+}
+
+/*!
+    \brief Forget all pairs and the model, for a new device clock
+*/
+void ClockSync::reset(void)
+{
+    pairs_ = 0;
+    latest_ = 0;
+    window_open_ = false;
+    window_ = 0;
+    next_ = 0;
+    memset(&window_min_, 0, sizeof(window_min_));
+    memset(&offset_min_, 0, sizeof(offset_min_));
+    memset(&fit_stats_, 0, sizeof(fit_stats_));
+    minima_.clear();
+    slopes_.clear();
+    residuals_.reset();
+
+    clock_model model;
+    memset(&model, 0, sizeof(model));
+    publish(model);
+}
+
+/*!
+    \brief Start a new reporting interval, the residual histogram restarts
+*/
+void ClockSync::endInterval(void)
+{
+    residuals_.reset();
+}
+
+/*!
+    \brief Latest model, for map() from any thread
+
+    Valid once a datagram was added, samples are queued after their
+    datagram so a writer always sees a valid model
+*/
+clock_model ClockSync::model(void) const
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    return shared_;
+}
+
+/*!
+    \brief Extend a 32 bit micros() time around the model's reference
+
+    Only the low 32 bits are used, so timestamps wrapped by the
+    firmware and 64 bit timestamps end up on the same time line.
+    Valid within 35 minutes of the reference.
+*/
+int64_t ClockSync::extend(const clock_model &model, int64_t device_time)
+{
+    return model.device_ref + (int32_t)((uint32_t)device_time - (uint32_t)model.device_ref);
+}
+
+/*!
+    \brief Host time of a device time
+
+    \param model       from model()
+    \param device_time sample timestamp or send time, us
+    \return host CLOCK_MONOTONIC, ns
+*/
+int64_t ClockSync::map(const clock_model &model, int64_t device_time)
+{
+    const int64_t d = extend(model, device_time) - model.device_ref;
+    return model.host_ref + d * 1000 + llround(d * 1000.0 * model.skew);
+}
+
+/*!
+    \brief One human readable line
+*/
+void ClockSync::print(FILE *file, const char *name) const
+{
+    fprintf(file, "%s clock: %s skew %+.2f ppm, host - device %.6f s | fit over %d windows, %d outliers, "
+            "rms/max %.1f/%.1f us | receive above fit p50/p99/max %lu/%lu/%lu us\n",
+            name, model_.fitted ? "fitted," : "offset only,", 1e6 * model_.skew,
+            1e-9 * (model_.host_ref - model_.device_ref * 1000), fit_stats_.windows,
+            fit_stats_.outliers, fit_stats_.rms_us, fit_stats_.max_us,
+            (unsigned long)residuals_.percentile(50), (unsigned long)residuals_.percentile(99),
+            (unsigned long)residuals_.max());
+}
+
+/*!
+    \brief One JSON line, for the stats file
+
+    \param file output
+    \param name board name
+    \param time seconds since the recorder started
+*/
+void ClockSync::printJson(FILE *file, const char *name, double time) const
+{
+    fprintf(file, "{\"board\":\"%s\",\"time\":%.3f,\"clock\":{\"fitted\":%s,\"skew_ppm\":%.3f,"
+            "\"offset_ns\":%ld,\"windows\":%d,\"outliers\":%d,\"fit_rms_us\":%.2f,\"fit_max_us\":%.2f,"
+            "\"residual_us\":{\"p50\":%lu,\"p99\":%lu,\"max\":%lu}}}\n",
+            name, time, model_.fitted ? "true" : "false", 1e6 * model_.skew,
+            (long)(model_.host_ref - model_.device_ref * 1000), fit_stats_.windows,
+            fit_stats_.outliers, fit_stats_.rms_us, fit_stats_.max_us,
+            (unsigned long)residuals_.percentile(50), (unsigned long)residuals_.percentile(99),
+            (unsigned long)residuals_.max());
+}
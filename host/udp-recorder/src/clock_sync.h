@@ -0,0 +1,113 @@
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <mutex>
+#include <vector>
+
+#include "config.h"
+#include "telemetry.h"
+
+/*!
+    @file clock_sync.h
+    @brief Device to host clock synchronization
+
+    Every sample datagram pairs the board's micros() at send time with
+    the host receive time. Queuing only ever adds delay, so the pair
+    with the smallest delay of every clock_sync_window_us of device
+    time is kept, and a robust line through the last
+    clock_sync_windows of them gives the host clock offset and the
+    crystal skew of the board. Maps device timestamps to the host
+    time a datagram sent at that instant is received with the
+    smallest delay, network latency of that path is not observable.
+*/
+
+
+/*!
+    \brief Device to host clock mapping, a straight line
+*/
+typedef struct _clock_model {
+
+    int64_t device_ref; // device time of the reference point, extended to 64 bits, us
+    int64_t host_ref;   // host CLOCK_MONOTONIC at device_ref, ns
+    double skew;        // host seconds per device second - 1
+    bool fitted;        // skew estimated, offset only from the smallest delay before
+
+} clock_model;
+
+/*!
+    \brief Residuals of the current fit
+*/
+typedef struct _clock_fit_stats {
+
+    int windows;        // window minima in the fit
+    int outliers;       // minima left out, more than clock_sync_outlier_us off
+    double rms_us;      // root mean square residual of the other minima
+    double max_us;      // largest absolute residual of the other minima
+
+} clock_fit_stats;
+
+
+/*!
+    \brief Online offset and skew estimator of one board
+
+    add() is called from the receive thread only, model() and map()
+    are safe from any thread
+*/
+class ClockSync
+{
+public:
+    ClockSync();
+
+    ClockSync(const ClockSync &) = delete;
+    ClockSync &operator=(const ClockSync &) = delete;
+
+    void add(uint32_t send_time, int64_t receive_time_ns);
+    void endInterval(void);
+    void reset(void);
+
+    clock_model model(void) const;
+    static int64_t extend(const clock_model &model, int64_t device_time);
+    static int64_t map(const clock_model &model, int64_t device_time);
+
+    uint64_t pairs(void) const { return pairs_; }
+    const clock_fit_stats &fitStats(void) const { return fit_stats_; }
+    const Histogram &residuals(void) const { return residuals_; }
+
+    void print(FILE *file, const char *name) const;
+    void printJson(FILE *file, const char *name, double time) const;
+
+private:
+    /*! \brief Send and receive time of one datagram */
+    struct pair
+    {
+        int64_t device; // extended send time, us
+        int64_t host;   // receive time, ns
+    };
+
+    void closeWindow(void);
+    void fit(void);
+    void publish(const clock_model &model);
+
+    uint64_t pairs_;
+    int64_t latest_;           // latest extended send time, us
+
+    bool window_open_;
+    int64_t window_;           // window number of the open window
+    pair window_min_;          // pair with the smallest delay in the open window
+    pair offset_min_;          // pair with the smallest delay so far, before the first fit
+
+    std::vector<pair> minima_; // ring of window minima, oldest at next_ once full
+    size_t next_;
+    std::vector<double> slopes_;
+
+    clock_model model_;        // receive thread copy
+    clock_fit_stats fit_stats_;
+    Histogram residuals_;      // receive time above the fit per datagram in this interval, us
+
+    mutable std::mutex lock_;  // guards shared_
+    clock_model shared_;
+};
+
+#endif
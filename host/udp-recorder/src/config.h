@@ -14,12 +14,80 @@
 /*! \brief Networking settings */
 #define port 5555
 #define buffer_size 100
-#define struct_size 26  // size of a single IMU data struct
+#define startup_packet_size 1000 // handshake packets of the firmware padded to PACKET_SIZE_STARTUP
 ///@}
 
 
 ///@{
-/*! \brief Size of IMU buffer and struct */
+/*! \brief Batched receive settings */
+#define receive_batch_size 64  // max datagrams drained per recvmmsg call
+#define receive_ring_size 256  // preallocated datagram slots
+#define stats_interval 10      // seconds between receive statistics prints
+///@}
+
+
+///@{
+/*! \brief Multi-board settings */
+#define max_boards 32          // boards served by one recorder
+#define board_ring_size 16384  // samples queued per board
+#define fan_in_workers 2       // conversion and recording threads
+///@}
+
+
+///@{
+/*! \brief Live filter changes, check FanInRecorder::setFilter */
+#define filter_retry_ms 250          // filter command repeated if the board did not answer
+#define filter_send_attempts 4       // filter commands sent before a board is given up
+///@}
+
+
+///@{
+/*! \brief Shared memory sample bus, check shm_bus.h */
+#define shm_bus_capacity 4096        // samples per board ring, power of two
+///@}
+
+
+///@{
+/*! \brief Real-time receive mode, --realtime */
+#define realtime_priority 80             // SCHED_FIFO priority of the receive thread
+#define realtime_rcvbuf 8388608          // socket receive buffer, bytes
+#define realtime_stack_prefault 262144   // receive thread stack touched before receiving, bytes
+///@}
+
+
+///@{
+/*! \brief Stage tracing, built with -DENABLE_TRACING=ON, check trace.h */
+#define trace_ring_events 65536         // events kept per thread, power of two
+///@}
+
+
+///@{
+/*! \brief Calibration cache, check calibration_store.h */
+#define calibration_dir "calibration"    // one file per sensor serial number, --calibration
+///@}
+
+
+///@{
+/*! \brief Device to host clock synchronization */
+#define clock_sync_window_us 1000000 // device time per window, its smallest delay enters the fit
+#define clock_sync_windows 64        // windows in the fit, about a minute
+#define clock_sync_min_windows 8     // windows before skew is estimated, offset only before
+#define clock_sync_outlier_us 1000   // window minima further off the robust line are left out
+///@}
+
+
+///@{
+/*! \brief GNSS time tagging from ubx_streamer.py timepoints and PPS flagged samples */
+#define gnss_port 5555               // localPort of ubx_streamer.py
+#define gnss_hello_ms 1000           // hello repeated until timepoints arrive
+#define gnss_timepoints 32           // recent timepoints in the host to GPS offset
+#define gnss_fit_pps 60              // PPS pairs in the device to GPS fit, a minute
+#define gnss_pps_outlier_us 5000     // PPS further off the fit are left out
+///@}
+
+
+///@{
+/*! \brief Samples per datagram asked from the boards, up to SCHA63X_WIRE_MAX_SAMPLES are received */
 #define imu_buffer_size 4
 #define imu_trigger_rate 500
 ///@}
@@ -55,8 +123,17 @@ struct filters {
 ///@}
 
 
-/*! \brief camera trigger rate */
+///@{
+/*! \brief Camera trigger rate and cameras exposed by every trigger */
 #define cam_trigger_rate 30
+#define cam_count 2
+///@}
+
+///@{
+/*! \brief Frame groups handed out before one is reused, trigger index entries kept per board */
+#define frame_group_pool 4
+#define frame_index_size 1024
+///@}
 
 
 ///@{
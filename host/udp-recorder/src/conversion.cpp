@@ -6,6 +6,12 @@
 #include "conversion.h"
 #include "config.h"
 
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+/*! \brief x86 SIMD kernels, AVX2 selected at runtime */
+#define CONVERSION_X86_SIMD
+#endif
+
 /*! \brief temperature calculation macro */
 #define GET_TEMPERATURE(temp) (25 + ((temp) / 30.0))
 
@@ -28,7 +34,7 @@ void cacvValues(scha63x_cacv values){
     \param data_in  pointer to summed "raw" data from sensor
     \param data_out pointer to converted values
 */
-void scha63x_convert_data(scha63x_raw_data *data_in, scha63x_real_data *data_out)
+void scha63x_convert_data(const scha63x_raw_data *data_in, scha63x_real_data *data_out)
 {
     data_out->acc_x = data_in->acc_x_lsb;
     data_out->acc_y = data_in->acc_y_lsb;
@@ -74,3 +80,279 @@ void scha63x_cross_axis_compensation(scha63x_real_data *data)
     data->gyro_y = gyro_y_comp;
     data->gyro_z = gyro_z_comp;
 }
+
+
+
+// Batch conversion
+
+///@{
+/*! \brief Reciprocal sensitivities, multiplication instead of division per sample */
+static const float acc_scale = 1.0f / (SENSITIVITY_ACC);
+static const float gyro_scale_x = 1.0f / (SENSITIVITY_GYRO_X);
+static const float gyro_scale_y = 1.0f / (SENSITIVITY_GYRO_Y);
+static const float gyro_scale_z = 1.0f / (SENSITIVITY_GYRO_Z);
+static const float temp_scale = 1.0f / 30.0f;
+static const float temp_offset = 25.0f;
+///@}
+
+/*!
+    \brief Scalar batch kernel, also handles the tail of the SIMD kernels
+
+    Same arithmetic order as the SIMD kernels so results match bit for bit
+
+    \param data_in  raw samples
+    \param begin    first sample to convert
+    \param end      one past the last sample to convert
+    \param k        cross-axis compensation values
+    \param data_out SoA output
+*/
+static void convert_batch_scalar(const scha63x_raw_data *data_in, size_t begin, size_t end,
+                                 const scha63x_cacv &k, scha63x_real_batch *data_out)
+{
+
+    for (size_t i = begin; i < end; i++)
+    {
+        const float ax = data_in[i].acc_x_lsb * acc_scale;
+        const float ay = data_in[i].acc_y_lsb * acc_scale;
+        const float az = data_in[i].acc_z_lsb * acc_scale;
+        const float gx = data_in[i].gyro_x_lsb * gyro_scale_x;
+        const float gy = data_in[i].gyro_y_lsb * gyro_scale_y;
+        const float gz = data_in[i].gyro_z_lsb * gyro_scale_z;
+
+        data_out->acc_x[i] = (k.bxx * ax) + (k.bxy * ay) + (k.bxz * az);
+        data_out->acc_y[i] = (k.byx * ax) + (k.byy * ay) + (k.byz * az);
+        data_out->acc_z[i] = (k.bzx * ax) + (k.bzy * ay) + (k.bzz * az);
+        data_out->gyro_x[i] = (k.cxx * gx) + (k.cxy * gy) + (k.cxz * gz);
+        data_out->gyro_y[i] = (k.cyx * gx) + (k.cyy * gy) + (k.cyz * gz);
+        data_out->gyro_z[i] = (k.czx * gx) + (k.czy * gy) + (k.czz * gz);
+
+        data_out->temp_due[i] = temp_offset + data_in[i].temp_due_lsb * temp_scale;
+        data_out->temp_uno[i] = temp_offset + data_in[i].temp_uno_lsb * temp_scale;
+    }
+}
+
+#ifdef CONVERSION_X86_SIMD
+
+/*!
+    \brief Load the eight int16 channels of eight samples as columns
+
+    Each sample holds acc x/y/z, gyro x/y/z and two temperatures as
+    consecutive int16 values, an 8x8 transpose turns them into one
+    register per channel
+
+    \param in pointer to eight consecutive samples
+    \param ch output, ch[0..7] = acc x/y/z, gyro x/y/z, temp due/uno
+*/
+static inline void load_channels(const scha63x_raw_data *in, __m128i ch[8])
+{
+    __m128i r[8];
+    for (int i = 0; i < 8; i++)
+        r[i] = _mm_loadu_si128((const __m128i *)&in[i].acc_x_lsb);
+
+    __m128i t0 = _mm_unpacklo_epi16(r[0], r[1]);
+    __m128i t1 = _mm_unpackhi_epi16(r[0], r[1]);
+    __m128i t2 = _mm_unpacklo_epi16(r[2], r[3]);
+    __m128i t3 = _mm_unpackhi_epi16(r[2], r[3]);
+    __m128i t4 = _mm_unpacklo_epi16(r[4], r[5]);
+    __m128i t5 = _mm_unpackhi_epi16(r[4], r[5]);
+    __m128i t6 = _mm_unpacklo_epi16(r[6], r[7]);
+    __m128i t7 = _mm_unpackhi_epi16(r[6], r[7]);
+
+    __m128i u0 = _mm_unpacklo_epi32(t0, t2);
+    __m128i u1 = _mm_unpackhi_epi32(t0, t2);
+    __m128i u2 = _mm_unpacklo_epi32(t4, t6);
+    __m128i u3 = _mm_unpackhi_epi32(t4, t6);
+    __m128i u4 = _mm_unpacklo_epi32(t1, t3);
+    __m128i u5 = _mm_unpackhi_epi32(t1, t3);
+    __m128i u6 = _mm_unpacklo_epi32(t5, t7);
+    __m128i u7 = _mm_unpackhi_epi32(t5, t7);
+
+    ch[0] = _mm_unpacklo_epi64(u0, u2);
+    ch[1] = _mm_unpackhi_epi64(u0, u2);
+    ch[2] = _mm_unpacklo_epi64(u1, u3);
+    ch[3] = _mm_unpackhi_epi64(u1, u3);
+    ch[4] = _mm_unpacklo_epi64(u4, u6);
+    ch[5] = _mm_unpackhi_epi64(u4, u6);
+    ch[6] = _mm_unpacklo_epi64(u5, u7);
+    ch[7] = _mm_unpackhi_epi64(u5, u7);
+}
+
+/*!
+    \brief SSE2 kernel, eight samples per iteration as two halves of four
+
+    \return number of samples converted, the rest is left for the scalar tail
+*/
+static size_t convert_batch_sse2(const scha63x_raw_data *data_in, size_t count,
+                                 const scha63x_cacv &k, scha63x_real_batch *data_out)
+{
+    const __m128 sa = _mm_set1_ps(acc_scale);
+    const __m128 sgx = _mm_set1_ps(gyro_scale_x);
+    const __m128 sgy = _mm_set1_ps(gyro_scale_y);
+    const __m128 sgz = _mm_set1_ps(gyro_scale_z);
+    const __m128 st = _mm_set1_ps(temp_scale);
+    const __m128 ot = _mm_set1_ps(temp_offset);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i ch[8];
+        load_channels(&data_in[i], ch);
+
+        for (int half = 0; half < 2; half++)
+        {
+            // sign extend four int16 lanes to float
+            __m128 f[8];
+            for (int c = 0; c < 8; c++)
+            {
+                __m128i v = half ? _mm_unpackhi_epi16(ch[c], ch[c]) : _mm_unpacklo_epi16(ch[c], ch[c]);
+                f[c] = _mm_cvtepi32_ps(_mm_srai_epi32(v, 16));
+            }
+
+            const __m128 ax = _mm_mul_ps(f[0], sa);
+            const __m128 ay = _mm_mul_ps(f[1], sa);
+            const __m128 az = _mm_mul_ps(f[2], sa);
+            const __m128 gx = _mm_mul_ps(f[3], sgx);
+            const __m128 gy = _mm_mul_ps(f[4], sgy);
+            const __m128 gz = _mm_mul_ps(f[5], sgz);
+
+#define MAT_ROW(m0, m1, m2, x, y, z) \
+    _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m0), x), _mm_mul_ps(_mm_set1_ps(m1), y)), \
+               _mm_mul_ps(_mm_set1_ps(m2), z))
+
+            const size_t o = i + 4 * half;
+            _mm_storeu_ps(&data_out->acc_x[o], MAT_ROW(k.bxx, k.bxy, k.bxz, ax, ay, az));
+            _mm_storeu_ps(&data_out->acc_y[o], MAT_ROW(k.byx, k.byy, k.byz, ax, ay, az));
+            _mm_storeu_ps(&data_out->acc_z[o], MAT_ROW(k.bzx, k.bzy, k.bzz, ax, ay, az));
+            _mm_storeu_ps(&data_out->gyro_x[o], MAT_ROW(k.cxx, k.cxy, k.cxz, gx, gy, gz));
+            _mm_storeu_ps(&data_out->gyro_y[o], MAT_ROW(k.cyx, k.cyy, k.cyz, gx, gy, gz));
+            _mm_storeu_ps(&data_out->gyro_z[o], MAT_ROW(k.czx, k.czy, k.czz, gx, gy, gz));
+#undef MAT_ROW
+
+            _mm_storeu_ps(&data_out->temp_due[o], _mm_add_ps(ot, _mm_mul_ps(f[6], st)));
+            _mm_storeu_ps(&data_out->temp_uno[o], _mm_add_ps(ot, _mm_mul_ps(f[7], st)));
+        }
+    }
+
+    return i;
+}
+
+/*!
+    \brief AVX2 kernel, eight samples per iteration
+
+    \return number of samples converted, the rest is left for the scalar tail
+*/
+__attribute__((target("avx2")))
+static size_t convert_batch_avx2(const scha63x_raw_data *data_in, size_t count,
+                                 const scha63x_cacv &k, scha63x_real_batch *data_out)
+{
+    const __m256 sa = _mm256_set1_ps(acc_scale);
+    const __m256 sgx = _mm256_set1_ps(gyro_scale_x);
+    const __m256 sgy = _mm256_set1_ps(gyro_scale_y);
+    const __m256 sgz = _mm256_set1_ps(gyro_scale_z);
+    const __m256 st = _mm256_set1_ps(temp_scale);
+    const __m256 ot = _mm256_set1_ps(temp_offset);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i ch[8];
+        load_channels(&data_in[i], ch);
+
+        __m256 f[8];
+        for (int c = 0; c < 8; c++)
+            f[c] = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(ch[c]));
+
+        const __m256 ax = _mm256_mul_ps(f[0], sa);
+        const __m256 ay = _mm256_mul_ps(f[1], sa);
+        const __m256 az = _mm256_mul_ps(f[2], sa);
+        const __m256 gx = _mm256_mul_ps(f[3], sgx);
+        const __m256 gy = _mm256_mul_ps(f[4], sgy);
+        const __m256 gz = _mm256_mul_ps(f[5], sgz);
+
+#define MAT_ROW(m0, m1, m2, x, y, z) \
+    _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m0), x), _mm256_mul_ps(_mm256_set1_ps(m1), y)), \
+                  _mm256_mul_ps(_mm256_set1_ps(m2), z))
+
+        _mm256_storeu_ps(&data_out->acc_x[i], MAT_ROW(k.bxx, k.bxy, k.bxz, ax, ay, az));
+        _mm256_storeu_ps(&data_out->acc_y[i], MAT_ROW(k.byx, k.byy, k.byz, ax, ay, az));
+        _mm256_storeu_ps(&data_out->acc_z[i], MAT_ROW(k.bzx, k.bzy, k.bzz, ax, ay, az));
+        _mm256_storeu_ps(&data_out->gyro_x[i], MAT_ROW(k.cxx, k.cxy, k.cxz, gx, gy, gz));
+        _mm256_storeu_ps(&data_out->gyro_y[i], MAT_ROW(k.cyx, k.cyy, k.cyz, gx, gy, gz));
+        _mm256_storeu_ps(&data_out->gyro_z[i], MAT_ROW(k.czx, k.czy, k.czz, gx, gy, gz));
+#undef MAT_ROW
+
+        _mm256_storeu_ps(&data_out->temp_due[i], _mm256_add_ps(ot, _mm256_mul_ps(f[6], st)));
+        _mm256_storeu_ps(&data_out->temp_uno[i], _mm256_add_ps(ot, _mm256_mul_ps(f[7], st)));
+    }
+
+    return i;
+}
+
+/*!
+    \brief AVX2 support, checked once
+*/
+static bool has_avx2(void)
+{
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+}
+
+#endif // CONVERSION_X86_SIMD
+
+/*!
+    \brief Convert and cross-axis compensate a batch of raw samples
+
+    Equivalent to scha63x_convert_data followed by 
+    scha63x_cross_axis_compensation for every sample, but multiplies
+    by precomputed reciprocal sensitivities, so results may differ
+    from the per-sample path in the last bits. Uses AVX2 or SSE2 when
+    available, scalar code otherwise.
+
+    \param data_in  raw samples
+    \param count    number of samples
+    \param data_out SoA output with room for count samples
+*/
+void scha63x_convert_batch(const scha63x_raw_data *data_in, size_t count, scha63x_real_batch *data_out)
+{
+    scha63x_convert_batch_cacv(data_in, count, &scha63x_cac_values, data_out);
+}
+
+/*!
+    \brief Batch conversion with the CAC values of a given sensor
+
+    Same as scha63x_convert_batch, for recording several boards
+    without the global values set by cacvValues
+
+    \param data_in  raw samples
+    \param count    number of samples
+    \param cacv     cross-axis compensation values of the sensor
+    \param data_out SoA output with room for count samples
+*/
+void scha63x_convert_batch_cacv(const scha63x_raw_data *data_in, size_t count,
+                                const scha63x_cacv *cacv, scha63x_real_batch *data_out)
+{
+    size_t done = 0;
+
+#ifdef CONVERSION_X86_SIMD
+    if (has_avx2())
+        done = convert_batch_avx2(data_in, count, *cacv, data_out);
+    else
+        done = convert_batch_sse2(data_in, count, *cacv, data_out);
+#endif
+
+    convert_batch_scalar(data_in, done, count, *cacv, data_out);
+}
+
+/*!
+    \brief Instruction set used by scha63x_convert_batch
+
+    \return "avx2", "sse2" or "scalar"
+*/
+const char *scha63x_convert_batch_isa(void)
+{
+#ifdef CONVERSION_X86_SIMD
+    return has_avx2() ? "avx2" : "sse2";
+#else
+    return "scalar";
+#endif
+}
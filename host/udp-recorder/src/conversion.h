@@ -1,6 +1,7 @@
 #ifndef CONVERSION_H
 #define CONVERSION_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -12,8 +13,33 @@
 */
 
 
+/*! 
+    \brief Converted and compensated data for a batch of samples
+
+    Structure of arrays, every pointer refers to caller owned
+    storage for at least the number of samples in the batch
+*/
+typedef struct _scha63x_real_batch {
+
+    float *acc_x;
+    float *acc_y;
+    float *acc_z;
+    float *gyro_x;
+    float *gyro_y;
+    float *gyro_z;
+    float *temp_due;
+    float *temp_uno;
+
+} scha63x_real_batch;
+
+
 void cacvValues(scha63x_cacv values);
-void scha63x_convert_data(scha63x_raw_data *data_in, scha63x_real_data *data_out);
+void scha63x_convert_data(const scha63x_raw_data *data_in, scha63x_real_data *data_out);
 void scha63x_cross_axis_compensation(scha63x_real_data *data);
 
+void scha63x_convert_batch(const scha63x_raw_data *data_in, size_t count, scha63x_real_batch *data_out);
+void scha63x_convert_batch_cacv(const scha63x_raw_data *data_in, size_t count,
+                                const scha63x_cacv *cacv, scha63x_real_batch *data_out);
+const char *scha63x_convert_batch_isa(void);
+
 #endif
\ No newline at end of file
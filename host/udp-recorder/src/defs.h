@@ -58,6 +58,10 @@ typedef struct _scha63x_raw_data {
 
     bool cam_trigger;
     bool ubx_trigger;
+
+    uint8_t crc_errors;   // channels whose MISO frame failed its CRC, SCHA63X_WIRE_CRC_*
+
+    int64_t receiveTime;  // host CLOCK_MONOTONIC ns the datagram arrived, 0 if unknown
     
 } scha63x_raw_data;
 
@@ -117,6 +121,8 @@ typedef struct _sensor_data {
     int buffer;
     int imu_trigger;
     int cam_trigger;   // trigger length defined in scha63x config.h
+    int cac_cached;    // set in the reply if the recorder has the board's CAC terms,
+                       // the board then skips the NVM read and the CAC TERMS packet
 
 } sensor_data;
 
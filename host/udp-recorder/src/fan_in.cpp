@@ -0,0 +1,999 @@
+/*!
+    @file fan_in.cpp
+    @brief One recorder for many IMU boards
+*/
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <chrono>
+#include <new>
+#include <stdexcept>
+
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include "fan_in.h"
+#include "receiver.h"
+#include "trace.h"
+
+
+/*! \brief Samples taken from a board's ring per writer call */
+#define writer_batch_size 256
+
+/*! \brief Receive timeout, bounds how long stop() waits for the receive thread */
+#define receive_timeout_us 100000
+
+/*! \brief Most filter codes in a log line, "acc 300 Hz, gyro 300 Hz" */
+#define filter_text_size 32
+
+
+/*!
+    \brief Handshake progress of a board, hello starts a session
+*/
+enum session_state {
+
+    wait_specs,     // config sent, waiting for status and serial number
+    wait_cacv,      // specs sent back, waiting for cross-axis terms
+    wait_timestamp, // waiting for the timestamp of older firmware or the first samples
+    streaming,      // samples are queued for the worker
+    closed,         // board reconnected, worker drains and drops the writer
+    drained,        // writer dropped, the receive thread may reuse the slot
+
+};
+
+/*!
+    \brief One connected board
+
+    Handshake fields are only touched by the receive thread. The writer
+    is created by the receive thread before the state becomes streaming
+    and belongs to the worker afterwards.
+*/
+struct FanInRecorder::session
+{
+    explicit session(size_t capacity)
+        : state(wait_specs), ring(capacity),
+          received(0), written(0), overflows(0), high_water(0),
+          filter_waiting(false), filter_attempts(0), filter_first_sent(0), filter_sent(0),
+          filter_changes(0), filter_failures(0), filter_ns(0)
+    {
+    }
+
+    /*!
+        \brief Counters and clock back to a new session, receive thread
+
+        Only for a drained slot, its ring is empty and its worker
+        no longer touches it
+    */
+    void reset(void)
+    {
+        received.store(0, std::memory_order_relaxed);
+        written.store(0, std::memory_order_relaxed);
+        overflows.store(0, std::memory_order_relaxed);
+        high_water.store(0, std::memory_order_relaxed);
+        filter_waiting = false;
+        filter_attempts = 0;
+        filter_first_sent = 0;
+        filter_sent = 0;
+        filter_changes.store(0, std::memory_order_relaxed);
+        filter_failures.store(0, std::memory_order_relaxed);
+        filter_ns.store(0, std::memory_order_relaxed);
+        telemetry = StreamTelemetry();
+        clock.reset();
+    }
+
+    // The ring is cache line aligned, plain new only guarantees 16 bytes before C++17
+    static void *operator new(size_t size)
+    {
+        void *p;
+        if (posix_memalign(&p, SPSC_CACHE_LINE, size) != 0)
+            throw std::bad_alloc();
+        return p;
+    }
+    static void operator delete(void *p) { free(p); }
+
+    board_info info;
+    std::atomic<int> state;
+    int64_t hello_time;        // receive time of the first hello, receive thread only
+    bool sampled;              // first sample arrived, receive thread only
+    StreamTelemetry telemetry; // receive thread only
+    ClockSync clock;           // fed by the receive thread, mapped by the writer
+
+    SpscRing<scha63x_raw_data> ring;
+    sample_writer writer;
+
+    std::atomic<uint64_t> received;
+    std::atomic<uint64_t> written;
+    std::atomic<uint64_t> overflows;
+    std::atomic<uint64_t> high_water;
+
+    // Filter command of the last setFilter(), receive thread only
+    bool filter_waiting;       // sent, no answer yet
+    int filter_attempts;       // commands sent
+    int64_t filter_first_sent; // host CLOCK_MONOTONIC ns
+    int64_t filter_sent;       // last attempt
+    std::atomic<uint64_t> filter_changes;
+    std::atomic<uint64_t> filter_failures;
+    std::atomic<int64_t> filter_ns;
+};
+
+
+/*!
+    \brief Same board address and port
+*/
+static bool sameAddress(const sockaddr_in &a, const sockaddr_in &b)
+{
+    return a.sin_addr.s_addr == b.sin_addr.s_addr && a.sin_port == b.sin_port;
+}
+
+/*!
+    \brief Startup ping from a board
+*/
+static bool isHello(const char *packet, int bytes)
+{
+    return bytes >= 6 && memcmp(packet, "hello", 6) == 0;
+}
+
+/*!
+    \brief TIMESTAMP packet, not the CAC TERMS of firmware that ignores cac_cached
+
+    Both come zero padded to the same size. The timestamp is up to ten
+    decimal digits of micros() and zeros, CAC TERMS can not look like
+    that, their diagonal terms are close to 1 and set bytes that would
+    be padding, whatever the first byte of cxx is.
+*/
+static bool isTimestamp(const char *packet, int bytes)
+{
+    int digits = 0;
+    while (digits < bytes && isdigit((unsigned char)packet[digits]))
+        digits++;
+    if (digits == 0 || digits > 10)
+        return false;
+
+    const int end = bytes < (int)sizeof(scha63x_cacv) ? bytes : (int)sizeof(scha63x_cacv);
+    for (int i = digits; i < end; i++)
+        if (packet[i] != 0)
+            return false;
+    return true;
+}
+
+/*!
+    \return host CLOCK_MONOTONIC, ns
+*/
+static int64_t monotonicNs(void)
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/*!
+    \brief Filters of a configuration for log lines
+*/
+static void filterText(const scha63x_sensor_config &config, char *text, size_t size)
+{
+    snprintf(text, size, "acc %d Hz, gyro %d Hz", filterHz(config.acc_filter.Ax), filterHz(config.gyro_filter.Ry));
+}
+
+
+/*!
+    \brief Set up the recorder, threads are started with start()
+
+    \param sock           bound UDP socket, no handshake done yet
+    \param config         filter configuration sent to every board
+    \param factory        creates the writer of a board after its handshake
+    \param workers        number of worker threads
+    \param capacity       ring capacity per board in samples
+    \param print_interval seconds between statistics prints, 0 disables
+*/
+FanInRecorder::FanInRecorder(int sock, const scha63x_sensor_config &config, writer_factory factory,
+                             unsigned int workers, size_t capacity, int print_interval)
+    : sock_(sock), config_(config), factory_(factory), workers_(workers ? workers : 1),
+      capacity_(capacity), print_interval_(print_interval), session_count_(0),
+      running_(false), receiving_(false), unknown_(0), kernel_drops_(0), stats_file_(nullptr),
+      realtime_(defaultRealtimeOptions()), calibration_(nullptr), recalibrate_(false),
+      filter_request_(config), filter_requested_(false), filter_sequence_(0), filter_waiting_(0)
+{
+}
+
+FanInRecorder::~FanInRecorder()
+{
+    stop();
+    if (stats_file_)
+        fclose(stats_file_);
+}
+
+/*!
+    \brief Append per-board telemetry to a file every print interval
+
+    Call before start(), one JSON object per board and interval
+
+    \param path stats file, appended to
+    \exception file can not be opened, throws std::runtime_error
+*/
+void FanInRecorder::setStatsFile(const std::string &path)
+{
+    FILE *file = fopen(path.c_str(), "a");
+    if (!file)
+        throw std::runtime_error("Can not open " + path);
+    if (stats_file_)
+        fclose(stats_file_);
+    stats_file_ = file;
+}
+
+/*!
+    \brief Run the receive thread pinned, SCHED_FIFO and with a large socket buffer
+
+    Call before start(). Memory is locked by the caller with
+    lockMemory(), it covers the whole process.
+
+    \param options check realtime.h, busy polling also applies without enabled
+*/
+void FanInRecorder::setRealtime(const realtime_options &options)
+{
+    realtime_ = options;
+}
+
+/*!
+    \brief Keep CAC terms per serial number, boards with a cached entry skip their NVM read
+
+    Call before start(). Entries are written from the receive thread
+    when a board sends its CAC terms.
+
+    \param store       calibration files, outlives the recorder
+    \param recalibrate never offer cached terms, every board reads and refreshes its entry
+*/
+void FanInRecorder::setCalibrationStore(CalibrationStore *store, bool recalibrate)
+{
+    calibration_ = store;
+    recalibrate_ = recalibrate;
+}
+
+/*!
+    \brief Start the receive thread and the worker pool
+*/
+void FanInRecorder::start(void)
+{
+    if (running_)
+        return;
+
+    if (realtime_.enabled && realtime_.rcvbuf > 0)
+        setReceiveBuffer(sock_, realtime_.rcvbuf);
+    if (realtime_.busy_poll_us > 0)
+        setBusyPoll(sock_, realtime_.busy_poll_us);
+
+    // Receive loop wakes up periodically to notice stop()
+    timeval timeout = {0, receive_timeout_us};
+    setsockopt(sock_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    running_ = true;
+    receiving_ = true;
+    for (unsigned int w = 0; w < workers_; w++)
+        worker_threads_.push_back(std::thread(&FanInRecorder::workLoop, this, w));
+    receive_thread_ = std::thread(&FanInRecorder::receiveLoop, this);
+}
+
+/*!
+    \brief Stop receiving, workers drain every board before exiting
+*/
+void FanInRecorder::stop(void)
+{
+    running_ = false;
+    if (receive_thread_.joinable())
+    {
+        receive_thread_.join();
+        if (print_interval_ > 0 && latency_total_.count() > 0)
+        {
+            printLatency(stdout, latency_total_, "whole run");
+            fflush(stdout);
+        }
+    }
+    for (auto &worker : worker_threads_)
+        worker.join();
+    worker_threads_.clear();
+}
+
+/*!
+    \brief Change the filters of all boards, from any thread
+
+    Returns right away, the receive thread sends the filter command
+    within receive_timeout_us. The outcome per board is printed and
+    counted in stats(). A change requested before the boards answered
+    the previous one replaces it.
+
+    \param config new filter configuration
+    \return false if a filter code is not valid, nothing is sent then
+*/
+bool FanInRecorder::setFilter(const scha63x_sensor_config &config)
+{
+    if (!validFilter(config))
+        return false;
+
+    std::lock_guard<std::mutex> lock(filter_lock_);
+    filter_request_ = config;
+    filter_requested_.store(true, std::memory_order_release);
+    return true;
+}
+
+/*!
+    \return number of boards currently streaming
+*/
+int FanInRecorder::streamingBoards(void) const
+{
+    int count = 0;
+    for (int i = 0; i < boards(); i++)
+        if (sessions_[i]->state.load(std::memory_order_acquire) == streaming)
+            count++;
+    return count;
+}
+
+/*!
+    \brief Snapshot of a board's counters
+
+    \param board session number, below boards()
+    \return counters, check fan_in.h
+*/
+board_stats FanInRecorder::stats(int board) const
+{
+    const session &s = *sessions_[board];
+    board_stats stats;
+    stats.received = s.received.load(std::memory_order_relaxed);
+    stats.written = s.written.load(std::memory_order_relaxed);
+    stats.overflows = s.overflows.load(std::memory_order_relaxed);
+    stats.high_water = s.high_water.load(std::memory_order_relaxed);
+    stats.filter_changes = s.filter_changes.load(std::memory_order_relaxed);
+    stats.filter_failures = s.filter_failures.load(std::memory_order_relaxed);
+    stats.filter_ms = 1e-6 * s.filter_ns.load(std::memory_order_relaxed);
+    return stats;
+}
+
+/*!
+    \brief Telemetry of a board's packet stream
+
+    \param board session number, below boards()
+    \return copy, consistent once the recorder is stopped
+*/
+StreamTelemetry FanInRecorder::telemetry(int board) const
+{
+    return sessions_[board]->telemetry;
+}
+
+/*!
+    \brief Device to host clock of a board
+
+    \param board session number, below boards()
+    \return latest model, check ClockSync::map()
+*/
+clock_model FanInRecorder::clockModel(int board) const
+{
+    return sessions_[board]->clock.model();
+}
+
+/*!
+    \brief Handshake results of a board
+
+    \param board session number of a streaming or closed board
+    \return copy of the board information
+*/
+board_info FanInRecorder::info(int board) const
+{
+    return sessions_[board]->info;
+}
+
+/*!
+    \brief Open session of a source address, closed ones of a rebooted board are skipped
+
+    \return session, nullptr if the address is unknown
+*/
+FanInRecorder::session *FanInRecorder::findSession(const sockaddr_in &from)
+{
+    for (int i = session_count_.load(std::memory_order_relaxed) - 1; i >= 0; i--)
+    {
+        const int state = sessions_[i]->state.load(std::memory_order_relaxed);
+        if (state != closed && state != drained && sameAddress(sessions_[i]->info.from, from))
+            return sessions_[i].get();
+    }
+    return nullptr;
+}
+
+/*!
+    \brief Start a session for a board that sent hello
+
+    \param from board address
+    \param time receive time of the hello, host CLOCK_MONOTONIC ns
+    \return new session, nullptr if max_boards sessions are open or draining
+*/
+FanInRecorder::session *FanInRecorder::newSession(const sockaddr_in &from, int64_t time)
+{
+    // A board repeating hello during the handshake starts it over
+    session *previous = findSession(from);
+    if (previous && previous->state.load(std::memory_order_relaxed) < streaming)
+    {
+        previous->state.store(wait_specs, std::memory_order_relaxed);
+        return previous;
+    }
+
+    // Slots of drained sessions first, reconnects do not use up max_boards
+    const int count = session_count_.load(std::memory_order_relaxed);
+    int index = 0;
+    while (index < count && sessions_[index]->state.load(std::memory_order_acquire) != drained)
+        index++;
+    if (index >= max_boards)
+        return nullptr;
+
+    // A rebooted board replaces its old session, which is drained and closed
+    if (previous)
+        previous->state.store(closed, std::memory_order_release);
+
+    if (index < count)
+        sessions_[index]->reset();
+    else
+        sessions_[index].reset(new session(capacity_));
+    session &s = *sessions_[index];
+    s.state.store(wait_specs, std::memory_order_relaxed);
+    memset(&s.info.specs, 0, sizeof(s.info.specs));
+    memset(&s.info.cacv, 0, sizeof(s.info.cacv));
+    s.info.cac_cached = false;
+    s.info.index = index;
+    s.info.from = from;
+    s.info.config = config_;
+    s.info.first_timestamp = 0;
+    s.info.clock = &s.clock;
+    s.hello_time = time;
+    s.sampled = false;
+
+    if (index == count)
+        session_count_.store(index + 1, std::memory_order_release);
+    return &s;
+}
+
+/*!
+    \brief Send a handshake packet to a board
+
+    Handshake packets are buffer_size bytes like in the single board
+    protocol, structs are zero padded
+
+    \exception send failed, throws std::runtime_error
+*/
+void FanInRecorder::sendPacket(const session &s, const void *data, size_t size)
+{
+    char packet[buffer_size];
+    memset(packet, 0, sizeof(packet));
+    memcpy(packet, data, size < sizeof(packet) ? size : sizeof(packet));
+
+    if (sendto(sock_, packet, sizeof(packet), 0,
+               (const struct sockaddr *)&s.info.from, sizeof(s.info.from)) < 0)
+        throw std::runtime_error("Can not send from client");
+}
+
+/*!
+    \brief Send the filters of the last setFilter() to every streaming board
+
+    \param now host CLOCK_MONOTONIC ns
+*/
+void FanInRecorder::applyFilter(int64_t now)
+{
+    {
+        std::lock_guard<std::mutex> lock(filter_lock_);
+        config_ = filter_request_;
+        filter_requested_.store(false, std::memory_order_relaxed);
+    }
+    filter_sequence_++;
+    filter_waiting_ = 0;
+
+    char text[filter_text_size];
+    filterText(config_, text, sizeof(text));
+    printf("Filters %s, sent to %d boards\n", text, streamingBoards());
+    fflush(stdout);
+
+    const int count = session_count_.load(std::memory_order_relaxed);
+    for (int i = 0; i < count; i++)
+    {
+        session &s = *sessions_[i];
+        s.filter_waiting = false;
+        if (s.state.load(std::memory_order_relaxed) != streaming)
+            continue;
+
+        s.filter_attempts = 0;
+        s.filter_first_sent = now;
+        sendFilter(s, now);
+    }
+}
+
+/*!
+    \brief Send the current filter command to a board
+
+    \param s   streaming board
+    \param now host CLOCK_MONOTONIC ns
+*/
+void FanInRecorder::sendFilter(session &s, int64_t now)
+{
+    scha63x_filter_command command;
+    memset(&command, 0, sizeof(command));
+    command.sequence = filter_sequence_;
+    filterCodes(config_, command.filter);
+
+    uint8_t packet[SCHA63X_WIRE_FILTER_SIZE];
+    const size_t size = scha63x_wire_put_filter(packet, &command);
+    if (sendto(sock_, packet, size, 0, (const struct sockaddr *)&s.info.from, sizeof(s.info.from)) < 0)
+        throw std::runtime_error("Can not send from client");
+
+    if (!s.filter_waiting)
+        filter_waiting_++;
+    s.filter_waiting = true;
+    s.filter_attempts++;
+    s.filter_sent = now;
+}
+
+/*!
+    \brief Repeat unanswered filter commands, give up after filter_attempts
+
+    \param now host CLOCK_MONOTONIC ns
+*/
+void FanInRecorder::resendFilters(int64_t now)
+{
+    const int count = session_count_.load(std::memory_order_relaxed);
+    for (int i = 0; i < count; i++)
+    {
+        session &s = *sessions_[i];
+        if (!s.filter_waiting || now - s.filter_sent < filter_retry_ms * 1000000LL)
+            continue;
+
+        if (s.filter_attempts < filter_send_attempts && s.state.load(std::memory_order_relaxed) == streaming)
+        {
+            sendFilter(s, now);
+            continue;
+        }
+
+        s.filter_waiting = false;
+        filter_waiting_--;
+        s.filter_failures.fetch_add(1, std::memory_order_relaxed);
+        fprintf(stderr, "Board %d: no answer to %d filter commands\n", s.info.index, s.filter_attempts);
+    }
+}
+
+/*!
+    \brief Answer of a board to a filter command, sent once its filters settled
+
+    \param s      session of the sender
+    \param answer decoded answer, stale sequence numbers are ignored
+    \param time   receive time, host CLOCK_MONOTONIC ns
+*/
+void FanInRecorder::filterAnswer(session &s, const scha63x_filter_command &answer, int64_t time)
+{
+    if (!s.filter_waiting || answer.sequence != filter_sequence_)
+        return;
+    s.filter_waiting = false;
+    filter_waiting_--;
+
+    const scha63x_sensor_config config = filterFromCodes(answer.filter);
+    char text[filter_text_size];
+    filterText(config, text, sizeof(text));
+    if (answer.status != 0)
+    {
+        s.filter_failures.fetch_add(1, std::memory_order_relaxed);
+        fprintf(stderr, "Board %d: filters %s rejected, status %d\n", s.info.index, text, answer.status);
+        return;
+    }
+
+    const int64_t took = time - s.filter_first_sent;
+    s.filter_ns.store(took, std::memory_order_relaxed);
+    s.filter_changes.fetch_add(1, std::memory_order_relaxed);
+    printf("Board %d: filters %s settled %.1f ms after the command, %u ms settling, %d commands sent\n",
+           s.info.index, text, 1e-6 * took, answer.settle_ms, s.filter_attempts);
+    fflush(stdout);
+}
+
+/*!
+    \brief Advance the startup handshake of a board by one packet
+
+    \param s      session of the sender
+    \param packet received datagram, may be truncated to a receive slot
+    \param bytes  number of valid bytes in packet
+*/
+void FanInRecorder::handshake(session &s, const char *packet, int bytes)
+{
+    board_info &info = s.info;
+
+    switch (s.state.load(std::memory_order_relaxed))
+    {
+    case wait_specs:
+        // STATUS : status and serial number, answered with buffer and trigger info
+        memcpy(&info.specs, packet, (size_t)bytes < sizeof(info.specs) ? bytes : sizeof(info.specs));
+        info.serial.assign(info.specs.serial_num, strnlen(info.specs.serial_num, sizeof(info.specs.serial_num)));
+        info.specs.buffer = imu_buffer_size;
+        info.specs.imu_trigger = imu_trigger_rate;
+        info.specs.cam_trigger = cam_trigger_rate;
+
+        // A cached entry spares the board its test mode NVM read and CAC TERMS
+        info.cac_cached = false;
+        if (calibration_ && !recalibrate_ && !info.serial.empty())
+        {
+            calibration_entry entry;
+            info.cac_cached = calibration_->load(info.serial, entry);
+            if (info.cac_cached)
+                info.cacv = entry.cacv;
+        }
+        info.specs.cac_cached = info.cac_cached;
+
+        sendPacket(s, &info.specs, sizeof(info.specs));
+        s.state.store(info.cac_cached ? wait_timestamp : wait_cacv, std::memory_order_relaxed);
+        break;
+
+    case wait_cacv:
+        // CAC TERMS : kept per board and in the calibration store
+        memcpy(&info.cacv, packet, (size_t)bytes < sizeof(info.cacv) ? bytes : sizeof(info.cacv));
+        if (calibration_)
+            saveCalibration(info);
+        s.state.store(wait_timestamp, std::memory_order_relaxed);
+        break;
+
+    case wait_timestamp:
+    {
+        // Firmware without the cache sends CAC TERMS anyway, they replace the cached ones,
+        // anything else that is no timestamp leaves them alone
+        if (info.cac_cached && !isTimestamp(packet, bytes))
+        {
+            scha63x_cacv cacv;
+            memcpy(&cacv, packet, (size_t)bytes < sizeof(cacv) ? bytes : sizeof(cacv));
+            if (bytes == startup_packet_size && CalibrationStore::validCacv(cacv))
+            {
+                info.cacv = cacv;
+                info.cac_cached = false;
+                saveCalibration(info);
+            }
+            break;
+        }
+
+        // TIMESTAMP : echoed back, samples follow
+        char timestamp[buffer_size + 1];
+        size_t n = (size_t)bytes < buffer_size ? bytes : buffer_size;
+        memcpy(timestamp, packet, n);
+        timestamp[n] = '\0';
+
+        unsigned long firstTimeStamp = 0;
+        sscanf(timestamp, "%lu", &firstTimeStamp);
+        info.first_timestamp = firstTimeStamp;
+        sendPacket(s, timestamp, n);
+        startStreaming(s);
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+/*!
+    \brief Create the board's writer once its handshake is through
+
+    \param s board, info.first_timestamp set
+*/
+void FanInRecorder::startStreaming(session &s)
+{
+    const board_info &info = s.info;
+    s.writer = factory_(info);
+    printf("Board %d: serial %s from IP:%s, Port:%hu streaming, CAC terms %s\n", info.index,
+           info.serial.c_str(), inet_ntoa(info.from.sin_addr), ntohs(info.from.sin_port),
+           info.cac_cached ? "cached" : "read");
+    fflush(stdout);
+    s.state.store(streaming, std::memory_order_release);
+}
+
+/*!
+    \brief Store the CAC terms a board sent, its user calibration is kept
+
+    \param info handshake results with the board's CAC terms
+*/
+void FanInRecorder::saveCalibration(const board_info &info)
+{
+    if (info.serial.empty())
+        return;
+    if (!CalibrationStore::validCacv(info.cacv))
+    {
+        fprintf(stderr, "Board %d: CAC terms of serial %s out of range, not cached\n", info.index,
+                info.serial.c_str());
+        return;
+    }
+
+    calibration_entry entry;
+    calibration_->load(info.serial, entry);
+    entry.cacv = info.cacv;
+    entry.config = info.config;
+    entry.updated = time(nullptr);
+    calibration_->save(entry);
+}
+
+/*!
+    \brief Receive thread, socket to handshakes and board rings
+
+    Never blocks on the workers, samples that do not fit a board's
+    ring are counted as overflows of that board. Spins on the socket
+    when busy polling.
+*/
+void FanInRecorder::receiveLoop(void)
+{
+    if (realtime_.enabled)
+    {
+        setRealtimeThread(realtime_.cpu, realtime_.priority);
+        prefaultStack(realtime_stack_prefault);
+    }
+    const int flags = realtime_.busy_poll_us > 0 ? MSG_DONTWAIT : MSG_WAITFORONE;
+    TRACE_THREAD("receive");
+
+    BatchReceiver receiver(sock_);
+    auto statsStart = std::chrono::steady_clock::now();
+    const auto receiveStart = statsStart;
+
+    while (running_)
+    {
+        int received;
+        try
+        {
+            received = receiver.receive(flags);
+            TRACE_SCOPE_ARG(trace_dispatch, received);
+
+            // Filter commands go out from here, like every packet to the boards
+            if (filter_requested_.load(std::memory_order_acquire))
+                applyFilter(monotonicNs());
+            if (filter_waiting_ > 0)
+                resendFilters(monotonicNs());
+
+            for (int packet = 0; packet < received; packet++)
+            {
+                const receive_slot &slot = receiver.slot(packet);
+                const char *data = receiver.packet(packet);
+                const int bytes = receiver.packetBytes(packet);
+
+                if (isHello(data, bytes))
+                {
+                    session *s = newSession(slot.from, slot.receive_time);
+                    if (!s)
+                    {
+                        fprintf(stderr, "Ignoring hello from IP:%s, %d boards connected already\n",
+                                inet_ntoa(slot.from.sin_addr), max_boards);
+                        continue;
+                    }
+                    // PING : echo hello, CONFIG : send IMU config
+                    sendPacket(*s, data, bytes);
+                    sendPacket(*s, &config_, sizeof(config_));
+                    continue;
+                }
+
+                session *s = findSession(slot.from);
+                if (!s)
+                {
+                    unknown_.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+
+                if (s->state.load(std::memory_order_relaxed) != streaming)
+                {
+                    // The firmware sends no TIMESTAMP, its first sample datagram ends the handshake
+                    if (s->state.load(std::memory_order_relaxed) != wait_timestamp ||
+                        !receiver.isSamplePacket(packet))
+                    {
+                        handshake(*s, data, bytes);
+                        continue;
+                    }
+                    s->info.first_timestamp = receiver.firstTimestamp(packet);
+                    startStreaming(*s);
+                }
+
+                if (!receiver.isSamplePacket(packet))
+                {
+                    scha63x_filter_command answer;
+                    if (scha63x_wire_get_filter((const uint8_t *)data, bytes, &answer))
+                        filterAnswer(*s, answer, slot.receive_time);
+                    else
+                        receiver.countInvalid();
+                    continue;
+                }
+
+                // Duplicates are counted and dropped
+                const unsigned int samples = receiver.samples(packet);
+                const int64_t first_timestamp = receiver.firstTimestamp(packet);
+                if (!s->telemetry.add(slot.header, samples, first_timestamp, slot.receive_time))
+                    continue;
+                s->clock.add(slot.header.send_time, slot.receive_time);
+                if (samples == 0 || int(first_timestamp) == 0)
+                    continue;
+                if (!s->sampled)
+                {
+                    s->sampled = true;
+                    printf("Board %d: first sample %.1f ms after hello\n", s->info.index,
+                           1e-6 * (slot.receive_time - s->hello_time));
+                    fflush(stdout);
+                }
+
+                // Decoded from the receive buffer straight into the ring
+                size_t queued;
+                {
+                    TRACE_SCOPE_ARG(trace_decode, samples);
+                    queued = s->ring.pushBatch(samples, [&](scha63x_raw_data *out, size_t first, size_t n) {
+                        receiver.decode(packet, first, n, out);
+                        s->telemetry.addCrcErrors(out, n);
+                    });
+                }
+                TRACE_COUNT(trace_queued, queued);
+                s->received.fetch_add(queued, std::memory_order_relaxed);
+                if (queued < samples)
+                    s->overflows.fetch_add(samples - queued, std::memory_order_relaxed);
+
+                size_t level = s->ring.size();
+                if (level > s->high_water.load(std::memory_order_relaxed))
+                    s->high_water.store(level, std::memory_order_relaxed);
+
+                // Kernel arrival time, without it the arrival on the fastest path from the clock fit
+                timespec now;
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                const int64_t arrival = slot.kernel_time ? slot.receive_time
+                                                         : ClockSync::map(s->clock.model(), slot.header.send_time);
+                const int64_t latency = now.tv_sec * 1000000000LL + now.tv_nsec - arrival;
+                latency_.add(latency > 0 ? latency : 0);
+            }
+        }
+        catch (std::runtime_error &e)
+        {
+            fprintf(stderr, "%s\n", e.what());
+            running_ = false;
+            break;
+        }
+        kernel_drops_.store(receiver.stats().kernel_drops, std::memory_order_relaxed);
+
+        if (print_interval_ > 0)
+        {
+            auto now = std::chrono::steady_clock::now();
+            std::chrono::duration<double> elapsed = now - statsStart;
+            if (elapsed.count() >= print_interval_)
+            {
+                printReceiveStats(receiver.stats(), elapsed.count());
+                printStats(std::chrono::duration<double>(now - receiveStart).count());
+                receiver.resetStats();
+                statsStart = now;
+            }
+        }
+    }
+
+    latency_total_.merge(latency_);
+    latency_.reset();
+    receiving_.store(false, std::memory_order_release);
+}
+
+/*!
+    \brief Worker thread, serves boards index % workers == worker
+
+    Backs off with short sleeps when all its rings are empty, exits
+    once stopped and drained. Writers are destroyed here, after the
+    last samples of their board.
+*/
+void FanInRecorder::workLoop(unsigned int worker)
+{
+    scha63x_raw_data batch[writer_batch_size];
+    int idle = 0;
+    TRACE_THREAD("worker " + std::to_string(worker));
+
+    while (true)
+    {
+        // Read before draining, a board queued before this point is drained below
+        const bool receiving = receiving_.load(std::memory_order_acquire);
+        const int count = session_count_.load(std::memory_order_acquire);
+        bool busy = false;
+
+        for (int i = worker; i < count; i += workers_)
+        {
+            session &s = *sessions_[i];
+            int state = s.state.load(std::memory_order_acquire);
+            if (state != streaming && state != closed)
+                continue;
+
+            size_t n = s.ring.popBatch(batch, writer_batch_size);
+            if (n > 0)
+            {
+                busy = true;
+                if (s.writer)
+                {
+                    TRACE_SCOPE_ARG(trace_write, n);
+                    s.writer(batch, n);
+                }
+                s.written.fetch_add(n, std::memory_order_relaxed);
+                TRACE_COUNT(trace_written, n);
+            }
+            else if (state == closed)
+            {
+                s.writer = nullptr;
+                s.state.store(drained, std::memory_order_release);
+            }
+        }
+
+        if (busy)
+        {
+            idle = 0;
+            continue;
+        }
+
+        // Receive thread has exited and every ring of this worker is empty
+        if (!receiving)
+            break;
+
+        if (++idle < 64)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+
+    for (int i = worker; i < session_count_.load(std::memory_order_acquire); i += workers_)
+        sessions_[i]->writer = nullptr;
+}
+
+/*!
+    \brief Print per-board counters and telemetry, start a new telemetry interval
+
+    Telemetry also goes to the stats file as one JSON line per board
+
+    \param time seconds since the receive thread started
+*/
+void FanInRecorder::printStats(double time)
+{
+    for (int i = 0; i < boards(); i++)
+    {
+        session &s = *sessions_[i];
+        int state = s.state.load(std::memory_order_acquire);
+        if (state != streaming)
+            continue;
+
+        const std::string name = s.info.serial.empty() ? "board" + std::to_string(i) : s.info.serial;
+        board_stats b = stats(i);
+        printf("board %d %s: %lu queued, %lu written, %lu overflows, high water %lu/%lu\n",
+               i, s.info.serial.c_str(), (unsigned long)b.received, (unsigned long)b.written,
+               (unsigned long)b.overflows, (unsigned long)b.high_water, (unsigned long)s.ring.capacity());
+        if (b.filter_changes || b.filter_failures)
+            printf("board %d %s: %lu filter changes, %lu failed, last %.1f ms\n", i, s.info.serial.c_str(),
+                   (unsigned long)b.filter_changes, (unsigned long)b.filter_failures, b.filter_ms);
+        s.telemetry.print(stdout, name.c_str());
+        s.clock.print(stdout, name.c_str());
+        if (stats_file_)
+        {
+            s.telemetry.printJson(stats_file_, name.c_str(), time);
+            s.clock.printJson(stats_file_, name.c_str(), time);
+        }
+        s.telemetry.endInterval();
+        s.clock.endInterval();
+    }
+    if (latency_.count() > 0)
+    {
+        printLatency(stdout, latency_, "interval");
+        if (stats_file_)
+            fprintf(stats_file_, "{\"time\":%.3f,\"kernel_drops\":%lu,\"receive_latency_us\":{\"realtime\":%s,"
+                    "\"datagrams\":%lu,\"p50\":%.1f,\"p99\":%.1f,\"p999\":%.1f,\"max\":%.1f}}\n",
+                    time, (unsigned long)kernelDrops(), realtime_.enabled ? "true" : "false",
+                    (unsigned long)latency_.count(),
+                    1e-3 * latency_.percentile(50), 1e-3 * latency_.percentile(99),
+                    1e-3 * latency_.percentile(99.9), 1e-3 * latency_.max());
+        latency_total_.merge(latency_);
+        latency_.reset();
+    }
+    if (unknown_.load(std::memory_order_relaxed) > 0)
+        printf("%lu datagrams from boards without handshake\n",
+               (unsigned long)unknown_.load(std::memory_order_relaxed));
+    fflush(stdout);
+    if (stats_file_)
+        fflush(stats_file_);
+}
+
+/*!
+    \brief One line of receive latency percentiles
+
+    \param file    output
+    \param latency datagram arrival to samples queued, ns
+    \param label   period the histogram covers
+*/
+void FanInRecorder::printLatency(FILE *file, const Histogram &latency, const char *label) const
+{
+    fprintf(file, "receive latency (%s, %s): %lu datagrams, p50/p99/p99.9/max %.1f/%.1f/%.1f/%.1f us\n",
+            realtime_.enabled ? "realtime" : "normal", label, (unsigned long)latency.count(),
+            1e-3 * latency.percentile(50), 1e-3 * latency.percentile(99),
+            1e-3 * latency.percentile(99.9), 1e-3 * latency.max());
+}
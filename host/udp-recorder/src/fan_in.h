@@ -0,0 +1,170 @@
+#ifndef FAN_IN_H
+#define FAN_IN_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>
+
+#include "defs.h"
+#include "config.h"
+#include "spsc_ring.h"
+#include "telemetry.h"
+#include "clock_sync.h"
+#include "realtime.h"
+#include "calibration_store.h"
+#include "filter_config.h"
+
+/*!
+    @file fan_in.h
+    @brief One recorder for many IMU boards
+
+    All boards talk to the same port. A receive thread drains the
+    socket, runs the startup handshake of every board by its source
+    address and queues samples of streaming boards into a ring per
+    board. Worker threads convert and record, every board is served
+    by one worker so its samples stay in order.
+
+    setFilter() changes the filters of all streaming boards without a
+    restart: the receive thread sends them a filter command, repeated
+    every filter_retry_ms until the board answers after its filters
+    have settled. Boards connecting later get the new filters in their
+    handshake.
+*/
+
+
+/*!
+    \brief Everything the handshake learned about a board
+*/
+typedef struct _board_info {
+
+    int index;                    // session number, slots of drained sessions are reused
+    sockaddr_in from;             // source address of the board
+    std::string serial;           // serial number reported in the handshake
+
+    sensor_data specs;            // as sent back to the board
+    scha63x_sensor_config config; // filter configuration sent in the handshake, see setFilter()
+    scha63x_cacv cacv;            // cross-axis compensation values of the board
+    bool cac_cached;              // cacv from the calibration store, the board skipped its NVM read
+    int64_t first_timestamp;      // device timestamp of the handshake
+    const ClockSync *clock;       // device to host clock, lives as long as the recorder
+
+} board_info;
+
+/*!
+    \brief Per-board counters, readable from any thread
+*/
+typedef struct _board_stats {
+
+    uint64_t received;   // samples queued by the receive thread
+    uint64_t written;    // samples handed to the board's writer
+    uint64_t overflows;  // samples dropped because the board's ring was full
+    uint64_t high_water; // largest ring occupancy seen
+    uint64_t filter_changes;  // filter commands the board answered with SCHA63X_OK
+    uint64_t filter_failures; // filter commands rejected or not answered
+    double filter_ms;    // last change, command to settled filters on the board
+
+} board_stats;
+
+
+/*!
+    \brief Receive thread, handshakes and worker pool for many boards
+*/
+class FanInRecorder
+{
+public:
+    /*! \brief Writer callback of one board, called from its worker thread */
+    typedef std::function<void(const scha63x_raw_data *samples, size_t count)> sample_writer;
+
+    /*!
+        \brief Creates the writer of a board once its handshake completes
+
+        Called from the receive thread. The writer is destroyed by the
+        worker after the board's last samples, which is where outputs
+        should be flushed and closed.
+    */
+    typedef std::function<sample_writer(const board_info &board)> writer_factory;
+
+    FanInRecorder(int sock, const scha63x_sensor_config &config, writer_factory factory,
+                  unsigned int workers = fan_in_workers,
+                  size_t capacity = board_ring_size,
+                  int print_interval = stats_interval);
+    ~FanInRecorder();
+
+    void setStatsFile(const std::string &path);
+    void setRealtime(const realtime_options &options);
+    void setCalibrationStore(CalibrationStore *store, bool recalibrate = false);
+    void start(void);
+    void stop(void);
+    bool setFilter(const scha63x_sensor_config &config);
+
+    int boards(void) const { return session_count_.load(std::memory_order_acquire); }
+    int streamingBoards(void) const;
+    board_stats stats(int board) const;
+    board_info info(int board) const;
+    StreamTelemetry telemetry(int board) const;
+    clock_model clockModel(int board) const;
+    uint64_t unknownDatagrams(void) const { return unknown_.load(std::memory_order_relaxed); }
+    uint64_t kernelDrops(void) const { return kernel_drops_.load(std::memory_order_relaxed); }
+    const Histogram &receiveLatency(void) const { return latency_total_; }
+
+private:
+    struct session;
+
+    void receiveLoop(void);
+    void workLoop(unsigned int worker);
+
+    session *findSession(const sockaddr_in &from);
+    session *newSession(const sockaddr_in &from, int64_t time);
+    void handshake(session &s, const char *packet, int bytes);
+    void startStreaming(session &s);
+    void saveCalibration(const board_info &info);
+    void sendPacket(const session &s, const void *data, size_t size);
+    void applyFilter(int64_t now);
+    void sendFilter(session &s, int64_t now);
+    void filterAnswer(session &s, const scha63x_filter_command &answer, int64_t time);
+    void resendFilters(int64_t now);
+    void printStats(double time);
+    void printLatency(FILE *file, const Histogram &latency, const char *label) const;
+
+    int sock_;
+    scha63x_sensor_config config_; // receive thread only after start()
+    writer_factory factory_;
+    unsigned int workers_;
+    size_t capacity_;
+    int print_interval_;
+
+    // Slots are appended or, once drained, reused by the receive thread, count published with release
+    std::unique_ptr<session> sessions_[max_boards];
+    std::atomic<int> session_count_;
+
+    std::atomic<bool> running_;
+    std::atomic<bool> receiving_;
+    std::thread receive_thread_;
+    std::vector<std::thread> worker_threads_;
+
+    std::atomic<uint64_t> unknown_;
+    std::atomic<uint64_t> kernel_drops_; // socket overflows, needs enableKernelTimestamps()
+    FILE *stats_file_;
+
+    realtime_options realtime_;
+    CalibrationStore *calibration_; // nullptr without the cache
+    bool recalibrate_;              // boards read their CAC terms anyway, the store is refreshed
+    Histogram latency_;        // arrival to samples queued per datagram in this interval, ns
+    Histogram latency_total_;  // same since start(), read after stop()
+
+    std::mutex filter_lock_;
+    scha63x_sensor_config filter_request_; // next filters, under filter_lock_
+    std::atomic<bool> filter_requested_;   // filter_request_ not applied yet
+    uint16_t filter_sequence_;             // last filter command, receive thread only
+    int filter_waiting_;                   // boards that did not answer it yet, receive thread only
+};
+
+#endif
@@ -0,0 +1,145 @@
+/*!
+    @file filter_config.cpp
+    @brief Sensor filter configurations from cutoff frequencies
+*/
+
+#include <stdlib.h>
+
+#include "filter_config.h"
+
+
+/*! \brief Cutoff of every filter code of struct filters, Hz */
+static const int filter_hz[] = { 13, 20, 46, 200, 300 };
+
+/*! \brief Number of filter codes */
+#define filter_codes (int)(sizeof(filter_hz) / sizeof(filter_hz[0]))
+
+
+/*!
+  \brief generate IMU's filter config from config.h
+
+  Defaults of the Acc_* and Gyro_* settings, --filter replaces them
+
+  \return struct of filter values, structure defined in defs
+*/
+scha63x_sensor_config generateConfig(void)
+{
+    scha63x_sensor_config sensor_config;
+
+    sensor_config.acc_filter.Ax = Acc_Ax;
+    sensor_config.acc_filter.Ay = Acc_Ay;
+    sensor_config.acc_filter.Az = Acc_Az;
+    sensor_config.gyro_filter.Rz2_Rx2 = Gyro_Rz2_Rx2;
+    sensor_config.gyro_filter.Rz_Rx = Gyro_Rz_Rx;
+    sensor_config.gyro_filter.Ry2 = Gyro_Ry2;
+    sensor_config.gyro_filter.Ry = Gyro_Ry;
+
+    return sensor_config;
+}
+
+/*!
+    \brief Same filter on all axes of acc and gyro
+
+    \param acc  filter code of the accelerometer, struct filters
+    \param gyro filter code of the gyro
+*/
+scha63x_sensor_config filterConfig(uint8_t acc, uint8_t gyro)
+{
+    scha63x_sensor_config config;
+    config.acc_filter.Ax = config.acc_filter.Ay = config.acc_filter.Az = acc;
+    config.gyro_filter.Rz2_Rx2 = config.gyro_filter.Rz_Rx = gyro;
+    config.gyro_filter.Ry2 = config.gyro_filter.Ry = gyro;
+    return config;
+}
+
+/*!
+    \return true if every filter code is one of struct filters
+*/
+bool validFilter(const scha63x_sensor_config &config)
+{
+    const uint16_t codes[] = {
+        config.acc_filter.Ax, config.acc_filter.Ay, config.acc_filter.Az, config.gyro_filter.Rz2_Rx2,
+        config.gyro_filter.Rz_Rx, config.gyro_filter.Ry2, config.gyro_filter.Ry,
+    };
+    for (uint16_t code : codes)
+        if (code >= filter_codes)
+            return false;
+    return true;
+}
+
+/*!
+    \brief Filter code of a cutoff frequency
+
+    \return code, -1 if the sensor has no such filter
+*/
+static int filterCode(long hz)
+{
+    for (int code = 0; code < filter_codes; code++)
+        if (filter_hz[code] == hz)
+            return code;
+    return -1;
+}
+
+/*!
+    \brief Parse "HZ" or "ACC_HZ,GYRO_HZ"
+
+    \param text   cutoff frequencies, 13, 20, 46, 200 or 300
+    \param config output, unchanged on failure
+    \return false if text names no filter of the sensor
+*/
+bool parseFilter(const char *text, scha63x_sensor_config &config)
+{
+    char *end;
+    const int acc = filterCode(strtol(text, &end, 10));
+    int gyro = acc;
+    if (*end == ',')
+        gyro = filterCode(strtol(end + 1, &end, 10));
+    if (acc < 0 || gyro < 0 || (*end != '\0' && *end != '\n'))
+        return false;
+
+    config = filterConfig((uint8_t)acc, (uint8_t)gyro);
+    return true;
+}
+
+/*!
+    \return cutoff of a filter code in Hz, 0 for an unknown code
+*/
+int filterHz(uint16_t code)
+{
+    return code < filter_codes ? filter_hz[code] : 0;
+}
+
+/*!
+    \brief Filter codes in the order of the filter command
+
+    \param config filter configuration
+    \param codes  output, SCHA63X_WIRE_FILTER_CODES codes
+*/
+void filterCodes(const scha63x_sensor_config &config, uint8_t *codes)
+{
+    codes[0] = (uint8_t)config.acc_filter.Ax;
+    codes[1] = (uint8_t)config.acc_filter.Ay;
+    codes[2] = (uint8_t)config.acc_filter.Az;
+    codes[3] = (uint8_t)config.gyro_filter.Rz2_Rx2;
+    codes[4] = (uint8_t)config.gyro_filter.Rz_Rx;
+    codes[5] = (uint8_t)config.gyro_filter.Ry2;
+    codes[6] = (uint8_t)config.gyro_filter.Ry;
+}
+
+/*!
+    \brief Filter configuration of a filter command
+
+    \param codes SCHA63X_WIRE_FILTER_CODES codes
+*/
+scha63x_sensor_config filterFromCodes(const uint8_t *codes)
+{
+    scha63x_sensor_config config;
+    config.acc_filter.Ax = codes[0];
+    config.acc_filter.Ay = codes[1];
+    config.acc_filter.Az = codes[2];
+    config.gyro_filter.Rz2_Rx2 = codes[3];
+    config.gyro_filter.Rz_Rx = codes[4];
+    config.gyro_filter.Ry2 = codes[5];
+    config.gyro_filter.Ry = codes[6];
+    return config;
+}
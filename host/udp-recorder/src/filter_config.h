@@ -0,0 +1,30 @@
+#ifndef FILTER_CONFIG_H
+#define FILTER_CONFIG_H
+
+#include <stdint.h>
+
+#include "defs.h"
+#include "config.h"
+#include "scha63x_wire.h"
+
+/*!
+    @file filter_config.h
+    @brief Sensor filter configurations from cutoff frequencies
+
+    The boards compute their filter frames from the scha63x_sensor_config
+    sent in the handshake and change them while streaming on a filter
+    command (scha63x_wire.h). Filters are given in Hz, e.g. "46" for all
+    channels or "46,200" for acc and gyro.
+*/
+
+
+scha63x_sensor_config generateConfig(void);
+scha63x_sensor_config filterConfig(uint8_t acc, uint8_t gyro);
+bool validFilter(const scha63x_sensor_config &config);
+bool parseFilter(const char *text, scha63x_sensor_config &config);
+int filterHz(uint16_t code);
+
+void filterCodes(const scha63x_sensor_config &config, uint8_t *codes);
+scha63x_sensor_config filterFromCodes(const uint8_t *codes);
+
+#endif
@@ -0,0 +1,127 @@
+/*!
+    @file frame_trigger.cpp
+    @brief Camera triggers of a sample stream to frame groups
+*/
+
+#include <math.h>
+#include <string.h>
+#include <stdexcept>
+
+#include "frame_trigger.h"
+
+
+/*!
+    \param cameras frames per group, camera indices 0 .. cameras - 1
+    \param rate    expected triggers per second, 0 disables missed and
+                   early trigger detection
+    \exception no camera, throws std::runtime_error
+*/
+FrameTrigger::FrameTrigger(int cameras, double rate)
+    : cameras_(cameras), period_us_(rate > 0 ? 1e6 / rate : 0), next_group_(0),
+      index_(frame_index_size), current_(nullptr), high_(false)
+{
+    if (cameras_ < 1)
+        throw std::runtime_error("At least one camera is needed for frame groups");
+
+    for (auto &group : pool_)
+    {
+        group.reserve(cameras_);
+        for (int index = 0; index < cameras_; index++)
+        {
+            recorder::FrameData frameData({ .t = 0, .cameraInd = index });
+            group.push_back(frameData);
+        }
+    }
+
+    for (auto &entry : index_)
+        entry.sequence = UINT64_MAX;
+    memset(&stats_, 0, sizeof(stats_));
+}
+
+/*!
+    \brief Feed the next sample of the stream
+
+    Call with every sample in order, the end of a pulse is only seen
+    on the sample after it
+
+    \param sample raw sample
+    \param time   recorded time of the sample, s
+    \return frame group of a new trigger, valid until frame_group_pool
+            more triggers, nullptr without one
+*/
+const std::vector<recorder::FrameData> *FrameTrigger::update(const scha63x_raw_data &sample, double time)
+{
+    if (!sample.cam_trigger)
+    {
+        high_ = false;
+        return nullptr;
+    }
+
+    // flag still set, the same pulse
+    if (high_ && current_)
+    {
+        if (++current_->width == 2)
+            stats_.wide++;
+        if (current_->width > stats_.max_width)
+            stats_.max_width = current_->width;
+        return nullptr;
+    }
+    high_ = true;
+
+    uint64_t sequence = 0;
+    if (current_)
+    {
+        // device time wraps at 32 bits like micros()
+        sequence = current_->sequence + 1;
+        const double gap = (uint32_t)(sample.timeStamp - current_->timestamp);
+        if (period_us_ > 0 && gap > 1.5 * period_us_)
+        {
+            const uint64_t missed = (uint64_t)llround(gap / period_us_) - 1;
+            stats_.missed += missed;
+            sequence += missed;
+        }
+        else if (period_us_ > 0 && gap < 0.5 * period_us_)
+            stats_.early++;
+    }
+
+    current_ = &index_[sequence % frame_index_size];
+    current_->sequence = sequence;
+    current_->timestamp = sample.timeStamp;
+    current_->time = time;
+    current_->width = 1;
+    stats_.triggers++;
+    if (stats_.max_width == 0)
+        stats_.max_width = 1;
+
+    std::vector<recorder::FrameData> &group = pool_[next_group_];
+    next_group_ = (next_group_ + 1) % frame_group_pool;
+    for (auto &frame : group)
+        frame.t = time;
+    return &group;
+}
+
+/*!
+    \brief Trigger of a camera frame
+
+    \param sequence frame number since the first trigger
+    \return trigger, nullptr if it was missed or is no longer indexed
+*/
+const frame_trigger_entry *FrameTrigger::find(uint64_t sequence) const
+{
+    const frame_trigger_entry &entry = index_[sequence % frame_index_size];
+    return entry.sequence == sequence ? &entry : nullptr;
+}
+
+/*!
+    \brief Print the trigger counters of a board
+
+    \param file output
+    \param name board name
+*/
+void FrameTrigger::print(FILE *file, const char *name) const
+{
+    fprintf(file, "%s: %llu camera triggers (%d frames each), %llu missed, %llu early, "
+            "%llu wide pulses, longest %u samples\n",
+            name, (unsigned long long)stats_.triggers, cameras_, (unsigned long long)stats_.missed,
+            (unsigned long long)stats_.early, (unsigned long long)stats_.wide, stats_.max_width);
+}
@@ -0,0 +1,83 @@
+#ifndef FRAME_TRIGGER_H
+#define FRAME_TRIGGER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#include <jsonl-recorder/recorder.hpp>
+
+#include "defs.h"
+#include "config.h"
+
+/*!
+    @file frame_trigger.h
+    @brief Camera triggers of a sample stream to frame groups
+
+    A trigger is the rising edge of cam_trigger, a flag held over
+    several samples is one wide pulse. Every trigger hands out a
+    frame group of one frame per camera from a pool of
+    frame_group_pool groups allocated up front, and is kept in an
+    index of the last frame_index_size triggers by frame sequence.
+    Triggers missing at the expected rate, e.g. in lost datagrams,
+    still advance the sequence so it keeps counting camera frames.
+    update() never allocates.
+*/
+
+
+/*!
+    \brief One camera trigger
+*/
+typedef struct _frame_trigger_entry {
+
+    uint64_t sequence;   // frame number since the first trigger, missed triggers included
+    int64_t timestamp;   // device time of the trigger sample, us
+    double time;         // recorded time of the frame group, s
+    uint32_t width;      // samples the trigger flag was set, grows until the pulse ends
+
+} frame_trigger_entry;
+
+/*!
+    \brief Trigger counters since the start of the stream
+*/
+typedef struct _frame_trigger_stats {
+
+    uint64_t triggers;   // rising edges, one frame group each
+    uint64_t missed;     // triggers absent from the stream at the trigger rate
+    uint64_t early;      // triggers less than half a period after the previous one
+    uint64_t wide;       // pulses longer than one sample
+    uint32_t max_width;  // longest pulse in samples
+
+} frame_trigger_stats;
+
+
+/*!
+    \brief Trigger detection and frame groups of one board
+*/
+class FrameTrigger
+{
+public:
+    explicit FrameTrigger(int cameras = cam_count, double rate = cam_trigger_rate);
+
+    const std::vector<recorder::FrameData> *update(const scha63x_raw_data &sample, double time);
+
+    const frame_trigger_entry *find(uint64_t sequence) const;
+    const frame_trigger_stats &stats(void) const { return stats_; }
+    int cameras(void) const { return cameras_; }
+
+    void print(FILE *file, const char *name) const;
+
+private:
+    int cameras_;
+    double period_us_;    // expected time between triggers
+
+    std::vector<recorder::FrameData> pool_[frame_group_pool];
+    unsigned int next_group_;
+
+    std::vector<frame_trigger_entry> index_; // ring by sequence
+    frame_trigger_entry *current_;           // latest trigger, nullptr before the first
+    bool high_;                              // trigger flag of the previous sample
+    frame_trigger_stats stats_;
+};
+
+#endif
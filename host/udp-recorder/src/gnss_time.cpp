@@ -0,0 +1,409 @@
+/*!
+    @file gnss_time.cpp
+    @brief GPS time of week of samples from PPS flags and ubx_streamer timepoints
+*/
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdexcept>
+
+#include <sys/socket.h>
+
+#include "gnss_time.h"
+
+
+/*!
+    \return CLOCK_MONOTONIC in ns, same clock as receive times
+*/
+static int64_t monotonicNs(void)
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/*!
+    \brief Value wrapped into [-week / 2, week / 2)
+*/
+static int64_t wrapWeek(int64_t v, int64_t week)
+{
+    v %= week;
+    if (v >= week / 2)
+        v -= week;
+    else if (v < -week / 2)
+        v += week;
+    return v;
+}
+
+/*!
+    \brief Read a protobuf varint
+
+    \return false if the buffer ends inside it
+*/
+static bool readVarint(const uint8_t *&p, const uint8_t *end, uint64_t &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7)
+    {
+        const uint8_t byte = *p++;
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+/*!
+    \brief Decode a timepoint message of timestamp.proto
+
+    Hand decoded, field 1 iTOW as varint, other fields are skipped
+
+    \param data  datagram from ubx_streamer.py
+    \param size  datagram length
+    \param itow  output, GPS time of week in ms
+    \return false if the datagram holds no valid iTOW
+*/
+bool gnssParseTimepoint(const uint8_t *data, size_t size, int32_t &itow)
+{
+    const uint8_t *p = data, *end = data + size;
+    bool found = false;
+
+    while (p < end)
+    {
+        uint64_t key, value;
+        if (!readVarint(p, end, key))
+            return false;
+
+        switch (key & 7)
+        {
+        case 0: // varint
+            if (!readVarint(p, end, value))
+                return false;
+            if ((key >> 3) == 1)
+            {
+                itow = (int32_t)value;
+                found = true;
+            }
+            break;
+        case 1: // 64 bit
+            p += 8;
+            break;
+        case 2: // length delimited
+            if (!readVarint(p, end, value) || value > (uint64_t)(end - p))
+                return false;
+            p += value;
+            break;
+        case 5: // 32 bit
+            p += 4;
+            break;
+        default:
+            return false;
+        }
+    }
+    return found && p == end && itow >= 0 && itow < gnss_week_ms;
+}
+
+
+GnssTimepoints::GnssTimepoints()
+    : next_(0), count_(0)
+{
+    offsets_.reserve(gnss_timepoints);
+}
+
+/*!
+    \brief Account one timepoint
+
+    \param itow    GPS time of week of the solution, ms
+    \param host_ns arrival time, CLOCK_MONOTONIC
+*/
+void GnssTimepoints::add(int32_t itow, int64_t host_ns)
+{
+    const int64_t offset = (int64_t)itow * 1000000 - host_ns;
+
+    std::lock_guard<std::mutex> lock(lock_);
+    if (offsets_.size() < gnss_timepoints)
+        offsets_.push_back(offset);
+    else
+        offsets_[next_] = offset;
+    next_ = (next_ + 1) % gnss_timepoints;
+    count_++;
+}
+
+/*!
+    \brief Host to GPS time of week offset
+
+    Largest iTOW minus arrival time of the recent timepoints, short
+    of the true offset by the shortest latency of the solutions
+
+    \param offset_ns output, GPS time of week = host time + offset, modulo a week
+    \return false before the first timepoint
+*/
+bool GnssTimepoints::offset(int64_t &offset_ns) const
+{
+    const int64_t week = gnss_week_ms * 1000000;
+
+    std::lock_guard<std::mutex> lock(lock_);
+    if (offsets_.empty())
+        return false;
+
+    // relative to the newest, the offsets jump by a week at rollover
+    const int64_t newest = offsets_[(next_ + offsets_.size() - 1) % offsets_.size()];
+    int64_t largest = 0;
+    for (int64_t offset : offsets_)
+    {
+        const int64_t d = wrapWeek(offset - newest, week);
+        if (d > largest)
+            largest = d;
+    }
+    offset_ns = newest + largest;
+    return true;
+}
+
+/*!
+    \return timepoints received
+*/
+uint64_t GnssTimepoints::count(void) const
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    return count_;
+}
+
+
+/*!
+    \param timepoints shared timepoints, outlive the clock
+*/
+GpsClock::GpsClock(const GnssTimepoints &timepoints)
+    : timepoints_(timepoints), next_(0), latest_(0), week_(0), rejected_(0)
+{
+    memset(&model_, 0, sizeof(model_));
+    memset(&stats_, 0, sizeof(stats_));
+    pairs_.reserve(gnss_fit_pps);
+}
+
+/*!
+    \brief micros() extended to 64 bits around the latest PPS
+*/
+int64_t GpsClock::extend(int64_t device_time) const
+{
+    if (stats_.pps == 1)
+        return (uint32_t)device_time;
+    return latest_ + (int32_t)((uint32_t)device_time - (uint32_t)latest_);
+}
+
+/*!
+    \brief Account a PPS flagged sample
+
+    The GPS second is the host time of the sample plus the timepoint
+    offset, rounded. PPS more than gnss_pps_outlier_us off the fit
+    are left out, three in a row start a new fit, e.g. after a board
+    reset.
+
+    \param device_time device time of the PPS, micros()
+    \param host_ns     host time of the PPS within a few 100 ms, e.g. the datagram's receive time
+*/
+void GpsClock::addPps(int64_t device_time, int64_t host_ns)
+{
+    stats_.pps++;
+    const int64_t device = extend(device_time);
+    if (stats_.pps == 1 || device > latest_)
+        latest_ = device;
+
+    int64_t offset_ns;
+    if (host_ns == 0 || !timepoints_.offset(offset_ns))
+    {
+        stats_.unpaired++;
+        return;
+    }
+
+    const int64_t tow = wrapWeek((host_ns + offset_ns) / 1000000, gnss_week_ms);
+    int64_t gps = (tow < 0 ? tow + gnss_week_ms : tow) + 500;
+    gps -= gps % 1000;
+
+    // continuous across week rollovers
+    gps += week_;
+    if (model_.valid && gps < model_.gps_ref - gnss_week_ms / 2)
+    {
+        week_ += gnss_week_ms;
+        gps += gnss_week_ms;
+    }
+
+    if (model_.valid)
+    {
+        const double predicted = model_.gps_ref + model_.rate * (device - model_.device_ref) / 1000;
+        if (fabs(gps - predicted) * 1000 > gnss_pps_outlier_us)
+        {
+            stats_.outliers++;
+            if (++rejected_ < 3)
+                return;
+            pairs_.clear();
+            next_ = 0;
+        }
+    }
+    rejected_ = 0;
+
+    const pair p = {device, gps};
+    if (pairs_.size() < gnss_fit_pps)
+        pairs_.push_back(p);
+    else
+        pairs_[next_] = p;
+    next_ = (next_ + 1) % gnss_fit_pps;
+    fit();
+}
+
+/*!
+    \brief Least squares line through the PPS pairs
+*/
+void GpsClock::fit(void)
+{
+    const size_t n = pairs_.size();
+    const pair &newest = pairs_[(next_ + n - 1) % n];
+
+    model_.device_ref = newest.device;
+    model_.gps_ref = newest.gps;
+    model_.rate = 1;
+    model_.valid = true;
+    stats_.pairs = (int)n;
+    stats_.max_us = 0;
+    if (n < 2)
+        return;
+
+    // x in us before the newest PPS, y in us of GPS time
+    double sx = 0, sy = 0;
+    for (const pair &q : pairs_)
+    {
+        sx += q.device - newest.device;
+        sy += 1000.0 * (q.gps - newest.gps);
+    }
+    const double mx = sx / n, my = sy / n;
+    double sxx = 0, sxy = 0;
+    for (const pair &q : pairs_)
+    {
+        const double dx = q.device - newest.device - mx;
+        sxx += dx * dx;
+        sxy += dx * (1000.0 * (q.gps - newest.gps) - my);
+    }
+    if (sxx <= 0)
+        return;
+
+    model_.rate = sxy / sxx;
+    model_.gps_ref = newest.gps + (my - model_.rate * mx) / 1000;
+
+    for (const pair &q : pairs_)
+    {
+        const double residual = 1000.0 * q.gps - 1000.0 * model_.gps_ref - model_.rate * (q.device - newest.device);
+        if (fabs(residual) > stats_.max_us)
+            stats_.max_us = fabs(residual);
+    }
+}
+
+/*!
+    \brief GPS time of week of a device timestamp
+
+    \param model       from model(), valid
+    \param device_time device micros(), within 35 minutes of the newest PPS
+    \return GPS time of week, s
+*/
+double GpsClock::map(const gps_model &model, int64_t device_time)
+{
+    const int64_t device = model.device_ref + (int32_t)((uint32_t)device_time - (uint32_t)model.device_ref);
+    const double gps = fmod(model.gps_ref + model.rate * (device - model.device_ref) / 1000, gnss_week_ms);
+    return (gps < 0 ? gps + gnss_week_ms : gps) / 1000;
+}
+
+/*!
+    \brief Print the fit of a board
+
+    \param file output
+    \param name board name
+*/
+void GpsClock::print(FILE *file, const char *name) const
+{
+    if (!model_.valid)
+    {
+        fprintf(file, "%s: no GPS time, %llu PPS, %llu without timepoints\n", name,
+                (unsigned long long)stats_.pps, (unsigned long long)stats_.unpaired);
+        return;
+    }
+    fprintf(file, "%s: GPS time from %d PPS, max residual %.1f us, device clock %+.2f ppm, "
+            "%llu PPS without timepoints, %llu outliers\n",
+            name, stats_.pairs, stats_.max_us, 1e6 * (model_.rate - 1),
+            (unsigned long long)stats_.unpaired, (unsigned long long)stats_.outliers);
+}
+
+
+/*!
+    \brief Open a socket towards ubx_streamer.py
+
+    \param streamer   address ubx_streamer.py listens on
+    \param timepoints receives every timepoint
+    \exception socket creation failed, throws std::runtime_error
+*/
+GnssListener::GnssListener(const sockaddr_in &streamer, GnssTimepoints &timepoints)
+    : streamer_(streamer), timepoints_(timepoints), running_(false)
+{
+    sock_ = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock_ < 0)
+        throw std::runtime_error("Can not create GNSS socket");
+
+    // timeout to see stop() and repeat the hello
+    timeval timeout = {0, 100000};
+    setsockopt(sock_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+}
+
+GnssListener::~GnssListener()
+{
+    stop();
+    close(sock_);
+}
+
+void GnssListener::start(void)
+{
+    if (running_)
+        return;
+    running_ = true;
+    thread_ = std::thread(&GnssListener::run, this);
+}
+
+void GnssListener::stop(void)
+{
+    running_ = false;
+    if (thread_.joinable())
+        thread_.join();
+}
+
+/*!
+    \brief Receive timepoints, say hello while none arrive
+*/
+void GnssListener::run(void)
+{
+    int64_t last_hello = 0, last_timepoint = 0;
+    const int64_t hello_ns = gnss_hello_ms * 1000000LL;
+
+    while (running_)
+    {
+        const int64_t now = monotonicNs();
+        if (now - last_timepoint > 2 * hello_ns && now - last_hello > hello_ns)
+        {
+            sendto(sock_, "hello", 6, 0, (const sockaddr *)&streamer_, sizeof(streamer_));
+            last_hello = now;
+        }
+
+        uint8_t packet[buffer_size];
+        sockaddr_in from;
+        socklen_t from_size = sizeof(from);
+        const ssize_t n = recvfrom(sock_, packet, sizeof(packet), 0, (sockaddr *)&from, &from_size);
+        const int64_t arrival = monotonicNs();
+        if (n <= 0 || from.sin_addr.s_addr != streamer_.sin_addr.s_addr || from.sin_port != streamer_.sin_port)
+            continue;
+
+        int32_t itow;
+        if (gnssParseTimepoint(packet, n, itow))
+        {
+            timepoints_.add(itow, arrival);
+            last_timepoint = arrival;
+        }
+    }
+}
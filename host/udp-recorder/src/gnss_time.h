@@ -0,0 +1,153 @@
+#ifndef GNSS_TIME_H
+#define GNSS_TIME_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>
+
+#include "config.h"
+
+/*!
+    @file gnss_time.h
+    @brief GPS time of week of samples from PPS flags and ubx_streamer timepoints
+
+    The board sets ubx_trigger on the first sample after the receiver's
+    timepulse, which comes at every whole GPS second. ubx_streamer.py
+    sends the iTOW of every confirmed UBX-NAV-PVT solution as a
+    protobuf timepoint. Timepoints arrive on the host some time after
+    their epoch, so iTOW minus host arrival time is at most the true
+    host to GPS offset, the largest of the recent ones lacks only the
+    shortest message latency. That offset names the GPS second of
+    every PPS, PPS to GPS second pairs then give a least squares line
+    from device time to GPS time per board, good to about half a
+    sample period where the flag quantizes the PPS.
+*/
+
+
+/*! \brief GPS week in ms, iTOW wraps here */
+#define gnss_week_ms 604800000LL
+
+
+/*!
+    \brief Device to GPS time mapping of one board, a straight line
+*/
+typedef struct _gps_model {
+
+    int64_t device_ref; // device time of the newest PPS, extended to 64 bits, us
+    double gps_ref;     // GPS time at device_ref, ms since the start of the first week seen
+    double rate;        // GPS seconds per device second, 1 until the second PPS
+    bool valid;         // one PPS at least
+
+} gps_model;
+
+/*!
+    \brief Residuals of the current fit
+*/
+typedef struct _gps_fit_stats {
+
+    uint64_t pps;       // PPS flags seen
+    uint64_t unpaired;  // PPS without a host to GPS offset yet
+    uint64_t outliers;  // PPS further than gnss_pps_outlier_us off the fit
+    int pairs;          // PPS in the fit
+    double max_us;      // largest absolute residual in the fit
+
+} gps_fit_stats;
+
+
+bool gnssParseTimepoint(const uint8_t *data, size_t size, int32_t &itow);
+
+
+/*!
+    \brief Recent ubx_streamer timepoints, shared by all boards
+
+    add() from the listener thread, offset() from any thread
+*/
+class GnssTimepoints
+{
+public:
+    GnssTimepoints();
+
+    void add(int32_t itow, int64_t host_ns);
+    bool offset(int64_t &offset_ns) const;
+    uint64_t count(void) const;
+
+private:
+    mutable std::mutex lock_;
+    std::vector<int64_t> offsets_;  // ring of iTOW minus arrival time, ns
+    size_t next_;
+    uint64_t count_;
+};
+
+
+/*!
+    \brief Device to GPS time fit of one board, used by its worker only
+*/
+class GpsClock
+{
+public:
+    explicit GpsClock(const GnssTimepoints &timepoints);
+
+    void addPps(int64_t device_time, int64_t host_ns);
+
+    const gps_model &model(void) const { return model_; }
+    static double map(const gps_model &model, int64_t device_time);
+    const gps_fit_stats &fitStats(void) const { return stats_; }
+
+    void print(FILE *file, const char *name) const;
+
+private:
+    /*! \brief One PPS and its GPS second */
+    struct pair
+    {
+        int64_t device; // extended device time, us
+        int64_t gps;    // ms since the start of the first week seen
+    };
+
+    int64_t extend(int64_t device_time) const;
+    void fit(void);
+
+    const GnssTimepoints &timepoints_;
+    std::vector<pair> pairs_; // ring of the last gnss_fit_pps
+    size_t next_;
+    int64_t latest_;          // latest extended device time, us
+    int64_t week_;            // ms added to iTOW for week rollovers
+    int rejected_;            // outliers in a row
+    gps_model model_;
+    gps_fit_stats stats_;
+};
+
+
+/*!
+    \brief Receives ubx_streamer timepoints on a thread of its own
+
+    ubx_streamer.py only sends to a client that sent it a datagram,
+    a hello is repeated until timepoints arrive and after they stop
+*/
+class GnssListener
+{
+public:
+    GnssListener(const sockaddr_in &streamer, GnssTimepoints &timepoints);
+    ~GnssListener();
+
+    GnssListener(const GnssListener &) = delete;
+    GnssListener &operator=(const GnssListener &) = delete;
+
+    void start(void);
+    void stop(void);
+
+private:
+    void run(void);
+
+    sockaddr_in streamer_;
+    GnssTimepoints &timepoints_;
+    int sock_;
+    std::thread thread_;
+    std::atomic<bool> running_;
+};
+
+#endif
@@ -0,0 +1,137 @@
+/*!
+    @file jsonl_output.cpp
+    @brief Raw samples to jsonl-recorder output
+*/
+
+#include "jsonl_output.h"
+#include "trace.h"
+
+
+/*! \brief microseconds in second*/
+#define micros 1000000
+
+
+/*!
+    \param recorder        jsonl-recorder instance
+    \param first_timestamp device timestamp received in the handshake,
+                           recorded times are relative to it
+    \param cacv            CAC values of the recorded board, nullptr uses
+                           the values set by cacvValues()
+    \param cameras         frames in the frame group of every camera trigger
+*/
+JsonlSampleWriter::JsonlSampleWriter(recorder::Recorder &recorder, int64_t first_timestamp,
+                                     const scha63x_cacv *cacv, int cameras)
+    : recorder_(recorder), first_timestamp_(first_timestamp), clock_(nullptr), clock_offset_ns_(0),
+      last_timestamp_(-1), gps_skipped_(0), board_cacv_(cacv != nullptr), trigger_(cameras)
+{
+    if (cacv)
+        cacv_ = *cacv;
+}
+
+/*!
+    \brief Record host times instead of times since the handshake
+
+    Timestamps are mapped with the board's clock model, in seconds
+    of CLOCK_MONOTONIC shifted by offset_ns, so boards recorded
+    together share one time line
+
+    \param clock     clock of the recorded board, nullptr records device time
+    \param offset_ns added to CLOCK_MONOTONIC, e.g. CLOCK_REALTIME - CLOCK_MONOTONIC
+*/
+void JsonlSampleWriter::setHostClock(const ClockSync *clock, int64_t offset_ns)
+{
+    clock_ = clock;
+    clock_offset_ns_ = offset_ns;
+}
+
+/*!
+    \brief Record GPS time of week instead of times since the handshake
+
+    Timestamps are mapped with a fit of the board's PPS flagged
+    samples, samples before the first PPS with a timepoint offset are
+    not recorded. Needs receive times, live recording only.
+
+    \param timepoints timepoints of ubx_streamer.py, nullptr records device time
+*/
+void JsonlSampleWriter::setGpsClock(const GnssTimepoints *timepoints)
+{
+    gps_.reset(timepoints ? new GpsClock(*timepoints) : nullptr);
+}
+
+/*!
+    \brief Convert, compensate and record a batch of samples
+
+    \param data_vector raw samples
+    \param count       number of samples
+*/
+void JsonlSampleWriter::write(const scha63x_raw_data *data_vector, size_t count)
+{
+    if (channels_[0].size() < count)
+    {
+        for (auto &channel : channels_)
+            channel.resize(count);
+        batch_ = { channels_[0].data(), channels_[1].data(), channels_[2].data(), channels_[3].data(),
+                   channels_[4].data(), channels_[5].data(), channels_[6].data(), channels_[7].data() };
+    }
+
+    // data conversion and cross-axis compensation for the whole batch
+    {
+        TRACE_SCOPE_ARG(trace_convert, count);
+        if (board_cacv_)
+            scha63x_convert_batch_cacv(data_vector, count, &cacv_, &batch_);
+        else
+            scha63x_convert_batch(data_vector, count, &batch_);
+    }
+
+    clock_model model;
+    if (clock_)
+        model = clock_->model();
+
+    TRACE_SCOPE_ARG(trace_record, count);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        double timeStamp;
+        if (gps_)
+        {
+            // PPS came between the previous sample and the flagged one
+            const int64_t ts = data_vector[i].timeStamp;
+            if (data_vector[i].ubx_trigger)
+            {
+                const uint32_t gap = last_timestamp_ < 0 ? 1000000 / imu_trigger_rate
+                                                         : (uint32_t)(ts - last_timestamp_);
+                gps_->addPps((uint32_t)(ts - gap / 2), data_vector[i].receiveTime);
+            }
+            last_timestamp_ = (uint32_t)ts;
+
+            if (!gps_->model().valid)
+            {
+                gps_skipped_++;
+                continue;
+            }
+            timeStamp = GpsClock::map(gps_->model(), ts);
+        }
+        else if (clock_)
+        {
+            const int64_t host = ClockSync::map(model, data_vector[i].timeStamp) + clock_offset_ns_;
+            timeStamp = host / 1000000000 + 1e-9 * (host % 1000000000);
+        }
+        else
+        {
+            // Timestamping should be checked, first timestamp would be positive 0
+            unsigned long timeStamp1 = data_vector[i].timeStamp - first_timestamp_;
+            timeStamp = (float)(1.0 * timeStamp1 / micros);
+        }
+
+        // IMU data, gyro & accel
+        recorder_.addGyroscope(timeStamp, \
+            batch_.gyro_x[i], batch_.gyro_y[i], batch_.gyro_z[i]);
+        recorder_.addAccelerometer(timeStamp, \
+            batch_.acc_x[i], batch_.acc_y[i], batch_.acc_z[i]);
+
+        // CAM frame, from the trigger stage's pool
+        const std::vector<recorder::FrameData> *frameGroup = trigger_.update(data_vector[i], timeStamp);
+        if (frameGroup)
+            recorder_.addFrameGroup(timeStamp, *frameGroup);
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef JSONL_OUTPUT_H
+#define JSONL_OUTPUT_H
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+#include <jsonl-recorder/recorder.hpp>
+
+#include "defs.h"
+#include "conversion.h"
+#include "clock_sync.h"
+#include "frame_trigger.h"
+#include "gnss_time.h"
+
+/*!
+    @file jsonl_output.h
+    @brief Raw samples to jsonl-recorder output
+
+    Shared by the live recorder and the offline binary converter so
+    both produce the same JSONL
+*/
+
+
+/*!
+    \brief Converts batches of raw samples and records them
+*/
+class JsonlSampleWriter
+{
+public:
+    JsonlSampleWriter(recorder::Recorder &recorder, int64_t first_timestamp,
+                      const scha63x_cacv *cacv = nullptr, int cameras = cam_count);
+
+    void setHostClock(const ClockSync *clock, int64_t offset_ns = 0);
+    void setGpsClock(const GnssTimepoints *timepoints);
+    void write(const scha63x_raw_data *samples, size_t count);
+
+    const FrameTrigger &trigger(void) const { return trigger_; }
+    const GpsClock *gpsClock(void) const { return gps_.get(); }
+    uint64_t gpsSkipped(void) const { return gps_skipped_; }
+
+private:
+    recorder::Recorder &recorder_;
+    int64_t first_timestamp_;
+    const ClockSync *clock_;  // host time if set
+    int64_t clock_offset_ns_;
+
+    std::unique_ptr<GpsClock> gps_;  // GPS time of week if set
+    int64_t last_timestamp_;         // device time of the previous sample, -1 before the first
+    uint64_t gps_skipped_;           // samples before the first PPS fit
+
+    bool board_cacv_;     // own CAC values instead of the global ones
+    scha63x_cacv cacv_;
+
+    std::vector<float> channels_[8];
+    scha63x_real_batch batch_;
+    FrameTrigger trigger_;  // camera triggers to frame groups
+};
+
+#endif
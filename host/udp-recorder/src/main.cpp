@@ -10,6 +10,15 @@
 #include <iostream>
 #include <sstream>
 #include <stdio.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
 
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -20,86 +29,96 @@
 #include "defs.h"
 #include "config.h"
 #include "conversion.h"
-
-
-/*! \brief microseconds in second*/
-#define micros 1000000
-
-///@{
-/*! \brief Macro */
-#define clear(buffer) memset(buffer, 0, sizeof(buffer));
-#define clear_s(buffer) memset(&buffer, 0, sizeof(buffer));
-#define resp_print(buffer, from)                                \
-    {                                                           \
-        printf("%s from IP:%s, Port:%hu\r\n", &buffer[0],         \
-               inet_ntoa(from.sin_addr), ntohs(from.sin_port)); \
-    }
-///@}
+#include "fan_in.h"
+#include "filter_config.h"
+#include "jsonl_output.h"
+#include "binary_recording.h"
+#include "shm_publisher.h"
+#include "realtime.h"
+#include "receiver.h"
+#include "calibration_store.h"
+#include "gnss_time.h"
+#include "trace.h"
 
 
 /*!
-    \brief Cast current system timestamp into string
-
-    Used in .jsonl file header generation
+    \brief Set by SIGINT/SIGTERM, stops recording and flushes output
+*/
+static std::atomic<bool> stop_requested(false);
 
-    \return string of system timestamp
+/*!
+    \brief Signal handler for a clean shutdown
 */
-std::string currentISO8601TimeUTC()
+static void requestStop(int)
 {
-    auto now = std::chrono::system_clock::now();
-    auto itt = std::chrono::system_clock::to_time_t(now);
-    std::ostringstream ss;
-    ss << std::put_time(gmtime(&itt), "%FT%H-%M-%SZ");
-    return ss.str();
+    stop_requested = true;
 }
 
 /*!
-    \brief Receive UDP packet from socket
+    \brief Print command line usage
+*/
+static void printUsage(const char *program)
+{
+    printf("usage: %s [--binary] [--workers N] [--stats FILE] [--clock BASE] [--shm [NAME]]\n"
+           "       [--realtime [CPU]] [--busy-poll US] [--calibration DIR] [--recalibrate]\n"
+           "       [--cameras N] [--gnss IP[:PORT]] [--filter ACC[,GYRO]]\n"
+           "  --binary     write raw samples to output/recording-*.bin instead of JSONL,\n"
+           "               convert offline with bin2jsonl\n"
+           "  --workers N  conversion and recording threads shared by all boards\n"
+           "  --stats FILE append per-board loss, jitter, delay and clock fit as JSON lines\n"
+           "  --clock BASE JSONL times: device (seconds since the handshake, default),\n"
+           "               monotonic or realtime (host seconds, drift corrected), gps\n"
+           "               (GPS time of week from PPS flags, needs --gnss)\n"
+           "  --shm [NAME] publish calibrated samples live to shared memory NAME,\n"
+           "               default " SHM_BUS_DEFAULT_NAME ", read with shm_bus.h\n"
+           "  --realtime [CPU] receive thread pinned to CPU (default the last one) with\n"
+           "               SCHED_FIFO, memory locked, large socket buffer\n"
+           "  --busy-poll US spin on the socket with SO_BUSY_POLL instead of blocking\n"
+           "  --calibration DIR CAC terms per serial number, boards found there skip\n"
+           "               their NVM read, default " calibration_dir ", none disables\n"
+           "  --recalibrate every board reads its CAC terms, the cache is refreshed\n"
+           "  --cameras N  frames in the JSONL frame group of every camera trigger, default %d\n"
+           "  --gnss IP[:PORT] receive timepoints from ubx_streamer.py, default port %d\n"
+           "  --filter ACC[,GYRO] filter cutoff in Hz, 13, 20, 46, 200 or 300, default\n"
+           "               from config.h. \"filter ACC[,GYRO]\" on stdin changes the\n"
+           "               filters of all streaming boards without a restart\n",
+           program, cam_count, gnss_port);
+}
 
-    Blocking function, 
+/*!
+    \brief Handle one line of stdin, "filter ACC[,GYRO]" changes the filters live
 
-    \param sock     bound socket
-    \param recBuf   pointer to a char buffer for storing the response from client
-    \param buffer_s size of the buffer to be sent
-    \param from     address of the client
-    \param fromlen  length 
+    \param fanIn recorder of the boards
 */
-template <typename T>
-int receivePacket(_udp connection, int buffer_s, T *recBuf)
+static void readCommand(FanInRecorder &fanIn)
 {
-    int n = recvfrom(connection.sock,
-                     recBuf, buffer_s, 0,
-                     (struct sockaddr *)&connection.from,
-                     &connection.fromlen);
-    if (n < 0)
-        std::runtime_error("Can not receive in server!");
-
-    return 0;
+    char line[64];
+    if (!fgets(line, sizeof(line), stdin))
+        return;
+
+    scha63x_sensor_config config;
+    if (strncmp(line, "filter ", 7) != 0 || !parseFilter(line + 7, config))
+    {
+        fprintf(stderr, "Unknown command, use \"filter ACC[,GYRO]\" with 13, 20, 46, 200 or 300 Hz\n");
+        return;
+    }
+    fanIn.setFilter(config);
 }
 
 /*!
-  \brief Send UDP packet to client
-
-  Blocking while buffer is not full 
+    \brief Cast current system timestamp into string
 
-  \param sock     bound socket
-  \param recBuf   pointer to a char buffer for storing the response from client
-  \param buffer_s size of the buffer to be sent
-  \param from     address of the client
-  \param fromlen  length 
+    Used in .jsonl file header generation
 
+    \return string of system timestamp
 */
-template <typename T>
-int sendPacket(_udp connection, int buffer_s, T *recBuf)
+std::string currentISO8601TimeUTC()
 {
-    int n = sendto(connection.sock,
-                   recBuf, buffer_s, 0,
-                   (const struct sockaddr *)&connection.from,
-                   connection.fromlen);
-    if (n < 0)
-        std::runtime_error("Can not send from client");
-
-    return 0;
+    auto now = std::chrono::system_clock::now();
+    auto itt = std::chrono::system_clock::to_time_t(now);
+    std::ostringstream ss;
+    ss << std::put_time(gmtime(&itt), "%FT%H-%M-%SZ");
+    return ss.str();
 }
 
 /*!
@@ -135,6 +154,12 @@ _udp setupUDP(void)
     {
         throw std::runtime_error("Can not bind in server!");
     }
+    // Kernel arrival time and socket drop counter with every datagram
+    if (!enableKernelTimestamps(sock))
+    {
+        fprintf(stderr, "No kernel receive timestamps, using the receive call time\n");
+    }
+
     memset(&from, 0, sizeof(struct sockaddr_in)); // clear from struct
     fromlen = sizeof(struct sockaddr_in);         // internet style socket address length
 
@@ -147,38 +172,184 @@ _udp setupUDP(void)
 }
 
 /*!
-  \brief generate IMU's filter config from config.h
+    \brief Offset from CLOCK_MONOTONIC to a clock
 
-  Currently hardcoded values, should be read from a config file
-
-  \return struct of filter values, structure defined in defs
+    \param base     "monotonic" or "realtime"
+    \param offset_ns output
+    \return false for an unknown clock
 */
-scha63x_sensor_config generateConfig(void)
+static bool clockOffset(const char *base, int64_t &offset_ns)
 {
-    scha63x_sensor_config sensor_config;
+    if (strcmp(base, "monotonic") == 0)
+    {
+        offset_ns = 0;
+        return true;
+    }
+    if (strcmp(base, "realtime") != 0)
+        return false;
+
+    timespec monotonic, realtime;
+    clock_gettime(CLOCK_MONOTONIC, &monotonic);
+    clock_gettime(CLOCK_REALTIME, &realtime);
+    offset_ns = (realtime.tv_sec - monotonic.tv_sec) * 1000000000LL + (realtime.tv_nsec - monotonic.tv_nsec);
+    return true;
+}
 
-    sensor_config.acc_filter.Ax = Acc_Ax;
-    sensor_config.acc_filter.Ay = Acc_Ay;
-    sensor_config.acc_filter.Az = Acc_Az;
-    sensor_config.gyro_filter.Rz2_Rx2 = Gyro_Rz2_Rx2;
-    sensor_config.gyro_filter.Rz_Rx = Gyro_Rz_Rx;
-    sensor_config.gyro_filter.Ry2 = Gyro_Ry2;
-    sensor_config.gyro_filter.Ry = Gyro_Ry;
+/*!
+    \brief Parse IP[:PORT] into an address
 
-    return sensor_config;
+    \param text    address, the port defaults to gnss_port
+    \param address output
+    \return false if the address is not valid
+*/
+static bool parseGnssAddress(const char *text, sockaddr_in &address)
+{
+    std::string ip = text;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(gnss_port);
+    size_t colon = ip.find(':');
+    if (colon != std::string::npos)
+    {
+        address.sin_port = htons(atoi(ip.c_str() + colon + 1));
+        ip.resize(colon);
+    }
+    return inet_pton(AF_INET, ip.c_str(), &address.sin_addr) == 1;
 }
 
+/*!
+    \brief Output file name part of a board
+
+    Serial number with anything unsafe in file names replaced, the
+    session number is appended if the serial number is missing or
+    already recorded by this process, and a counter if that name is
+    taken too, so no earlier recording is overwritten
+
+    \param board handshake results
+    \param used  names given out so far
+    \return name unique within the recording
+*/
+static std::string boardName(const board_info &board, std::set<std::string> &used)
+{
+    std::string name = board.serial;
+    for (auto &c : name)
+    {
+        if (!isalnum((unsigned char)c) && c != '-' && c != '_')
+            c = '_';
+    }
+    if (name.empty() || used.count(name))
+    {
+        // session slots are reused, a board rebooting onto the same one needs a counter too
+        const std::string base = (name.empty() ? "board" : name + "-") + std::to_string(board.index);
+        name = base;
+        for (int n = 2; used.count(name); n++)
+            name = base + "-" + std::to_string(n);
+    }
+
+    used.insert(name);
+    return name;
+}
 
 
-int main(void)
+int main(int argc, char **argv)
 {
+    bool binaryOutput = false;
+    unsigned int workers = fan_in_workers;
+    std::string statsPath;
+    bool hostClock = false;
+    int64_t clockOffsetNs = 0;
+    std::string shmName;
+    realtime_options realtime = defaultRealtimeOptions();
+    std::string calibrationDir = calibration_dir;
+    bool recalibrate = false;
+    int cameras = cam_count;
+    bool gpsClock = false;
+    sockaddr_in gnssAddress;
+    bool gnss = false;
+    scha63x_sensor_config config = generateConfig();
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--binary") == 0)
+        {
+            binaryOutput = true;
+        }
+        else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc)
+        {
+            workers = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc)
+        {
+            statsPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--clock") == 0 && i + 1 < argc && strcmp(argv[i + 1], "gps") == 0)
+        {
+            gpsClock = true;
+            hostClock = false;
+            i++;
+        }
+        else if (strcmp(argv[i], "--clock") == 0 && i + 1 < argc &&
+                 (strcmp(argv[i + 1], "device") == 0 || clockOffset(argv[i + 1], clockOffsetNs)))
+        {
+            hostClock = strcmp(argv[++i], "device") != 0;
+            gpsClock = false;
+        }
+        else if (strcmp(argv[i], "--shm") == 0)
+        {
+            shmName = i + 1 < argc && argv[i + 1][0] == '/' ? argv[++i] : SHM_BUS_DEFAULT_NAME;
+        }
+        else if (strcmp(argv[i], "--realtime") == 0)
+        {
+            realtime.enabled = true;
+            if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0]))
+                realtime.cpu = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--busy-poll") == 0 && i + 1 < argc)
+        {
+            realtime.busy_poll_us = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--calibration") == 0 && i + 1 < argc)
+        {
+            calibrationDir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--recalibrate") == 0)
+        {
+            recalibrate = true;
+        }
+        else if (strcmp(argv[i], "--cameras") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0)
+        {
+            cameras = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--gnss") == 0 && i + 1 < argc && parseGnssAddress(argv[i + 1], gnssAddress))
+        {
+            gnss = true;
+            i++;
+        }
+        else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc && parseFilter(argv[i + 1], config))
+        {
+            i++;
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (gpsClock && !gnss)
+    {
+        fprintf(stderr, "--clock gps needs --gnss\n");
+        return EXIT_FAILURE;
+    }
+
     try
     {
-        /* JSONL Recorder initialization */
+        /* Recorder initialization */
+
+        // Before any thread starts, locks everything allocated later too
+        if (realtime.enabled)
+            lockMemory();
 
         auto startTimeString = currentISO8601TimeUTC();
         auto outputPrefix = "output/recording-" + startTimeString;
-        auto recorder = recorder::Recorder::build(outputPrefix + ".jsonl");
 
 
         /* Setup connections */
@@ -188,100 +359,144 @@ int main(void)
 
         /* Connection startup */
 
-        // PING : "hello"
-        char recBuf[buffer_size]; // receive buffer
-        char outBuf[buffer_size]; // compare buffer
-        sprintf(outBuf, "hello");
+        // Boards connect at any time, each one gets its own output file
+        // output/recording-<time>-<serial>.jsonl or .bin
+        std::set<std::string> boardNames;
+
+        // CAC terms of known sensors, saves their NVM read on every power cycle
+        CalibrationStore calibrationStore(calibrationDir);
 
-        printf("Waiting for packet!\n");
-        while (1) // Might not be needed since receive is blocking
+        // Live consumers read the bus while the samples are recorded
+        std::unique_ptr<ShmBusPublisher> shmBus;
+        if (!shmName.empty())
         {
-            receivePacket(connection, sizeof(recBuf), &recBuf);
-            resp_print(recBuf, connection.from);
-            // if received packet buffer has "hello" then ping and continue
-            if (strcmp(recBuf, outBuf) == 0)
-            {
-                sendPacket(connection, buffer_size, &recBuf);
-                break;
-            }
+            shmBus.reset(new ShmBusPublisher(shmName));
+            printf("Publishing samples to shared memory %s\n", shmName.c_str());
         }
 
-        // CONFIG : send IMU config
-        scha63x_sensor_config config = generateConfig();
-        sendPacket(connection, buffer_size, &config);
+        // Timepoints of ubx_streamer.py name the GPS second of every PPS flag
+        GnssTimepoints gnssTimepoints;
+        std::unique_ptr<GnssListener> gnssListener;
+        if (gnss)
+        {
+            gnssListener.reset(new GnssListener(gnssAddress, gnssTimepoints));
+            printf("Receiving GNSS timepoints from %s:%hu\n", inet_ntoa(gnssAddress.sin_addr),
+                   ntohs(gnssAddress.sin_port));
+        }
 
-        // STATUS : Receive status update
-        sensor_data specs;
-        receivePacket(connection, buffer_size, &specs);
+        // JSONL writers of all boards, for their camera trigger and GPS counters at exit
+        std::mutex jsonlWritersLock;
+        std::vector<std::pair<std::string, std::shared_ptr<JsonlSampleWriter>>> jsonlWriters;
 
-        // SAMPLE BUFFER : send sample buffer and trigger info
-        int data_buffer = imu_buffer_size;
-        specs.buffer = imu_buffer_size;
-        specs.imu_trigger = imu_trigger_rate;
-        specs.cam_trigger = cam_trigger_rate;
-        sendPacket(connection, buffer_size, &specs);
+        FanInRecorder::writer_factory createWriter = [&](const board_info &board) {
+            std::string path = outputPrefix + "-" + boardName(board, boardNames);
+            FanInRecorder::sample_writer record;
 
-        // CAC TERMS : receive cross-axis terms
-        scha63x_cacv cac_values;
-        receivePacket(connection, buffer_size, &cac_values); // size was 72
-        cacvValues(cac_values);
+            if (binaryOutput)
+            {
+                binary_file_header header = makeBinaryHeader(board.serial.c_str(), board.cacv,
+                                                             board.config, board.first_timestamp);
+                std::shared_ptr<BinaryRecorder> binaryRecorder(new BinaryRecorder(path + ".bin", header));
+                record = [binaryRecorder](const scha63x_raw_data *data_vector, size_t count) {
+                    binaryRecorder->addSamples(data_vector, count);
+                };
+            }
+            else
+            {
+                // Writer keeps the recorder alive, both close when the board's worker drops it
+                std::shared_ptr<recorder::Recorder> recorder(recorder::Recorder::build(path + ".jsonl"));
+                std::shared_ptr<JsonlSampleWriter> jsonlWriter(
+                    new JsonlSampleWriter(*recorder, board.first_timestamp, &board.cacv, cameras));
+                if (hostClock)
+                    jsonlWriter->setHostClock(board.clock, clockOffsetNs);
+                if (gpsClock)
+                    jsonlWriter->setGpsClock(&gnssTimepoints);
+                {
+                    std::lock_guard<std::mutex> lock(jsonlWritersLock);
+                    jsonlWriters.push_back(std::make_pair(board.serial, jsonlWriter));
+                }
+                record = [recorder, jsonlWriter](const scha63x_raw_data *data_vector, size_t count) {
+                    jsonlWriter->write(data_vector, count);
+                };
+            }
 
-        // TIMESTAMP might not be needed
-        unsigned long firstTimeStamp;
-        clear(recBuf);
-        receivePacket(connection, buffer_size, &recBuf);
-        sscanf(recBuf, "%lu", &firstTimeStamp);
-        sendPacket(connection, buffer_size, &recBuf);
+            if (!shmBus)
+                return record;
 
-        /* INIT COMPLETE */
+            // Publish first, live readers should not wait for the file system
+            std::shared_ptr<ShmSampleWriter> shmWriter(new ShmSampleWriter(*shmBus, board));
+            return FanInRecorder::sample_writer([shmWriter, record](const scha63x_raw_data *data_vector, size_t count) {
+                shmWriter->write(data_vector, count);
+                record(data_vector, count);
+            });
+        };
 
 
         /* Start receiving sampled raw data packets */
 
-        const int receive_size = struct_size * data_buffer;
-        scha63x_raw_data data_vector[data_buffer];
-        scha63x_real_data scha63x_data;
-
-        while (1) 
+        // Receive thread runs the handshakes, workers convert and record
+        FanInRecorder fanIn(connection.sock, config, createWriter, workers);
+        if (!statsPath.empty())
+            fanIn.setStatsFile(statsPath);
+        fanIn.setRealtime(realtime);
+        if (calibrationDir != "none")
+            fanIn.setCalibrationStore(&calibrationStore, recalibrate);
+
+        signal(SIGINT, requestStop);
+        signal(SIGTERM, requestStop);
+
+        // Stage trace of the last trace_ring_events per thread, on SIGUSR1 and at exit
+        int traceDumps = 0;
+        auto dumpTrace = [&]() {
+            traceDump(outputPrefix + "-trace-" + std::to_string(traceDumps++) + ".json", stdout);
+        };
+#ifdef UDP_RECORDER_TRACING
+        traceInstallSignal();
+        printf("Tracing pipeline stages, kill -USR1 %d writes %s-trace-N.json\n", (int)getpid(),
+               outputPrefix.c_str());
+#endif
+
+        printf("Waiting for boards on port %d\n", port);
+        fflush(stdout);
+        if (gnssListener)
+            gnssListener->start();
+        fanIn.start();
+
+        // Commands on stdin until it is closed, e.g. when started in the background
+        pollfd input = { STDIN_FILENO, POLLIN, 0 };
+        while (!stop_requested)
         {
-            fflush(stdout);
-            receivePacket(connection, receive_size, data_vector);
-
-            if (int(data_vector->timeStamp) != 0)
+            if (poll(&input, 1, 100) > 0)
             {
-                for (int i = 0; i < data_buffer; i++)
-                {
-                    // Timestamping should be checked, first timestamp would be positive 0
-                    unsigned long timeStamp1 = data_vector[i].timeStamp - firstTimeStamp;
-                    float timeStamp = 1.0 * timeStamp1 / micros;
-
-                    // data conversion
-                    scha63x_convert_data(&data_vector[i], &scha63x_data); // convert LSB values to float
-                    scha63x_cross_axis_compensation(&scha63x_data);       // cross-axis compensation
-
-                    // IMU data, gyro & accel
-                    recorder->addGyroscope(timeStamp, \
-                        scha63x_data.gyro_x, scha63x_data.gyro_y, scha63x_data.gyro_z);
-                    recorder->addAccelerometer(timeStamp, \
-                        scha63x_data.acc_x, scha63x_data.acc_y, scha63x_data.acc_z);
-
-                    // CAM frame 
-                    if (data_vector[i].cam_trigger)
-                    {
-                        std::vector<recorder::FrameData> frameGroup;
-                        for (int index = 0; index < 2; index++)
-                        { 
-                            recorder::FrameData frameData({ .t = timeStamp, .cameraInd = index });
-                            frameGroup.push_back(frameData);
-                        }
-                        recorder->addFrameGroup(frameGroup[0].t, frameGroup);
-                    }
-                }
+                if (input.revents & POLLIN)
+                    readCommand(fanIn);
+                if (feof(stdin) || input.revents == POLLHUP || (input.revents & (POLLERR | POLLNVAL)))
+                    input.fd = -1;
+            }
+            traceCollect();
+            if (traceDumpRequested())
+                dumpTrace();
+        }
 
-                clear_s(scha63x_data);
-                clear(data_vector);
+        fanIn.stop();
+        if (gnssListener)
+        {
+            gnssListener->stop();
+            printf("%llu GNSS timepoints\n", (unsigned long long)gnssTimepoints.count());
+        }
+        for (const auto &writer : jsonlWriters)
+        {
+            writer.second->trigger().print(stdout, writer.first.c_str());
+            if (writer.second->gpsClock())
+            {
+                writer.second->gpsClock()->print(stdout, writer.first.c_str());
+                printf("%s: %llu samples before GPS time left out\n", writer.first.c_str(),
+                       (unsigned long long)writer.second->gpsSkipped());
             }
         }
+#ifdef UDP_RECORDER_TRACING
+        dumpTrace();
+#endif
     }
 
     catch (std::runtime_error &e) {
@@ -296,4 +511,4 @@ int main(void)
     }
 
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
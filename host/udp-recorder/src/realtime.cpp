@@ -0,0 +1,145 @@
+/*!
+    @file realtime.cpp
+    @brief Scheduling, memory and socket setup for low latency receiving
+*/
+
+#include <alloca.h>
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#include "realtime.h"
+
+
+/*!
+    \return options of --realtime without further arguments, last CPU
+*/
+realtime_options defaultRealtimeOptions(void)
+{
+    realtime_options options;
+    options.enabled = false;
+    options.cpu = (int)sysconf(_SC_NPROCESSORS_ONLN) - 1;
+    options.priority = realtime_priority;
+    options.rcvbuf = realtime_rcvbuf;
+    options.busy_poll_us = 0;
+    return options;
+}
+
+/*!
+    \brief Lock the process in memory, no page faults after this
+
+    Current and future mappings are locked and populated, and freed
+    heap memory is kept instead of being returned to the kernel, so
+    buffers allocated later, e.g. a new board's ring, are faulted in
+    once at allocation time.
+
+    \return false if memory could not be locked
+*/
+bool lockMemory(void)
+{
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+    {
+        fprintf(stderr, "Can not lock memory: %s\n", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/*!
+    \brief Pin the calling thread to a CPU and make it SCHED_FIFO
+
+    \param cpu      CPU number, -1 keeps the affinity
+    \param priority SCHED_FIFO priority, 1-99
+    \return false if either setting failed
+*/
+bool setRealtimeThread(int cpu, int priority)
+{
+    bool ok = true;
+
+    if (cpu >= 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (err != 0)
+        {
+            fprintf(stderr, "Can not pin receive thread to CPU %d: %s\n", cpu, strerror(err));
+            ok = false;
+        }
+    }
+
+    sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = priority;
+    int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (err != 0)
+    {
+        fprintf(stderr, "Can not set SCHED_FIFO priority %d: %s\n", priority, strerror(err));
+        ok = false;
+    }
+    return ok;
+}
+
+/*!
+    \brief Touch the calling thread's stack so it is not faulted in later
+
+    \param bytes stack depth to touch
+*/
+void prefaultStack(size_t bytes)
+{
+    volatile unsigned char *stack = (volatile unsigned char *)alloca(bytes);
+    const size_t page = sysconf(_SC_PAGESIZE);
+    for (size_t i = 0; i < bytes; i += page)
+        stack[i] = 0;
+}
+
+/*!
+    \brief Size the socket receive buffer
+
+    SO_RCVBUFFORCE goes beyond net.core.rmem_max with CAP_NET_ADMIN,
+    SO_RCVBUF is capped at it otherwise
+
+    \param sock  UDP socket
+    \param bytes requested buffer size
+    \return buffer size the kernel reports, it doubles the request for bookkeeping
+*/
+int setReceiveBuffer(int sock, int bytes)
+{
+    if (setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &bytes, sizeof(bytes)) < 0)
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &bytes, sizeof(bytes));
+
+    int actual = 0;
+    socklen_t length = sizeof(actual);
+    getsockopt(sock, SOL_SOCKET, SO_RCVBUF, &actual, &length);
+    if (actual < bytes)
+        fprintf(stderr, "Receive buffer is %d bytes, raise net.core.rmem_max for %d\n", actual, bytes);
+    return actual;
+}
+
+/*!
+    \brief Let the kernel busy poll the device queue on receive
+
+    \param sock UDP socket
+    \param us   busy poll time per receive call
+    \return false if not supported or not permitted
+*/
+bool setBusyPoll(int sock, int us)
+{
+    if (setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL, &us, sizeof(us)) < 0)
+    {
+        fprintf(stderr, "Can not set SO_BUSY_POLL: %s\n", strerror(errno));
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,41 @@
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "config.h"
+
+/*!
+    @file realtime.h
+    @brief Scheduling, memory and socket setup for low latency receiving
+
+    Every call needs privileges (root, CAP_SYS_NICE, CAP_IPC_LOCK or
+    CAP_NET_ADMIN for buffers above net.core.rmem_max). Failures are
+    reported on stderr and the recorder carries on with what it got.
+*/
+
+
+/*!
+    \brief Real-time settings of the receive thread
+*/
+typedef struct _realtime_options {
+
+    bool enabled;       // --realtime given
+    int cpu;            // receive thread CPU, -1 keeps the affinity
+    int priority;       // SCHED_FIFO priority
+    int rcvbuf;         // socket receive buffer, bytes, 0 keeps the default
+    int busy_poll_us;   // spin on the socket with SO_BUSY_POLL, 0 blocks in recvmmsg
+
+} realtime_options;
+
+
+realtime_options defaultRealtimeOptions(void);
+
+bool lockMemory(void);
+bool setRealtimeThread(int cpu, int priority);
+void prefaultStack(size_t bytes);
+int setReceiveBuffer(int sock, int bytes);
+bool setBusyPoll(int sock, int us);
+
+#endif
@@ -0,0 +1,284 @@
+/*!
+    @file receiver.cpp
+    @brief Batched UDP receive engine
+*/
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <stdexcept>
+
+#include <sys/uio.h>
+
+#include "receiver.h"
+#include "wire_decode.h"
+#include "trace.h"
+
+
+/*!
+    \brief Preallocate ring slots and message headers
+
+    Every slot gets its own iovec and mmsghdr once, receive() only
+    has to reset the address lengths before each call
+
+    \param sock       bound UDP socket
+    \param batch_size maximum number of datagrams drained per call
+    \param ring_size  number of slots in the ring
+    \exception ring smaller than a batch, throws std::runtime_error
+*/
+BatchReceiver::BatchReceiver(int sock, unsigned int batch_size, unsigned int ring_size)
+    : sock_(sock), batch_size_(batch_size), head_(0), next_(0),
+      ring_(ring_size), msgs_(ring_size), iovecs_(ring_size)
+{
+    if (batch_size == 0 || ring_size < batch_size)
+    {
+        throw std::runtime_error("Receive ring must hold at least one batch");
+    }
+
+    memset(ring_.data(), 0, ring_.size() * sizeof(receive_slot));
+    memset(msgs_.data(), 0, msgs_.size() * sizeof(mmsghdr));
+
+    for (unsigned int i = 0; i < ring_size; i++)
+    {
+        iovecs_[i].iov_base = ring_[i].packet;
+        iovecs_[i].iov_len = sizeof(ring_[i].packet);
+
+        msgs_[i].msg_hdr.msg_iov = &iovecs_[i];
+        msgs_[i].msg_hdr.msg_iovlen = 1;
+        msgs_[i].msg_hdr.msg_name = &ring_[i].from;
+        msgs_[i].msg_hdr.msg_control = ring_[i].control;
+    }
+
+    memset(&stats_, 0, sizeof(stats_));
+}
+
+/*!
+    \brief Receive a batch of datagrams
+
+    Blocks until at least one datagram is available with the default
+    MSG_WAITFORONE, then drains whatever else is already queued up to
+    the batch size. A batch never wraps around the end of the ring.
+
+    \param flags recvmmsg flags, MSG_DONTWAIT for polling
+    \return number of datagrams received, 0 if interrupted or nothing queued
+    \exception receive failed, throws std::runtime_error
+*/
+int BatchReceiver::receive(int flags)
+{
+    unsigned int count = ring_.size() - next_;
+    if (count > batch_size_)
+        count = batch_size_;
+
+    for (unsigned int i = next_; i < next_ + count; i++)
+    {
+        msgs_[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        msgs_[i].msg_hdr.msg_controllen = sizeof(receive_slot::control);
+    }
+
+    int n;
+    {
+        TRACE_SCOPE(trace_receive);
+        n = recvmmsg(sock_, &msgs_[next_], count, flags, nullptr);
+    }
+    if (n < 0)
+    {
+        if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+            return 0;
+        throw std::runtime_error("Can not receive in server!");
+    }
+
+    timespec now, realtime;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const int64_t receive_time = now.tv_sec * 1000000000LL + now.tv_nsec;
+
+    // Kernel timestamps are CLOCK_REALTIME, moved to CLOCK_MONOTONIC with the current offset
+    clock_gettime(CLOCK_REALTIME, &realtime);
+    const int64_t realtime_offset = realtime.tv_sec * 1000000000LL + realtime.tv_nsec - receive_time;
+
+    for (int i = 0; i < n; i++)
+    {
+        receive_slot &slot = ring_[next_ + i];
+        slot.receive_time = receive_time;
+        slot.kernel_time = false;
+
+        msghdr &hdr = msgs_[next_ + i].msg_hdr;
+        for (cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg))
+        {
+            if (cmsg->cmsg_level != SOL_SOCKET)
+                continue;
+            if (cmsg->cmsg_type == SCM_TIMESTAMPNS)
+            {
+                timespec arrival;
+                memcpy(&arrival, CMSG_DATA(cmsg), sizeof(arrival));
+                const int64_t kernel = arrival.tv_sec * 1000000000LL + arrival.tv_nsec - realtime_offset;
+                slot.receive_time = kernel < receive_time ? kernel : receive_time;
+                slot.kernel_time = true;
+            }
+            else if (cmsg->cmsg_type == SO_RXQ_OVFL)
+            {
+                uint32_t drops;
+                memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+                stats_.kernel_drops = drops;
+            }
+        }
+
+        slot.bytes = msgs_[next_ + i].msg_len;
+        slot.truncated = (msgs_[next_ + i].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+        slot.samples = scha63x_wire_check(slot.packet, slot.bytes, &slot.header);
+
+        stats_.bytes += slot.bytes;
+        if (slot.truncated)
+            stats_.truncated++;
+    }
+
+    if (n > 0)
+    {
+        TRACE_COUNT(trace_datagrams, n);
+        stats_.calls++;
+        stats_.datagrams += n;
+        stats_.last_batch = n;
+        if ((unsigned int)n > stats_.max_batch)
+            stats_.max_batch = n;
+
+        head_ = next_;
+        next_ = (next_ + n) % ring_.size();
+    }
+
+    return n;
+}
+
+/*!
+    \brief Datagram of the latest batch
+
+    \param index position within the latest batch
+    \return ring slot holding the datagram
+*/
+const receive_slot &BatchReceiver::slot(unsigned int index) const
+{
+    return ring_[(head_ + index) % ring_.size()];
+}
+
+/*!
+    \brief Raw bytes of a datagram of the latest batch, e.g. handshake packets
+
+    \param index position within the latest batch
+    \return start of the datagram, packetBytes() long
+*/
+const char *BatchReceiver::packet(unsigned int index) const
+{
+    return (const char *)slot(index).packet;
+}
+
+/*!
+    \brief Number of datagram bytes available in the slot
+
+    \param index position within the latest batch
+    \return received bytes, at most the slot size
+*/
+int BatchReceiver::packetBytes(unsigned int index) const
+{
+    const int capacity = sizeof(receive_slot::packet);
+    return slot(index).bytes < capacity ? slot(index).bytes : capacity;
+}
+
+/*!
+    \brief Check for a complete sample batch of this wire format version
+
+    \param index position within the latest batch
+    \return false for handshake packets, unknown firmware and datagrams
+            shorter than their sample count
+*/
+bool BatchReceiver::isSamplePacket(unsigned int index) const
+{
+    return slot(index).samples >= 0;
+}
+
+/*!
+    \brief Number of samples in a datagram of the latest batch
+
+    \param index position within the latest batch
+    \return sample count from the header, 0 if the datagram is not a sample batch
+*/
+unsigned int BatchReceiver::samples(unsigned int index) const
+{
+    return slot(index).samples > 0 ? slot(index).samples : 0;
+}
+
+/*!
+    \brief Device timestamp of the first sample, without decoding the batch
+
+    \param index position within the latest batch
+    \return timestamp in us, 0 if the datagram holds no samples
+*/
+int64_t BatchReceiver::firstTimestamp(unsigned int index) const
+{
+    if (samples(index) == 0)
+        return 0;
+    return (int64_t)scha63x_wire_get64(slot(index).packet + SCHA63X_WIRE_HEADER_SIZE);
+}
+
+/*!
+    \brief Decode samples of a datagram of the latest batch
+
+    Reads straight from the receive buffer, e.g. into ring slots,
+    raw and delta encoded batches alike. Every sample gets the
+    datagram's receive time.
+
+    \param index position within the latest batch
+    \param first first sample to decode
+    \param count number of samples, first + count at most samples(index)
+    \param out   destination for count samples
+*/
+void BatchReceiver::decode(unsigned int index, unsigned int first, unsigned int count,
+                           scha63x_raw_data *out) const
+{
+    scha63x_decode_samples(slot(index).packet, &slot(index).header, first, count, out);
+    for (unsigned int i = 0; i < count; i++)
+        out[i].receiveTime = slot(index).receive_time;
+}
+
+/*!
+    \brief Clear statistics
+*/
+void BatchReceiver::resetStats(void)
+{
+    const uint64_t kernel_drops = stats_.kernel_drops;
+    memset(&stats_, 0, sizeof(stats_));
+    stats_.kernel_drops = kernel_drops;
+}
+
+/*!
+    \brief Ask the kernel for arrival timestamps and drop counts
+
+    Both come with every datagram as control messages, read by
+    BatchReceiver
+
+    \param sock UDP socket
+    \return false if the kernel refused either option
+*/
+bool enableKernelTimestamps(int sock)
+{
+    const int on = 1;
+    bool ok = setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) == 0;
+    ok &= setsockopt(sock, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on)) == 0;
+    return ok;
+}
+
+/*!
+    \brief Print receive engine statistics
+
+    \param stats   statistics from the receive engine
+    \param seconds length of the reporting period
+*/
+void printReceiveStats(const receive_stats &stats, double seconds)
+{
+    printf("recv: %lu datagrams, %lu bytes in %lu calls (%.1f datagrams/s, "
+           "avg batch %.2f, max batch %u, truncated %lu, invalid %lu, kernel drops %lu)\n",
+           (unsigned long)stats.datagrams, (unsigned long)stats.bytes,
+           (unsigned long)stats.calls, stats.datagrams / seconds,
+           stats.calls ? 1.0 * stats.datagrams / stats.calls : 0.0,
+           stats.max_batch, (unsigned long)stats.truncated, (unsigned long)stats.invalid,
+           (unsigned long)stats.kernel_drops);
+}
@@ -0,0 +1,116 @@
+#ifndef RECEIVER_H
+#define RECEIVER_H
+
+#include <stdint.h>
+#include <vector>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "defs.h"
+#include "config.h"
+#include "scha63x_wire.h"
+
+/*!
+    @file receiver.h
+    @brief Batched UDP receive engine
+
+    Drains many datagrams per system call with recvmmsg(2) into a
+    preallocated ring of datagram buffers, samples are decoded from
+    the wire format in place. On sockets set up with
+    enableKernelTimestamps() every datagram carries its kernel arrival
+    time and the socket's drop counter.
+*/
+
+
+/*! \brief Control message space per datagram, SCM_TIMESTAMPNS and SO_RXQ_OVFL */
+#define receive_control_size 64
+
+
+/*!
+    \brief One received datagram
+
+    packet is filled straight from the socket, bytes is the real
+    datagram length reported by the kernel. Sample batches are
+    validated and their header decoded right after receiving,
+    samples stay in wire format until decode().
+*/
+typedef struct _receive_slot {
+
+    uint8_t packet[SCHA63X_WIRE_MAX_PAYLOAD];
+
+    scha63x_packet_header header; // decoded header, valid if samples >= 0
+    int samples;                  // samples in the datagram, -1 if not a sample batch
+    int bytes;
+    bool truncated;
+    int64_t receive_time;    // CLOCK_MONOTONIC ns, kernel arrival or after the receive call
+    bool kernel_time;        // receive_time is the kernel arrival time
+    sockaddr_in from;
+
+    alignas(8) uint8_t control[receive_control_size];
+
+} receive_slot;
+
+/*!
+    \brief Receive statistics, totals and latest batch
+*/
+typedef struct _receive_stats {
+
+    uint64_t calls;          // recvmmsg calls returning data
+    uint64_t datagrams;      // datagrams received
+    uint64_t bytes;          // payload bytes received
+    uint64_t truncated;      // datagrams larger than a slot
+    uint64_t invalid;        // datagrams counted by countInvalid()
+    uint64_t kernel_drops;   // datagrams the socket dropped since it was opened, as of the latest datagram, kept by resetStats()
+
+    unsigned int last_batch; // datagrams drained by the latest call
+    unsigned int max_batch;  // largest batch seen
+
+} receive_stats;
+
+
+/*!
+    \brief recvmmsg based receiver
+
+    Slots of the latest batch stay valid until the ring wraps around
+    to them again, i.e. for at least ring_size - batch_size datagrams
+*/
+class BatchReceiver
+{
+public:
+    BatchReceiver(int sock,
+                  unsigned int batch_size = receive_batch_size,
+                  unsigned int ring_size = receive_ring_size);
+
+    int receive(int flags = MSG_WAITFORONE);
+
+    const receive_slot &slot(unsigned int index) const;
+    const char *packet(unsigned int index) const;
+    int packetBytes(unsigned int index) const;
+    bool isSamplePacket(unsigned int index) const;
+    unsigned int samples(unsigned int index) const;
+    int64_t firstTimestamp(unsigned int index) const;
+    void decode(unsigned int index, unsigned int first, unsigned int count, scha63x_raw_data *out) const;
+
+    const receive_stats &stats(void) const { return stats_; }
+    void resetStats(void);
+    void countInvalid(void) { stats_.invalid++; }
+
+private:
+    int sock_;
+    unsigned int batch_size_;
+    unsigned int head_;       // first slot of the latest batch
+    unsigned int next_;       // first slot of the next batch
+
+    std::vector<receive_slot> ring_;
+    std::vector<mmsghdr> msgs_;
+    std::vector<iovec> iovecs_;
+
+    receive_stats stats_;
+};
+
+
+bool enableKernelTimestamps(int sock);
+void printReceiveStats(const receive_stats &stats, double seconds);
+
+#endif
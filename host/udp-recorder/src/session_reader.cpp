@@ -0,0 +1,420 @@
+/*!
+    @file session_reader.cpp
+    @brief Memory-mapped random access to recorded sessions
+*/
+
+#include <limits>
+#include <stdexcept>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "session_reader.h"
+
+
+/*! \brief microseconds in second*/
+#define micros 1000000
+
+/*! \brief key of the timestamp in jsonl-recorder lines */
+static const char time_key[] = "\"time\":";
+
+
+/*!
+    \brief Sidecar index file header
+*/
+typedef struct _session_index_header {
+
+    char magic[8];
+    uint64_t file_size;  // size of the indexed recording
+    int64_t file_mtime;  // modification time of the indexed recording
+    uint64_t stride;
+    uint64_t entries;
+
+} session_index_header;
+
+
+
+// Memory mapping
+
+/*!
+    \brief Map a file read-only
+
+    \param path file to map
+    \exception file can not be opened or mapped, throws std::runtime_error
+*/
+MappedFile::MappedFile(const std::string &path)
+    : data_(nullptr), size_(0), mtime_(0)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Can not open " + path);
+
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        throw std::runtime_error("Can not stat " + path);
+    }
+    size_ = st.st_size;
+    mtime_ = st.st_mtime;
+
+    if (size_ > 0)
+    {
+        void *map = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+        {
+            close(fd);
+            throw std::runtime_error("Can not map " + path);
+        }
+        data_ = (const char *)map;
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+    if (data_)
+        munmap((void *)data_, size_);
+}
+
+/*!
+    \brief Check the magic of a binary recording
+
+    \param path recording file
+    \return true for binary recordings, false for anything else (JSONL)
+*/
+bool isBinaryRecording(const std::string &path)
+{
+    char magic[8] = {0};
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+    size_t n = fread(magic, 1, sizeof(magic), file);
+    fclose(file);
+    return n == sizeof(magic) && memcmp(magic, BINARY_FILE_MAGIC, sizeof(magic)) == 0;
+}
+
+
+
+// JSONL sessions
+
+/*!
+    \brief Map a JSONL recording and load or build its index
+
+    \param path        recording file
+    \param use_sidecar load and store the index in <path>.idx, otherwise
+                       the index is always built in memory
+*/
+JsonlSession::JsonlSession(const std::string &path, bool use_sidecar)
+    : file_(path), loaded_(false)
+{
+    const std::string indexPath = path + ".idx";
+
+    if (use_sidecar && loadIndex(indexPath))
+    {
+        loaded_ = true;
+        return;
+    }
+
+    buildIndex();
+    if (use_sidecar)
+        saveIndex(indexPath);
+}
+
+/*!
+    \brief Parse the "time" value of a jsonl-recorder line
+
+    \param line   start of the line
+    \param length length of the line without newline
+    \param time   parsed time
+    \return false if the line has no time
+*/
+bool JsonlSession::lineTime(const char *line, size_t length, double &time)
+{
+    const char *key = (const char *)memmem(line, length, time_key, sizeof(time_key) - 1);
+    if (!key)
+        return false;
+
+    // copy the number, the mapping is not NUL terminated
+    const char *value = key + sizeof(time_key) - 1;
+    size_t n = line + length - value;
+    char number[32];
+    if (n >= sizeof(number))
+        n = sizeof(number) - 1;
+    memcpy(number, value, n);
+    number[n] = '\0';
+
+    char *end;
+    time = strtod(number, &end);
+    return end != number;
+}
+
+/*!
+    \brief Single pass over the file, one index block per stride bytes
+
+    Blocks end at line boundaries and keep the minimum and maximum
+    time of their lines, so queries stay correct even if times are
+    not strictly ordered in the file
+*/
+void JsonlSession::buildIndex(void)
+{
+    const char *data = file_.data();
+    const uint64_t size = file_.size();
+
+    madvise((void *)data, size, MADV_SEQUENTIAL);
+
+    session_index_entry entry = { 0, 0, std::numeric_limits<double>::infinity(),
+                                  -std::numeric_limits<double>::infinity() };
+    uint64_t offset = 0;
+
+    while (offset < size)
+    {
+        const char *newline = (const char *)memchr(data + offset, '\n', size - offset);
+        uint64_t end = newline ? (newline - data) : size;
+
+        double time;
+        if (lineTime(data + offset, end - offset, time))
+        {
+            if (time < entry.min_time) entry.min_time = time;
+            if (time > entry.max_time) entry.max_time = time;
+        }
+
+        offset = newline ? end + 1 : size;
+        if (offset - entry.begin >= session_index_stride || offset >= size)
+        {
+            entry.end = offset;
+            index_.push_back(entry);
+            entry.begin = offset;
+            entry.min_time = std::numeric_limits<double>::infinity();
+            entry.max_time = -std::numeric_limits<double>::infinity();
+        }
+    }
+}
+
+/*!
+    \brief Load a sidecar index if it matches the mapped file
+
+    \return false if missing, stale or corrupted
+*/
+bool JsonlSession::loadIndex(const std::string &path)
+{
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+
+    session_index_header header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+              memcmp(header.magic, SESSION_INDEX_MAGIC, sizeof(header.magic)) == 0 &&
+              header.file_size == file_.size() &&
+              header.file_mtime == file_.mtime() &&
+              header.stride == session_index_stride;
+
+    if (ok)
+    {
+        index_.resize(header.entries);
+        ok = fread(index_.data(), sizeof(session_index_entry), header.entries, file) == header.entries;
+    }
+    fclose(file);
+
+    if (!ok)
+        index_.clear();
+    return ok;
+}
+
+/*!
+    \brief Store the index next to the recording, failures are ignored
+*/
+void JsonlSession::saveIndex(const std::string &path) const
+{
+    FILE *file = fopen(path.c_str(), "wb");
+    if (!file)
+        return;
+
+    session_index_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SESSION_INDEX_MAGIC, sizeof(header.magic));
+    header.file_size = file_.size();
+    header.file_mtime = file_.mtime();
+    header.stride = session_index_stride;
+    header.entries = index_.size();
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(index_.data(), sizeof(session_index_entry), index_.size(), file) == index_.size();
+    fclose(file);
+
+    if (!ok)
+        remove(path.c_str());
+}
+
+/*!
+    \brief Visit all lines with time in [t0, t1]
+
+    Only blocks whose time range overlaps the window are touched
+
+    \param t0       window start, seconds
+    \param t1       window end, seconds
+    \param callback called with every matching line, without newline
+    \return number of matching lines
+*/
+size_t JsonlSession::query(double t0, double t1,
+                           const std::function<void(const char *line, size_t length)> &callback) const
+{
+    const char *data = file_.data();
+    size_t matches = 0;
+
+    for (const session_index_entry &entry : index_)
+    {
+        if (entry.max_time < t0 || entry.min_time > t1)
+            continue;
+
+        madvise((void *)(data + (entry.begin & ~4095ULL)), entry.end - (entry.begin & ~4095ULL), MADV_WILLNEED);
+
+        uint64_t offset = entry.begin;
+        while (offset < entry.end)
+        {
+            const char *newline = (const char *)memchr(data + offset, '\n', entry.end - offset);
+            uint64_t end = newline ? (newline - data) : entry.end;
+
+            double time;
+            if (lineTime(data + offset, end - offset, time) && time >= t0 && time <= t1)
+            {
+                callback(data + offset, end - offset);
+                matches++;
+            }
+
+            offset = end + 1;
+        }
+    }
+
+    return matches;
+}
+
+
+
+// Binary sessions
+
+/*!
+    \brief Map a binary recording and index it by its chunk headers
+
+    \param path recording file
+    \exception not a valid binary recording, throws std::runtime_error
+*/
+BinarySession::BinarySession(const std::string &path)
+    : file_(path)
+{
+    const char *data = file_.data();
+    const uint64_t size = file_.size();
+
+    if (size < sizeof(binary_file_header))
+        throw std::runtime_error("Binary recording too short");
+    memcpy(&header_, data, sizeof(header_));
+    checkBinaryHeader(header_);
+
+    uint64_t offset = sizeof(binary_file_header);
+    while (offset + sizeof(binary_chunk_header) <= size)
+    {
+        binary_chunk_header chunk;
+        memcpy(&chunk, data + offset, sizeof(chunk));
+        if (chunk.magic != BINARY_CHUNK_MAGIC)
+            throw std::runtime_error("Corrupted binary recording chunk");
+
+        // a chunk cut short by an interrupted recording keeps its complete samples
+        const uint32_t sample_size = header_.sample_size;
+        uint64_t begin = offset + sizeof(chunk);
+        uint64_t available = (size - begin) / sample_size;
+        uint64_t samples = chunk.samples < available ? chunk.samples : available;
+        if (samples == 0)
+            break;
+
+        scha63x_raw_data first, last;
+        readBinarySamples((const uint8_t *)data + begin, 1, sample_size, &first);
+        readBinarySamples((const uint8_t *)data + begin + (samples - 1) * sample_size, 1, sample_size, &last);
+        session_index_entry entry;
+        entry.begin = begin;
+        entry.end = begin + samples * sample_size;
+        entry.min_time = sampleTime(first);
+        entry.max_time = sampleTime(last);
+        index_.push_back(entry);
+
+        offset = entry.end;
+    }
+}
+
+/*!
+    \brief Recording time of a sample, same as the JSONL "time"
+
+    \param sample raw sample from the recording
+    \return seconds since the handshake timestamp
+*/
+double BinarySession::sampleTime(const scha63x_raw_data &sample) const
+{
+    unsigned long timeStamp1 = sample.timeStamp - header_.first_timestamp;
+    float timeStamp = 1.0 * timeStamp1 / micros;
+    return timeStamp;
+}
+
+/*!
+    \brief Visit all samples with time in [t0, t1]
+
+    Only chunks whose time range overlaps the window are touched,
+    consecutive matching samples are passed in one call
+
+    \param t0       window start, seconds
+    \param t1       window end, seconds
+    \param callback called with runs of matching samples, pointing into the mapping
+                    for current recordings
+    \return number of matching samples
+*/
+size_t BinarySession::query(double t0, double t1,
+                            const std::function<void(const scha63x_raw_data *samples, size_t count)> &callback) const
+{
+    size_t matches = 0;
+    std::vector<scha63x_raw_data> upgraded;
+
+    for (const session_index_entry &entry : index_)
+    {
+        if (entry.max_time < t0 || entry.min_time > t1)
+            continue;
+
+        const scha63x_raw_data *samples = (const scha63x_raw_data *)(file_.data() + entry.begin);
+        const size_t count = (entry.end - entry.begin) / header_.sample_size;
+        if (header_.sample_size != sizeof(scha63x_raw_data))
+        {
+            // older recordings are copied chunk by chunk into the current layout
+            upgraded.resize(count);
+            readBinarySamples((const uint8_t *)file_.data() + entry.begin, count, header_.sample_size,
+                              upgraded.data());
+            samples = upgraded.data();
+        }
+
+        size_t run = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            double time = sampleTime(samples[i]);
+            if (time >= t0 && time <= t1)
+            {
+                run++;
+                continue;
+            }
+            if (run > 0)
+            {
+                callback(&samples[i - run], run);
+                matches += run;
+                run = 0;
+            }
+        }
+        if (run > 0)
+        {
+            callback(&samples[count - run], run);
+            matches += run;
+        }
+    }
+
+    return matches;
+}
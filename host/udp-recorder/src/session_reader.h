@@ -0,0 +1,120 @@
+#ifndef SESSION_READER_H
+#define SESSION_READER_H
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "defs.h"
+#include "binary_recording.h"
+
+/*!
+    @file session_reader.h
+    @brief Memory-mapped random access to recorded sessions
+
+    JSONL recordings get a sparse sidecar index (<recording>.idx) of
+    blocks with their byte range and time range, built on first use.
+    Binary recordings are indexed through their chunk headers, which
+    already carry the time range of every chunk.
+
+    Times are seconds relative to the handshake timestamp, the same
+    "time" values jsonl-recorder writes.
+*/
+
+
+///@{
+/*! \brief Sidecar index settings */
+#define SESSION_INDEX_MAGIC "SCHAIDX1"
+#define session_index_stride (1 << 20) // bytes of JSONL per index block
+///@}
+
+
+/*!
+    \brief One index block, a byte range and the times inside it
+*/
+typedef struct _session_index_entry {
+
+    uint64_t begin;   // offset of the first line
+    uint64_t end;     // offset one past the last line
+    double min_time;
+    double max_time;
+
+} session_index_entry;
+
+
+/*!
+    \brief Read-only memory mapping of a whole file
+*/
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string &path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *data(void) const { return data_; }
+    uint64_t size(void) const { return size_; }
+    int64_t mtime(void) const { return mtime_; }
+
+private:
+    const char *data_;
+    uint64_t size_;
+    int64_t mtime_;
+};
+
+
+/*!
+    \brief JSONL recording with sparse sidecar index
+*/
+class JsonlSession
+{
+public:
+    explicit JsonlSession(const std::string &path, bool use_sidecar = true);
+
+    size_t query(double t0, double t1,
+                 const std::function<void(const char *line, size_t length)> &callback) const;
+
+    const std::vector<session_index_entry> &index(void) const { return index_; }
+    bool indexLoaded(void) const { return loaded_; }
+
+    static bool lineTime(const char *line, size_t length, double &time);
+
+private:
+    void buildIndex(void);
+    bool loadIndex(const std::string &path);
+    void saveIndex(const std::string &path) const;
+
+    MappedFile file_;
+    std::vector<session_index_entry> index_;
+    bool loaded_;
+};
+
+
+/*!
+    \brief Binary recording indexed by its chunk headers
+*/
+class BinarySession
+{
+public:
+    explicit BinarySession(const std::string &path);
+
+    const binary_file_header &header(void) const { return header_; }
+    const std::vector<session_index_entry> &index(void) const { return index_; }
+
+    size_t query(double t0, double t1,
+                 const std::function<void(const scha63x_raw_data *samples, size_t count)> &callback) const;
+
+    double sampleTime(const scha63x_raw_data &sample) const;
+
+private:
+    MappedFile file_;
+    binary_file_header header_;
+    std::vector<session_index_entry> index_; // begin/end cover the samples of a chunk
+};
+
+bool isBinaryRecording(const std::string &path);
+
+#endif
@@ -0,0 +1,365 @@
+#ifndef SHM_BUS_H
+#define SHM_BUS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+/*!
+    @file shm_bus.h
+    @brief Live IMU samples in POSIX shared memory, layout and reader
+
+    udp_recorder --shm publishes the calibrated samples of every board
+    (converted and cross-axis compensated like the JSONL output) with
+    their trigger flags into a shared memory segment. Every board has
+    its own ring with a single writer, every slot is a seqlock: the
+    slot sequence is odd while the writer fills it and 2 * (n + 1)
+    once record n is complete. Readers copy records and check the
+    sequence again, neither side ever waits for the other and a slow
+    reader only loses records it was lapped on. There are max_boards
+    rings of config.h, a ring is given to the next board session once
+    its board reconnects or drops out. Every hand-over bumps the
+    ring's generation and publishes its serial number under it,
+    records before the hand-over are still read as the old board's.
+
+    Self-contained, consumers only need this header:
+
+        ShmBusReader bus;              // SHM_BUS_DEFAULT_NAME
+        shm_bus_sample samples[64];
+        while (running)
+        {
+            bus.wait(1000);            // or spin on read()
+            for (unsigned int b = 0; b < bus.boards(); b++)
+                for (size_t n = bus.read(b, samples, 64), i = 0; i < n; i++)
+                    use(bus.serial(b), bus.generation(b), samples[i]);
+        }
+*/
+
+
+///@{
+/*! \brief Segment identification */
+#define SHM_BUS_DEFAULT_NAME "/udp_recorder"
+#define SHM_BUS_MAGIC 0x53484D42 // "SHMB"
+#define SHM_BUS_VERSION 2
+///@}
+
+///@{
+/*! \brief shm_bus_sample flags, as in scha63x_raw_data */
+#define SHM_BUS_RS_ERROR_DUE (1u << 0)
+#define SHM_BUS_RS_ERROR_UNO (1u << 1)
+#define SHM_BUS_CAM_TRIGGER (1u << 2)
+#define SHM_BUS_UBX_TRIGGER (1u << 3)
+///@}
+
+
+/*!
+    \brief One calibrated sample, a camera or GNSS trigger is flagged on its sample
+*/
+typedef struct _shm_bus_sample {
+
+    int64_t device_time_us;  // board micros(), extended across wraps
+    int64_t host_time_ns;    // CLOCK_MONOTONIC from the board's clock fit
+    float acc[3];            // x, y, z, cross-axis compensated
+    float gyro[3];           // x, y, z, cross-axis compensated
+    float temp_due;
+    float temp_uno;
+    uint32_t flags;          // SHM_BUS_* bits
+    uint32_t sequence;       // low 32 bits of the record number in the board's ring
+
+} shm_bus_sample;
+
+/*!
+    \brief Ring slot, one cache line
+*/
+typedef struct _shm_bus_slot {
+
+    std::atomic<uint64_t> sequence; // odd while written, 2 * (record + 1) when complete
+    shm_bus_sample sample;
+
+} shm_bus_slot;
+
+/*!
+    \brief Per-board ring header, followed by the board's slots
+*/
+typedef struct _shm_bus_board {
+
+    alignas(64) std::atomic<uint64_t> head;  // records published
+    std::atomic<uint64_t> start;            // head when the current board got the ring
+    std::atomic<uint32_t> generation;       // odd while the ring changes board, 2 * board sessions on it
+    char serial[24];                        // serial number, zero terminated, valid while generation is even
+
+} shm_bus_board;
+
+/*!
+    \brief Segment header
+
+    Followed by the shm_bus_board headers of all rings and then
+    the rings of capacity slots each
+*/
+typedef struct _shm_bus_header {
+
+    std::atomic<uint32_t> magic;       // SHM_BUS_MAGIC once initialized
+    uint32_t version;                  // SHM_BUS_VERSION
+    uint32_t rings;                    // board rings in the segment
+    uint32_t capacity;                 // slots per board, power of two
+    uint32_t slot_size;                // sizeof(shm_bus_slot)
+    std::atomic<uint32_t> boards;      // rings in use
+    std::atomic<uint32_t> notify;      // futex word, incremented after every batch
+    int64_t writer_pid;
+
+} shm_bus_header;
+
+static_assert(sizeof(shm_bus_slot) == 64, "one slot per cache line");
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+              "atomics in shared memory need to be lock free");
+
+
+/*!
+    \brief Byte offsets in the segment
+*/
+static inline size_t shm_bus_board_offset(uint32_t board)
+{
+    return ((sizeof(shm_bus_header) + 63) & ~(size_t)63) + board * sizeof(shm_bus_board);
+}
+
+static inline size_t shm_bus_ring_offset(uint32_t rings, uint32_t capacity, uint32_t board)
+{
+    return shm_bus_board_offset(rings) + (size_t)board * capacity * sizeof(shm_bus_slot);
+}
+
+static inline size_t shm_bus_size(uint32_t rings, uint32_t capacity)
+{
+    return shm_bus_ring_offset(rings, capacity, rings);
+}
+
+/*!
+    \brief Wake readers blocked in ShmBusReader::wait()
+*/
+static inline void shm_bus_wake(std::atomic<uint32_t> *word)
+{
+    syscall(SYS_futex, (uint32_t *)word, FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+}
+
+
+/*!
+    \brief Reader of the live sample bus, one per consumer thread
+
+    Maps the segment read only, starts at the newest record of every
+    board. read() never blocks, wait() sleeps until the writer
+    publishes or the timeout elapses.
+*/
+class ShmBusReader
+{
+public:
+    /*!
+        \param name shared memory object name
+        \exception segment missing or not initialized, throws std::runtime_error
+    */
+    explicit ShmBusReader(const char *name = SHM_BUS_DEFAULT_NAME)
+        : base_(nullptr), size_(0), overruns_(0)
+    {
+        int fd = shm_open(name, O_RDONLY, 0);
+        if (fd < 0)
+            throw std::runtime_error(std::string("Can not open shared memory ") + name);
+        struct stat st;
+        if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(shm_bus_header))
+        {
+            close(fd);
+            throw std::runtime_error(std::string("Shared memory too small: ") + name);
+        }
+        size_ = st.st_size;
+        void *p = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED)
+            throw std::runtime_error(std::string("Can not map shared memory ") + name);
+        base_ = (const uint8_t *)p;
+
+        const shm_bus_header *h = header();
+        if (h->magic.load(std::memory_order_acquire) != SHM_BUS_MAGIC || h->version != SHM_BUS_VERSION ||
+            h->slot_size != sizeof(shm_bus_slot) || size_ < shm_bus_size(h->rings, h->capacity))
+        {
+            munmap((void *)base_, size_);
+            throw std::runtime_error(std::string("Not a sample bus: ") + name);
+        }
+        next_.resize(h->rings);
+        generation_.resize(h->rings, 0);
+        serial_.resize(h->rings);
+        for (uint32_t b = 0; b < h->rings; b++)
+        {
+            next_[b] = board(b)->head.load(std::memory_order_acquire);
+            uint32_t generation;
+            uint64_t start;
+            char serial[sizeof(shm_bus_board::serial)];
+            if (owner(b, generation, start, serial))
+            {
+                generation_[b] = generation;
+                serial_[b] = serial;
+            }
+        }
+    }
+
+    ~ShmBusReader()
+    {
+        if (base_)
+            munmap((void *)base_, size_);
+    }
+
+    ShmBusReader(const ShmBusReader &) = delete;
+    ShmBusReader &operator=(const ShmBusReader &) = delete;
+
+    /*! \return rings in use, board numbers below it are valid */
+    unsigned int boards(void) const { return header()->boards.load(std::memory_order_acquire); }
+
+    /*! \return serial number of the board of the records read last from a ring */
+    const char *serial(unsigned int b) const { return serial_[b].c_str(); }
+
+    /*! \return session of the ring's board, changes when a read() reaches records of the next board */
+    uint32_t generation(unsigned int b) const { return generation_[b]; }
+
+    /*! \return records lost because the writer lapped this reader */
+    uint64_t overruns(void) const { return overruns_; }
+
+    /*!
+        \brief Copy the records published since the last call
+
+        \param b   board number, below boards()
+        \param out destination
+        \param max records to copy at most
+        \return records copied, in order
+    */
+    size_t read(unsigned int b, shm_bus_sample *out, size_t max)
+    {
+        const shm_bus_header *h = header();
+        const shm_bus_board *bb = board(b);
+        const shm_bus_slot *slots = ring(b);
+        const uint64_t mask = h->capacity - 1;
+
+        uint64_t head = bb->head.load(std::memory_order_acquire);
+        uint64_t next = next_[b];
+        if (head - next > h->capacity)
+        {
+            overruns_ += head - h->capacity - next;
+            next = head - h->capacity;
+        }
+
+        // the ring changed board: first the old board's records, then switch to the new one
+        uint32_t generation;
+        uint64_t start;
+        char serial[sizeof(shm_bus_board::serial)];
+        if (owner(b, generation, start, serial) && generation != generation_[b])
+        {
+            if (next >= start)
+            {
+                generation_[b] = generation;
+                serial_[b] = serial;
+            }
+            else if (head > start)
+            {
+                head = start;
+            }
+        }
+
+        size_t n = 0;
+        for (; next < head && n < max; next++)
+        {
+            const shm_bus_slot &slot = slots[next & mask];
+            const uint64_t expected = 2 * (next + 1);
+            if (slot.sequence.load(std::memory_order_acquire) != expected)
+            {
+                overruns_++;
+                continue;
+            }
+            // may race with the writer, a torn copy is caught by the second check
+            memcpy(&out[n], &slot.sample, sizeof(shm_bus_sample));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence.load(std::memory_order_relaxed) != expected)
+            {
+                overruns_++;
+                continue;
+            }
+            n++;
+        }
+        next_[b] = next;
+        return n;
+    }
+
+    /*!
+        \brief Sleep until a batch is published on any board
+
+        \param timeout_us longest sleep
+        \return false on timeout
+    */
+    bool wait(int timeout_us)
+    {
+        const shm_bus_header *h = header();
+        const uint32_t seen = h->notify.load(std::memory_order_acquire);
+
+        bool pending = false;
+        for (unsigned int b = 0; b < boards() && !pending; b++)
+            pending = board(b)->head.load(std::memory_order_acquire) != next_[b];
+
+        if (pending)
+            return true;
+
+        // returns at once if the writer published after notify was read
+        timespec timeout = {timeout_us / 1000000, (timeout_us % 1000000) * 1000};
+        syscall(SYS_futex, (const uint32_t *)&h->notify, FUTEX_WAIT, seen, &timeout, nullptr, 0);
+        return h->notify.load(std::memory_order_acquire) != seen;
+    }
+
+private:
+    const shm_bus_header *header(void) const { return (const shm_bus_header *)base_; }
+
+    /*!
+        \brief Consistent copy of a ring's owner, a seqlock like the slots
+
+        \param b          board number
+        \param generation output, even
+        \param start      output, first record of the owner
+        \param serial     output, serial number
+        \return false while the ring changes board
+    */
+    bool owner(unsigned int b, uint32_t &generation, uint64_t &start, char *serial) const
+    {
+        const shm_bus_board *bb = board(b);
+        generation = bb->generation.load(std::memory_order_acquire);
+        if (generation & 1)
+            return false;
+        start = bb->start.load(std::memory_order_relaxed);
+        memcpy(serial, bb->serial, sizeof(bb->serial));
+        serial[sizeof(bb->serial) - 1] = 0;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return bb->generation.load(std::memory_order_relaxed) == generation;
+    }
+
+    const shm_bus_board *board(unsigned int b) const
+    {
+        return (const shm_bus_board *)(base_ + shm_bus_board_offset(b));
+    }
+
+    const shm_bus_slot *ring(unsigned int b) const
+    {
+        return (const shm_bus_slot *)(base_ + shm_bus_ring_offset(header()->rings, header()->capacity, b));
+    }
+
+    const uint8_t *base_;
+    size_t size_;
+    std::vector<uint64_t> next_;    // next record per board
+    std::vector<uint32_t> generation_;  // owner of the records read last per board
+    std::vector<std::string> serial_;
+    uint64_t overruns_;
+};
+
+#endif
@@ -0,0 +1,197 @@
+/*!
+    @file shm_publisher.cpp
+    @brief Writer side of the shared memory sample bus
+*/
+
+#include <errno.h>
+#include <string.h>
+#include <stdexcept>
+
+#include "shm_publisher.h"
+#include "trace.h"
+
+
+/*!
+    \brief Create the segment, a stale segment of an earlier run is replaced
+
+    \param name     shared memory object name, starting with /
+    \param boards   board rings
+    \param capacity samples per ring, rounded up to a power of two
+    \exception segment can not be created, throws std::runtime_error
+*/
+ShmBusPublisher::ShmBusPublisher(const std::string &name, uint32_t boards, uint32_t capacity)
+    : name_(name), base_(nullptr), size_(0)
+{
+    uint32_t slots = 1;
+    while (slots < capacity)
+        slots <<= 1;
+    size_ = shm_bus_size(boards, slots);
+
+    shm_unlink(name_.c_str());
+    int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0)
+        throw std::runtime_error("Can not create shared memory " + name_ + ": " + strerror(errno));
+    if (ftruncate(fd, size_) < 0)
+    {
+        close(fd);
+        shm_unlink(name_.c_str());
+        throw std::runtime_error("Can not size shared memory " + name_);
+    }
+    void *p = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+    {
+        shm_unlink(name_.c_str());
+        throw std::runtime_error("Can not map shared memory " + name_);
+    }
+    base_ = (uint8_t *)p;
+
+    // ftruncate zeroed the segment, readers check magic last
+    shm_bus_header *h = header();
+    h->version = SHM_BUS_VERSION;
+    h->rings = boards;
+    h->capacity = slots;
+    h->slot_size = sizeof(shm_bus_slot);
+    h->writer_pid = getpid();
+    h->magic.store(SHM_BUS_MAGIC, std::memory_order_release);
+}
+
+/*!
+    \brief Unmap and remove the segment, mapped readers keep their copy
+*/
+ShmBusPublisher::~ShmBusPublisher()
+{
+    munmap(base_, size_);
+    shm_unlink(name_.c_str());
+}
+
+/*!
+    \brief Give a ring to a board session and make it visible to readers
+
+    A reused session slot hands its ring to the new board: the
+    generation is odd while the serial number is rewritten, readers
+    switch to the new board at the records published from here on.
+    Only called when the ring's previous writer is gone.
+
+    \param board  session number of the board
+    \param serial serial number, truncated to the ring's field
+    \return false if the bus has no ring for the board
+*/
+bool ShmBusPublisher::addBoard(uint32_t board, const std::string &serial)
+{
+    shm_bus_header *h = header();
+    if (board >= h->rings)
+        return false;
+
+    shm_bus_board *b = (shm_bus_board *)(base_ + shm_bus_board_offset(board));
+    const uint32_t generation = b->generation.load(std::memory_order_relaxed);
+    b->generation.store(generation + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    strncpy(b->serial, serial.c_str(), sizeof(b->serial) - 1);
+    b->start.store(b->head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    b->generation.store(generation + 2, std::memory_order_release);
+
+    uint32_t boards = h->boards.load(std::memory_order_relaxed);
+    while (boards < board + 1 &&
+           !h->boards.compare_exchange_weak(boards, board + 1, std::memory_order_release))
+    {
+    }
+    return true;
+}
+
+/*!
+    \brief Append samples to a board's ring and wake waiting readers
+
+    Only the board's worker may call this. Slots are overwritten
+    whether read or not.
+
+    \param board   ring added with addBoard()
+    \param samples calibrated samples
+    \param count   number of samples
+*/
+void ShmBusPublisher::publish(uint32_t board, const shm_bus_sample *samples, size_t count)
+{
+    TRACE_SCOPE_ARG(trace_publish, count);
+    shm_bus_header *h = header();
+    shm_bus_board *b = (shm_bus_board *)(base_ + shm_bus_board_offset(board));
+    shm_bus_slot *slots = (shm_bus_slot *)(base_ + shm_bus_ring_offset(h->rings, h->capacity, board));
+    const uint64_t mask = h->capacity - 1;
+    const uint64_t head = b->head.load(std::memory_order_relaxed);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const uint64_t n = head + i;
+        shm_bus_slot &slot = slots[n & mask];
+        slot.sequence.store(2 * n + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.sample = samples[i];
+        slot.sample.sequence = (uint32_t)n;
+        slot.sequence.store(2 * n + 2, std::memory_order_release);
+    }
+
+    b->head.store(head + count, std::memory_order_release);
+    h->notify.fetch_add(1, std::memory_order_release);
+    shm_bus_wake(&h->notify);
+}
+
+
+/*!
+    \param bus   shared bus
+    \param board handshake results, the board's clock maps host times
+*/
+ShmSampleWriter::ShmSampleWriter(ShmBusPublisher &bus, const board_info &board)
+    : bus_(bus), board_(board.index), clock_(board.clock), cacv_(board.cacv)
+{
+    published_ = bus_.addBoard(board_, board.serial);
+}
+
+/*!
+    \brief Convert, compensate and publish a batch of samples
+
+    \param data_vector raw samples
+    \param count       number of samples
+*/
+void ShmSampleWriter::write(const scha63x_raw_data *data_vector, size_t count)
+{
+    if (!published_)
+        return;
+
+    if (out_.size() < count)
+    {
+        for (auto &channel : channels_)
+            channel.resize(count);
+        batch_ = { channels_[0].data(), channels_[1].data(), channels_[2].data(), channels_[3].data(),
+                   channels_[4].data(), channels_[5].data(), channels_[6].data(), channels_[7].data() };
+        out_.resize(count);
+    }
+
+    {
+        TRACE_SCOPE_ARG(trace_convert, count);
+        scha63x_convert_batch_cacv(data_vector, count, &cacv_, &batch_);
+    }
+
+    clock_model model;
+    if (clock_)
+        model = clock_->model();
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const scha63x_raw_data &raw = data_vector[i];
+        shm_bus_sample &s = out_[i];
+        s.device_time_us = clock_ ? ClockSync::extend(model, raw.timeStamp) : raw.timeStamp;
+        s.host_time_ns = clock_ ? ClockSync::map(model, raw.timeStamp) : 0;
+        s.acc[0] = batch_.acc_x[i];
+        s.acc[1] = batch_.acc_y[i];
+        s.acc[2] = batch_.acc_z[i];
+        s.gyro[0] = batch_.gyro_x[i];
+        s.gyro[1] = batch_.gyro_y[i];
+        s.gyro[2] = batch_.gyro_z[i];
+        s.temp_due = batch_.temp_due[i];
+        s.temp_uno = batch_.temp_uno[i];
+        s.flags = (raw.rs_error_due ? SHM_BUS_RS_ERROR_DUE : 0) | (raw.rs_error_uno ? SHM_BUS_RS_ERROR_UNO : 0) |
+                  (raw.cam_trigger ? SHM_BUS_CAM_TRIGGER : 0) | (raw.ubx_trigger ? SHM_BUS_UBX_TRIGGER : 0);
+        s.sequence = 0;
+    }
+
+    bus_.publish(board_, out_.data(), count);
+}
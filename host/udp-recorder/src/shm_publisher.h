@@ -0,0 +1,76 @@
+#ifndef SHM_PUBLISHER_H
+#define SHM_PUBLISHER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "defs.h"
+#include "config.h"
+#include "conversion.h"
+#include "clock_sync.h"
+#include "fan_in.h"
+#include "shm_bus.h"
+
+/*!
+    @file shm_publisher.h
+    @brief Writer side of the shared memory sample bus
+
+    Readers only need shm_bus.h
+*/
+
+
+/*!
+    \brief Owns the shared memory segment of the sample bus
+
+    Creates the segment on construction and removes it on
+    destruction. Every board ring has a single writer, the board's
+    worker, so publish() of different boards may run concurrently.
+*/
+class ShmBusPublisher
+{
+public:
+    explicit ShmBusPublisher(const std::string &name = SHM_BUS_DEFAULT_NAME,
+                             uint32_t boards = max_boards, uint32_t capacity = shm_bus_capacity);
+    ~ShmBusPublisher();
+
+    ShmBusPublisher(const ShmBusPublisher &) = delete;
+    ShmBusPublisher &operator=(const ShmBusPublisher &) = delete;
+
+    bool addBoard(uint32_t board, const std::string &serial);
+    void publish(uint32_t board, const shm_bus_sample *samples, size_t count);
+
+    const std::string &name(void) const { return name_; }
+
+private:
+    shm_bus_header *header(void) const { return (shm_bus_header *)base_; }
+
+    std::string name_;
+    uint8_t *base_;
+    size_t size_;
+};
+
+
+/*!
+    \brief Converts a board's raw samples and publishes them on the bus
+*/
+class ShmSampleWriter
+{
+public:
+    ShmSampleWriter(ShmBusPublisher &bus, const board_info &board);
+
+    void write(const scha63x_raw_data *samples, size_t count);
+
+private:
+    ShmBusPublisher &bus_;
+    uint32_t board_;
+    bool published_;          // the bus has a ring for the board
+    const ClockSync *clock_;
+    scha63x_cacv cacv_;
+
+    std::vector<float> channels_[8];
+    scha63x_real_batch batch_;
+    std::vector<shm_bus_sample> out_;
+};
+
+#endif
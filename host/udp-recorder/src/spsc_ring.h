@@ -0,0 +1,159 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stddef.h>
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+/*!
+    @file spsc_ring.h
+    @brief Bounded lock-free single-producer/single-consumer ring
+
+    Exactly one thread may push and exactly one thread may pop. Head
+    and tail are free running counters on separate cache lines, the
+    capacity is rounded up to a power of two.
+*/
+
+
+/*! \brief assumed cache line size, keeps head and tail apart */
+#define SPSC_CACHE_LINE 64
+
+
+template <typename T>
+class SpscRing
+{
+public:
+    /*!
+        \param capacity minimum number of elements, rounded up to a power of two
+        \exception capacity 0, throws std::runtime_error
+    */
+    explicit SpscRing(size_t capacity)
+    {
+        if (capacity == 0)
+            throw std::runtime_error("Ring capacity must be positive");
+
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+
+        buffer_.resize(size);
+        mask_ = size - 1;
+        head_.store(0, std::memory_order_relaxed);
+        tail_.store(0, std::memory_order_relaxed);
+    }
+
+    /*! \return number of slots in the ring */
+    size_t capacity(void) const { return mask_ + 1; }
+
+    /*! \return number of elements queued, approximate from a third thread */
+    size_t size(void) const
+    {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+
+    /*!
+        \brief Producer side, append one element
+
+        \return false if the ring is full, element is not queued
+    */
+    bool push(const T &item)
+    {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head - cached_tail_ > mask_)
+        {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head - cached_tail_ > mask_)
+                return false;
+        }
+
+        buffer_[head & mask_] = item;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /*!
+        \brief Producer side, append up to count elements written in place
+
+        Saves a staging copy when elements are decoded from another
+        buffer. fill(T *out, size_t first, size_t n) writes elements
+        first to first + n - 1 of the batch to out, it is called once
+        or twice when the free space wraps around the end of the ring.
+
+        \param count elements to append
+        \param fill  writes elements into the ring
+        \return number of elements appended, less than count if the ring is full
+    */
+    template <typename Fill>
+    size_t pushBatch(size_t count, Fill fill)
+    {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (capacity() - (head - cached_tail_) < count)
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+
+        const size_t space = capacity() - (head - cached_tail_);
+        if (count > space)
+            count = space;
+        if (count == 0)
+            return 0;
+
+        const size_t start = head & mask_;
+        const size_t first = capacity() - start < count ? capacity() - start : count;
+        fill(&buffer_[start], 0, first);
+        if (first < count)
+            fill(&buffer_[0], first, count - first);
+
+        head_.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+    /*!
+        \brief Consumer side, take one element
+
+        \return false if the ring is empty
+    */
+    bool pop(T &item)
+    {
+        return popBatch(&item, 1) == 1;
+    }
+
+    /*!
+        \brief Consumer side, take up to max elements at once
+
+        \param out destination for the elements
+        \param max maximum number of elements to take
+        \return number of elements taken
+    */
+    size_t popBatch(T *out, size_t max)
+    {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (cached_head_ == tail)
+        {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if (cached_head_ == tail)
+                return 0;
+        }
+
+        size_t count = cached_head_ - tail;
+        if (count > max)
+            count = max;
+
+        for (size_t i = 0; i < count; i++)
+            out[i] = buffer_[(tail + i) & mask_];
+
+        tail_.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+private:
+    std::vector<T> buffer_;
+    size_t mask_;
+
+    alignas(SPSC_CACHE_LINE) std::atomic<size_t> head_; // written by producer
+    size_t cached_tail_ = 0;                             // producer's view of tail
+
+    alignas(SPSC_CACHE_LINE) std::atomic<size_t> tail_; // written by consumer
+    size_t cached_head_ = 0;                             // consumer's view of head
+};
+
+#endif
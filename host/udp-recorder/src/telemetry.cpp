@@ -0,0 +1,314 @@
+/*!
+    @file telemetry.cpp
+    @brief Loss, reordering, jitter and delay statistics of a sample stream
+*/
+
+#include <string.h>
+#include <limits>
+
+#include "telemetry.h"
+
+
+/*! \brief sequence numbers remembered for duplicate detection */
+#define sequence_window 64
+
+
+// Histogram
+
+/*!
+    \brief Bucket of a value, exact below 16, 8 buckets per power of two above
+*/
+int Histogram::bucket(uint64_t value)
+{
+    if (value < (1u << histogram_exact_bits))
+        return (int)value;
+
+    const int msb = 63 - __builtin_clzll(value);
+    const int sub = (value >> (msb - histogram_sub_bits)) & ((1 << histogram_sub_bits) - 1);
+    return (1 << histogram_exact_bits) + ((msb - histogram_exact_bits) << histogram_sub_bits) + sub;
+}
+
+/*!
+    \brief Largest value falling into a bucket
+*/
+uint64_t Histogram::bucketUpper(int bucket)
+{
+    if (bucket < (1 << histogram_exact_bits))
+        return bucket;
+
+    const int i = bucket - (1 << histogram_exact_bits);
+    const int msb = (i >> histogram_sub_bits) + histogram_exact_bits;
+    const uint64_t sub = i & ((1 << histogram_sub_bits) - 1);
+    const int shift = msb - histogram_sub_bits;
+    return (((1ULL << histogram_sub_bits) + sub + 1) << shift) - 1;
+}
+
+void Histogram::add(uint64_t value)
+{
+    counts_[bucket(value)]++;
+    count_++;
+    sum_ += value;
+    if (value > max_)
+        max_ = value;
+}
+
+void Histogram::merge(const Histogram &other)
+{
+    for (int i = 0; i < histogram_buckets; i++)
+        counts_[i] += other.counts_[i];
+    count_ += other.count_;
+    sum_ += other.sum_;
+    if (other.max_ > max_)
+        max_ = other.max_;
+}
+
+void Histogram::reset(void)
+{
+    memset(counts_, 0, sizeof(counts_));
+    count_ = 0;
+    sum_ = 0;
+    max_ = 0;
+}
+
+/*!
+    \brief Value below which p percent of the values fall
+
+    \param p percentile, 0-100
+    \return upper edge of the bucket, never above the maximum, 0 if empty
+*/
+uint64_t Histogram::percentile(double p) const
+{
+    if (count_ == 0)
+        return 0;
+
+    uint64_t target = (uint64_t)(p / 100.0 * count_ + 0.5);
+    if (target < 1)
+        target = 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < histogram_buckets; i++)
+    {
+        seen += counts_[i];
+        if (seen >= target)
+        {
+            uint64_t upper = bucketUpper(i);
+            return upper < max_ ? upper : max_;
+        }
+    }
+    return max_;
+}
+
+
+
+// Stream telemetry
+
+StreamTelemetry::StreamTelemetry()
+    : started_(false), highest_(0), window_(0), missed_ticks_(0), overruns_(0), send_time_(0), prev_send_(0), prev_receive_(0),
+      min_delay_(std::numeric_limits<int64_t>::max()),
+      baseline_(std::numeric_limits<int64_t>::max()), smoothed_jitter_(0)
+{
+    memset(&counters_, 0, sizeof(counters_));
+}
+
+/*!
+    \brief Track a sequence number
+
+    Gaps are counted as lost right away and taken back when a late
+    packet fills them
+
+    \return false for a duplicate
+*/
+bool StreamTelemetry::sequence(uint32_t seq)
+{
+    if (!started_)
+    {
+        started_ = true;
+        highest_ = seq;
+        window_ = 1;
+        return true;
+    }
+
+    const int32_t diff = (int32_t)(seq - highest_);
+    if (diff > 0)
+    {
+        counters_.lost += diff - 1;
+        window_ = diff >= sequence_window ? 0 : window_ << diff;
+        window_ |= 1;
+        highest_ = seq;
+        return true;
+    }
+
+    const uint32_t back = -diff;
+    if (back < sequence_window)
+    {
+        if (window_ & (1ULL << back))
+        {
+            counters_.duplicates++;
+            return false;
+        }
+        window_ |= 1ULL << back;
+    }
+
+    counters_.reordered++;
+    if (counters_.lost > 0)
+        counters_.lost--;
+    return true;
+}
+
+/*!
+    \brief Account one received sample packet
+
+    \param header          packet header
+    \param count           number of samples
+    \param first_timestamp device timestamp of the first sample, us
+    \param receive_time_ns host receive time, CLOCK_MONOTONIC
+    \return false for a duplicate packet, its samples should be dropped
+*/
+bool StreamTelemetry::add(const scha63x_packet_header &header, unsigned int count,
+                          int64_t first_timestamp, int64_t receive_time_ns)
+{
+    counters_.packets++;
+    counters_.samples += count;
+
+    if (!sequence(header.sequence))
+        return false;
+
+    // device counters wrap, older values of reordered packets are left out
+    const int16_t missed = (int16_t)(header.missed_ticks - missed_ticks_);
+    if (missed > 0)
+    {
+        counters_.missed_ticks += missed;
+        missed_ticks_ = header.missed_ticks;
+    }
+    const int8_t overruns = (int8_t)(header.overruns - overruns_);
+    if (overruns > 0)
+    {
+        counters_.overruns += overruns;
+        overruns_ = header.overruns;
+    }
+
+    // micros() wraps every 71 minutes, extend around the latest send time
+    const int64_t send = counters_.packets == 1
+        ? header.send_time
+        : send_time_ + (int32_t)(header.send_time - (uint32_t)send_time_);
+    if (counters_.packets == 1 || send > send_time_)
+        send_time_ = send;
+
+    const int64_t receive = receive_time_ns / 1000;
+
+    if (counters_.packets > 1)
+    {
+        int64_t d = (receive - prev_receive_) - (send - prev_send_);
+        if (d < 0)
+            d = -d;
+        jitter_.add(d);
+        smoothed_jitter_ += (d - smoothed_jitter_) / 16.0;
+    }
+    prev_send_ = send;
+    prev_receive_ = receive;
+
+    const int64_t delay = receive - send;
+    if (delay < min_delay_)
+        min_delay_ = delay;
+    const int64_t base = baseline_ != std::numeric_limits<int64_t>::max() ? baseline_ : min_delay_;
+    delay_.add(delay > base ? delay - base : 0);
+
+    if (count > 0)
+    {
+        const uint32_t age = header.send_time - (uint32_t)first_timestamp;
+        if (age < (1u << 31))
+            age_.add(age);
+    }
+
+    return true;
+}
+
+/*!
+    \brief Start a new reporting interval
+
+    Histograms restart, the delay baseline follows the smallest delay
+    of the interval that ended so clock drift does not accumulate
+*/
+void StreamTelemetry::endInterval(void)
+{
+    if (min_delay_ != std::numeric_limits<int64_t>::max())
+        baseline_ = min_delay_;
+    min_delay_ = std::numeric_limits<int64_t>::max();
+
+    jitter_.reset();
+    delay_.reset();
+    age_.reset();
+}
+
+/*!
+    \brief One human readable line
+*/
+void StreamTelemetry::print(FILE *file, const char *name) const
+{
+    const uint64_t expected = counters_.packets - counters_.duplicates + counters_.lost;
+    uint64_t crc_total = 0;
+    for (uint64_t errors : counters_.crc_errors)
+        crc_total += errors;
+    fprintf(file, "%s: %lu packets, %lu lost (%.3f %%), %lu reordered, %lu duplicates | "
+            "device %lu missed ticks, %lu overruns, %lu CRC errors | "
+            "jitter p50/p99/max %lu/%lu/%lu us | delay p50/p99/p99.9/max %lu/%lu/%lu/%lu us | "
+            "batch age p50/p99 %lu/%lu us\n",
+            name, (unsigned long)counters_.packets, (unsigned long)counters_.lost,
+            expected ? 100.0 * counters_.lost / expected : 0.0,
+            (unsigned long)counters_.reordered, (unsigned long)counters_.duplicates,
+            (unsigned long)counters_.missed_ticks, (unsigned long)counters_.overruns, (unsigned long)crc_total,
+            (unsigned long)jitter_.percentile(50), (unsigned long)jitter_.percentile(99),
+            (unsigned long)jitter_.max(),
+            (unsigned long)delay_.percentile(50), (unsigned long)delay_.percentile(99),
+            (unsigned long)delay_.percentile(99.9), (unsigned long)delay_.max(),
+            (unsigned long)age_.percentile(50), (unsigned long)age_.percentile(99));
+}
+
+/*!
+    \brief Count the CRC errors of decoded samples per channel
+
+    \param samples samples of an accepted packet
+    \param count   number of samples
+*/
+void StreamTelemetry::addCrcErrors(const scha63x_raw_data *samples, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        const uint8_t errors = samples[i].crc_errors;
+        if (!errors)
+            continue;
+        for (int c = 0; c < SCHA63X_WIRE_DELTA_CHANNELS; c++)
+            counters_.crc_errors[c] += (errors >> c) & 1;
+    }
+}
+
+/*!
+    \brief One JSON line, for the stats file
+
+    \param file output
+    \param name board name
+    \param time seconds since the recorder started
+*/
+void StreamTelemetry::printJson(FILE *file, const char *name, double time) const
+{
+    fprintf(file, "{\"board\":\"%s\",\"time\":%.3f,\"packets\":%lu,\"samples\":%lu,\"lost\":%lu,"
+            "\"reordered\":%lu,\"duplicates\":%lu,\"missed_ticks\":%lu,\"overruns\":%lu,"
+            "\"crc_errors\":[%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu],"
+            "\"jitter_us\":{\"p50\":%lu,\"p99\":%lu,\"max\":%lu,\"smoothed\":%.1f},"
+            "\"delay_us\":{\"p50\":%lu,\"p99\":%lu,\"p999\":%lu,\"max\":%lu},"
+            "\"age_us\":{\"p50\":%lu,\"p99\":%lu,\"max\":%lu}}\n",
+            name, time, (unsigned long)counters_.packets, (unsigned long)counters_.samples,
+            (unsigned long)counters_.lost, (unsigned long)counters_.reordered,
+            (unsigned long)counters_.duplicates, (unsigned long)counters_.missed_ticks,
+            (unsigned long)counters_.overruns,
+            (unsigned long)counters_.crc_errors[0], (unsigned long)counters_.crc_errors[1],
+            (unsigned long)counters_.crc_errors[2], (unsigned long)counters_.crc_errors[3],
+            (unsigned long)counters_.crc_errors[4], (unsigned long)counters_.crc_errors[5],
+            (unsigned long)counters_.crc_errors[6], (unsigned long)counters_.crc_errors[7],
+            (unsigned long)jitter_.percentile(50), (unsigned long)jitter_.percentile(99),
+            (unsigned long)jitter_.max(), smoothed_jitter_,
+            (unsigned long)delay_.percentile(50), (unsigned long)delay_.percentile(99),
+            (unsigned long)delay_.percentile(99.9), (unsigned long)delay_.max(),
+            (unsigned long)age_.percentile(50), (unsigned long)age_.percentile(99),
+            (unsigned long)age_.max());
+}
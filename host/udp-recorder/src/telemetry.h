@@ -0,0 +1,126 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "defs.h"
+#include "scha63x_wire.h"
+
+/*!
+    @file telemetry.h
+    @brief Loss, reordering, jitter and delay statistics of a sample stream
+
+    Built from the packet header of every sample batch: the sequence
+    number tells lost and reordered packets apart from timer hiccups,
+    the device send time gives inter-arrival jitter and delays, the
+    device's own counters tell samples it never took or dropped. CRC
+    errors are counted per channel from the decoded samples.
+*/
+
+
+/*! \brief exact buckets below 2^histogram_exact_bits, 8 buckets per power of two above */
+#define histogram_exact_bits 4
+#define histogram_sub_bits 3
+#define histogram_buckets (((64 - histogram_exact_bits) << histogram_sub_bits) + (1 << histogram_exact_bits))
+
+
+/*!
+    \brief Log-linear histogram of non-negative integer values
+
+    Relative bucket width is at most 12.5 %, percentiles report the
+    upper edge of their bucket. Fixed size, add() never allocates.
+*/
+class Histogram
+{
+public:
+    Histogram() { reset(); }
+
+    void add(uint64_t value);
+    void merge(const Histogram &other);
+    void reset(void);
+
+    uint64_t count(void) const { return count_; }
+    uint64_t max(void) const { return max_; }
+    double mean(void) const { return count_ ? 1.0 * sum_ / count_ : 0.0; }
+    uint64_t percentile(double p) const;
+
+private:
+    static int bucket(uint64_t value);
+    static uint64_t bucketUpper(int bucket);
+
+    uint64_t counts_[histogram_buckets];
+    uint64_t count_;
+    uint64_t sum_;
+    uint64_t max_;
+};
+
+
+/*!
+    \brief Packet counters since the start of the stream
+*/
+typedef struct _stream_counters {
+
+    uint64_t packets;     // sample packets received, duplicates included
+    uint64_t samples;     // samples in those packets
+    uint64_t lost;        // sequence numbers never received
+    uint64_t reordered;   // packets arriving after a later sequence number
+    uint64_t duplicates;  // sequence numbers received more than once
+    uint64_t missed_ticks; // sample timer ticks the device did not sample
+    uint64_t overruns;    // batches the device dropped with both buffers full
+    uint64_t crc_errors[SCHA63X_WIRE_DELTA_CHANNELS]; // samples whose MISO frame failed its CRC, acc x first
+
+} stream_counters;
+
+
+/*!
+    \brief Telemetry of one board's packet stream
+
+    Histograms cover the current reporting interval, counters the
+    whole stream. Device and host clocks are not synchronized, so
+    delay is the one-way delay above the smallest delay of the
+    previous interval: network and host queuing, not absolute latency.
+*/
+class StreamTelemetry
+{
+public:
+    StreamTelemetry();
+
+    bool add(const scha63x_packet_header &header, unsigned int count,
+             int64_t first_timestamp, int64_t receive_time_ns);
+    void addCrcErrors(const scha63x_raw_data *samples, size_t count);
+    void endInterval(void);
+
+    const stream_counters &counters(void) const { return counters_; }
+    const Histogram &jitter(void) const { return jitter_; }
+    const Histogram &delay(void) const { return delay_; }
+    const Histogram &age(void) const { return age_; }
+    double smoothedJitter(void) const { return smoothed_jitter_; }
+
+    void print(FILE *file, const char *name) const;
+    void printJson(FILE *file, const char *name, double time) const;
+
+private:
+    bool sequence(uint32_t seq);
+
+    stream_counters counters_;
+
+    bool started_;
+    uint32_t highest_;       // highest sequence number received
+    uint64_t window_;        // bit i set: highest_ - i received
+    uint16_t missed_ticks_;  // latest device counters, they wrap
+    uint8_t overruns_;
+
+    int64_t send_time_;      // latest device send time, extended to 64 bits, us
+    int64_t prev_send_;      // send time of the previous packet in arrival order, us
+    int64_t prev_receive_;   // host receive time of the previous packet, us
+    int64_t min_delay_;      // smallest receive - send time in this interval
+    int64_t baseline_;       // smallest receive - send time of the previous interval
+    double smoothed_jitter_; // RFC 3550 interarrival jitter, us
+
+    Histogram jitter_;       // |receive spacing - send spacing| per packet, us
+    Histogram delay_;        // one-way delay above baseline, us
+    Histogram age_;          // send time - first sample time on the device, us
+};
+
+#endif
@@ -0,0 +1,315 @@
+/*!
+    @file trace.cpp
+    @brief Scoped tracing of the recorder's pipeline stages
+*/
+
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "trace.h"
+#include "telemetry.h"
+
+
+static_assert((trace_ring_events & (trace_ring_events - 1)) == 0, "trace ring size must be a power of two");
+
+
+/*!
+    \return CLOCK_MONOTONIC in ns, same clock as receive times
+*/
+int64_t traceNow(void)
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+
+#ifdef UDP_RECORDER_TRACING
+
+static const char *const stage_names[trace_stage_count] = {
+    "receive", "dispatch", "decode", "write", "convert", "record", "publish",
+};
+
+static const char *const counter_names[trace_counter_count] = {
+    "datagrams", "queued", "written",
+};
+
+
+/*!
+    \brief One timed scope
+*/
+typedef struct _trace_event {
+
+    int64_t start;     // CLOCK_MONOTONIC ns
+    uint32_t duration; // ns, saturated
+    uint16_t stage;    // trace_stage
+    uint32_t arg;      // e.g. samples in the batch
+
+} trace_event;
+
+/*!
+    \brief Event ring of one thread, written by that thread only
+*/
+struct trace_thread
+{
+    explicit trace_thread(int id) : tid(id), head(0), collected(0), events(trace_ring_events)
+    {
+        for (auto &counter : counters)
+            counter.store(0, std::memory_order_relaxed);
+    }
+
+    int tid;
+    std::string name;                                  // registry lock
+    std::atomic<uint64_t> head;                        // events written, published with release
+    std::atomic<uint64_t> counters[trace_counter_count];
+    uint64_t collected;                                // next event for traceCollect(), collector lock
+    std::vector<trace_event> events;
+};
+
+
+static std::mutex registry_lock;
+static std::vector<trace_thread *> registry;   // never shrinks, rings outlive their threads
+
+static std::mutex collector_lock;
+static Histogram stage_latency[trace_stage_count]; // ns, collector lock
+static uint64_t events_lost = 0;                   // overwritten before collection, collector lock
+
+static std::atomic<bool> dump_requested(false);
+static thread_local trace_thread *current = nullptr;
+
+
+/*!
+    \brief Ring of the calling thread, registered on first use
+*/
+static trace_thread *threadRing(void)
+{
+    if (!current)
+    {
+        std::lock_guard<std::mutex> lock(registry_lock);
+        current = new trace_thread((int)registry.size());
+        current->name = "thread " + std::to_string(current->tid);
+        registry.push_back(current);
+    }
+    return current;
+}
+
+/*!
+    \brief Store one event in the calling thread's ring
+
+    \param stage trace_stage
+    \param start scope start, traceNow()
+    \param end   scope end, traceNow()
+    \param arg   shown with the event
+*/
+void traceRecord(int stage, int64_t start, int64_t end, uint32_t arg)
+{
+    trace_thread *t = threadRing();
+    const uint64_t head = t->head.load(std::memory_order_relaxed);
+    const int64_t duration = end - start;
+
+    trace_event &e = t->events[head & (trace_ring_events - 1)];
+    e.start = start;
+    e.duration = duration < (int64_t)UINT32_MAX ? (uint32_t)duration : UINT32_MAX;
+    e.stage = (uint16_t)stage;
+    e.arg = arg;
+
+    t->head.store(head + 1, std::memory_order_release);
+}
+
+/*!
+    \brief Add to a counter of the calling thread
+*/
+void traceCount(int counter, uint64_t n)
+{
+    std::atomic<uint64_t> &c = threadRing()->counters[counter];
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+/*!
+    \brief Name the calling thread in the trace, also allocates its ring
+
+    Call at thread start, the ring is faulted in before the first event
+*/
+void traceThreadName(const std::string &name)
+{
+    trace_thread *t = threadRing();
+    std::lock_guard<std::mutex> lock(registry_lock);
+    t->name = name;
+}
+
+static void requestDump(int)
+{
+    dump_requested.store(true, std::memory_order_relaxed);
+}
+
+/*!
+    \brief Dump on SIGUSR1, check traceDumpRequested() periodically
+*/
+void traceInstallSignal(void)
+{
+    signal(SIGUSR1, requestDump);
+}
+
+/*!
+    \return true once after every SIGUSR1
+*/
+bool traceDumpRequested(void)
+{
+    return dump_requested.exchange(false, std::memory_order_relaxed);
+}
+
+/*!
+    \brief Copy events of a ring that are not overwritten
+
+    The owner keeps writing, events are copied first and those the
+    owner may have reached in the meantime are dropped afterwards
+
+    \param t     ring
+    \param from  first event wanted
+    \param out   copied events in order
+    \return index of the first event in out, events before it were overwritten
+*/
+static uint64_t copyEvents(const trace_thread &t, uint64_t from, std::vector<trace_event> &out)
+{
+    const uint64_t head = t.head.load(std::memory_order_acquire);
+    if (head > trace_ring_events && from < head - trace_ring_events)
+        from = head - trace_ring_events;
+
+    out.clear();
+    for (uint64_t i = from; i < head; i++)
+        out.push_back(t.events[i & (trace_ring_events - 1)]);
+
+    // Events up to the one being written now may have replaced copied ones
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64_t now = t.head.load(std::memory_order_relaxed);
+    uint64_t valid = from;
+    if (now + 1 > trace_ring_events && valid < now + 1 - trace_ring_events)
+        valid = now + 1 - trace_ring_events;
+    if (valid > head)
+        valid = head;
+
+    out.erase(out.begin(), out.begin() + (valid - from));
+    return valid;
+}
+
+/*!
+    \brief Fold new events of every thread into the stage histograms
+
+    Run at least every trace_ring_events events of the busiest thread,
+    older events are overwritten and only counted as lost
+*/
+void traceCollect(void)
+{
+    std::vector<trace_thread *> threads;
+    {
+        std::lock_guard<std::mutex> lock(registry_lock);
+        threads = registry;
+    }
+
+    std::lock_guard<std::mutex> lock(collector_lock);
+    std::vector<trace_event> events;
+    for (trace_thread *t : threads)
+    {
+        const uint64_t first = copyEvents(*t, t->collected, events);
+        events_lost += first - t->collected;
+        for (const trace_event &e : events)
+            stage_latency[e.stage].add(e.duration);
+        t->collected = first + events.size();
+    }
+}
+
+/*!
+    \brief Write the events still in the rings as Chrome trace JSON
+
+    Collects first, the stage histograms and counters since start are
+    printed to summary
+
+    \param path    trace file, replaced
+    \param summary stage latencies and counters, nullptr for none
+    \return false if the file could not be written
+*/
+bool traceDump(const std::string &path, FILE *summary)
+{
+    traceCollect();
+
+    std::vector<trace_thread *> threads;
+    std::vector<std::string> names;
+    {
+        std::lock_guard<std::mutex> lock(registry_lock);
+        threads = registry;
+        for (trace_thread *t : threads)
+            names.push_back(t->name);
+    }
+
+    uint64_t counters[trace_counter_count] = {};
+    for (trace_thread *t : threads)
+        for (int c = 0; c < trace_counter_count; c++)
+            counters[c] += t->counters[c].load(std::memory_order_relaxed);
+
+    FILE *file = fopen(path.c_str(), "w");
+    if (!file)
+    {
+        fprintf(stderr, "Can not write trace %s\n", path.c_str());
+        return false;
+    }
+
+    const int pid = getpid();
+    fprintf(file, "{\"traceEvents\":[\n");
+    bool first = true;
+    std::vector<trace_event> events;
+    for (size_t i = 0; i < threads.size(); i++)
+    {
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",\n", pid, threads[i]->tid, names[i].c_str());
+        first = false;
+
+        copyEvents(*threads[i], 0, events);
+        for (const trace_event &e : events)
+            fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"udp_recorder\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                    "\"pid\":%d,\"tid\":%d,\"args\":{\"n\":%u}}",
+                    stage_names[e.stage], 1e-3 * e.start, 1e-3 * e.duration, pid, threads[i]->tid, e.arg);
+    }
+    fprintf(file, "\n],\n\"displayTimeUnit\":\"ns\",\n\"otherData\":{");
+    for (int c = 0; c < trace_counter_count; c++)
+        fprintf(file, "\"%s\":\"%llu\",", counter_names[c], (unsigned long long)counters[c]);
+
+    std::lock_guard<std::mutex> lock(collector_lock);
+    fprintf(file, "\"events_lost\":\"%llu\"}}\n", (unsigned long long)events_lost);
+    const bool ok = fclose(file) == 0;
+
+    if (summary)
+    {
+        for (int s = 0; s < trace_stage_count; s++)
+        {
+            const Histogram &h = stage_latency[s];
+            if (h.count() == 0)
+                continue;
+            fprintf(summary, "trace %-8s %10llu events, p50/p99/p99.9/max %8.2f/%8.2f/%8.2f/%9.2f us\n",
+                    stage_names[s], (unsigned long long)h.count(), 1e-3 * h.percentile(50),
+                    1e-3 * h.percentile(99), 1e-3 * h.percentile(99.9), 1e-3 * h.max());
+        }
+        fprintf(summary, "trace counters:");
+        for (int c = 0; c < trace_counter_count; c++)
+            fprintf(summary, " %s %llu,", counter_names[c], (unsigned long long)counters[c]);
+        fprintf(summary, " events lost %llu, written to %s\n", (unsigned long long)events_lost, path.c_str());
+        fflush(summary);
+    }
+    return ok;
+}
+
+#else
+
+void traceRecord(int, int64_t, int64_t, uint32_t) {}
+void traceCount(int, uint64_t) {}
+void traceThreadName(const std::string &) {}
+void traceInstallSignal(void) {}
+bool traceDumpRequested(void) { return false; }
+void traceCollect(void) {}
+bool traceDump(const std::string &, FILE *) { return false; }
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+#include "config.h"
+
+/*!
+    @file trace.h
+    @brief Scoped tracing of the recorder's pipeline stages
+
+    TRACE_SCOPE(stage) times the rest of the enclosing block into a
+    ring of trace_ring_events per thread, stamped with CLOCK_MONOTONIC
+    like the receive times. The thread that owns a ring is its only
+    writer, no locks or atomics beyond the ring head. traceCollect()
+    folds new events into per-stage latency histograms and should run
+    periodically, traceDump() writes the events still in the rings as
+    Chrome trace JSON, readable in chrome://tracing and Perfetto.
+
+    Built with -DENABLE_TRACING=ON (UDP_RECORDER_TRACING), the macros
+    expand to nothing otherwise and the functions do nothing.
+*/
+
+
+/*!
+    \brief Traced pipeline stages
+*/
+enum trace_stage {
+
+    trace_receive,    // recvmmsg call, includes waiting for the first datagram
+    trace_dispatch,   // handshakes, telemetry and queueing of one received batch
+    trace_decode,     // one datagram decoded into its board's ring
+    trace_write,      // writer call of one batch taken from a board's ring
+    trace_convert,    // conversion and cross-axis compensation of a batch
+    trace_record,     // recorder add* calls or binary chunk writes of a batch
+    trace_publish,    // shared memory publish of a batch
+    trace_stage_count
+
+};
+
+/*!
+    \brief Traced counters, summed over all threads
+*/
+enum trace_counter {
+
+    trace_datagrams,  // datagrams received
+    trace_queued,     // samples queued into board rings
+    trace_written,    // samples handed to writers
+    trace_counter_count
+
+};
+
+
+int64_t traceNow(void);
+void traceRecord(int stage, int64_t start, int64_t end, uint32_t arg);
+void traceCount(int counter, uint64_t n);
+void traceThreadName(const std::string &name);
+
+void traceInstallSignal(void);
+bool traceDumpRequested(void);
+void traceCollect(void);
+bool traceDump(const std::string &path, FILE *summary);
+
+
+/*!
+    \brief Times its own lifetime as one event of a stage
+*/
+class TraceScope
+{
+public:
+    explicit TraceScope(int stage, uint32_t arg = 0) : stage_(stage), arg_(arg), start_(traceNow()) {}
+    ~TraceScope() { traceRecord(stage_, start_, traceNow(), arg_); }
+
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+    int stage_;
+    uint32_t arg_;
+    int64_t start_;
+};
+
+
+#ifdef UDP_RECORDER_TRACING
+#define TRACE_JOIN2(a, b) a##b
+#define TRACE_JOIN(a, b) TRACE_JOIN2(a, b)
+/*! \brief Time the rest of the block, arg shows up with the event, e.g. a sample count */
+#define TRACE_SCOPE(stage) TraceScope TRACE_JOIN(trace_scope_, __LINE__)(stage)
+#define TRACE_SCOPE_ARG(stage, arg) TraceScope TRACE_JOIN(trace_scope_, __LINE__)(stage, (uint32_t)(arg))
+#define TRACE_COUNT(counter, n) traceCount(counter, n)
+#define TRACE_THREAD(name) traceThreadName(name)
+#else
+#define TRACE_SCOPE(stage)
+#define TRACE_SCOPE_ARG(stage, arg)
+#define TRACE_COUNT(counter, n)
+#define TRACE_THREAD(name)
+#endif
+
+#endif
@@ -0,0 +1,204 @@
+/*!
+    @file wire_decode.cpp
+    @brief Server side decoder of sample batches in either wire encoding
+*/
+
+#include <stddef.h>
+#include <string.h>
+
+#include "wire_decode.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+/*! \brief SSE2 channel accumulation, always available on x86-64 */
+#define WIRE_DECODE_SSE2
+#endif
+
+
+static_assert(offsetof(scha63x_raw_data, temp_uno_lsb) == offsetof(scha63x_raw_data, acc_x_lsb) + 14,
+              "the eight int16 channels are stored and accumulated as one vector");
+
+
+/*!
+    \brief Delta encoded columns unpacked into sample rows
+
+    Row i holds the codes of sample i + 1, rows of eight channels are
+    16 bytes so a sample's deltas load as one vector
+*/
+typedef struct _delta_rows {
+
+    alignas(16) uint16_t channels[256][SCHA63X_WIRE_DELTA_CHANNELS];
+    uint32_t timestamps[256];
+    uint8_t flags[256];
+
+} delta_rows;
+
+
+/*!
+    \brief Read 64 bits at a byte offset, byte by byte near the end
+
+    \param bits bit columns
+    \param end  bytes in the bit columns
+    \param byte offset of the first byte
+*/
+static inline uint64_t load64(const uint8_t *bits, size_t end, size_t byte)
+{
+    uint64_t v = 0;
+    if (byte + 8 <= end)
+    {
+        memcpy(&v, bits + byte, 8);
+        return v; // little endian host
+    }
+    for (size_t i = 0; byte + i < end && i < 8; i++)
+        v |= (uint64_t)bits[byte + i] << (8 * i);
+    return v;
+}
+
+/*!
+    \brief Unpack rows values of a fixed bit width column
+
+    \param bits   bit columns
+    \param end    bytes in the bit columns
+    \param start  first bit of the column
+    \param width  bits per value, up to 32
+    \param rows   values to unpack
+    \param out    destination
+    \param stride distance between destination values
+*/
+template <typename T>
+static void unpackColumn(const uint8_t *bits, size_t end, size_t start, int width,
+                         unsigned int rows, T *out, size_t stride)
+{
+    if (width == 0)
+    {
+        for (unsigned int i = 0; i < rows; i++)
+            out[i * stride] = 0;
+        return;
+    }
+
+    const uint64_t mask = (1ULL << width) - 1;
+    size_t bit = start;
+    for (unsigned int i = 0; i < rows; i++, bit += width)
+        out[i * stride] = (T)((load64(bits, end, bit >> 3) >> (bit & 7)) & mask);
+}
+
+/*!
+    \brief Decode samples first to first + count - 1 of a delta batch
+
+    Channel deltas are summed for all eight channels at once with
+    wrapping int16 adds, which is exactly the encoder's int16 difference
+*/
+static void decodeDelta(const uint8_t *packet, const scha63x_packet_header *header,
+                        unsigned int first, unsigned int count, scha63x_raw_data *out)
+{
+    scha63x_raw_data base;
+    scha63x_wire_get_sample(packet + SCHA63X_WIRE_HEADER_SIZE, &base);
+    if (first == 0)
+        out[0] = base;
+
+    const unsigned int last = first + count;
+    if (last < 2)
+        return;
+
+    const uint8_t *info = packet + SCHA63X_WIRE_PACKET_SIZE(1);
+    const uint8_t *bits = info + SCHA63X_WIRE_DELTA_INFO_SIZE;
+    const size_t end = scha63x_wire_delta_size(packet, SIZE_MAX, header->count) -
+                       SCHA63X_WIRE_PACKET_SIZE(1) - SCHA63X_WIRE_DELTA_INFO_SIZE;
+    const unsigned int values = header->count - 1; // per column in the datagram
+    const unsigned int rows = last - 1;            // per column needed
+
+    delta_rows d;
+    size_t column = 0;
+    unpackColumn(bits, end, column, info[4], rows, d.timestamps, 1);
+    column += (size_t)values * info[4];
+    for (int c = 0; c < SCHA63X_WIRE_DELTA_CHANNELS; c++)
+    {
+        unpackColumn(bits, end, column, info[5 + c], rows, &d.channels[0][c], SCHA63X_WIRE_DELTA_CHANNELS);
+        column += (size_t)values * info[5 + c];
+    }
+    unpackColumn(bits, end, column, 4, rows, d.flags, 1);
+
+    const int32_t step = (int32_t)scha63x_wire_get32(info);
+    uint64_t timestamp = (uint64_t)base.timeStamp;
+
+#ifdef WIRE_DECODE_SSE2
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = _mm_loadu_si128((const __m128i *)&base.acc_x_lsb);
+#else
+    int16_t acc[SCHA63X_WIRE_DELTA_CHANNELS];
+    memcpy(acc, &base.acc_x_lsb, sizeof(acc));
+#endif
+
+    for (unsigned int i = 1; i < last; i++)
+    {
+        const unsigned int r = i - 1;
+        timestamp += (uint64_t)((int64_t)step + scha63x_wire_unzigzag(d.timestamps[r]));
+
+#ifdef WIRE_DECODE_SSE2
+        // zigzag: (z >> 1) ^ -(z & 1), then running sum
+        const __m128i z = _mm_load_si128((const __m128i *)d.channels[r]);
+        const __m128i delta = _mm_xor_si128(_mm_srli_epi16(z, 1), _mm_sub_epi16(zero, _mm_and_si128(z, one)));
+        acc = _mm_add_epi16(acc, delta);
+#else
+        for (int c = 0; c < SCHA63X_WIRE_DELTA_CHANNELS; c++)
+            acc[c] = (int16_t)(uint16_t)(acc[c] + scha63x_wire_unzigzag(d.channels[r][c]));
+#endif
+
+        if (i < first)
+            continue;
+
+        scha63x_raw_data &sample = out[i - first];
+        sample.timeStamp = (int64_t)timestamp;
+#ifdef WIRE_DECODE_SSE2
+        _mm_storeu_si128((__m128i *)&sample.acc_x_lsb, acc);
+#else
+        memcpy(&sample.acc_x_lsb, acc, sizeof(acc));
+#endif
+        scha63x_wire_set_flags(&sample, d.flags[r]);
+    }
+}
+
+/*!
+    \brief Decode samples of a datagram checked by scha63x_wire_check
+
+    Decodes straight from the datagram, e.g. into ring slots. Raw
+    batches decode sample by sample, delta batches unpack their bit
+    columns and accumulate all channels of a sample with SSE2.
+
+    \param packet datagram
+    \param header header from scha63x_wire_check
+    \param first  first sample to decode
+    \param count  number of samples, first + count at most header->count
+    \param out    destination for count samples
+*/
+void scha63x_decode_samples(const uint8_t *packet, const scha63x_packet_header *header,
+                            unsigned int first, unsigned int count, scha63x_raw_data *out)
+{
+    if (count == 0)
+        return;
+
+    if (header->encoding == SCHA63X_WIRE_ENCODING_DELTA)
+    {
+        decodeDelta(packet, header, first, count, out);
+        return;
+    }
+
+    const uint8_t *p = packet + SCHA63X_WIRE_PACKET_SIZE(first);
+    for (unsigned int i = 0; i < count; i++, p += SCHA63X_WIRE_SAMPLE_SIZE)
+        scha63x_wire_get_sample(p, &out[i]);
+}
+
+/*!
+    \brief Instruction set used for delta batches
+
+    \return "sse2" or "scalar"
+*/
+const char *scha63x_decode_isa(void)
+{
+#ifdef WIRE_DECODE_SSE2
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,20 @@
+#ifndef WIRE_DECODE_H
+#define WIRE_DECODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "defs.h"
+#include "scha63x_wire.h"
+
+/*!
+    @file wire_decode.h
+    @brief Server side decoder of sample batches in either wire encoding
+*/
+
+
+void scha63x_decode_samples(const uint8_t *packet, const scha63x_packet_header *header,
+                            unsigned int first, unsigned int count, scha63x_raw_data *out);
+const char *scha63x_decode_isa(void);
+
+#endif
@@ -0,0 +1,82 @@
+/*!
+    @file bin2jsonl.cpp
+    @brief Offline converter from binary recordings to JSONL
+
+    Produces the same JSONL as recording directly with udp_recorder,
+    using the cross-axis terms stored in the recording header.
+
+    usage: bin2jsonl recording.bin [recording.jsonl]
+*/
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <jsonl-recorder/recorder.hpp>
+
+#include "defs.h"
+#include "config.h"
+#include "conversion.h"
+#include "jsonl_output.h"
+#include "binary_recording.h"
+
+
+int main(int argc, char **argv)
+{
+    if (argc < 2 || argc > 3)
+    {
+        printf("usage: %s recording.bin [recording.jsonl]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::string input = argv[1];
+    std::string output;
+    if (argc == 3)
+        output = argv[2];
+    else if (input.size() > 4 && input.compare(input.size() - 4, 4, ".bin") == 0)
+        output = input.substr(0, input.size() - 4) + ".jsonl";
+    else
+        output = input + ".jsonl";
+
+    try
+    {
+        BinaryRecordingReader reader(input);
+        const binary_file_header &header = reader.header();
+
+        if (header.sensitivity_acc != SENSITIVITY_ACC ||
+            header.sensitivity_gyro_x != SENSITIVITY_GYRO_X ||
+            header.sensitivity_gyro_y != SENSITIVITY_GYRO_Y ||
+            header.sensitivity_gyro_z != SENSITIVITY_GYRO_Z)
+        {
+            std::cerr << "Warning: recording sensitivities differ from this build's config.h\n";
+        }
+
+        printf("serial number: %s\n", header.serial_num);
+        cacvValues(header.cacv);
+
+        auto recorder = recorder::Recorder::build(output);
+        JsonlSampleWriter writer(*recorder, header.first_timestamp);
+
+        std::vector<scha63x_raw_data> samples;
+        uint64_t total = 0;
+        while (reader.nextChunk(samples))
+        {
+            writer.write(samples.data(), samples.size());
+            total += samples.size();
+        }
+
+        printf("%lu samples written to %s\n", (unsigned long)total, output.c_str());
+        writer.trigger().print(stdout, header.serial_num);
+    }
+    catch (std::runtime_error &e)
+    {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
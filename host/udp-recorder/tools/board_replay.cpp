@@ -0,0 +1,230 @@
+/*!
+    @file board_replay.cpp
+    @brief Re-streams binary recordings to udp_recorder as their boards
+
+    Every recording becomes one simulated board with the recorded
+    serial number, CAC terms and handshake timestamp. After the
+    Arduino startup handshake its samples are sent in their original
+    datagrams at their original times, scaled by --speed, with
+    optional datagram loss and reordering, until the recording ends or
+    SIGINT. Reproduces field sessions and serves as a throughput
+    workload with --speed 0 and --loops.
+
+    usage: board_replay [options] recording.bin..., check printUsage()
+*/
+
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <arpa/inet.h>
+
+#include "defs.h"
+#include "config.h"
+#include "board_simulator.h"
+#include "session_reader.h"
+
+
+/*!
+    \brief Set by SIGINT/SIGTERM, ends all streams
+*/
+static std::atomic<bool> stop_requested(false);
+
+static void requestStop(int)
+{
+    stop_requested = true;
+}
+
+/*!
+    \brief Print command line usage
+*/
+static void printUsage(const char *program)
+{
+    printf("usage: %s [options] recording.bin...\n"
+           "  --server IP[:PORT]  recorder address, default 127.0.0.1:%d\n"
+           "  --speed X           time scale, 2 replays twice as fast, default 1\n"
+           "  --max-speed         send datagrams back to back, same as --speed 0\n"
+           "  --from S            first second of the recordings, as in the JSONL time\n"
+           "  --to S              last second of the recordings\n"
+           "  --loops N           replay N times, device time continues, default 1\n"
+           "  --batch N           samples per datagram at most, default as recorded\n"
+           "  --loss P            probability of dropping a datagram\n"
+           "  --reorder P         probability of sending a datagram after the next one\n"
+           "  --delta             delta encoded datagrams\n"
+           "  --seed N            random seed of loss and reordering\n"
+           "  --firmware-timing   wait like the sensor startup in scha63x_init\n"
+           "  --no-cac-cache      always send the recorded CAC terms like older firmware\n",
+           program, port);
+}
+
+/*!
+    \brief Parse IP[:PORT] into an address
+
+    \return false if the address is not valid
+*/
+static bool parseServer(const char *text, sockaddr_in &server)
+{
+    std::string address = text;
+    size_t colon = address.find(':');
+    if (colon != std::string::npos)
+    {
+        server.sin_port = htons(atoi(address.c_str() + colon + 1));
+        address.resize(colon);
+    }
+    return inet_pton(AF_INET, address.c_str(), &server.sin_addr) == 1;
+}
+
+
+int main(int argc, char **argv)
+{
+    simulator_options options = BoardSimulator::defaultOptions();
+    std::vector<std::string> paths;
+    double from = -INFINITY, to = INFINITY;
+    int batch = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const bool value = i + 1 < argc;
+        if (strcmp(argv[i], "--server") == 0 && value && parseServer(argv[i + 1], options.server))
+            i++;
+        else if (strcmp(argv[i], "--speed") == 0 && value)
+            options.speed = strtod(argv[++i], nullptr);
+        else if (strcmp(argv[i], "--max-speed") == 0)
+            options.speed = 0;
+        else if (strcmp(argv[i], "--from") == 0 && value)
+            from = strtod(argv[++i], nullptr);
+        else if (strcmp(argv[i], "--to") == 0 && value)
+            to = strtod(argv[++i], nullptr);
+        else if (strcmp(argv[i], "--loops") == 0 && value)
+            options.loops = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--batch") == 0 && value)
+            batch = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--loss") == 0 && value)
+            options.loss = strtod(argv[++i], nullptr);
+        else if (strcmp(argv[i], "--reorder") == 0 && value)
+            options.reorder = strtod(argv[++i], nullptr);
+        else if (strcmp(argv[i], "--delta") == 0)
+            options.delta = true;
+        else if (strcmp(argv[i], "--seed") == 0 && value)
+            options.seed = strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--firmware-timing") == 0)
+        {
+            options.serial_read_ms = simulator_serial_read_ms;
+            options.nvm_read_ms = simulator_nvm_read_ms;
+            options.init_ms = simulator_init_ms;
+        }
+        else if (strcmp(argv[i], "--no-cac-cache") == 0)
+            options.use_cac_cache = false;
+        else if (argv[i][0] != '-')
+            paths.push_back(argv[i]);
+        else
+        {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (paths.empty())
+    {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    signal(SIGINT, requestStop);
+    signal(SIGTERM, requestStop);
+
+    std::vector<std::vector<scha63x_raw_data>> recordings(paths.size());
+    std::vector<std::unique_ptr<BoardSimulator>> simulators;
+    std::vector<std::thread> threads;
+    std::atomic<int> failed(0);
+
+    try
+    {
+        for (size_t r = 0; r < paths.size(); r++)
+        {
+            BinarySession session(paths[r]);
+            std::vector<scha63x_raw_data> &samples = recordings[r];
+            session.query(from, to, [&samples](const scha63x_raw_data *s, size_t count) {
+                samples.insert(samples.end(), s, s + count);
+            });
+            if (samples.empty())
+                throw std::runtime_error(paths[r] + ": no samples to replay");
+
+            // datagrams are delimited by their receive times, without
+            // them the batches are cut at the size asked from the board
+            const binary_file_header &header = session.header();
+            simulator_options board = options;
+            board.serial = std::string(header.serial_num, strnlen(header.serial_num, sizeof(header.serial_num)));
+            board.cacv = header.cacv;
+            board.start_timestamp = header.first_timestamp;
+            // the recorded handshake timestamp, a window of the recording starts later
+            board.send_timestamp = true;
+            board.batch = batch > 0 ? batch
+                        : samples[0].receiveTime != 0 ? SCHA63X_WIRE_MAX_SAMPLES
+                        : header.imu_buffer > 0 ? header.imu_buffer : imu_buffer_size;
+            board.seed = options.seed + r;
+            simulators.emplace_back(new BoardSimulator(board));
+
+            printf("%s: %s, %lu samples, %s\n", paths[r].c_str(), board.serial.c_str(),
+                   (unsigned long)samples.size(),
+                   samples[0].receiveTime != 0 ? "original datagrams and receive times" : "device times");
+        }
+    }
+    catch (std::runtime_error &e)
+    {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    for (size_t r = 0; r < simulators.size(); r++)
+    {
+        BoardSimulator *sim = simulators[r].get();
+        const std::vector<scha63x_raw_data> *samples = &recordings[r];
+        threads.push_back(std::thread([sim, samples, &failed]() {
+            if (!sim->handshake())
+            {
+                failed++;
+                return;
+            }
+            sim->replay(*samples, &stop_requested);
+        }));
+    }
+    for (auto &thread : threads)
+        thread.join();
+
+    simulator_stats total;
+    memset(&total, 0, sizeof(total));
+    for (auto &simulator : simulators)
+    {
+        const simulator_stats &s = simulator->stats();
+        total.samples += s.samples;
+        total.datagrams += s.datagrams;
+        total.bytes += s.bytes;
+        total.dropped += s.dropped;
+        total.reordered += s.reordered;
+        if (s.seconds > total.seconds)
+            total.seconds = s.seconds;
+    }
+
+    printf("%d boards, %lu samples in %.2f s (%.0f samples/s), %lu datagrams sent, %lu dropped, %lu reordered\n",
+           (int)simulators.size() - failed, (unsigned long)total.samples, total.seconds,
+           total.seconds > 0 ? total.samples / total.seconds : 0.0, (unsigned long)total.datagrams,
+           (unsigned long)total.dropped, (unsigned long)total.reordered);
+
+    if (failed > 0)
+    {
+        std::cerr << failed << " boards got no handshake reply\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,205 @@
+/*!
+    @file board_sim.cpp
+    @brief Simulated IMU boards for testing udp_recorder without hardware
+
+    Every board runs the Arduino startup handshake and streams synthetic
+    samples from its own socket until the duration elapses or SIGINT.
+    The time from hello to the first sample is printed per board, with
+    --firmware-timing it includes the sensor startup waits.
+
+    usage: board_sim [options], check printUsage()
+*/
+
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <arpa/inet.h>
+
+#include "defs.h"
+#include "config.h"
+#include "board_simulator.h"
+
+
+/*!
+    \brief Set by SIGINT/SIGTERM, ends all streams
+*/
+static std::atomic<bool> stop_requested(false);
+
+static void requestStop(int)
+{
+    stop_requested = true;
+}
+
+/*!
+    \brief Print command line usage
+*/
+static void printUsage(const char *program)
+{
+    printf("usage: %s [options]\n"
+           "  --server IP[:PORT]  recorder address, default 127.0.0.1:%d\n"
+           "  --boards N          simulated boards, serial numbers SIM000000001...\n"
+           "  --rate HZ           samples per second per board, default %d\n"
+           "  --batch N           samples per datagram, default %d, at most %d\n"
+           "  --jitter US         uniform send time jitter in microseconds\n"
+           "  --loss P            probability of dropping a datagram\n"
+           "  --reorder P         probability of sending a datagram after the next one\n"
+           "  --seconds S         stream duration, default until SIGINT\n"
+           "  --delta             delta encoded datagrams\n"
+           "  --drift PPM         device clock runs fast by PPM against the host clock\n"
+           "  --clock-start US    device micros() at the end of the handshake, wraps at 2^32\n"
+           "  --seed N            random seed\n"
+           "  --firmware-timing   wait like the sensor startup in scha63x_init\n"
+           "  --no-cac-cache      always read and send the CAC terms like older firmware\n"
+           "  --timestamp         send the handshake timestamp like older firmware\n",
+           program, port, imu_trigger_rate, imu_buffer_size, SCHA63X_WIRE_MAX_SAMPLES);
+}
+
+/*!
+    \brief Parse IP[:PORT] into an address
+
+    \return false if the address is not valid
+*/
+static bool parseServer(const char *text, sockaddr_in &server)
+{
+    std::string address = text;
+    size_t colon = address.find(':');
+    if (colon != std::string::npos)
+    {
+        server.sin_port = htons(atoi(address.c_str() + colon + 1));
+        address.resize(colon);
+    }
+    return inet_pton(AF_INET, address.c_str(), &server.sin_addr) == 1;
+}
+
+
+int main(int argc, char **argv)
+{
+    simulator_options options = BoardSimulator::defaultOptions();
+    int boards = 1;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const bool value = i + 1 < argc;
+        if (strcmp(argv[i], "--server") == 0 && value && parseServer(argv[i + 1], options.server))
+            i++;
+        else if (strcmp(argv[i], "--boards") == 0 && value)
+            boards = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--rate") == 0 && value)
+            options.rate = strtod(argv[++i], nullptr);
+        else if (strcmp(argv[i], "--batch") == 0 && value)
+            options.batch = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--jitter") == 0 && value)
+            options.jitter_us = strtod(argv[++i], nullptr);
+        else if (strcmp(argv[i], "--loss") == 0 && value)
+            options.loss = strtod(argv[++i], nullptr);
+        else if (strcmp(argv[i], "--reorder") == 0 && value)
+            options.reorder = strtod(argv[++i], nullptr);
+        else if (strcmp(argv[i], "--seconds") == 0 && value)
+            options.seconds = strtod(argv[++i], nullptr);
+        else if (strcmp(argv[i], "--delta") == 0)
+            options.delta = true;
+        else if (strcmp(argv[i], "--drift") == 0 && value)
+            options.drift_ppm = strtod(argv[++i], nullptr);
+        else if (strcmp(argv[i], "--clock-start") == 0 && value)
+            options.start_timestamp = strtoll(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--seed") == 0 && value)
+            options.seed = strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--firmware-timing") == 0)
+        {
+            options.serial_read_ms = simulator_serial_read_ms;
+            options.nvm_read_ms = simulator_nvm_read_ms;
+            options.init_ms = simulator_init_ms;
+        }
+        else if (strcmp(argv[i], "--no-cac-cache") == 0)
+            options.use_cac_cache = false;
+        else if (strcmp(argv[i], "--timestamp") == 0)
+            options.send_timestamp = true;
+        else
+        {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    signal(SIGINT, requestStop);
+    signal(SIGTERM, requestStop);
+
+    std::vector<std::unique_ptr<BoardSimulator>> simulators;
+    std::vector<std::thread> threads;
+    std::atomic<int> failed(0);
+
+    try
+    {
+        for (int b = 0; b < boards; b++)
+        {
+            simulator_options board = options;
+            char serial[16];
+            snprintf(serial, sizeof(serial), "SIM%09d", b + 1);
+            board.serial = serial;
+            board.seed = options.seed + b;
+            simulators.emplace_back(new BoardSimulator(board));
+        }
+    }
+    catch (std::runtime_error &e)
+    {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    for (auto &simulator : simulators)
+    {
+        BoardSimulator *sim = simulator.get();
+        threads.push_back(std::thread([sim, &failed]() {
+            if (!sim->handshake())
+            {
+                failed++;
+                return;
+            }
+            sim->stream(&stop_requested);
+        }));
+    }
+    for (auto &thread : threads)
+        thread.join();
+
+    simulator_stats total;
+    memset(&total, 0, sizeof(total));
+    for (auto &simulator : simulators)
+    {
+        const simulator_stats &s = simulator->stats();
+        if (s.samples > 0)
+            printf("%s: first sample %.1f ms after hello, CAC terms %s\n", simulator->serial().c_str(),
+                   s.startup_ms, options.use_cac_cache && simulator->specs().cac_cached ? "cached" : "read");
+        total.samples += s.samples;
+        total.datagrams += s.datagrams;
+        total.bytes += s.bytes;
+        total.dropped += s.dropped;
+        total.reordered += s.reordered;
+        if (s.seconds > total.seconds)
+            total.seconds = s.seconds;
+    }
+
+    printf("%d boards, %lu samples in %.2f s (%.0f samples/s), %lu datagrams sent (%.1f bytes/sample), "
+           "%lu dropped, %lu reordered\n",
+           boards - failed, (unsigned long)total.samples, total.seconds,
+           total.seconds > 0 ? total.samples / total.seconds : 0.0, (unsigned long)total.datagrams,
+           total.datagrams ? 1.0 * total.bytes / (total.samples - total.dropped * options.batch) : 0.0,
+           (unsigned long)total.dropped, (unsigned long)total.reordered);
+
+    if (failed > 0)
+    {
+        std::cerr << failed << " boards got no handshake reply\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
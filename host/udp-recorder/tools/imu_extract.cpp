@@ -0,0 +1,75 @@
+/*!
+    @file imu_extract.cpp
+    @brief Extract a time window from a recorded session
+
+    Works on JSONL and binary recordings. JSONL input is copied line by
+    line, binary input is written as a binary recording with the same
+    file header, so bin2jsonl still works on the result.
+
+    usage: imu_extract recording t0 t1 [output]
+*/
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "binary_recording.h"
+#include "session_reader.h"
+
+
+int main(int argc, char **argv)
+{
+    if (argc < 4 || argc > 5)
+    {
+        printf("usage: %s recording t0 t1 [output]\n", argv[0]);
+        printf("  t0, t1 in seconds from the start of the recording\n");
+        return EXIT_FAILURE;
+    }
+
+    std::string input = argv[1];
+    double t0 = strtod(argv[2], nullptr);
+    double t1 = strtod(argv[3], nullptr);
+    std::string output = argc == 5 ? argv[4] : input + ".extract";
+
+    try
+    {
+        size_t total;
+
+        if (isBinaryRecording(input))
+        {
+            BinarySession session(input);
+            BinaryRecorder writer(output, session.header());
+            total = session.query(t0, t1, [&](const scha63x_raw_data *samples, size_t count) {
+                writer.addSamples(samples, count);
+            });
+        }
+        else
+        {
+            JsonlSession session(input);
+            FILE *file = fopen(output.c_str(), "wb");
+            if (!file)
+                throw std::runtime_error("Can not open " + output);
+            setvbuf(file, nullptr, _IOFBF, 1 << 20);
+
+            total = session.query(t0, t1, [&](const char *line, size_t length) {
+                fwrite(line, 1, length, file);
+                fputc('\n', file);
+            });
+
+            if (fclose(file) != 0)
+                throw std::runtime_error("Can not write " + output);
+        }
+
+        printf("%lu records in [%g, %g] written to %s\n", (unsigned long)total, t0, t1, output.c_str());
+    }
+    catch (std::runtime_error &e)
+    {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}